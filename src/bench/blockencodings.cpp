@@ -0,0 +1,93 @@
+// Copyright (c) 2022 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <chainparams.h>
+#include <config.h>
+#include <consensus/merkle.h>
+#include <pow/pow.h>
+#include <random.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <vector>
+
+/**
+ * Reconstruct a block of 1000 transactions from a compact block, with all its
+ * transactions in the mempool among many others. The mempool size can be
+ * changed with -asymptote to measure how the reconstruction latency scales
+ * with it.
+ */
+static void CompactBlockReconstruction(benchmark::Bench &bench) {
+    const Config &config = GetConfig();
+    const size_t mempool_size =
+        bench.complexityN() > 1 ? static_cast<size_t>(bench.complexityN())
+                                : 100000;
+    constexpr size_t BLOCK_TX_COUNT = 1000;
+
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */
+        {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    FastRandomContext det_rand{true};
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42 * SATOSHI;
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    {
+        LOCK2(cs_main, pool.cs);
+        for (size_t i = 0; i < mempool_size; ++i) {
+            tx.vin[0].prevout = COutPoint(TxId(det_rand.rand256()), 0);
+            CTransactionRef txref = MakeTransactionRef(tx);
+            pool.addUnchecked(entry.FromTx(txref));
+            if (block.vtx.size() < std::min(BLOCK_TX_COUNT, mempool_size + 1) &&
+                det_rand.randrange(mempool_size) < BLOCK_TX_COUNT) {
+                block.vtx.push_back(txref);
+            }
+        }
+    }
+
+    // The block transactions are ordered canonically after the coinbase.
+    std::sort(block.vtx.begin() + 1, block.vtx.end(),
+              [](const CTransactionRef &a, const CTransactionRef &b) {
+                  return a->GetId() < b->GetId();
+              });
+    block.nBits = 0x207fffff;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    while (!CheckProofOfWork(block.GetHash(), block.nBits,
+                             config.GetChainParams().GetConsensus())) {
+        ++block.nNonce;
+    }
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CBlockHeaderAndShortTxIDs(block);
+    CBlockHeaderAndShortTxIDs cmpctblock;
+    stream >> cmpctblock;
+
+    const std::vector<std::pair<TxHash, CTransactionRef>> extra_txn;
+    bench.unit("block").run([&] {
+        PartiallyDownloadedBlock partialBlock(config, &pool);
+        ReadStatus status = partialBlock.InitData(cmpctblock, extra_txn);
+        assert(status == READ_STATUS_OK);
+        CBlock reconstructed;
+        status = partialBlock.FillBlock(reconstructed, {});
+        assert(status == READ_STATUS_OK);
+    });
+}
+
+BENCHMARK(CompactBlockReconstruction);
@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <script/signingprovider.h>
 #include <test/util/transaction_utils.h>
 
@@ -51,3 +52,36 @@ static void CCoinsCaching(benchmark::Bench &bench) {
 }
 
 BENCHMARK(CCoinsCaching);
+
+// Fill a cache with coins, access them all and flush it to its parent, like
+// the chainstate cache does during IBD.
+static void CCoinsCachingFillAccessFlush(benchmark::Bench &bench) {
+    static constexpr size_t NUM_COINS = 100000;
+
+    FastRandomContext rng(true);
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(NUM_COINS);
+    for (size_t i = 0; i < NUM_COINS; ++i) {
+        outpoints.emplace_back(TxId(rng.rand256()), rng.randrange(4));
+    }
+
+    CCoinsView coinsDummy;
+    CCoinsViewCache base(&coinsDummy);
+    bench.batch(NUM_COINS).unit("coin").run([&] {
+        CCoinsViewCache coins(&base);
+        for (const COutPoint &outpoint : outpoints) {
+            coins.AddCoin(outpoint,
+                          Coin(CTxOut(50 * COIN, CScript() << OP_1), 1, false),
+                          false);
+        }
+        for (const COutPoint &outpoint : outpoints) {
+            assert(!coins.AccessCoin(outpoint).IsSpent());
+        }
+        coins.SetBestBlock(BlockHash(rng.rand256()));
+        assert(coins.Flush());
+        // The dummy view at the bottom discards the coins.
+        base.Flush();
+    });
+}
+
+BENCHMARK(CCoinsCachingFillAccessFlush);
@@ -4,10 +4,13 @@
 
 #include <bench/bench.h>
 #include <checkqueue.h>
+#include <crypto/sha256.h>
 #include <key.h>
 #include <prevector.h>
 #include <pubkey.h>
 #include <random.h>
+#include <tinyformat.h>
+#include <uint256.h>
 #include <util/system.h>
 
 #include <vector>
@@ -17,6 +20,7 @@ static const size_t BATCHES = 101;
 static const size_t BATCH_SIZE = 30;
 static const int PREVECTOR_SIZE = 28;
 static const size_t QUEUE_BATCH_SIZE = 128;
+static const int HASH_ROUNDS = 16;
 
 // This Benchmark tests the CheckQueue with a slightly realistic workload, where
 // checks all contain a prevector that is indirect 50% of the time and there is
@@ -65,3 +69,48 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::Bench &bench) {
     ECC_Stop();
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+
+// This Benchmark measures how the CheckQueue scales with the number of threads
+// taking part in the verification (the master plus threads - 1 workers), where
+// every check does a fixed amount of hashing.
+static void CCheckQueueSpeedHashJob(benchmark::Bench &bench, int threads) {
+    struct HashJob {
+        uint256 hash;
+        bool operator()() {
+            for (int i = 0; i < HASH_ROUNDS; ++i) {
+                CSHA256()
+                    .Write(hash.begin(), hash.size())
+                    .Finalize(hash.begin());
+            }
+            return true;
+        }
+        void swap(HashJob &x) { std::swap(hash, x.hash); }
+    };
+    CCheckQueue<HashJob> queue{QUEUE_BATCH_SIZE};
+    queue.StartWorkerThreads(threads - 1);
+
+    bench.minEpochIterations(10)
+        .batch(BATCH_SIZE * BATCHES)
+        .unit("job")
+        .run([&] {
+            CCheckQueueControl<HashJob> control(&queue);
+            std::vector<std::vector<HashJob>> vBatches(
+                BATCHES, std::vector<HashJob>(BATCH_SIZE));
+            for (auto &vChecks : vBatches) {
+                control.Add(vChecks);
+            }
+            control.Wait();
+        });
+    queue.StopWorkerThreads();
+}
+
+// Register the hash job benchmark for each number of threads.
+[[maybe_unused]] static const bool hash_job_benchmarks = [] {
+    for (const int threads : {1, 2, 4, 8, 16, 32, 64}) {
+        benchmark::BenchRunner(strprintf("CCheckQueueSpeedHashJob%d", threads),
+                               [threads](benchmark::Bench &bench) {
+                                   CCheckQueueSpeedHashJob(bench, threads);
+                               });
+    }
+    return true;
+}();
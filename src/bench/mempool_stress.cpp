@@ -3,8 +3,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <config.h>
+#include <consensus/validation.h>
+#include <key.h>
 #include <policy/policy.h>
 #include <random.h>
+#include <script/interpreter.h>
+#include <script/sighashtype.h>
+#include <test/util/mining.h>
 #include <test/util/setup_common.h>
 #include <txmempool.h>
 #include <validation.h>
@@ -127,5 +133,139 @@ static void MempoolCheck(benchmark::Bench &bench) {
     });
 }
 
+/**
+ * Sign the only input of tx, spending an output of value paid to key with a
+ * pay-to-pubkey script.
+ */
+static void SignSpend(CMutableTransaction &tx, const CKey &key,
+                      const CScript &scriptPubKey, Amount value) {
+    std::vector<uint8_t> vchSig;
+    const uint256 hash = SignatureHash(scriptPubKey, CTransaction(tx), 0,
+                                       SigHashType().withForkId(), value);
+    assert(key.SignECDSA(hash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+    tx.vin[0].scriptSig = CScript() << vchSig;
+}
+
+/**
+ * Create unrelated transactions spending confirmed coins with a signature
+ * each, so that their acceptance to the mempool is dominated by the script
+ * checks.
+ */
+static std::vector<CTransactionRef>
+CreateSignedSpends(const Config &config, TestingSetup &test_setup,
+                   size_t count) {
+    constexpr size_t MAX_SPLIT_OUTPUTS{1000};
+    const Amount fee{1000 * SATOSHI};
+
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey())
+                                           << OP_CHECKSIG;
+
+    // Mine enough mature coinbases, then split them into as many confirmed
+    // outputs as there are transactions to create.
+    const size_t n_splits = (count + MAX_SPLIT_OUTPUTS - 1) / MAX_SPLIT_OUTPUTS;
+    std::vector<CTxIn> coinbases;
+    for (size_t i = 0; i < n_splits + COINBASE_MATURITY; ++i) {
+        coinbases.push_back(MineBlock(config, test_setup.m_node, scriptPubKey));
+    }
+
+    std::vector<CTransactionRef> splits;
+    for (size_t i = 0; i < n_splits; ++i) {
+        LOCK(cs_main);
+        const Amount value = test_setup.m_node.chainman->ActiveChainstate()
+                                 .CoinsTip()
+                                 .AccessCoin(coinbases[i].prevout)
+                                 .GetTxOut()
+                                 .nValue;
+        const size_t n_outputs =
+            std::min(MAX_SPLIT_OUTPUTS, count - i * MAX_SPLIT_OUTPUTS);
+        CMutableTransaction split;
+        split.vin.push_back(coinbases[i]);
+        split.vout.assign(n_outputs,
+                          CTxOut((value - fee) / int64_t(n_outputs),
+                                 scriptPubKey));
+        SignSpend(split, key, scriptPubKey, value);
+        splits.push_back(MakeTransactionRef(split));
+        const MempoolAcceptResult res =
+            test_setup.m_node.chainman->ProcessTransaction(splits.back());
+        assert(res.m_result_type == MempoolAcceptResult::ResultType::VALID);
+    }
+    MineBlock(config, test_setup.m_node, scriptPubKey);
+
+    std::vector<CTransactionRef> spends;
+    for (const CTransactionRef &split : splits) {
+        for (size_t n = 0; n < split->vout.size(); ++n) {
+            CMutableTransaction tx;
+            tx.vin.emplace_back(COutPoint(split->GetId(), n));
+            tx.vout.emplace_back(split->vout[n].nValue - fee, scriptPubKey);
+            SignSpend(tx, key, scriptPubKey, split->vout[n].nValue);
+            spends.push_back(MakeTransactionRef(tx));
+        }
+    }
+    return spends;
+}
+
+/**
+ * Accept signed transactions to the mempool, one by one or as a batch with the
+ * script checks running on the script check worker threads. The signature and
+ * script caches are disabled so that every round checks all the signatures.
+ */
+static void MempoolAccept(benchmark::Bench &bench, bool batch) {
+    const Config &config = GetConfig();
+    const size_t count =
+        bench.complexityN() > 1 ? static_cast<size_t>(bench.complexityN())
+                                : 2000;
+    TestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */
+        {
+            "-nodebuglogfile",
+            "-nodebug",
+            "-maxsigcachesize=0",
+            "-maxscriptcachesize=0",
+        },
+    };
+    const std::vector<CTransactionRef> spends =
+        CreateSignedSpends(config, test_setup, count);
+    CTxMemPool &pool = *test_setup.m_node.mempool;
+    CChainState &chainstate =
+        test_setup.m_node.chainman->ActiveChainstate();
+
+    // The mempool is not checked after each transaction here, unlike with
+    // ChainstateManager::ProcessTransaction() in the test setup.
+    bench.batch(count).unit("tx").run([&] {
+        LOCK(cs_main);
+        if (batch) {
+            for (const MempoolAcceptResult &res :
+                 AcceptToMemoryPoolBatch(config, chainstate, spends,
+                                         GetTime())) {
+                assert(res.m_result_type ==
+                       MempoolAcceptResult::ResultType::VALID);
+            }
+        } else {
+            for (const CTransactionRef &tx : spends) {
+                const MempoolAcceptResult res =
+                    AcceptToMemoryPool(config, chainstate, tx, GetTime(),
+                                       /* bypass_limits */ false);
+                assert(res.m_result_type ==
+                       MempoolAcceptResult::ResultType::VALID);
+            }
+        }
+        pool.clear();
+    });
+}
+
+static void MempoolAcceptSerial(benchmark::Bench &bench) {
+    MempoolAccept(bench, /* batch */ false);
+}
+
+static void MempoolAcceptBatch(benchmark::Bench &bench) {
+    MempoolAccept(bench, /* batch */ true);
+}
+
 BENCHMARK(ComplexMemPool);
 BENCHMARK(MempoolCheck);
+BENCHMARK(MempoolAcceptSerial);
+BENCHMARK(MempoolAcceptBatch);
@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 #include <bench/data.h>
 
+#include <node/blockstorage.h>
 #include <rpc/blockchain.h>
 #include <streams.h>
 #include <validation.h>
@@ -26,8 +27,10 @@ static void BlockToJsonVerbose(benchmark::Bench &bench) {
     blockindex.phashBlock = &blockHash;
     blockindex.nBits = 403014710;
 
+    node::BlockManager blockman;
     bench.run([&] {
-        (void)blockToJSON(block, &blockindex, &blockindex, /*verbose*/ true);
+        (void)blockToJSON(blockman, block, &blockindex, &blockindex,
+                          /*verbose*/ true);
     });
 }
 
@@ -0,0 +1,66 @@
+// Copyright (c) 2023 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <hash.h>
+#include <key.h>
+#include <pubkey.h>
+#include <random.h>
+
+#include <vector>
+
+// Number of signatures verified per iteration, about the number of inputs
+// a script check worker pulls from the queue at once.
+static constexpr size_t SIGNATURE_COUNT = 128;
+
+struct SchnorrSignatures {
+    std::vector<CPubKey> pubkeys;
+    std::vector<uint256> hashes;
+    std::vector<SchnorrSig> sigs;
+
+    SchnorrSignatures() {
+        for (size_t i = 0; i < SIGNATURE_COUNT; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            pubkeys.push_back(key.GetPubKey());
+            hashes.push_back(GetRandHash());
+            sigs.emplace_back();
+            bool ret = key.SignSchnorr(hashes.back(), sigs.back());
+            assert(ret);
+        }
+    }
+};
+
+static void SchnorrVerify(benchmark::Bench &bench) {
+    const ECCVerifyHandle verify_handle;
+    ECC_Start();
+
+    SchnorrSignatures signatures;
+    bench.batch(SIGNATURE_COUNT).unit("signature").run([&] {
+        for (size_t i = 0; i < SIGNATURE_COUNT; i++) {
+            bool ret = signatures.pubkeys[i].VerifySchnorr(
+                signatures.hashes[i], signatures.sigs[i]);
+            assert(ret);
+        }
+    });
+
+    ECC_Stop();
+}
+
+static void SchnorrVerifyBatch(benchmark::Bench &bench) {
+    const ECCVerifyHandle verify_handle;
+    ECC_Start();
+
+    SchnorrSignatures signatures;
+    bench.batch(SIGNATURE_COUNT).unit("signature").run([&] {
+        bool ret = CPubKey::VerifySchnorrBatch(
+            signatures.pubkeys, signatures.hashes, signatures.sigs);
+        assert(ret);
+    });
+
+    ECC_Stop();
+}
+
+BENCHMARK(SchnorrVerify);
+BENCHMARK(SchnorrVerifyBatch);
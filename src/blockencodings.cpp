@@ -5,6 +5,7 @@
 #include <blockencodings.h>
 
 #include <chainparams.h>
+#include <checkqueue.h>
 #include <config.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
@@ -16,11 +17,15 @@
 #include <util/system.h>
 #include <validation.h>
 
+#include <algorithm>
+#include <atomic>
 #include <unordered_map>
 
-CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block)
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block,
+                                                     bool sortedShortTxIDsIn)
     : nonce(GetRand(std::numeric_limits<uint64_t>::max())),
-      shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
+      sortedShortTxIDs(sortedShortTxIDsIn), shorttxids(block.vtx.size() - 1),
+      prefilledtxn(1), header(block) {
     FillShortTxIDSelector();
     // TODO: Use our mempool prior to block acceptance to predictively fill more
     // than just the coinbase.
@@ -29,6 +34,34 @@ CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block)
         const CTransaction &tx = *block.vtx[i];
         shorttxids[i - 1] = GetShortID(tx.GetHash());
     }
+    if (sortedShortTxIDs) {
+        std::sort(shorttxids.begin(), shorttxids.end());
+    }
+}
+
+std::vector<uint32_t>
+CBlockHeaderAndShortTxIDs::GetSortedTxIndexes(const CBlock &block,
+                                              uint64_t nonceIn) {
+    CBlockHeaderAndShortTxIDs cmpctblock;
+    cmpctblock.header = block;
+    cmpctblock.nonce = nonceIn;
+    cmpctblock.FillShortTxIDSelector();
+
+    std::vector<std::pair<uint64_t, uint32_t>> shortids;
+    shortids.reserve(block.vtx.size());
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        shortids.emplace_back(cmpctblock.GetShortID(block.vtx[i]->GetHash()),
+                              i);
+    }
+    std::sort(shortids.begin(), shortids.end());
+
+    std::vector<uint32_t> indexes;
+    indexes.reserve(block.vtx.size());
+    indexes.push_back(0);
+    for (const auto &shortid : shortids) {
+        indexes.push_back(shortid.second);
+    }
+    return indexes;
 }
 
 void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
@@ -48,6 +81,91 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const TxHash &txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(Span<const uint256> txhashes,
+                                            Span<uint64_t> shortids) const {
+    static_assert(SHORTTXIDS_LENGTH == 6,
+                  "shorttxids calculation assumes 6-byte shorttxids");
+    assert(shortids.size() >= txhashes.size());
+    SipHashUint256Many(shorttxidk0, shorttxidk1, txhashes.data(),
+                       shortids.data(), txhashes.size());
+    for (size_t i = 0; i < txhashes.size(); i++) {
+        shortids[i] &= 0xffffffffffffL;
+    }
+}
+
+namespace {
+/**
+ * Closure representing the computation of the short IDs of a shard of the
+ * mempool transaction hashes, so that they can be computed in parallel
+ * through a CCheckQueue.
+ */
+class CShortIdCheck {
+private:
+    const CBlockHeaderAndShortTxIDs *m_cmpctblock;
+    Span<const uint256> m_txhashes;
+    Span<uint64_t> m_shortids;
+
+public:
+    CShortIdCheck() : m_cmpctblock(nullptr) {}
+
+    CShortIdCheck(const CBlockHeaderAndShortTxIDs &cmpctblockIn,
+                  Span<const uint256> txhashesIn, Span<uint64_t> shortidsOut)
+        : m_cmpctblock(&cmpctblockIn), m_txhashes(txhashesIn),
+          m_shortids(shortidsOut) {}
+
+    bool operator()() {
+        m_cmpctblock->GetShortIDs(m_txhashes, m_shortids);
+        return true;
+    }
+
+    void swap(CShortIdCheck &check) {
+        std::swap(m_cmpctblock, check.m_cmpctblock);
+        std::swap(m_txhashes, check.m_txhashes);
+        std::swap(m_shortids, check.m_shortids);
+    }
+};
+} // namespace
+
+static CCheckQueue<CShortIdCheck> shortidqueue(1, "shortid");
+
+//! Whether there are worker threads to compute the short IDs with.
+static std::atomic<bool> g_shortid_workers_enabled{false};
+
+void StartShortIdWorkerThreads(int threads_num) {
+    shortidqueue.StartWorkerThreads(threads_num);
+    g_shortid_workers_enabled = threads_num > 0;
+}
+
+void StopShortIdWorkerThreads() {
+    g_shortid_workers_enabled = false;
+    shortidqueue.StopWorkerThreads();
+}
+
+/**
+ * Compute the short IDs of txhashes into shortids, split into shards over the
+ * short ID worker threads if there are many of them.
+ */
+static void ComputeShortIDs(const CBlockHeaderAndShortTxIDs &cmpctblock,
+                            Span<const uint256> txhashes,
+                            Span<uint64_t> shortids) {
+    if (!g_shortid_workers_enabled ||
+        txhashes.size() < MIN_PARALLEL_SHORTIDS) {
+        cmpctblock.GetShortIDs(txhashes, shortids);
+        return;
+    }
+
+    std::vector<CShortIdCheck> vChecks;
+    vChecks.reserve(txhashes.size() / SHORTID_SHARD_SIZE + 1);
+    for (size_t i = 0; i < txhashes.size(); i += SHORTID_SHARD_SIZE) {
+        const size_t count = std::min(SHORTID_SHARD_SIZE, txhashes.size() - i);
+        vChecks.emplace_back(cmpctblock, txhashes.subspan(i, count),
+                             shortids.subspan(i, count));
+    }
+    CCheckQueueControl<CShortIdCheck> control(&shortidqueue);
+    control.Add(vChecks);
+    control.Wait();
+}
+
 ReadStatus PartiallyDownloadedBlock::InitData(
     const CBlockHeaderAndShortTxIDs &cmpctblock,
     const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txns) {
@@ -70,6 +188,7 @@ ReadStatus PartiallyDownloadedBlock::InitData(
         }
     }
     prefilled_count = cmpctblock.prefilledtxn.size();
+    sortTransactions = cmpctblock.HasSortedShortTxIDs();
 
     // To determine the chance that the number of entries in a bucket exceeds N,
     // we use the fact that the number of elements in a single bucket is
@@ -96,15 +215,38 @@ ReadStatus PartiallyDownloadedBlock::InitData(
         return READ_STATUS_FAILED;
     }
 
+    // Only take a snapshot of the mempool transaction hashes with the lock
+    // held, their short IDs are computed after it is released. The
+    // transactions are then only fetched for the matching short IDs.
+    std::vector<uint256> txhashes;
     {
         LOCK(pool->cs);
-        auto it = pool->mapTx.begin();
-        while (it != pool->mapTx.end()) {
-            uint64_t shortid = cmpctblock.GetShortID(it->GetTx().GetHash());
+        txhashes.reserve(pool->mapTx.size());
+        for (const CTxMemPoolEntry &entry : pool->mapTx) {
+            txhashes.push_back(entry.GetTx().GetHash());
+        }
+    }
+
+    std::vector<uint64_t> shortids(txhashes.size());
+    ComputeShortIDs(cmpctblock, txhashes, shortids);
+
+    std::vector<size_t> matches;
+    for (size_t i = 0; i < shortids.size(); i++) {
+        if (shortidProcessor->hasShortId(shortids[i])) {
+            matches.push_back(i);
+        }
+    }
 
-            mempool_count +=
-                shortidProcessor->matchKnownItem(shortid, it->GetSharedTx());
-            it++;
+    if (!matches.empty()) {
+        LOCK(pool->cs);
+        for (const size_t i : matches) {
+            // The transaction might have left the mempool in the meantime.
+            CTransactionRef tx = pool->get(TxId(txhashes[i]));
+            if (!tx) {
+                continue;
+            }
+
+            mempool_count += shortidProcessor->matchKnownItem(shortids[i], tx);
 
             if (mempool_count == shortidProcessor->getShortIdCount()) {
                 break;
@@ -168,6 +310,16 @@ ReadStatus PartiallyDownloadedBlock::FillBlock(
         return READ_STATUS_INVALID;
     }
 
+    if (sortTransactions && !block.vtx.empty()) {
+        // The compact block only told which transactions are in the block, put
+        // them in the canonical order. A mismatch with the merkle root is
+        // caught by CheckBlock like for a short ID collision.
+        std::sort(block.vtx.begin() + 1, block.vtx.end(),
+                  [](const CTransactionRef &a, const CTransactionRef &b) {
+                      return a->GetId() < b->GetId();
+                  });
+    }
+
     BlockValidationState state;
     if (!CheckBlock(block, state, config->GetChainParams().GetConsensus(),
                     BlockValidationOptions(*config))) {
@@ -5,11 +5,16 @@
 #ifndef BITCOIN_BLOCKENCODINGS_H
 #define BITCOIN_BLOCKENCODINGS_H
 
+#include <crypto/common.h>
 #include <primitives/block.h>
 #include <serialize.h>
 #include <shortidprocessor.h>
+#include <span.h>
+#include <util/golombrice.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <memory>
 #include <vector>
 
@@ -77,10 +82,83 @@ typedef enum ReadStatus_t {
     READ_STATUS_CHECKBLOCK_FAILED,
 } ReadStatus;
 
+/**
+ * Formatter for a sorted list of 6-byte short IDs, used by the compact blocks
+ * relying on the canonical transaction order. The short IDs are uniformly
+ * distributed, so the differences between consecutive ones are Golomb-Rice
+ * coded with a parameter derived from their number, which takes about
+ * 48 - log2(count) + 2 bits per short ID instead of 48.
+ *
+ * The count is checked against max_count before decoding anything: a large
+ * count gives a small Rice parameter, so a few bytes could otherwise decode
+ * into a huge number of short IDs.
+ */
+struct SortedShortIdsFormatter {
+    static constexpr int SHORTID_BITS = 48;
+
+    uint64_t max_count = std::numeric_limits<uint64_t>::max();
+
+    static uint8_t GetRiceParameter(uint64_t count) {
+        return SHORTID_BITS - std::min<uint64_t>(CountBits(count), 47);
+    }
+
+    template <typename Stream>
+    void Ser(Stream &s, const std::vector<uint64_t> &shortids) {
+        WriteCompactSize(s, shortids.size());
+        const uint8_t P = GetRiceParameter(shortids.size());
+        BitStreamWriter<Stream> bitwriter(s);
+        uint64_t last = 0;
+        for (const uint64_t shortid : shortids) {
+            assert(shortid >= last);
+            GolombRiceEncode(bitwriter, P, shortid - last);
+            last = shortid;
+        }
+        bitwriter.Flush();
+    }
+
+    template <typename Stream>
+    void Unser(Stream &s, std::vector<uint64_t> &shortids) {
+        const uint64_t count = ReadCompactSize(s);
+        if (count > max_count) {
+            throw std::ios_base::failure("too many short IDs");
+        }
+        const uint8_t P = GetRiceParameter(count);
+        shortids.clear();
+        BitStreamReader<Stream> bitreader(s);
+        uint64_t last = 0;
+        for (uint64_t i = 0; i < count; i++) {
+            // Unlike GolombRiceDecode, bound the quotient so that the
+            // differences cannot overflow.
+            uint64_t q = 0;
+            while (bitreader.Read(1) == 1) {
+                if (++q >= (1ULL << (SHORTID_BITS - P))) {
+                    throw std::ios_base::failure("short ID out of range");
+                }
+            }
+            last += (q << P) + bitreader.Read(P);
+            if (last >= (1ULL << SHORTID_BITS)) {
+                throw std::ios_base::failure("short ID out of range");
+            }
+            shortids.push_back(last);
+        }
+    }
+};
+
 class CBlockHeaderAndShortTxIDs {
 private:
     mutable uint64_t shorttxidk0, shorttxidk1;
     uint64_t nonce;
+    /**
+     * Whether the short IDs are sorted rather than in the order of the block
+     * transactions. This depends on the compact block version used with the
+     * peer, so it is not serialized.
+     */
+    bool sortedShortTxIDs = false;
+    /**
+     * Maximum number of sorted short IDs accepted when deserializing. This is
+     * a local limit, so it is not serialized either.
+     */
+    uint64_t maxShortTxIDs = std::numeric_limits<uint64_t>::max();
 
     void FillShortTxIDSelector() const;
 
@@ -97,22 +175,65 @@ public:
 
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
+    explicit CBlockHeaderAndShortTxIDs(
+        bool sortedShortTxIDsIn,
+        uint64_t maxShortTxIDsIn = std::numeric_limits<uint64_t>::max())
+        : sortedShortTxIDs(sortedShortTxIDsIn), maxShortTxIDs(maxShortTxIDsIn) {
+    }
 
-    explicit CBlockHeaderAndShortTxIDs(const CBlock &block);
+    /**
+     * With sortedShortTxIDsIn, only the coinbase is prefilled and the short IDs
+     * of the other transactions are sorted. Their order is rebuilt from their
+     * txids by the receiver, as blocks use the canonical transaction order.
+     */
+    explicit CBlockHeaderAndShortTxIDs(const CBlock &block,
+                                       bool sortedShortTxIDsIn = false);
+
+    bool HasSortedShortTxIDs() const { return sortedShortTxIDs; }
+    uint64_t GetNonce() const { return nonce; }
+
+    /**
+     * The indexes in `block` of the transactions of its compact block with
+     * sorted short IDs built with `nonceIn`: the coinbase first, then the other
+     * transactions in the order of their short IDs. The getblocktxn requests
+     * following such a compact block refer to the transactions by their
+     * position in this list.
+     */
+    static std::vector<uint32_t> GetSortedTxIndexes(const CBlock &block,
+                                                    uint64_t nonceIn);
 
     uint64_t GetShortID(const TxHash &txhash) const;
 
+    /**
+     * Compute the short IDs of many transaction hashes at once, into
+     * `shortids` which must be as large as `txhashes`.
+     */
+    void GetShortIDs(Span<const uint256> txhashes,
+                     Span<uint64_t> shortids) const;
+
     size_t BlockTxCount() const {
         return shorttxids.size() + prefilledtxn.size();
     }
 
     SERIALIZE_METHODS(CBlockHeaderAndShortTxIDs, obj) {
-        READWRITE(
-            obj.header, obj.nonce,
-            Using<VectorFormatter<CustomUintFormatter<SHORTTXIDS_LENGTH>>>(
-                obj.shorttxids),
-            Using<VectorFormatter<DifferentialIndexedItemFormatter>>(
-                obj.prefilledtxn));
+        READWRITE(obj.header, obj.nonce);
+        if (obj.sortedShortTxIDs) {
+            // The lambdas are generic so that each one is only instantiated
+            // for the streams it is used with.
+            ::SerWrite(s, ser_action, obj, [&](auto &s, const auto &obj) {
+                SortedShortIdsFormatter{}.Ser(s, obj.shorttxids);
+            });
+            ::SerRead(s, ser_action, obj, [&](auto &s, auto &obj) {
+                SortedShortIdsFormatter{obj.maxShortTxIDs}.Unser(
+                    s, obj.shorttxids);
+            });
+        } else {
+            READWRITE(
+                Using<VectorFormatter<CustomUintFormatter<SHORTTXIDS_LENGTH>>>(
+                    obj.shorttxids));
+        }
+        READWRITE(Using<VectorFormatter<DifferentialIndexedItemFormatter>>(
+            obj.prefilledtxn));
 
         if (ser_action.ForRead() && obj.prefilledtxn.size() > 0) {
             // Thanks to the DifferenceFormatter, the index values in the
@@ -138,6 +259,23 @@ public:
     }
 };
 
+//! Number of short IDs computed together by each compact block short ID check.
+static constexpr size_t SHORTID_SHARD_SIZE = 4096;
+//! Minimum number of mempool transactions to compute their short IDs in
+//! parallel.
+static constexpr size_t MIN_PARALLEL_SHORTIDS = 4 * SHORTID_SHARD_SIZE;
+
+/**
+ * Run instances of the worker threads computing the short IDs of the mempool
+ * transactions when a compact block is received
+ */
+void StartShortIdWorkerThreads(int threads_num);
+
+/**
+ * Stop all of the short ID worker threads
+ */
+void StopShortIdWorkerThreads();
+
 class PartiallyDownloadedBlock {
     struct CTransactionRefCompare {
         bool operator()(const CTransactionRef &lhs,
@@ -158,6 +296,9 @@ class PartiallyDownloadedBlock {
 
 protected:
     size_t prefilled_count = 0, mempool_count = 0, extra_count = 0;
+    //! Whether the transactions are sorted by txid after the coinbase, rather
+    //! than in the order of the compact block.
+    bool sortTransactions = false;
     const CTxMemPool *pool;
     const Config *config;
 
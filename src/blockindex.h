@@ -21,46 +21,41 @@ struct BlockHash;
  * one of them can be part of the currently active branch.
  */
 class CBlockIndex {
+    // The members are ordered by how often they are accessed: the ones used
+    // when walking the tree and comparing chains come first and fit in a
+    // single cache line, the ones only used when reading the block from disk
+    // or validating it come last. The order also avoids any padding.
 public:
-    //! pointer to the hash of the block, if any. Memory is owned by this
-    //! CBlockIndex
-    const BlockHash *phashBlock{nullptr};
-
     //! pointer to the index of the predecessor of this block
     CBlockIndex *pprev{nullptr};
 
     //! pointer to the index of some further predecessor of this block
     CBlockIndex *pskip{nullptr};
 
-    //! height of the entry in the chain. The genesis block has height 0
-    int nHeight{0};
-
-    //! Which # file this block is stored in (blk?????.dat)
-    int nFile{0};
-
-    //! Byte offset within blk?????.dat where this block's data is stored
-    unsigned int nDataPos{0};
-
-    //! Byte offset within rev?????.dat where this block's undo data is stored
-    unsigned int nUndoPos{0};
+    //! pointer to the hash of the block, if any. Memory is owned by this
+    //! CBlockIndex
+    const BlockHash *phashBlock{nullptr};
 
     //! (memory only) Total amount of work (expected number of hashes) in the
     //! chain up to and including this block
     arith_uint256 nChainWork{};
 
-    //! Number of transactions in this block.
-    //! Note: in a potential headers-first mode, this number cannot be relied
-    //! upon
-    //! Note: this value is faked during UTXO snapshot load to ensure that
-    //! LoadBlockIndex() will load index entries for blocks that we lack data
-    //! for.
-    //! @sa ActivateSnapshot
-    unsigned int nTx{0};
+    //! height of the entry in the chain. The genesis block has height 0
+    int nHeight{0};
 
-    //! Size of this block.
-    //! Note: in a potential headers-first mode, this number cannot be relied
-    //! upon
-    unsigned int nSize{0};
+    //! Verification status of this block. See enum BlockStatus
+    BlockStatus nStatus{};
+
+    //! (memory only) Sequential id assigned to distinguish order in which
+    //! blocks are received.
+    int32_t nSequenceId{0};
+
+    //! block header
+    uint32_t nTime{0};
+    uint32_t nBits{0};
+
+    //! (memory only) Maximum nTime in the chain up to and including this block.
+    unsigned int nTimeMax{0};
 
     //! (memory only) Number of transactions in the chain up to and including
     //! this block.
@@ -74,6 +69,15 @@ public:
     //! @sa ActivateSnapshot
     unsigned int nChainTx{0};
 
+    //! Number of transactions in this block.
+    //! Note: in a potential headers-first mode, this number cannot be relied
+    //! upon
+    //! Note: this value is faked during UTXO snapshot load to ensure that
+    //! LoadBlockIndex() will load index entries for blocks that we lack data
+    //! for.
+    //! @sa ActivateSnapshot
+    unsigned int nTx{0};
+
 private:
     //! (memory only) Size of all blocks in the chain up to and including this
     //! block. This value will be non-zero only if and only if transactions for
@@ -81,32 +85,34 @@ private:
     uint64_t nChainSize{0};
 
 public:
-    //! Verification status of this block. See enum BlockStatus
-    BlockStatus nStatus{};
+    //! (memory only) block header metadata
+    uint64_t nTimeReceived{0};
 
-    //! block header
-    int32_t nVersion{0};
-    uint256 hashMerkleRoot{};
-    uint32_t nTime{0};
-    uint32_t nBits{0};
-    uint32_t nNonce{0};
+    //! Which # file this block is stored in (blk?????.dat)
+    int nFile{0};
 
-    //! (memory only) Sequential id assigned to distinguish order in which
-    //! blocks are received.
-    int32_t nSequenceId{0};
+    //! Byte offset within blk?????.dat where this block's data is stored
+    unsigned int nDataPos{0};
 
-    //! (memory only) block header metadata
-    uint64_t nTimeReceived{0};
+    //! Byte offset within rev?????.dat where this block's undo data is stored
+    unsigned int nUndoPos{0};
 
-    //! (memory only) Maximum nTime in the chain up to and including this block.
-    unsigned int nTimeMax{0};
+    //! Size of this block.
+    //! Note: in a potential headers-first mode, this number cannot be relied
+    //! upon
+    unsigned int nSize{0};
+
+    //! block header
+    int32_t nVersion{0};
+    uint32_t nNonce{0};
+    uint256 hashMerkleRoot{};
 
     explicit CBlockIndex() = default;
 
     explicit CBlockIndex(const CBlockHeader &block)
-        : nVersion{block.nVersion}, hashMerkleRoot{block.hashMerkleRoot},
-          nTime{block.nTime}, nBits{block.nBits}, nNonce{block.nNonce},
-          nTimeReceived{0} {}
+        : nTime{block.nTime}, nBits{block.nBits}, nTimeReceived{0},
+          nVersion{block.nVersion}, nNonce{block.nNonce},
+          hashMerkleRoot{block.hashMerkleRoot} {}
 
     FlatFilePos GetBlockPos() const {
         FlatFilePos ret;
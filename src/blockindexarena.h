@@ -0,0 +1,60 @@
+// Copyright (c) 2022 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKINDEXARENA_H
+#define BITCOIN_BLOCKINDEXARENA_H
+
+#include <blockindex.h>
+#include <memusage.h>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * Storage for the block index entries, which are allocated contiguously in
+ * large chunks rather than one at a time. This avoids the allocator overhead
+ * of each entry, and keeps entries created together (e.g. the headers of a
+ * chain received from a peer) next to each other in memory.
+ *
+ * The entries never move once created, and are only freed all at once.
+ */
+class BlockIndexArena {
+public:
+    //! Number of entries in each chunk.
+    static constexpr size_t CHUNK_SIZE = 4096;
+
+    template <typename... Args> CBlockIndex *New(Args &&...args) {
+        if (m_chunks.empty() || m_chunks.back().size() == CHUNK_SIZE) {
+            m_chunks.emplace_back();
+            m_chunks.back().reserve(CHUNK_SIZE);
+        }
+        // The chunk never grows past its reserved capacity, so the entries
+        // already in there are not moved.
+        return &m_chunks.back().emplace_back(std::forward<Args>(args)...);
+    }
+
+    void Clear() {
+        m_chunks.clear();
+        m_chunks.shrink_to_fit();
+    }
+
+    size_t Size() const {
+        if (m_chunks.empty()) {
+            return 0;
+        }
+        return (m_chunks.size() - 1) * CHUNK_SIZE + m_chunks.back().size();
+    }
+
+    size_t DynamicMemoryUsage() const {
+        return memusage::DynamicUsage(m_chunks) +
+               m_chunks.size() *
+                   memusage::MallocUsage(CHUNK_SIZE * sizeof(CBlockIndex));
+    }
+
+private:
+    std::vector<std::vector<CBlockIndex>> m_chunks;
+};
+
+#endif // BITCOIN_BLOCKINDEXARENA_H
@@ -128,6 +128,12 @@ public:
 
     SERIALIZE_METHODS(BlockStatus, obj) { READWRITE(VARINT(obj.status)); }
 
+    //! The raw status flags, for storage in fixed size records.
+    uint32_t getRawValue() const { return status; }
+    static constexpr BlockStatus fromRawValue(uint32_t rawValue) {
+        return BlockStatus(rawValue);
+    }
+
     friend constexpr bool operator==(const BlockStatus a, const BlockStatus b) {
         return a.status == b.status;
     }
@@ -10,10 +10,37 @@
 #include <util/threadnames.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 template <typename T> class CCheckQueueControl;
 
+/**
+ * Checks can defer part of their work (e.g. signature verifications) into a
+ * batch owned by the worker running them, which is settled at once after the
+ * worker ran all the checks it took from the queue. A check type opts into
+ * this by defining a Batch type, providing a `bool Verify()` method, and an
+ * operator() overload taking a Batch reference.
+ */
+template <typename T, typename = void> struct CheckBatchTraits {
+    struct Batch {
+        bool Verify() { return true; }
+    };
+    static bool Run(T &check, Batch &batch) { return check(); }
+};
+
+template <typename T>
+struct CheckBatchTraits<T, std::void_t<typename T::Batch>> {
+    using Batch = typename T::Batch;
+    static bool Run(T &check, Batch &batch) { return check(batch); }
+};
+
 /**
  * Queue for verifications that have to be performed.
  * The verifications are represented by a type T, which must provide an
@@ -23,10 +50,23 @@ template <typename T> class CCheckQueueControl;
  * queue, where they are processed by N-1 worker threads. When the master is
  * done adding work, it temporarily joins the worker pool as an N'th worker,
  * until all jobs are done.
+ *
+ * Every participant owns a deque of pending verifications, which only needs
+ * to be locked for the short time it takes to move a batch in or out of it.
+ * The master spreads added verifications over all the deques, each worker
+ * consumes its own deque from the back and steals from the front of the
+ * others once it runs dry. Completion is tracked with atomic counters, so the
+ * shared mutex is only taken to put idle threads to sleep and wake them up.
  */
 template <typename T> class CCheckQueue {
 private:
-    //! Mutex to protect the inner state
+    //! Pending verifications owned by one participant
+    struct WorkQueue {
+        Mutex m_mutex;
+        std::deque<T> m_checks GUARDED_BY(m_mutex);
+    };
+
+    //! Mutex used to put idle threads to sleep
     Mutex m_mutex;
 
     //! Worker threads block on this when out of work
@@ -35,104 +75,142 @@ private:
     //! Master thread blocks on this when out of work
     std::condition_variable m_master_cv;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue GUARDED_BY(m_mutex);
+    //! One work queue per participant, the master's first. Only resized when
+    //! no worker threads are running.
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle GUARDED_BY(m_mutex){0};
+    //! Work queue the next added verifications are distributed from. Only
+    //! used by the master.
+    size_t m_next_queue{0};
 
-    //! The total number of workers (including the master).
-    int nTotal GUARDED_BY(m_mutex){0};
+    //! Number of verifications added that have not been taken out of the
+    //! work queues yet.
+    std::atomic<unsigned int> m_queued{0};
 
     //! The temporary evaluation result.
-    bool fAllOk GUARDED_BY(m_mutex){true};
+    std::atomic<bool> fAllOk{true};
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo GUARDED_BY(m_mutex){0};
+    std::atomic<unsigned int> nTodo{0};
 
     //! The maximum number of elements to be processed in one batch
     const unsigned int nBatchSize;
 
+    //! Prefix used to name the worker threads
+    const std::string m_thread_name;
+
     std::vector<std::thread> m_worker_threads;
-    bool m_request_stop GUARDED_BY(m_mutex){false};
+    std::atomic<bool> m_request_stop{false};
+
+    /**
+     * Move a batch of verifications out of a work queue into vChecks. The
+     * owner of the queue takes from the back, so the most recently added
+     * (and likely still cached) checks run first, while thieves take from
+     * the front. Either takes half of what is left, within the batch size
+     * limit, so all participants finish approximately simultaneously.
+     */
+    unsigned int TakeChecks(WorkQueue &work, bool owner,
+                            std::vector<T> &vChecks) {
+        LOCK(work.m_mutex);
+        std::deque<T> &checks = work.m_checks;
+        if (checks.empty()) {
+            return 0;
+        }
+        const unsigned int nNow = std::min<size_t>(
+            nBatchSize, std::max<size_t>(1, checks.size() / 2));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // Swap jobs from the work queue to the local batch vector instead
+            // of copying, to hold the lock as short as possible.
+            if (owner) {
+                vChecks[i].swap(checks.back());
+                checks.pop_back();
+            } else {
+                vChecks[i].swap(checks.front());
+                checks.pop_front();
+            }
+        }
+        m_queued -= nNow;
+        return nNow;
+    }
+
+    /** Take a batch of verifications from our own queue or steal one. */
+    unsigned int FindWork(size_t index, std::vector<T> &vChecks) {
+        const size_t nQueues = m_queues.size();
+        for (size_t i = 0; i < nQueues; i++) {
+            const size_t victim = (index + i) % nQueues;
+            if (unsigned int nNow =
+                    TakeChecks(*m_queues[victim], i == 0, vChecks)) {
+                return nNow;
+            }
+        }
+        return 0;
+    }
 
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster) {
+    bool Loop(size_t index) {
+        const bool fMaster = index == 0;
         std::condition_variable &cond = fMaster ? m_master_cv : m_worker_cv;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
+        while (!m_request_stop) {
+            const unsigned int nNow = FindWork(index, vChecks);
+            if (nNow == 0) {
                 WAIT_LOCK(m_mutex, lock);
-                // first do the clean-up of the previous loop run (allowing us
-                // to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster) {
-                        // We processed the last element; inform the master it
-                        // can exit and return the result
-                        m_master_cv.notify_one();
-                    }
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty() && !m_request_stop) {
+                while (m_queued == 0 && !m_request_stop) {
                     if (fMaster && nTodo == 0) {
-                        nTotal--;
                         bool fRet = fAllOk;
                         // reset the status for new work later
                         fAllOk = true;
                         // return the current status
                         return fRet;
                     }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                if (m_request_stop) {
-                    return false;
-                }
-
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for
-                // increasingly smaller batches so all workers finish
-                // approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start
-                // helping.
-                // * Don't do batches smaller than 1 (duh), or larger than
-                // nBatchSize.
-                nNow = std::max(
-                    1U, std::min(nBatchSize, (unsigned int)queue.size() /
-                                                 (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the m_mutex to be as short as
-                    // possible, so swap jobs from the global queue to the local
-                    // batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                    cond.wait(lock);
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
+
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
             // execute work
+            typename CheckBatchTraits<T>::Batch batch;
             for (T &check : vChecks) {
                 if (fOk) {
-                    fOk = check();
+                    fOk = CheckBatchTraits<T>::Run(check, batch);
                 }
             }
+            // settle the work deferred by the checks
+            if (fOk) {
+                fOk = batch.Verify();
+            }
             vChecks.clear();
-        } while (true);
+
+            if (!fOk) {
+                fAllOk = false;
+            }
+            if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                // We processed the last element; inform the master it can
+                // exit and return the result
+                WITH_LOCK(m_mutex, m_master_cv.notify_one());
+            }
+        }
+        return false;
+    }
+
+    //! Replace the work queues, one per participant.
+    void ResetQueues(size_t nQueues) {
+        m_queues.clear();
+        for (size_t i = 0; i < nQueues; i++) {
+            m_queues.push_back(std::make_unique<WorkQueue>());
+        }
+        m_next_queue = 0;
+        m_queued = 0;
+        nTodo = 0;
+        fAllOk = true;
     }
 
 public:
@@ -140,41 +218,60 @@ public:
     Mutex m_control_mutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn)
-        : nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn,
+                         std::string thread_name = "scriptch")
+        : nBatchSize(nBatchSizeIn), m_thread_name(std::move(thread_name)) {
+        ResetQueues(1);
+    }
 
     //! Create a pool of new worker threads.
     void StartWorkerThreads(const int threads_num) {
-        {
-            LOCK(m_mutex);
-            nIdle = 0;
-            nTotal = 0;
-            fAllOk = true;
-        }
         assert(m_worker_threads.empty());
+        ResetQueues(1 + std::max(threads_num, 0));
         for (int n = 0; n < threads_num; ++n) {
             m_worker_threads.emplace_back([this, n]() {
-                util::ThreadRename(strprintf("scriptch.%i", n));
-                Loop(false /* worker thread */);
+                util::ThreadRename(strprintf("%s.%i", m_thread_name, n));
+                Loop(n + 1 /* worker thread */);
             });
         }
     }
 
     //! Wait until execution finishes, and return whether all evaluations were
     //! successful.
-    bool Wait() { return Loop(true /* master thread */); }
+    bool Wait() { return Loop(0 /* master thread */); }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T> &vChecks) {
-        LOCK(m_mutex);
-        for (T &check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty()) {
+            return;
         }
+        // Account for the checks before they become visible, so that neither
+        // the master nor a thief can observe them as completed or missing.
         nTodo += vChecks.size();
+        m_queued += vChecks.size();
+
+        // Spread the checks over the work queues in contiguous chunks, so
+        // every participant has work at hand without stealing.
+        const size_t nQueues = m_queues.size();
+        const size_t nChunk = std::max<size_t>(
+            1, (vChecks.size() + nQueues - 1) / nQueues);
+        size_t index = m_next_queue;
+        for (size_t begin = 0; begin < vChecks.size(); begin += nChunk) {
+            const size_t end = std::min(vChecks.size(), begin + nChunk);
+            WorkQueue &work = *m_queues[index];
+            LOCK(work.m_mutex);
+            for (size_t i = begin; i < end; i++) {
+                work.m_checks.emplace_back();
+                vChecks[i].swap(work.m_checks.back());
+            }
+            index = (index + 1) % nQueues;
+        }
+        m_next_queue = index;
+
+        LOCK(m_mutex);
         if (vChecks.size() == 1) {
             m_worker_cv.notify_one();
-        } else if (vChecks.size() > 1) {
+        } else {
             m_worker_cv.notify_all();
         }
     }
@@ -187,7 +284,8 @@ public:
             t.join();
         }
         m_worker_threads.clear();
-        WITH_LOCK(m_mutex, m_request_stop = false);
+        ResetQueues(1);
+        m_request_stop = false;
     }
 
     ~CCheckQueue() { assert(m_worker_threads.empty()); }
@@ -30,6 +30,20 @@ bool CCoinsView::HaveCoin(const COutPoint &outpoint) const {
     return GetCoin(outpoint, coin);
 }
 
+size_t CCoinsView::GetCoins(Span<const COutPoint> outpoints,
+                            Span<Coin> coins) const {
+    assert(outpoints.size() == coins.size());
+    size_t found = 0;
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (GetCoin(outpoints[i], coins[i])) {
+            ++found;
+        } else {
+            coins[i].Clear();
+        }
+    }
+    return found;
+}
+
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) {}
 bool CCoinsViewBacked::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return base->GetCoin(outpoint, coin);
@@ -149,6 +163,18 @@ void CCoinsViewCache::EmplaceCoinInternalDANGER(COutPoint &&outpoint,
         std::forward_as_tuple(std::move(coin), CCoinsCacheEntry::DIRTY));
 }
 
+bool CCoinsViewCache::EmplaceFetchedCoin(const COutPoint &outpoint,
+                                         Coin &&coin) {
+    assert(!coin.IsSpent());
+    CCoinsMap::iterator it;
+    bool inserted;
+    std::tie(it, inserted) = cacheCoins.try_emplace(outpoint, std::move(coin));
+    if (inserted) {
+        cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    }
+    return inserted;
+}
+
 void AddCoins(CCoinsViewCache &cache, const CTransaction &tx, int nHeight,
               bool check_for_overwrite) {
     bool fCoinbase = tx.IsCoinBase();
@@ -283,6 +309,9 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
 bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
+    // Start over with a fresh pool: the base may have taken the coins over
+    // along with their memory, which must not be shared with this cache.
+    ReallocateCache();
     cachedCoinsUsage = 0;
     return fOk;
 }
@@ -339,20 +368,34 @@ const Coin &AccessByTxid(const CCoinsViewCache &view, const TxId &txid) {
     return coinEmpty;
 }
 
+void CCoinsViewErrorCatcher::HandleReadError(
+    const std::runtime_error &e) const {
+    for (auto f : m_err_callbacks) {
+        f();
+    }
+    LogPrintf("Error reading from database: %s\n", e.what());
+    // Starting the shutdown sequence and returning false to the caller
+    // would be interpreted as 'entry not found' (as opposed to unable to
+    // read data), and could lead to invalid interpretation. Just exit
+    // immediately, as we can't continue anyway, and all writes should be
+    // atomic.
+    std::abort();
+}
+
 bool CCoinsViewErrorCatcher::GetCoin(const COutPoint &outpoint,
                                      Coin &coin) const {
     try {
         return CCoinsViewBacked::GetCoin(outpoint, coin);
     } catch (const std::runtime_error &e) {
-        for (auto f : m_err_callbacks) {
-            f();
-        }
-        LogPrintf("Error reading from database: %s\n", e.what());
-        // Starting the shutdown sequence and returning false to the caller
-        // would be interpreted as 'entry not found' (as opposed to unable to
-        // read data), and could lead to invalid interpretation. Just exit
-        // immediately, as we can't continue anyway, and all writes should be
-        // atomic.
-        std::abort();
+        HandleReadError(e);
+    }
+}
+
+size_t CCoinsViewErrorCatcher::GetCoins(Span<const COutPoint> outpoints,
+                                        Span<Coin> coins) const {
+    try {
+        return base->GetCoins(outpoints, coins);
+    } catch (const std::runtime_error &e) {
+        HandleReadError(e);
     }
 }
@@ -10,11 +10,14 @@
 #include <memusage.h>
 #include <primitives/blockhash.h>
 #include <serialize.h>
+#include <span.h>
+#include <support/allocators/pool.h>
 #include <util/hasher.h>
 
 #include <cassert>
 #include <cstdint>
 #include <functional>
+#include <stdexcept>
 #include <unordered_map>
 
 /**
@@ -120,8 +123,21 @@ struct CCoinsCacheEntry {
         : coin(std::move(coin_)), flags(flag) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>
-    CCoinsMap;
+/**
+ * The coins cache map allocates its nodes from a pool rather than from the
+ * general purpose allocator: this saves the per allocation overhead of malloc
+ * for each cached coin, fitting more coins in the same -dbcache, and keeps the
+ * nodes packed together in memory.
+ *
+ * The pool blocks are sized after the map nodes, which are made of the
+ * key/value pair and a pointer to the next node; the extra pointers leave room
+ * for implementations with larger nodes.
+ */
+using CCoinsMap = std::unordered_map<
+    COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>,
+    PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                  sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) +
+                      sizeof(void *) * 4>>;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor {
@@ -156,6 +172,18 @@ public:
     //! Just check whether a given outpoint is unspent.
     virtual bool HaveCoin(const COutPoint &outpoint) const;
 
+    /**
+     * Retrieve the coins for many outpoints at once. coins[i] is set to the
+     * coin of outpoints[i], or cleared if it is not found. Views backed by a
+     * database resolve them in a single pass over it, which is cheapest when
+     * the outpoints are sorted (by COutPoint's operator<, which follows the
+     * database order). Both spans must have the same size.
+     *
+     * @returns the number of coins found.
+     */
+    virtual size_t GetCoins(Span<const COutPoint> outpoints,
+                            Span<Coin> coins) const;
+
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual BlockHash GetBestBlock() const;
 
@@ -266,6 +294,19 @@ public:
      */
     void EmplaceCoinInternalDANGER(COutPoint &&outpoint, Coin &&coin);
 
+    /**
+     * Insert a coin that was read from the backing view out of band (e.g. by
+     * an input prefetcher), as if FetchCoin() had pulled it in: the entry is
+     * neither DIRTY nor FRESH. Nothing is done if the cache already holds an
+     * entry for this outpoint, as that entry supersedes the backing view.
+     *
+     * The caller must guarantee that the backing view has not been modified
+     * since the coin was read from it.
+     *
+     * @returns whether the coin was inserted.
+     */
+    bool EmplaceFetchedCoin(const COutPoint &outpoint, Coin &&coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call has no
@@ -346,12 +387,16 @@ public:
     }
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    size_t GetCoins(Span<const COutPoint> outpoints,
+                    Span<Coin> coins) const override;
 
 private:
     /**
      * A list of callbacks to execute upon leveldb read error.
      */
     std::vector<std::function<void()>> m_err_callbacks;
+
+    [[noreturn]] void HandleReadError(const std::runtime_error &e) const;
 };
 
 #endif // BITCOIN_COINS_H
@@ -22,5 +22,15 @@ void static inline GetCPUID(uint32_t leaf, uint32_t subleaf, uint32_t &a,
 #endif
 }
 
+/**
+ * Check whether the OS has enabled the AVX registers. Only valid if CPUID
+ * reports both XSAVE and AVX support, as xgetbv is not available otherwise.
+ */
+bool static inline AVXEnabled() {
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+
 #endif // defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
 #endif // BITCOIN_COMPAT_CPUID_H
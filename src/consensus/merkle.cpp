@@ -74,3 +74,24 @@ uint256 BlockMerkleRoot(const CBlock &block, bool *mutated) {
     }
     return ComputeMerkleRoot(std::move(leaves), mutated);
 }
+
+std::vector<uint256> BlockCoinbaseMerkleBranch(const CBlock &block) {
+    std::vector<uint256> hashes;
+    hashes.resize(block.vtx.size());
+    for (size_t s = 0; s < block.vtx.size(); s++) {
+        hashes[s] = block.vtx[s]->GetId();
+    }
+
+    // The coinbase is always first, so its sibling at each level is the
+    // second hash of that level.
+    std::vector<uint256> branch;
+    while (hashes.size() > 1) {
+        branch.push_back(hashes[1]);
+        if (hashes.size() & 1) {
+            hashes.push_back(hashes.back());
+        }
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+    }
+    return branch;
+}
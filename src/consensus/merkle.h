@@ -18,4 +18,10 @@ uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool *mutated = nullptr);
  */
 uint256 BlockMerkleRoot(const CBlock &block, bool *mutated = nullptr);
 
+/**
+ * Compute the Merkle branch of the coinbase transaction of a block, i.e. the
+ * hashes which, along with the coinbase txid, give the Merkle root.
+ */
+std::vector<uint256> BlockCoinbaseMerkleBranch(const CBlock &block);
+
 #endif // BITCOIN_CONSENSUS_MERKLE_H
@@ -59,4 +59,12 @@ static inline size_t RecursiveDynamicUsage(const std::shared_ptr<X> &p) {
     return p ? memusage::DynamicUsage(p) + RecursiveDynamicUsage(*p) : 0;
 }
 
+static inline size_t RecursiveDynamicUsage(const CBlock &block) {
+    size_t mem = memusage::DynamicUsage(block.vtx);
+    for (const CTransactionRef &tx : block.vtx) {
+        mem += RecursiveDynamicUsage(tx);
+    }
+    return mem;
+}
+
 #endif // BITCOIN_CORE_MEMUSAGE_H
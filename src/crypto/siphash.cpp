@@ -4,6 +4,13 @@
 
 #include <crypto/siphash.h>
 
+#include <compat/cpuid.h>
+
+namespace siphash_avx2 {
+void SipHashUint256_4way(uint64_t k0, uint64_t k1, const uint256 *vals,
+                         uint64_t *out);
+}
+
 #define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
 
 #define SIPROUND                                                               \
@@ -175,3 +182,42 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256 &val,
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+namespace {
+using SipHashUint256_4way_t = void (*)(uint64_t, uint64_t, const uint256 *,
+                                       uint64_t *);
+
+/** Pick the 4-way implementation supported by the CPU, if any. */
+SipHashUint256_4way_t SipHashUint256_4wayAutoDetect() {
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_AVX2) &&      \
+    !defined(BUILD_BITCOIN_INTERNAL)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_xsave = (ecx >> 27) & 1;
+    const bool have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx && AVXEnabled()) {
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        if ((ebx >> 5) & 1) {
+            return siphash_avx2::SipHashUint256_4way;
+        }
+    }
+#endif
+    return nullptr;
+}
+} // namespace
+
+void SipHashUint256Many(uint64_t k0, uint64_t k1, const uint256 *vals,
+                        uint64_t *out, size_t count) {
+    static const SipHashUint256_4way_t SipHashUint256_4way =
+        SipHashUint256_4wayAutoDetect();
+
+    size_t i = 0;
+    if (SipHashUint256_4way) {
+        for (; i + 4 <= count; i += 4) {
+            SipHashUint256_4way(k0, k1, vals + i, out + i);
+        }
+    }
+    for (; i < count; ++i) {
+        out[i] = SipHashUint256(k0, k1, vals[i]);
+    }
+}
@@ -48,4 +48,13 @@ uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256 &val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256 &val,
                              uint32_t extra);
 
+/**
+ * Compute SipHashUint256(k0, k1, vals[i]) for the `count` values into out[i].
+ *
+ * When the CPU supports AVX2, four values are hashed at once in the lanes of
+ * vector registers, which is faster than hashing them one by one.
+ */
+void SipHashUint256Many(uint64_t k0, uint64_t k1, const uint256 *vals,
+                        uint64_t *out, size_t count);
+
 #endif // BITCOIN_CRYPTO_SIPHASH_H
@@ -8,13 +8,22 @@
 #include <clientversion.h>
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
 #include <streams.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 
+#include <leveldb/comparator.h>
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
@@ -252,6 +261,77 @@ public:
         return true;
     }
 
+    /**
+     * Read the values of many keys in a single pass over the database.
+     *
+     * The keys are sorted in the database order and resolved by a single
+     * iterator, which only seeks when the next key lies beyond its current
+     * position. Keys close to each other are thus found without going through
+     * the whole lookup again, unlike with as many Read() calls.
+     *
+     * values[i] is set to the value of keys[i], or to std::nullopt if that key
+     * is not in the database or its value could not be deserialized.
+     *
+     * @returns the number of values found.
+     */
+    template <typename K, typename V>
+    size_t ReadMany(Span<const K> keys,
+                    std::vector<std::optional<V>> &values) const {
+        std::vector<std::pair<std::string, size_t>> sorted_keys;
+        sorted_keys.reserve(keys.size());
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            ssKey.clear();
+            ssKey << keys[i];
+            sorted_keys.emplace_back(std::string(ssKey.begin(), ssKey.end()),
+                                     i);
+        }
+        const leveldb::Comparator *comparator = options.comparator;
+        std::sort(sorted_keys.begin(), sorted_keys.end(),
+                  [comparator](const auto &a, const auto &b) {
+                      return comparator->Compare(a.first, b.first) < 0;
+                  });
+
+        values.assign(keys.size(), std::nullopt);
+        size_t found = 0;
+        std::unique_ptr<leveldb::Iterator> it(pdb->NewIterator(readoptions));
+        for (const auto &[key, index] : sorted_keys) {
+            const leveldb::Slice slKey(key);
+            if (!it->Valid() || comparator->Compare(it->key(), slKey) < 0) {
+                it->Seek(slKey);
+                if (!it->Valid()) {
+                    // Past the last key, the remaining ones are not found.
+                    break;
+                }
+            }
+            if (comparator->Compare(it->key(), slKey) != 0) {
+                continue;
+            }
+
+            try {
+                const leveldb::Slice slValue = it->value();
+                CDataStream ssValue(slValue.data(),
+                                    slValue.data() + slValue.size(), SER_DISK,
+                                    CLIENT_VERSION);
+                ssValue.Xor(obfuscate_key);
+                V value;
+                ssValue >> value;
+                values[index] = std::move(value);
+                ++found;
+            } catch (const std::exception &) {
+                // Left unset, like Read() returning false.
+            }
+        }
+
+        const leveldb::Status status = it->status();
+        if (!status.ok()) {
+            LogPrintf("LevelDB read failure: %s\n", status.ToString());
+            dbwrapper_private::HandleError(status);
+        }
+        return found;
+    }
+
     template <typename K, typename V>
     bool Write(const K &key, const V &value, bool fSync = false) {
         CDBBatch batch(*this);
@@ -8,10 +8,189 @@
 #include <tinyformat.h>
 #include <util/system.h>
 
+#include <algorithm>
+#include <cerrno>
 #include <stdexcept>
 
-FlatFileSeq::FlatFileSeq(fs::path dir, const char *prefix, size_t chunk_size)
-    : m_dir(std::move(dir)), m_prefix(prefix), m_chunk_size(chunk_size) {
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifndef WIN32
+/** Get the device and inode of the file at path. */
+static bool GetFileId(const fs::path &path, uint64_t &dev, uint64_t &ino) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    dev = st.st_dev;
+    ino = st.st_ino;
+    return true;
+}
+#endif
+
+std::shared_ptr<const MappedFlatFile>
+MappedFlatFile::Map(const fs::path &path) {
+#ifdef WIN32
+    return nullptr;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+    const size_t size = st.st_size;
+    void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping holds its own reference to the file.
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogPrintf("Unable to map file %s\n", fs::PathToString(path));
+        return nullptr;
+    }
+    return std::shared_ptr<const MappedFlatFile>(
+        new MappedFlatFile(static_cast<const uint8_t *>(data), size, st.st_dev,
+                           st.st_ino));
+#endif
+}
+
+MappedFlatFile::~MappedFlatFile() {
+#ifndef WIN32
+    munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+}
+
+bool MappedFlatFile::IsFile(const fs::path &path) const {
+#ifdef WIN32
+    return false;
+#else
+    uint64_t dev, ino;
+    return GetFileId(path, dev, ino) && dev == m_dev && ino == m_ino;
+#endif
+}
+
+std::shared_ptr<const MappedFlatFile>
+FlatFileMapCache::Get(const fs::path &path, size_t min_size) {
+    LOCK(m_mutex);
+    auto it =
+        std::find_if(m_files.begin(), m_files.end(),
+                     [&](const auto &entry) { return entry.first == path; });
+    if (it != m_files.end()) {
+        if (it->second->Data().size() >= min_size &&
+            it->second->IsFile(path)) {
+            m_files.splice(m_files.begin(), m_files, it);
+            return it->second;
+        }
+        m_files.erase(it);
+    }
+
+    std::shared_ptr<const MappedFlatFile> file = MappedFlatFile::Map(path);
+    if (!file || file->Data().size() < min_size) {
+        return nullptr;
+    }
+    m_files.emplace_front(path, file);
+    if (m_files.size() > m_max_files) {
+        m_files.pop_back();
+    }
+    return file;
+}
+
+void FlatFileMapCache::Remove(const fs::path &path) {
+    LOCK(m_mutex);
+    m_files.remove_if([&](const auto &entry) { return entry.first == path; });
+}
+
+size_t FlatFileMapCache::Size() {
+    LOCK(m_mutex);
+    return m_files.size();
+}
+
+std::shared_ptr<const FlatFileHandle>
+FlatFileHandle::Open(const fs::path &path) {
+#ifdef WIN32
+    return nullptr;
+#else
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    return std::shared_ptr<const FlatFileHandle>(new FlatFileHandle(fd));
+#endif
+}
+
+FlatFileHandle::~FlatFileHandle() {
+#ifndef WIN32
+    close(m_fd);
+#endif
+}
+
+bool FlatFileHandle::Read(uint64_t pos, Span<uint8_t> out) const {
+#ifdef WIN32
+    return false;
+#else
+    while (!out.empty()) {
+        const ssize_t ret = pread(m_fd, out.data(), out.size(), pos);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return false;
+        }
+        out = out.subspan(ret);
+        pos += ret;
+    }
+    return true;
+#endif
+}
+
+std::shared_ptr<const FlatFileHandle>
+FlatFileHandleCache::Get(const fs::path &path) {
+    LOCK(m_mutex);
+    auto it =
+        std::find_if(m_files.begin(), m_files.end(),
+                     [&](const auto &entry) { return entry.first == path; });
+    if (it != m_files.end()) {
+        m_files.splice(m_files.begin(), m_files, it);
+        return it->second;
+    }
+
+    std::shared_ptr<const FlatFileHandle> file = FlatFileHandle::Open(path);
+    if (!file) {
+        return nullptr;
+    }
+    m_files.emplace_front(path, file);
+    if (m_files.size() > m_max_files) {
+        m_files.pop_back();
+    }
+    return file;
+}
+
+void FlatFileHandleCache::Remove(const fs::path &path) {
+    LOCK(m_mutex);
+    m_files.remove_if([&](const auto &entry) { return entry.first == path; });
+}
+
+void FlatFileHandleCache::Clear() {
+    LOCK(m_mutex);
+    m_files.clear();
+}
+
+size_t FlatFileHandleCache::Size() {
+    LOCK(m_mutex);
+    return m_files.size();
+}
+
+FlatFileSeq::FlatFileSeq(fs::path dir, const char *prefix, size_t chunk_size,
+                         FlatFileMapCache *map_cache,
+                         FlatFileHandleCache *handle_cache)
+    : m_dir(std::move(dir)), m_prefix(prefix), m_chunk_size(chunk_size),
+      m_map_cache(map_cache), m_handle_cache(handle_cache) {
     if (chunk_size == 0) {
         throw std::invalid_argument("chunk_size must be positive");
     }
@@ -48,6 +227,22 @@ FILE *FlatFileSeq::Open(const FlatFilePos &pos, bool read_only) {
     return file;
 }
 
+std::shared_ptr<const MappedFlatFile>
+FlatFileSeq::Map(const FlatFilePos &pos, size_t size) const {
+    if (!m_map_cache || pos.IsNull()) {
+        return nullptr;
+    }
+    return m_map_cache->Get(FileName(pos), size_t(pos.nPos) + size);
+}
+
+std::shared_ptr<const FlatFileHandle>
+FlatFileSeq::OpenCached(const FlatFilePos &pos) const {
+    if (!m_handle_cache || pos.IsNull()) {
+        return nullptr;
+    }
+    return m_handle_cache->Get(FileName(pos));
+}
+
 size_t FlatFileSeq::Allocate(const FlatFilePos &pos, size_t add_size,
                              bool &out_of_space) {
     out_of_space = false;
@@ -87,6 +282,12 @@ bool FlatFileSeq::Flush(const FlatFilePos &pos, bool finalize) {
         fclose(file);
         return error("%s: failed to truncate file %d", __func__, pos.nFile);
     }
+    // Accessing a mapping past the end of the truncated file raises SIGBUS,
+    // so a mapping of the pre-allocated size must not be handed out again.
+    // The ones still in use are only read within the data written before pos.
+    if (finalize && m_map_cache) {
+        m_map_cache->Remove(FileName(pos));
+    }
     if (!FileCommit(file)) {
         fclose(file);
         return error("%s: failed to commit file %d", __func__, pos.nFile);
@@ -8,8 +8,14 @@
 
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
+#include <sync.h>
 
+#include <cstdint>
+#include <list>
+#include <memory>
 #include <string>
+#include <utility>
 
 struct FlatFilePos {
     int nFile;
@@ -42,6 +48,144 @@ struct FlatFilePos {
     std::string ToString() const;
 };
 
+/**
+ * A read-only memory mapping of a whole flat file, taken at its size at the
+ * time it was mapped. Data appended to the file later is not covered by the
+ * mapping.
+ *
+ * Reading from the mapping must stay within the data actually written to the
+ * file: the pre-allocated space past it is truncated when the file is
+ * finalized, and accessing pages beyond the end of a file is an error.
+ */
+class MappedFlatFile {
+private:
+    const uint8_t *const m_data;
+    const size_t m_size;
+    //! Device and inode of the mapped file, to detect it being replaced.
+    const uint64_t m_dev;
+    const uint64_t m_ino;
+
+    MappedFlatFile(const uint8_t *data, size_t size, uint64_t dev,
+                   uint64_t ino)
+        : m_data(data), m_size(size), m_dev(dev), m_ino(ino) {}
+
+public:
+    /**
+     * Map the file at the given path. Returns nullptr if it could not be
+     * mapped, or if memory mapped files are not supported on this platform.
+     */
+    static std::shared_ptr<const MappedFlatFile> Map(const fs::path &path);
+
+    ~MappedFlatFile();
+
+    MappedFlatFile(const MappedFlatFile &) = delete;
+    MappedFlatFile &operator=(const MappedFlatFile &) = delete;
+
+    Span<const uint8_t> Data() const { return {m_data, m_size}; }
+
+    //! Whether the file currently at path is still the one which was mapped.
+    bool IsFile(const fs::path &path) const;
+};
+
+/**
+ * Bounded cache of MappedFlatFile, which unmaps the least recently used files
+ * when it is full. Mappings handed out stay valid as long as they are
+ * referenced, even once evicted from the cache. This class is thread safe.
+ */
+class FlatFileMapCache {
+private:
+    const size_t m_max_files;
+
+    Mutex m_mutex;
+    //! Mapped files, the most recently used first.
+    std::list<std::pair<fs::path, std::shared_ptr<const MappedFlatFile>>>
+        m_files GUARDED_BY(m_mutex);
+
+public:
+    explicit FlatFileMapCache(size_t max_files) : m_max_files(max_files) {}
+
+    /**
+     * Get a mapping of the file at the given path covering at least its
+     * min_size first bytes. The file is mapped again if it grew past the
+     * current mapping or was replaced. Returns nullptr if it could not be
+     * mapped or is smaller than min_size.
+     */
+    std::shared_ptr<const MappedFlatFile> Get(const fs::path &path,
+                                              size_t min_size)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Drop the mapping of the file at path, if any. */
+    void Remove(const fs::path &path) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Number of files currently mapped. */
+    size_t Size() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+};
+
+/**
+ * A flat file kept open for reading, which can be read at any position from
+ * several threads at once without seeking.
+ */
+class FlatFileHandle {
+private:
+    const int m_fd;
+
+    explicit FlatFileHandle(int fd) : m_fd(fd) {}
+
+public:
+    /**
+     * Open the file at the given path. Returns nullptr if it could not be
+     * opened, or if positioned reads are not supported on this platform.
+     */
+    static std::shared_ptr<const FlatFileHandle> Open(const fs::path &path);
+
+    ~FlatFileHandle();
+
+    FlatFileHandle(const FlatFileHandle &) = delete;
+    FlatFileHandle &operator=(const FlatFileHandle &) = delete;
+
+    /**
+     * Read out.size() bytes starting at pos. Returns false if the file is too
+     * short or could not be read.
+     */
+    bool Read(uint64_t pos, Span<uint8_t> out) const;
+};
+
+/**
+ * Bounded cache of FlatFileHandle, which closes the least recently used files
+ * when it is full. Handles handed out stay open as long as they are
+ * referenced, even once evicted from the cache. The handles of files which
+ * get deleted or replaced must be removed from the cache. This class is
+ * thread safe.
+ */
+class FlatFileHandleCache {
+private:
+    const size_t m_max_files;
+
+    Mutex m_mutex;
+    //! Open files, the most recently used first.
+    std::list<std::pair<fs::path, std::shared_ptr<const FlatFileHandle>>>
+        m_files GUARDED_BY(m_mutex);
+
+public:
+    explicit FlatFileHandleCache(size_t max_files) : m_max_files(max_files) {}
+
+    /**
+     * Get a handle to the file at the given path, opening it if it is not in
+     * the cache. Returns nullptr if it could not be opened.
+     */
+    std::shared_ptr<const FlatFileHandle> Get(const fs::path &path)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Drop the handle to the file at path, if any. */
+    void Remove(const fs::path &path) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Drop all the handles. */
+    void Clear() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Number of files currently open. */
+    size_t Size() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+};
+
 /**
  * FlatFileSeq represents a sequence of numbered files storing raw data. This
  * class facilitates access to and efficient management of these files.
@@ -51,6 +195,8 @@ private:
     const fs::path m_dir;
     const char *const m_prefix;
     const size_t m_chunk_size;
+    FlatFileMapCache *const m_map_cache;
+    FlatFileHandleCache *const m_handle_cache;
 
 public:
     /**
@@ -60,8 +206,14 @@ public:
      * @param prefix A short prefix given to all file names.
      * @param chunk_size Disk space is pre-allocated in multiples of this
      * amount.
+     * @param map_cache If not nullptr, the cache holding the memory mappings
+     * of the files, which enables Map().
+     * @param handle_cache If not nullptr, the cache holding open handles to
+     * the files, which enables OpenCached().
      */
-    FlatFileSeq(fs::path dir, const char *prefix, size_t chunk_size);
+    FlatFileSeq(fs::path dir, const char *prefix, size_t chunk_size,
+                FlatFileMapCache *map_cache = nullptr,
+                FlatFileHandleCache *handle_cache = nullptr);
 
     /** Get the name of the file at the given position. */
     fs::path FileName(const FlatFilePos &pos) const;
@@ -69,6 +221,24 @@ public:
     /** Open a handle to the file at the given position. */
     FILE *Open(const FlatFilePos &pos, bool read_only = false);
 
+    /**
+     * Get a read-only memory mapping of the file at the given position,
+     * covering at least the size bytes starting at the position. Returns
+     * nullptr if the sequence has no map cache or the file could not be
+     * mapped, in which case the caller should read the file through Open().
+     */
+    std::shared_ptr<const MappedFlatFile> Map(const FlatFilePos &pos,
+                                              size_t size) const;
+
+    /**
+     * Get a cached read-only handle to the file at the given position.
+     * Returns nullptr if the sequence has no handle cache or the file could
+     * not be opened, in which case the caller should read the file through
+     * Open().
+     */
+    std::shared_ptr<const FlatFileHandle>
+    OpenCached(const FlatFilePos &pos) const;
+
     /**
      * Allocate additional space in a file after the given starting position.
      * The amount allocated will be the minimum multiple of the sequence chunk
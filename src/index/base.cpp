@@ -17,7 +17,6 @@
 
 #include <functional>
 
-using node::ReadBlockFromDisk;
 
 constexpr char DB_BEST_BLOCK = 'B';
 
@@ -188,13 +187,14 @@ void BaseIndex::ThreadSync() {
                 Commit();
             }
 
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            std::shared_ptr<const CBlock> block =
+                m_chainstate->m_blockman.ReadBlock(pindex, consensus_params);
+            if (!block) {
                 FatalError("%s: Failed to read block %s from disk", __func__,
                            pindex->GetBlockHash().ToString());
                 return;
             }
-            if (!WriteBlock(block, pindex)) {
+            if (!WriteBlock(*block, pindex)) {
                 FatalError("%s: Failed to write block %s to index database",
                            __func__, pindex->GetBlockHash().ToString());
                 return;
@@ -10,6 +10,8 @@
 #include <util/system.h>
 #include <validation.h>
 
+using node::BLOCK_STORAGE_COMPRESSED_FLAG;
+using node::DecompressStoredData;
 using node::OpenBlockFile;
 
 constexpr char DB_TXINDEX = 't';
@@ -80,17 +82,44 @@ bool TxIndex::FindTx(const TxId &txid, BlockHash &block_hash,
         return false;
     }
 
-    CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+    if (postx.nPos < sizeof(uint32_t)) {
+        return error("%s: Invalid block position", __func__);
+    }
+    // Open the block file at the size of the block, which tells whether it is
+    // stored compressed.
+    FlatFilePos size_pos{postx.nFile, postx.nPos - uint32_t(sizeof(uint32_t))};
+    CAutoFile file(OpenBlockFile(size_pos, true), SER_DISK, CLIENT_VERSION);
     if (file.IsNull()) {
         return error("%s: OpenBlockFile failed", __func__);
     }
     CBlockHeader header;
     try {
-        file >> header;
-        if (fseek(file.Get(), postx.nTxOffset, SEEK_CUR)) {
-            return error("%s: fseek(...) failed", __func__);
+        uint32_t stored_size;
+        file >> stored_size;
+        if (stored_size & BLOCK_STORAGE_COMPRESSED_FLAG) {
+            // The whole block needs to be decompressed to get to the
+            // transaction.
+            stored_size &= ~BLOCK_STORAGE_COMPRESSED_FLAG;
+            if (stored_size > MAX_SIZE) {
+                return error("%s: Invalid block size", __func__);
+            }
+            std::vector<uint8_t> stored(stored_size);
+            file.read(reinterpret_cast<char *>(stored.data()), stored_size);
+            std::vector<uint8_t> block;
+            if (!DecompressStoredData(stored, block)) {
+                return error("%s: Corrupted compressed block", __func__);
+            }
+            SpanReader reader(SER_DISK, CLIENT_VERSION, block);
+            reader >> header;
+            reader.ignore(postx.nTxOffset);
+            reader >> tx;
+        } else {
+            file >> header;
+            if (fseek(file.Get(), postx.nTxOffset, SEEK_CUR)) {
+                return error("%s: fseek(...) failed", __func__);
+            }
+            file >> tx;
         }
-        file >> tx;
     } catch (const std::exception &e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -16,6 +16,7 @@
 #include <avalanche/validation.h>
 #include <avalanche/voterecord.h> // For AVALANCHE_VOTE_STALE_*
 #include <banman.h>
+#include <blockencodings.h>
 #include <blockfilter.h>
 #include <chain.h>
 #include <chainparams.h>
@@ -93,9 +94,11 @@
 #include <csignal>
 #include <sys/stat.h>
 #endif
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <functional>
+#include <limits>
 #include <set>
 #include <thread>
 #include <vector>
@@ -105,11 +108,23 @@ using node::CalculateCacheSizes;
 using node::ChainstateLoadingError;
 using node::ChainstateLoadVerifyError;
 using node::CleanupBlockRevFiles;
+using node::DEFAULT_BACKGROUND_PRUNE;
+using node::DEFAULT_BLOCK_CACHE_SIZE_MB;
+using node::DEFAULT_BLOCK_COMPRESSION;
+using node::DEFAULT_BLOCK_INDEX_SNAPSHOT;
+using node::DEFAULT_INCREMENTAL_BLOCK_TEMPLATE;
+using node::DEFAULT_MMAP_BLOCK_FILES;
+using node::DEFAULT_REINDEX_THREADS;
 using node::DEFAULT_STOPAFTERBLOCKIMPORT;
 using node::fHavePruned;
 using node::fPruneMode;
 using node::fReindex;
+using node::g_background_prune;
+using node::IncrementalBlockAssembler;
 using node::LoadChainstate;
+using node::MAX_OPEN_BLOCK_FILES;
+using node::MAX_REINDEX_READ_AHEAD_SIZE;
+using node::MAX_REINDEX_THREADS;
 using node::NodeContext;
 using node::nPruneTarget;
 using node::ThreadImport;
@@ -123,7 +138,8 @@ static const bool DEFAULT_REST_ENABLE = false;
 // block files don't count towards the fd_set size limit anyway.
 #define MIN_CORE_FILEDESCRIPTORS 0
 #else
-#define MIN_CORE_FILEDESCRIPTORS 150
+// Including the block and undo files kept open for reading.
+#define MIN_CORE_FILEDESCRIPTORS (150 + 2 * int(MAX_OPEN_BLOCK_FILES))
 #endif
 
 static const char *DEFAULT_ASMAP_FILENAME = "ip_asn.map";
@@ -202,6 +218,14 @@ void Interrupt(NodeContext &node) {
     }
 }
 
+//! Whether the signature and script execution caches were loaded from disk,
+//! and should be saved back on shutdown.
+static bool g_script_caches_loaded = false;
+
+//! Whether the block index was loaded, and can be written to a snapshot file
+//! on shutdown.
+static bool g_block_index_loaded = false;
+
 void Shutdown(NodeContext &node) {
     static Mutex g_shutdown_mutex;
     TRY_LOCK(g_shutdown_mutex, lock_shutdown);
@@ -263,6 +287,10 @@ void Shutdown(NodeContext &node) {
         node.chainman->m_load_block.join();
     }
     StopScriptCheckWorkerThreads();
+    StopInputFetchWorkerThreads();
+    StopTxCheckWorkerThreads();
+    StopShortIdWorkerThreads();
+    StopBlockReadAheadThreads();
 
     // After the threads that potentially access these pointers have been
     // stopped, destruct and reset all to nullptr.
@@ -279,6 +307,12 @@ void Shutdown(NodeContext &node) {
         DumpMempool(*node.mempool);
     }
 
+    // Don't overwrite the saved caches if we stopped before loading them.
+    if (g_script_caches_loaded) {
+        DumpSignatureCache();
+        WITH_LOCK(cs_main, DumpScriptExecutionCache());
+    }
+
     // FlushStateToDisk generates a ChainStateFlushed callback, which we should
     // avoid missing
     if (node.chainman) {
@@ -320,6 +354,11 @@ void Shutdown(NodeContext &node) {
                 chainstate->ResetCoinsViews();
             }
         }
+        if (g_block_index_loaded &&
+            node.args->GetBoolArg("-blockindexsnapshot",
+                                  DEFAULT_BLOCK_INDEX_SNAPSHOT)) {
+            node.chainman->m_blockman.WriteBlockIndexSnapshot();
+        }
     }
     for (const auto &client : node.chain_clients) {
         client->stop();
@@ -333,6 +372,11 @@ void Shutdown(NodeContext &node) {
     }
 #endif
 
+    if (node.block_template) {
+        UnregisterValidationInterface(node.block_template.get());
+        node.block_template.reset();
+    }
+
     node.chain_clients.clear();
     UnregisterAllValidationInterfaces();
     GetMainSignals().UnregisterBackgroundSignalScheduler();
@@ -470,6 +514,41 @@ void SetupServerArgs(NodeContext &node) {
             defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(),
             testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()),
         ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg(
+        "-backgroundflush",
+        strprintf("Write periodic flushes of the coins cache to the chainstate "
+                  "database in the background, while validation continues "
+                  "with an empty cache. This can temporarily use up to twice "
+                  "the -dbcache memory (default: %u)",
+                  DEFAULT_BACKGROUND_FLUSH),
+        ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg(
+        "-backgroundprune",
+        strprintf("When pruning, delete the pruned block and undo files in the "
+                  "background rather than while holding up block connection "
+                  "(default: %u)",
+                  DEFAULT_BACKGROUND_PRUNE),
+        ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg(
+        "-blockcachesize=<n>",
+        strprintf("Maximum memory used by each of the caches of recently read "
+                  "blocks and undo data, in MiB (default: %d)",
+                  DEFAULT_BLOCK_CACHE_SIZE_MB),
+        ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg(
+        "-blockcompression",
+        strprintf("Store the new blocks and undo data compressed in the block "
+                  "files. Existing block files are left as they are, unless "
+                  "-convertblockfiles is used (default: %u)",
+                  DEFAULT_BLOCK_COMPRESSION),
+        ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg(
+        "-blockindexsnapshot",
+        strprintf("Write the block index to a compact snapshot file at "
+                  "shutdown, which is loaded instead of the block index "
+                  "database on the next startup (default: %u)",
+                  DEFAULT_BLOCK_INDEX_SNAPSHOT),
+        ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-blocksdir=<dir>",
                    "Specify directory to hold blocks subdirectory for *.dat "
                    "files (default: <datadir>)",
@@ -510,6 +589,13 @@ void SetupServerArgs(NodeContext &node) {
                   "paths will be prefixed by datadir location. (default: %s)",
                   BITCOIN_CONF_FILENAME),
         ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg(
+        "-convertblockfiles",
+        "Rewrite the existing block files at startup, so that their blocks "
+        "and undo data are stored compressed or not as selected by "
+        "-blockcompression. This requires enough free disk space for a copy "
+        "of the largest block file, and the transaction index gets rebuilt",
+        ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg("-datadir=<dir>", "Specify data directory",
                    ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg(
@@ -558,6 +644,14 @@ void SetupServerArgs(NodeContext &node) {
                              "than <n> hours (default: %u)",
                              DEFAULT_MEMPOOL_EXPIRY),
                    ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg(
+        "-mmapblockfiles",
+        strprintf("Read blocks and undo data from memory mapped block files, "
+                  "rather than copying them through file reads. This uses a "
+                  "lot of virtual address space and is not available on "
+                  "Windows (default: %u)",
+                  DEFAULT_MMAP_BLOCK_FILES),
+        ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg(
         "-minimumchainwork=<hex>",
         strprintf(
@@ -579,6 +673,12 @@ void SetupServerArgs(NodeContext &node) {
                              "on restart (default: %u)",
                              DEFAULT_PERSIST_MEMPOOL),
                    ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg("-persistsigcache",
+                   strprintf("Whether to save the signature and script "
+                             "execution caches on shutdown and load them on "
+                             "restart (default: %u)",
+                             DEFAULT_PERSIST_SIGCACHE),
+                   ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg(
         "-pid=<file>",
         strprintf("Specify pid file. Relative paths will be prefixed "
@@ -609,6 +709,14 @@ void SetupServerArgs(NodeContext &node) {
         "-reindex",
         "Rebuild chain state and block index from the blk*.dat files on disk",
         ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    argsman.AddArg(
+        "-reindexthreads=<n>",
+        strprintf("Number of threads reading and checking the blk*.dat files "
+                  "during -reindex (1 to %d, default: %d). The files read "
+                  "ahead are held in memory, up to %d MiB of them",
+                  MAX_REINDEX_THREADS, DEFAULT_REINDEX_THREADS,
+                  MAX_REINDEX_READ_AHEAD_SIZE >> 20),
+        ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     argsman.AddArg(
         "-settings=<file>",
         strprintf(
@@ -700,6 +808,13 @@ void SetupServerArgs(NodeContext &node) {
                   regtestBaseParams->OnionServiceTargetPort()),
         ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY,
         OptionsCategory::CONNECTION);
+    argsman.AddArg(
+        "-compactblockctor",
+        strprintf("Exchange compact blocks with sorted short IDs, relying on "
+                  "the canonical transaction order, with the peers supporting "
+                  "them (default: %d)",
+                  DEFAULT_COMPACT_BLOCK_CTOR),
+        ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     argsman.AddArg(
         "-connect=<ip>",
         "Connect only to the specified node(s); -connect=0 disables automatic "
@@ -1198,6 +1313,14 @@ void SetupServerArgs(NodeContext &node) {
                   ticker, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE_PER_KB)),
         ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
 
+    argsman.AddArg(
+        "-incrementalblocktemplate",
+        strprintf("Keep the block template up to date as transactions enter "
+                  "and leave the mempool, instead of assembling it from "
+                  "scratch for getblocktemplate (default: %d)",
+                  DEFAULT_INCREMENTAL_BLOCK_TEMPLATE),
+        ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+
     argsman.AddArg("-blockversion=<n>",
                    "Override block version to test forking scenarios",
                    ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY,
@@ -1841,6 +1964,8 @@ bool AppInitParameterInteraction(Config &config, const ArgsManager &args) {
     } else {
         LogPrintf("Skipping checkpoint verification.\n");
     }
+    g_background_flush =
+        args.GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH);
 
     hashAssumeValid = BlockHash::fromHex(
         args.GetArg("-assumevalid",
@@ -1932,6 +2057,8 @@ bool AppInitParameterInteraction(Config &config, const ArgsManager &args) {
                   nPruneTarget / 1024 / 1024);
         fPruneMode = true;
     }
+    g_background_prune =
+        args.GetBoolArg("-backgroundprune", DEFAULT_BACKGROUND_PRUNE);
 
     nConnectTimeout = args.GetIntArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0) {
@@ -2158,6 +2285,11 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    if (args.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        LoadSignatureCache();
+        WITH_LOCK(cs_main, LoadScriptExecutionCache());
+        g_script_caches_loaded = true;
+    }
 
     int script_threads = args.GetIntArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (script_threads <= 0) {
@@ -2177,6 +2309,19 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
               script_threads);
     if (script_threads >= 1) {
         StartScriptCheckWorkerThreads(script_threads);
+        // Block inputs are prefetched from the database on as many threads.
+        StartInputFetchWorkerThreads(script_threads);
+        // And the transactions of large blocks are checked on at most as
+        // many.
+        StartTxCheckWorkerThreads(
+            std::min(script_threads, MAX_TX_CHECK_THREADS));
+        // And the short IDs of the mempool transactions are computed on as
+        // many when a compact block is received.
+        StartShortIdWorkerThreads(script_threads);
+        // Blocks about to be connected are read ahead on at most as many
+        // threads as there are blocks read ahead.
+        StartBlockReadAheadThreads(
+            std::min(script_threads, MAX_BLOCKS_READ_AHEAD));
     }
 
     assert(!node.scheduler);
@@ -2302,12 +2447,27 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
     node.chainman = std::make_unique<ChainstateManager>();
     ChainstateManager &chainman = *node.chainman;
 
+    const size_t block_cache_size =
+        std::clamp<int64_t>(
+            args.GetIntArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE_MB), 0,
+            std::numeric_limits<size_t>::max() >> 20)
+        << 20;
+    chainman.m_blockman.m_block_cache.SetMaxUsage(block_cache_size);
+    chainman.m_blockman.m_undo_cache.SetMaxUsage(block_cache_size);
+
     assert(!node.peerman);
     node.peerman = PeerManager::make(
         chainparams, *node.connman, *node.addrman, node.banman.get(), chainman,
         *node.mempool, args.GetBoolArg("-blocksonly", DEFAULT_BLOCKSONLY));
     RegisterValidationInterface(node.peerman.get());
 
+    if (args.GetBoolArg("-incrementalblocktemplate",
+                        DEFAULT_INCREMENTAL_BLOCK_TEMPLATE)) {
+        node.block_template = std::make_unique<IncrementalBlockAssembler>(
+            config, chainman, *node.mempool);
+        RegisterValidationInterface(node.block_template.get());
+    }
+
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
     for (const std::string &cmt : args.GetArgs("-uacomment")) {
@@ -2623,6 +2783,26 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
         LogPrintf("Shutdown requested. Exiting.\n");
         return false;
     }
+    g_block_index_loaded = true;
+
+    if (args.GetBoolArg("-convertblockfiles", false)) {
+        if (fReindex) {
+            return InitError(
+                _("-convertblockfiles can not be used while reindexing."));
+        }
+        // The transaction index points to the transactions in the block
+        // files, so it is rebuilt from scratch.
+        fs::remove_all(args.GetDataDirNet() / "indexes" / "txindex");
+        uiInterface.InitMessage(_("Converting block files…").translated);
+        LOCK(cs_main);
+        if (!chainman.m_blockman.ConvertBlockFiles(chainparams)) {
+            return InitError(_("Error converting the block files."));
+        }
+        if (ShutdownRequested()) {
+            LogPrintf("Shutdown requested. Exiting.\n");
+            return false;
+        }
+    }
 
     // Encoded addresses using cashaddr instead of base58.
     // We do this by default to avoid confusion with BTC addresses.
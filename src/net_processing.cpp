@@ -48,12 +48,13 @@
 #include <algorithm>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <typeinfo>
 
 using node::fImporting;
 using node::fPruneMode;
 using node::fReindex;
-using node::ReadBlockFromDisk;
+using node::ReadRawBlockFromDisk;
 
 /** How long to cache transactions in mapRelay for normal relay */
 static constexpr auto RELAY_TX_CACHE_TIME = 15min;
@@ -105,6 +106,11 @@ static constexpr int HISTORICAL_BLOCK_AGE = 7 * 24 * 60 * 60;
 static constexpr std::chrono::minutes PING_INTERVAL{2};
 /** The maximum number of entries in a locator */
 static const unsigned int MAX_LOCATOR_SZ = 101;
+/**
+ * The maximum number of orphan transactions reconsidered together, with their
+ * script checks running in parallel
+ */
+static constexpr size_t MAX_ORPHAN_TX_BATCH_SIZE = 16;
 /** The maximum number of entries in an 'inv' protocol message */
 static const unsigned int MAX_INV_SZ = 50000;
 static_assert(MAX_PROTOCOL_MESSAGE_LENGTH > MAX_INV_SZ * sizeof(CInv),
@@ -204,6 +210,14 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
  *  when requested. For older blocks, a regular BLOCK response will be sent.
  */
 static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Version of the compact blocks with the short IDs in the block order. */
+static const uint64_t CMPCTBLOCKS_VERSION = 1;
+/**
+ * Version of the compact blocks with sorted short IDs, the receiver putting the
+ * transactions in the canonical order. The getblocktxn requests following them
+ * refer to the transactions in the compact block order, and carry its nonce.
+ */
+static const uint64_t CMPCTBLOCKS_VERSION_CTOR = 2;
 /**
  * Maximum depth of blocks we're willing to respond to GETBLOCKTXN requests
  * for.
@@ -609,8 +623,14 @@ private:
                                const std::vector<CBlockHeader> &headers,
                                bool via_compact_block);
 
+    /**
+     * Answer a getblocktxn request. With the nonce of a compact block with
+     * sorted short IDs, the request indexes refer to the transactions in the
+     * order of this compact block.
+     */
     void SendBlockTransactions(CNode &pfrom, const CBlock &block,
-                               const BlockTransactionsRequest &req);
+                               const BlockTransactionsRequest &req,
+                               std::optional<uint64_t> sorted_nonce);
 
     /**
      * Register with InvRequestTracker that a TX INV has been received from a
@@ -687,6 +707,9 @@ private:
     /** Whether this node is running in blocks only mode */
     const bool m_ignore_incoming_txs;
 
+    /** Whether to offer the compact blocks with sorted short IDs */
+    const bool m_compact_block_ctor;
+
     /**
      * Whether we've completed initial sync yet, for determining when to turn
      * on extra block-relay-only peers.
@@ -1059,6 +1082,11 @@ struct CNodeState {
      * non-witnesses in cmpctblocks/blocktxns.
      */
     bool fSupportsDesiredCmpctVersion;
+    /**
+     * Whether the peer supports the compact blocks with sorted short IDs, in
+     * which case they are used both ways. Only set with -compactblockctor.
+     */
+    bool fSupportsCmpctCTOR;
 
     /**
      * State used to enforce CHAIN_SYNC_TIMEOUT and EXTRA_PEER_CHECK_INTERVAL
@@ -1135,6 +1163,7 @@ struct CNodeState {
         fPreferHeaderAndIDs = false;
         fProvidesHeaderAndIDs = false;
         fSupportsDesiredCmpctVersion = false;
+        fSupportsCmpctCTOR = false;
         m_chain_sync = {0, nullptr, false, false};
         m_last_block_announcement = 0;
         m_recently_announced_invs.reset();
@@ -1303,13 +1332,20 @@ void PeerManagerImpl::MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid) {
     m_connman.ForNode(nodeid, [this](CNode *pfrom) EXCLUSIVE_LOCKS_REQUIRED(
                                   ::cs_main) {
         AssertLockHeld(::cs_main);
-        uint64_t nCMPCTBLOCKVersion = 1;
+        uint64_t nCMPCTBLOCKVersion = State(pfrom->GetId())->fSupportsCmpctCTOR
+                                          ? CMPCTBLOCKS_VERSION_CTOR
+                                          : CMPCTBLOCKS_VERSION;
         if (lNodesAnnouncingHeaderAndIDs.size() >= 3) {
             // As per BIP152, we only get 3 of our peers to announce
             // blocks using compact encodings.
             m_connman.ForNode(
                 lNodesAnnouncingHeaderAndIDs.front(),
-                [this, nCMPCTBLOCKVersion](CNode *pnodeStop) {
+                [this](CNode *pnodeStop) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
+                    AssertLockHeld(::cs_main);
+                    uint64_t nCMPCTBLOCKVersion =
+                        State(pnodeStop->GetId())->fSupportsCmpctCTOR
+                            ? CMPCTBLOCKS_VERSION_CTOR
+                            : CMPCTBLOCKS_VERSION;
                     m_connman.PushMessage(
                         pnodeStop, CNetMsgMaker(pnodeStop->GetCommonVersion())
                                        .Make(NetMsgType::SENDCMPCT,
@@ -2133,7 +2169,9 @@ PeerManagerImpl::PeerManagerImpl(const CChainParams &chainparams,
                                  CTxMemPool &pool, bool ignore_incoming_txs)
     : m_chainparams(chainparams), m_connman(connman), m_addrman(addrman),
       m_banman(banman), m_chainman(chainman), m_mempool(pool),
-      m_stale_tip_check_time(0), m_ignore_incoming_txs(ignore_incoming_txs) {
+      m_stale_tip_check_time(0), m_ignore_incoming_txs(ignore_incoming_txs),
+      m_compact_block_ctor(gArgs.GetBoolArg("-compactblockctor",
+                                            DEFAULT_COMPACT_BLOCK_CTOR)) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
 
@@ -2243,6 +2281,8 @@ void PeerManagerImpl::NewPoWValidBlock(
     const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock =
         std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock);
+    // Only built if a peer uses the compact blocks with sorted short IDs.
+    std::optional<CBlockHeaderAndShortTxIDs> sorted_cmpctblock;
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
@@ -2263,7 +2303,7 @@ void PeerManagerImpl::NewPoWValidBlock(
     }
 
     m_connman.ForEachNode(
-        [this, &pcmpctblock, pindex, &msgMaker,
+        [this, &pcmpctblock, &sorted_cmpctblock, &pblock, pindex, &msgMaker,
          &hashBlock](CNode *pnode) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
             AssertLockHeld(::cs_main);
 
@@ -2283,8 +2323,19 @@ void PeerManagerImpl::NewPoWValidBlock(
                          "%s sending header-and-ids %s to peer=%d\n",
                          "PeerManager::NewPoWValidBlock", hashBlock.ToString(),
                          pnode->GetId());
-                m_connman.PushMessage(
-                    pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+                if (state.fSupportsCmpctCTOR) {
+                    if (!sorted_cmpctblock) {
+                        sorted_cmpctblock.emplace(*pblock,
+                                                  /*sortedShortTxIDsIn=*/true);
+                    }
+                    m_connman.PushMessage(
+                        pnode,
+                        msgMaker.Make(NetMsgType::CMPCTBLOCK, *sorted_cmpctblock));
+                } else {
+                    m_connman.PushMessage(
+                        pnode,
+                        msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+                }
                 state.pindexBestHeaderSent = pindex;
             }
         });
@@ -2588,15 +2639,30 @@ void PeerManagerImpl::ProcessGetBlockData(const Config &config, CNode &pfrom,
         if (a_recent_block &&
             a_recent_block->GetHash() == pindex->GetBlockHash()) {
             pblock = a_recent_block;
+        } else if (inv.IsMsgBlk()) {
+            pblock = m_chainman.m_blockman.m_block_cache.Get(
+                pindex->GetBlockHash());
+            if (!pblock) {
+                // Send block from disk as it is stored there, there is no
+                // need to deserialize it.
+                CSerializedNetMsg msg;
+                msg.m_type = NetMsgType::BLOCK;
+                if (!ReadRawBlockFromDisk(msg.data, pindex,
+                                          m_chainparams.DiskMagic())) {
+                    assert(!"cannot load block from disk");
+                }
+                connman.PushMessage(&pfrom, std::move(msg));
+            }
         } else {
             // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
+            pblock = m_chainman.m_blockman.ReadBlock(pindex, consensusParams);
+            if (!pblock) {
                 assert(!"cannot load block from disk");
             }
-            pblock = pblockRead;
         }
-        if (inv.IsMsgBlk()) {
+        if (!pblock) {
+            // The block was sent from its raw bytes above.
+        } else if (inv.IsMsgBlk()) {
             connman.PushMessage(&pfrom,
                                 msgMaker.Make(NetMsgType::BLOCK, *pblock));
         } else if (inv.IsMsgFilteredBlk()) {
@@ -2641,7 +2707,9 @@ void PeerManagerImpl::ProcessGetBlockData(const Config &config, CNode &pfrom,
             if (CanDirectFetch(consensusParams) &&
                 pindex->nHeight >=
                     m_chainman.ActiveChain().Height() - MAX_CMPCTBLOCK_DEPTH) {
-                CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
+                const bool sorted = WITH_LOCK(
+                    cs_main, return State(pfrom.GetId())->fSupportsCmpctCTOR);
+                CBlockHeaderAndShortTxIDs cmpctblock(*pblock, sorted);
                 connman.PushMessage(
                     &pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
                                           cmpctblock));
@@ -2889,7 +2957,13 @@ void PeerManagerImpl::ProcessGetData(
 }
 
 void PeerManagerImpl::SendBlockTransactions(
-    CNode &pfrom, const CBlock &block, const BlockTransactionsRequest &req) {
+    CNode &pfrom, const CBlock &block, const BlockTransactionsRequest &req,
+    std::optional<uint64_t> sorted_nonce) {
+    std::vector<uint32_t> sorted_indexes;
+    if (sorted_nonce) {
+        sorted_indexes =
+            CBlockHeaderAndShortTxIDs::GetSortedTxIndexes(block, *sorted_nonce);
+    }
     BlockTransactions resp(req);
     for (size_t i = 0; i < req.indices.size(); i++) {
         if (req.indices[i] >= block.vtx.size()) {
@@ -2897,7 +2971,8 @@ void PeerManagerImpl::SendBlockTransactions(
                         "getblocktxn with out-of-bounds tx indices");
             return;
         }
-        resp.txn[i] = block.vtx[req.indices[i]];
+        resp.txn[i] = block.vtx[sorted_nonce ? sorted_indexes[req.indices[i]]
+                                             : req.indices[i]];
     }
     LOCK(cs_main);
     const CNetMsgMaker msgMaker(pfrom.GetCommonVersion());
@@ -3144,15 +3219,18 @@ void PeerManagerImpl::ProcessHeadersMessage(
  * mempool.
  *
  * @param[in,out]  orphan_work_set  The set of orphan transactions to
- *    reconsider. Generally only one orphan will be reconsidered on each call of
- *    this function. This set may be added to if accepting an orphan causes its
- *    children to be reconsidered.
+ *    reconsider. Up to MAX_ORPHAN_TX_BATCH_SIZE orphans are reconsidered
+ *    together on each call of this function. This set may be added to if
+ *    accepting an orphan causes its children to be reconsidered.
  */
 void PeerManagerImpl::ProcessOrphanTx(const Config &config,
                                       std::set<TxId> &orphan_work_set) {
     AssertLockHeld(cs_main);
     AssertLockHeld(g_cs_orphans);
-    while (!orphan_work_set.empty()) {
+    std::vector<CTransactionRef> orphans;
+    std::vector<NodeId> from_peers;
+    while (!orphan_work_set.empty() &&
+           orphans.size() < MAX_ORPHAN_TX_BATCH_SIZE) {
         const TxId orphanTxId = *orphan_work_set.begin();
         orphan_work_set.erase(orphan_work_set.begin());
 
@@ -3160,9 +3238,22 @@ void PeerManagerImpl::ProcessOrphanTx(const Config &config,
         if (porphanTx == nullptr) {
             continue;
         }
+        orphans.push_back(porphanTx);
+        from_peers.push_back(from_peer);
+    }
+    if (orphans.empty()) {
+        return;
+    }
 
-        const MempoolAcceptResult result =
-            m_chainman.ProcessTransaction(porphanTx);
+    // An orphan spending another one of the batch is rejected for missing
+    // inputs. It stays in the orphanage, and is reconsidered once its parent
+    // is accepted.
+    const std::vector<MempoolAcceptResult> results =
+        m_chainman.ProcessTransactions(orphans);
+    for (size_t i = 0; i < orphans.size(); ++i) {
+        const CTransactionRef &porphanTx = orphans[i];
+        const TxId &orphanTxId = porphanTx->GetId();
+        const MempoolAcceptResult &result = results[i];
         const TxValidationState &state = result.m_state;
         if (result.m_result_type == MempoolAcceptResult::ResultType::VALID) {
             LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n",
@@ -3170,14 +3261,14 @@ void PeerManagerImpl::ProcessOrphanTx(const Config &config,
             RelayTransaction(orphanTxId);
             m_orphanage.AddChildrenToWorkSet(*porphanTx, orphan_work_set);
             m_orphanage.EraseTx(orphanTxId);
-            break;
         } else if (state.GetResult() != TxValidationResult::TX_MISSING_INPUTS) {
             if (state.IsInvalid()) {
                 LogPrint(BCLog::MEMPOOL,
                          "   invalid orphan tx %s from peer=%d. %s\n",
-                         orphanTxId.ToString(), from_peer, state.ToString());
+                         orphanTxId.ToString(), from_peers[i],
+                         state.ToString());
                 // Punish peer that gave us an invalid orphan tx
-                MaybePunishNodeForTx(from_peer, state);
+                MaybePunishNodeForTx(from_peers[i], state);
             }
             // Has inputs but not accepted to mempool
             // Probably non-standard or insufficient fee
@@ -3188,7 +3279,6 @@ void PeerManagerImpl::ProcessOrphanTx(const Config &config,
             recentRejects->insert(orphanTxId);
 
             m_orphanage.EraseTx(orphanTxId);
-            break;
         }
     }
 }
@@ -3819,7 +3909,15 @@ void PeerManagerImpl::ProcessMessage(
             // using cmpctblock messages. We send this to non-NODE NETWORK peers
             // as well, because they may wish to request compact blocks from us.
             bool fAnnounceUsingCMPCTBLOCK = false;
-            uint64_t nCMPCTBLOCKVersion = 1;
+            if (m_compact_block_ctor) {
+                // Offer the compact blocks with sorted short IDs first, so
+                // that the peers supporting them lock them in.
+                m_connman.PushMessage(&pfrom,
+                                      msgMaker.Make(NetMsgType::SENDCMPCT,
+                                                    fAnnounceUsingCMPCTBLOCK,
+                                                    CMPCTBLOCKS_VERSION_CTOR));
+            }
+            uint64_t nCMPCTBLOCKVersion = CMPCTBLOCKS_VERSION;
             m_connman.PushMessage(&pfrom,
                                   msgMaker.Make(NetMsgType::SENDCMPCT,
                                                 fAnnounceUsingCMPCTBLOCK,
@@ -3995,12 +4093,18 @@ void PeerManagerImpl::ProcessMessage(
         bool fAnnounceUsingCMPCTBLOCK = false;
         uint64_t nCMPCTBLOCKVersion = 0;
         vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
-        if (nCMPCTBLOCKVersion == 1) {
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION ||
+            (m_compact_block_ctor &&
+             nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION_CTOR)) {
             LOCK(cs_main);
             // fProvidesHeaderAndIDs is used to "lock in" version of compact
             // blocks we send.
             if (!State(pfrom.GetId())->fProvidesHeaderAndIDs) {
                 State(pfrom.GetId())->fProvidesHeaderAndIDs = true;
+                // We offered the sorted short IDs first, so a peer supporting
+                // them locks them in as well.
+                State(pfrom.GetId())->fSupportsCmpctCTOR =
+                    nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION_CTOR;
             }
 
             State(pfrom.GetId())->fPreferHeaderAndIDs =
@@ -4245,6 +4349,13 @@ void PeerManagerImpl::ProcessMessage(
     if (msg_type == NetMsgType::GETBLOCKTXN) {
         BlockTransactionsRequest req;
         vRecv >> req;
+        std::optional<uint64_t> sorted_nonce;
+        if (WITH_LOCK(cs_main,
+                      return State(pfrom.GetId())->fSupportsCmpctCTOR)) {
+            uint64_t nonce;
+            vRecv >> nonce;
+            sorted_nonce = nonce;
+        }
 
         std::shared_ptr<const CBlock> recent_block;
         {
@@ -4255,7 +4366,7 @@ void PeerManagerImpl::ProcessMessage(
             // Unlock cs_most_recent_block to avoid cs_main lock inversion
         }
         if (recent_block) {
-            SendBlockTransactions(pfrom, *recent_block, req);
+            SendBlockTransactions(pfrom, *recent_block, req, sorted_nonce);
             return;
         }
 
@@ -4274,12 +4385,12 @@ void PeerManagerImpl::ProcessMessage(
 
             if (pindex->nHeight >=
                 m_chainman.ActiveChain().Height() - MAX_BLOCKTXN_DEPTH) {
-                CBlock block;
-                bool ret = ReadBlockFromDisk(block, pindex,
-                                             m_chainparams.GetConsensus());
-                assert(ret);
+                std::shared_ptr<const CBlock> block =
+                    m_chainman.m_blockman.ReadBlock(
+                        pindex, m_chainparams.GetConsensus());
+                assert(block);
 
-                SendBlockTransactions(pfrom, block, req);
+                SendBlockTransactions(pfrom, *block, req, sorted_nonce);
                 return;
             }
         }
@@ -4556,7 +4667,12 @@ void PeerManagerImpl::ProcessMessage(
             return;
         }
 
-        CBlockHeaderAndShortTxIDs cmpctblock;
+        // Reject oversized short ID lists before decoding them, like
+        // PartiallyDownloadedBlock::InitData would afterwards.
+        CBlockHeaderAndShortTxIDs cmpctblock(
+            WITH_LOCK(cs_main,
+                      return State(pfrom.GetId())->fSupportsCmpctCTOR),
+            config.GetMaxBlockSize() / MIN_TRANSACTION_SIZE);
         try {
             vRecv >> cmpctblock;
         } catch (std::ios_base::failure &e) {
@@ -4731,9 +4847,16 @@ void PeerManagerImpl::ProcessMessage(
                         fProcessBLOCKTXN = true;
                     } else {
                         req.blockhash = pindex->GetBlockHash();
-                        m_connman.PushMessage(
-                            &pfrom,
-                            msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+                        if (cmpctblock.HasSortedShortTxIDs()) {
+                            m_connman.PushMessage(
+                                &pfrom,
+                                msgMaker.Make(NetMsgType::GETBLOCKTXN, req,
+                                              cmpctblock.GetNonce()));
+                        } else {
+                            m_connman.PushMessage(
+                                &pfrom,
+                                msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+                        }
                     }
                 } else {
                     // This block is either already in flight from a different
@@ -6690,7 +6813,7 @@ bool PeerManagerImpl::SendMessages(const Config &config, CNode *pto) {
                         if (most_recent_block_hash ==
                             pBestIndex->GetBlockHash()) {
                             CBlockHeaderAndShortTxIDs cmpctblock(
-                                *most_recent_block);
+                                *most_recent_block, state.fSupportsCmpctCTOR);
                             m_connman.PushMessage(
                                 pto, msgMaker.Make(nSendFlags,
                                                    NetMsgType::CMPCTBLOCK,
@@ -6699,11 +6822,12 @@ bool PeerManagerImpl::SendMessages(const Config &config, CNode *pto) {
                         }
                     }
                     if (!fGotBlockFromCache) {
-                        CBlock block;
-                        bool ret = ReadBlockFromDisk(block, pBestIndex,
-                                                     consensusParams);
-                        assert(ret);
-                        CBlockHeaderAndShortTxIDs cmpctblock(block);
+                        std::shared_ptr<const CBlock> block =
+                            m_chainman.m_blockman.ReadBlock(pBestIndex,
+                                                            consensusParams);
+                        assert(block);
+                        CBlockHeaderAndShortTxIDs cmpctblock(
+                            *block, state.fSupportsCmpctCTOR);
                         m_connman.PushMessage(
                             pto,
                             msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
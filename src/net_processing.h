@@ -32,6 +32,11 @@ static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
  */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 static const bool DEFAULT_PEERBLOCKFILTERS = false;
+/**
+ * Default for -compactblockctor, whether to exchange compact blocks with sorted
+ * short IDs with the peers supporting them.
+ */
+static const bool DEFAULT_COMPACT_BLOCK_CTOR = false;
 /** Threshold for marking a node to be discouraged, e.g. disconnected and added
  * to the discouragement filter. */
 static const int DISCOURAGEMENT_THRESHOLD{100};
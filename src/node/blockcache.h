@@ -0,0 +1,118 @@
+// Copyright (c) 2022 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKCACHE_H
+#define BITCOIN_NODE_BLOCKCACHE_H
+
+#include <primitives/blockhash.h>
+#include <sync.h>
+#include <util/hasher.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+namespace node {
+/**
+ * Thread safe cache of block data read from disk (blocks or their undo data),
+ * keyed by block hash.
+ *
+ * The data is shared with the callers, which must not modify it. Once the
+ * memory used by the cached data exceeds the limit, the least recently used
+ * entries are evicted.
+ */
+template <typename T> class BlockDataCache {
+public:
+    struct Stats {
+        size_t entries;
+        size_t usage;
+        size_t max_usage;
+        uint64_t hits;
+        uint64_t misses;
+    };
+
+    explicit BlockDataCache(size_t max_usage) : m_max_usage(max_usage) {}
+
+    /** Get the data of a block, or nullptr if it is not in the cache. */
+    std::shared_ptr<const T> Get(const BlockHash &hash)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_mutex) {
+        LOCK(m_mutex);
+        auto it = m_index.find(hash);
+        if (it == m_index.end()) {
+            ++m_misses;
+            return nullptr;
+        }
+        ++m_hits;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return it->second->data;
+    }
+
+    /**
+     * Add the data of a block, whose memory usage is given, to the cache.
+     * Data larger than the whole cache is not added.
+     */
+    void Insert(const BlockHash &hash, std::shared_ptr<const T> data,
+                size_t usage) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex) {
+        LOCK(m_mutex);
+        if (usage > m_max_usage || m_index.count(hash)) {
+            return;
+        }
+        m_entries.push_front({hash, std::move(data), usage});
+        m_index.emplace(hash, m_entries.begin());
+        m_usage += usage;
+        Trim();
+    }
+
+    /** Change the memory limit, evicting entries as needed. */
+    void SetMaxUsage(size_t max_usage) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex) {
+        LOCK(m_mutex);
+        m_max_usage = max_usage;
+        Trim();
+    }
+
+    void Clear() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex) {
+        LOCK(m_mutex);
+        m_entries.clear();
+        m_index.clear();
+        m_usage = 0;
+    }
+
+    Stats GetStats() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex) {
+        LOCK(m_mutex);
+        return {m_entries.size(), m_usage, m_max_usage, m_hits, m_misses};
+    }
+
+private:
+    struct Entry {
+        BlockHash hash;
+        std::shared_ptr<const T> data;
+        size_t usage;
+    };
+
+    Mutex m_mutex;
+    size_t m_max_usage GUARDED_BY(m_mutex);
+    //! Cached entries, the most recently used first.
+    std::list<Entry> m_entries GUARDED_BY(m_mutex);
+    std::unordered_map<BlockHash, typename std::list<Entry>::iterator,
+                       BlockHasher>
+        m_index GUARDED_BY(m_mutex);
+    size_t m_usage GUARDED_BY(m_mutex){0};
+    uint64_t m_hits GUARDED_BY(m_mutex){0};
+    uint64_t m_misses GUARDED_BY(m_mutex){0};
+
+    void Trim() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+        while (m_usage > m_max_usage) {
+            const Entry &last = m_entries.back();
+            m_usage -= last.usage;
+            m_index.erase(last.hash);
+            m_entries.pop_back();
+        }
+    }
+};
+} // namespace node
+
+#endif // BITCOIN_NODE_BLOCKCACHE_H
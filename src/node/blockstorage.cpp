@@ -10,27 +10,57 @@
 #include <clientversion.h>
 #include <config.h>
 #include <consensus/validation.h>
+#include <core_memusage.h>
+#include <crypto/common.h>
 #include <flatfile.h>
 #include <fs.h>
 #include <hash.h>
 #include <pow/pow.h>
+#include <random.h>
 #include <reverse_iterator.h>
 #include <shutdown.h>
 #include <streams.h>
 #include <undo.h>
+#include <util/compression.h>
+#include <util/strencodings.h>
 #include <util/system.h>
+#include <util/thread.h>
+#include <util/threadnames.h>
+#include <util/time.h>
 #include <validation.h>
 
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <limits>
+#include <map>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+
 namespace node {
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
 bool fPruneMode = false;
 uint64_t nPruneTarget = 0;
+bool g_background_prune = DEFAULT_BACKGROUND_PRUNE;
+
+/** Memory mappings of the block and undo files, used with -mmapblockfiles */
+static FlatFileMapCache g_block_file_maps{MAX_MAPPED_BLOCK_FILES};
+static FlatFileMapCache g_undo_file_maps{MAX_MAPPED_BLOCK_FILES};
+/**
+ * Open handles to the block and undo files, which saves opening them for each
+ * read and lets several threads read them at once.
+ */
+static FlatFileHandleCache g_block_file_handles{MAX_OPEN_BLOCK_FILES};
+static FlatFileHandleCache g_undo_file_handles{MAX_OPEN_BLOCK_FILES};
 
 static FILE *OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
+static FlatFileSeq ConvertedBlockFileSeq();
+static FlatFileSeq ConvertedUndoFileSeq();
 
 CBlockIndex *BlockManager::LookupBlockIndex(const BlockHash &hash) const {
     AssertLockHeld(cs_main);
@@ -49,7 +79,7 @@ CBlockIndex *BlockManager::AddToBlockIndex(const CBlockHeader &block) {
     }
 
     // Construct new block index object
-    CBlockIndex *pindexNew = new CBlockIndex(block);
+    CBlockIndex *pindexNew = m_block_index_arena.New(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -225,7 +255,7 @@ CBlockIndex *BlockManager::InsertBlockIndex(const BlockHash &hash) {
     }
 
     // Create new
-    CBlockIndex *pindexNew = new CBlockIndex();
+    CBlockIndex *pindexNew = m_block_index_arena.New();
     mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -235,7 +265,10 @@ CBlockIndex *BlockManager::InsertBlockIndex(const BlockHash &hash) {
 bool BlockManager::LoadBlockIndex(const Consensus::Params &params,
                                   ChainstateManager &chainman) {
     AssertLockHeld(cs_main);
-    if (!m_block_tree_db->LoadBlockIndexGuts(
+    const bool use_snapshot =
+        gArgs.GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT);
+    if (!(use_snapshot && LoadBlockIndexSnapshot(params)) &&
+        !m_block_tree_db->LoadBlockIndexGuts(
             params, [this](const BlockHash &hash) EXCLUSIVE_LOCKS_REQUIRED(
                         cs_main) { return this->InsertBlockIndex(hash); })) {
         return false;
@@ -368,13 +401,11 @@ bool BlockManager::LoadBlockIndex(const Consensus::Params &params,
 }
 
 void BlockManager::Unload() {
+    WaitForPrunedFiles();
     m_blocks_unlinked.clear();
 
-    for (const BlockMap::value_type &entry : m_block_index) {
-        delete entry.second;
-    }
-
     m_block_index.clear();
+    m_block_index_arena.Clear();
 
     m_blockfile_info.clear();
     m_last_blockfile = 0;
@@ -382,6 +413,12 @@ void BlockManager::Unload() {
     m_dirty_fileinfo.clear();
 }
 
+size_t BlockManager::GetBlockIndexMemoryUsage() const {
+    AssertLockHeld(cs_main);
+    return m_block_index_arena.DynamicMemoryUsage() +
+           memusage::DynamicUsage(m_block_index);
+}
+
 bool BlockManager::WriteBlockIndexDB() {
     std::vector<std::pair<int, const CBlockFileInfo *>> vFiles;
     vFiles.reserve(m_dirty_fileinfo.size());
@@ -405,10 +442,287 @@ bool BlockManager::WriteBlockIndexDB() {
     return true;
 }
 
+void BlockManager::UnlinkPrunedFilesInBackground(
+    const std::set<int> &setFilesToPrune) {
+    // Only one batch of files is deleted at a time.
+    WaitForPrunedFiles();
+    m_prune_thread =
+        std::thread(&util::TraceThread, "prune", [setFilesToPrune] {
+            UnlinkPrunedFiles(setFilesToPrune);
+            // Report the disk space after the deletion, now that it doesn't
+            // hold up the validation thread.
+            if (!CheckDiskSpace(gArgs.GetBlocksDirPath())) {
+                LogPrintf("Warning: Disk space is low after pruning\n");
+            }
+        });
+}
+
+void BlockManager::WaitForPrunedFiles() {
+    if (m_prune_thread.joinable()) {
+        m_prune_thread.join();
+    }
+}
+
+namespace {
+//! Bytes identifying a block index snapshot file.
+constexpr std::array<uint8_t, 4> BLOCK_INDEX_SNAPSHOT_MAGIC = {
+    {'b', 'i', 'd', 'x'}};
+constexpr uint32_t BLOCK_INDEX_SNAPSHOT_VERSION = 1;
+
+fs::path BlockIndexSnapshotPath() {
+    return gArgs.GetBlocksDirPath() / "blockindex.dat";
+}
+
+struct BlockIndexSnapshotHeader {
+    std::array<uint8_t, 4> magic{BLOCK_INDEX_SNAPSHOT_MAGIC};
+    uint32_t version{BLOCK_INDEX_SNAPSHOT_VERSION};
+    int32_t client_version{CLIENT_VERSION};
+    //! Random id, also stored in the block tree database.
+    uint256 id;
+    //! The last block file and its sizes, which change as soon as a block or
+    //! its undo data is written.
+    int32_t last_file{0};
+    uint32_t last_file_size{0};
+    uint32_t last_file_undo_size{0};
+    uint64_t count{0};
+
+    SERIALIZE_METHODS(BlockIndexSnapshotHeader, obj) {
+        READWRITE(obj.magic, obj.version, obj.client_version, obj.id,
+                  obj.last_file, obj.last_file_size, obj.last_file_undo_size,
+                  obj.count);
+    }
+};
+
+/**
+ * Block index entry, as stored in the snapshot file. The parent is referenced
+ * by the position of its record, which always comes first in the file.
+ */
+struct BlockIndexRecord {
+    static constexpr size_t SIZE = 108;
+    static constexpr uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+
+    BlockHash hash;
+    uint32_t prev{NO_PARENT};
+    int32_t nHeight{0};
+    uint32_t nStatus{0};
+    uint32_t nTx{0};
+    int32_t nFile{0};
+    uint32_t nDataPos{0};
+    uint32_t nUndoPos{0};
+    int32_t nVersion{0};
+    uint256 hashMerkleRoot;
+    uint32_t nTime{0};
+    uint32_t nBits{0};
+    uint32_t nNonce{0};
+
+    SERIALIZE_METHODS(BlockIndexRecord, obj) {
+        READWRITE(obj.hash, obj.prev, obj.nHeight, obj.nStatus, obj.nTx,
+                  obj.nFile, obj.nDataPos, obj.nUndoPos, obj.nVersion,
+                  obj.hashMerkleRoot, obj.nTime, obj.nBits, obj.nNonce);
+    }
+};
+} // namespace
+
+bool BlockManager::WriteBlockIndexSnapshot() {
+    AssertLockHeld(cs_main);
+    if (!m_dirty_blockindex.empty() || !m_dirty_fileinfo.empty()) {
+        return error("%s: the block index is not flushed", __func__);
+    }
+
+    std::vector<const CBlockIndex *> entries;
+    entries.reserve(m_block_index.size());
+    for (const auto &[hash, pindex] : m_block_index) {
+        entries.push_back(pindex);
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const CBlockIndex *a, const CBlockIndex *b) {
+                  return a->nHeight < b->nHeight;
+              });
+
+    BlockIndexSnapshotHeader header;
+    header.id = GetRandHash();
+    {
+        LOCK(cs_LastBlockFile);
+        header.last_file = m_last_blockfile;
+        if (size_t(m_last_blockfile) < m_blockfile_info.size()) {
+            header.last_file_size = m_blockfile_info[m_last_blockfile].nSize;
+            header.last_file_undo_size =
+                m_blockfile_info[m_last_blockfile].nUndoSize;
+        }
+    }
+    header.count = entries.size();
+
+    const fs::path path = BlockIndexSnapshotPath();
+    fs::path path_tmp = path;
+    path_tmp += ".new";
+    try {
+        CAutoFile file(fsbridge::fopen(path_tmp, "wb"), SER_DISK,
+                       CLIENT_VERSION);
+        if (file.IsNull()) {
+            return error("%s: failed to open %s", __func__,
+                         fs::PathToString(path_tmp));
+        }
+        file << header;
+
+        std::unordered_map<const CBlockIndex *, uint32_t> positions;
+        positions.reserve(entries.size());
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        for (const CBlockIndex *pindex : entries) {
+            BlockIndexRecord record;
+            record.hash = pindex->GetBlockHash();
+            if (pindex->pprev) {
+                record.prev = positions.at(pindex->pprev);
+            }
+            record.nHeight = pindex->nHeight;
+            record.nStatus = pindex->nStatus.getRawValue();
+            record.nTx = pindex->nTx;
+            record.nFile = pindex->nFile;
+            record.nDataPos = pindex->nDataPos;
+            record.nUndoPos = pindex->nUndoPos;
+            record.nVersion = pindex->nVersion;
+            record.hashMerkleRoot = pindex->hashMerkleRoot;
+            record.nTime = pindex->nTime;
+            record.nBits = pindex->nBits;
+            record.nNonce = pindex->nNonce;
+            file << record;
+            hasher << record;
+            positions.emplace(pindex, positions.size());
+        }
+        file << hasher.GetHash();
+
+        if (!FileCommit(file.Get())) {
+            throw std::runtime_error("FileCommit failed");
+        }
+        file.fclose();
+        if (!RenameOver(path_tmp, path)) {
+            throw std::runtime_error("Rename failed");
+        }
+    } catch (const std::exception &e) {
+        return error("%s: failed to write %s: %s", __func__,
+                     fs::PathToString(path), e.what());
+    }
+
+    if (!m_block_tree_db->WriteBlockIndexSnapshotId(header.id)) {
+        return error("%s: failed to write the snapshot id", __func__);
+    }
+    LogPrintf("Wrote %u block index entries to %s\n", header.count,
+              fs::PathToString(path));
+    return true;
+}
+
+bool BlockManager::LoadBlockIndexSnapshot(const Consensus::Params &params) {
+    AssertLockHeld(cs_main);
+    uint256 id;
+    if (!m_block_tree_db->ReadBlockIndexSnapshotId(id)) {
+        return false;
+    }
+    // The snapshot becomes stale as soon as the block tree database is
+    // written to, so it must not be used again after this startup.
+    if (!m_block_tree_db->EraseBlockIndexSnapshotId()) {
+        return error("%s: failed to erase the snapshot id", __func__);
+    }
+
+    const fs::path path = BlockIndexSnapshotPath();
+    std::shared_ptr<const MappedFlatFile> file = MappedFlatFile::Map(path);
+    try {
+        fs::remove(path);
+    } catch (const fs::filesystem_error &e) {
+        LogPrintf("Unable to remove %s: %s\n", fs::PathToString(path),
+                  fsbridge::get_filesystem_error_message(e));
+    }
+    if (!file) {
+        return false;
+    }
+
+    try {
+        SpanReader reader(SER_DISK, CLIENT_VERSION, file->Data());
+        BlockIndexSnapshotHeader header;
+        reader >> header;
+
+        int last_file = 0;
+        CBlockFileInfo last_file_info;
+        m_block_tree_db->ReadLastBlockFile(last_file);
+        m_block_tree_db->ReadBlockFileInfo(last_file, last_file_info);
+        if (header.magic != BLOCK_INDEX_SNAPSHOT_MAGIC ||
+            header.version != BLOCK_INDEX_SNAPSHOT_VERSION ||
+            header.client_version != CLIENT_VERSION || header.id != id ||
+            header.last_file != last_file ||
+            header.last_file_size != last_file_info.nSize ||
+            header.last_file_undo_size != last_file_info.nUndoSize) {
+            LogPrintf("Ignoring stale block index snapshot %s\n",
+                      fs::PathToString(path));
+            return false;
+        }
+
+        if (header.count > std::numeric_limits<uint32_t>::max() ||
+            reader.size() !=
+                header.count * BlockIndexRecord::SIZE + sizeof(uint256)) {
+            throw std::ios_base::failure("Unexpected size");
+        }
+        const Span<const uint8_t> records =
+            file->Data()
+                .last(reader.size())
+                .first(header.count * BlockIndexRecord::SIZE);
+        uint256 checksum;
+        SpanReader(SER_DISK, CLIENT_VERSION,
+                   file->Data().last(sizeof(uint256))) >>
+            checksum;
+        if (checksum != Hash(records)) {
+            throw std::ios_base::failure("Checksum mismatch");
+        }
+
+        m_block_index.reserve(header.count);
+        std::vector<CBlockIndex *> loaded;
+        loaded.reserve(header.count);
+        for (uint64_t i = 0; i < header.count; ++i) {
+            BlockIndexRecord record;
+            reader >> record;
+            if (record.prev != BlockIndexRecord::NO_PARENT &&
+                record.prev >= i) {
+                throw std::ios_base::failure("Invalid parent");
+            }
+
+            CBlockIndex *pindexNew = InsertBlockIndex(record.hash);
+            pindexNew->pprev = record.prev == BlockIndexRecord::NO_PARENT
+                                   ? nullptr
+                                   : loaded[record.prev];
+            pindexNew->nHeight = record.nHeight;
+            pindexNew->nFile = record.nFile;
+            pindexNew->nDataPos = record.nDataPos;
+            pindexNew->nUndoPos = record.nUndoPos;
+            pindexNew->nVersion = record.nVersion;
+            pindexNew->hashMerkleRoot = record.hashMerkleRoot;
+            pindexNew->nTime = record.nTime;
+            pindexNew->nBits = record.nBits;
+            pindexNew->nNonce = record.nNonce;
+            pindexNew->nStatus = BlockStatus::fromRawValue(record.nStatus);
+            pindexNew->nTx = record.nTx;
+
+            if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits,
+                                  params)) {
+                throw std::ios_base::failure("CheckProofOfWork failed");
+            }
+            loaded.push_back(pindexNew);
+        }
+    } catch (const std::exception &e) {
+        Unload();
+        return error("%s: failed to read %s: %s", __func__,
+                     fs::PathToString(path), e.what());
+    }
+
+    LogPrintf("Loaded %u block index entries from %s\n", m_block_index.size(),
+              fs::PathToString(path));
+    return true;
+}
+
 bool BlockManager::LoadBlockIndexDB(ChainstateManager &chainman) {
     if (!LoadBlockIndex(::Params().GetConsensus(), chainman)) {
         return false;
     }
+    LogPrintf("%s: %u block index entries, %u bytes per entry\n", __func__,
+              m_block_index.size(),
+              GetBlockIndexMemoryUsage() /
+                  std::max<size_t>(m_block_index.size(), 1));
 
     // Load block file info
     m_block_tree_db->ReadLastBlockFile(m_last_blockfile);
@@ -428,6 +742,14 @@ bool BlockManager::LoadBlockIndexDB(ChainstateManager &chainman) {
         }
     }
 
+    // Finish replacing a block file rewritten by ConvertBlockFiles(), if it
+    // got interrupted after the block index was updated.
+    int converted_file;
+    if (m_block_tree_db->ReadBlockFileConversion(converted_file) &&
+        !ReplaceConvertedBlockFile(converted_file)) {
+        return false;
+    }
+
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
     std::set<int> setBlkDataFiles;
@@ -520,6 +842,10 @@ void CleanupBlockRevFiles() {
         }
         remove(item.second);
     }
+
+    // Drop the handles to the files removed above.
+    g_block_file_handles.Clear();
+    g_undo_file_handles.Clear();
 }
 
 CBlockFileInfo *BlockManager::GetBlockFileInfo(size_t n) {
@@ -528,17 +854,94 @@ CBlockFileInfo *BlockManager::GetBlockFileInfo(size_t n) {
     return &m_blockfile_info.at(n);
 }
 
-static bool UndoWriteToDisk(const CBlockUndo &blockundo, FlatFilePos &pos,
+static bool CompressBlockFiles() {
+    return gArgs.GetBoolArg("-blockcompression", DEFAULT_BLOCK_COMPRESSION);
+}
+
+/**
+ * Compress serialized block or undo data for storage. Returns an empty vector
+ * if it doesn't get smaller, in which case it is stored uncompressed.
+ */
+static std::vector<uint8_t> CompressStoredData(Span<const uint8_t> data) {
+    const std::vector<uint8_t> compressed = CompressLZ(data);
+    if (sizeof(uint32_t) + compressed.size() >= data.size()) {
+        return {};
+    }
+    std::vector<uint8_t> stored(sizeof(uint32_t));
+    stored.reserve(sizeof(uint32_t) + compressed.size());
+    WriteLE32(stored.data(), data.size());
+    stored.insert(stored.end(), compressed.begin(), compressed.end());
+    return stored;
+}
+
+bool DecompressStoredData(Span<const uint8_t> stored,
+                          std::vector<uint8_t> &data) {
+    if (stored.size() < sizeof(uint32_t)) {
+        return false;
+    }
+    const uint32_t size = ReadLE32(stored.data());
+    return DecompressLZ(stored.subspan(sizeof(uint32_t)), size, data);
+}
+
+/**
+ * Serialize a block or its undo data and compress it, if -blockcompression is
+ * set. Returns an empty vector if it is to be stored uncompressed.
+ */
+template <typename T>
+static std::vector<uint8_t> CompressStoredObject(const T &obj) {
+    if (!CompressBlockFiles()) {
+        return {};
+    }
+    std::vector<uint8_t> data;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0) << obj;
+    return CompressStoredData(data);
+}
+
+/**
+ * Read the size field of the storage header from a file positioned right
+ * before a block or undo data. If the data is stored compressed, it is read
+ * and decompressed into data, and true is returned. Otherwise the file is left
+ * at the start of the data.
+ */
+static bool ReadCompressedData(CAutoFile &file, std::vector<uint8_t> &data) {
+    uint32_t stored_size;
+    file >> stored_size;
+    if (!(stored_size & BLOCK_STORAGE_COMPRESSED_FLAG)) {
+        return false;
+    }
+    stored_size &= ~BLOCK_STORAGE_COMPRESSED_FLAG;
+    std::vector<uint8_t> stored(stored_size);
+    file.read(reinterpret_cast<char *>(stored.data()), stored.size());
+    if (!DecompressStoredData(stored, data)) {
+        throw std::ios_base::failure("Corrupted compressed data");
+    }
+    return true;
+}
+
+/**
+ * Write the undo data of a block to the given file sequence, as compressed
+ * unless it is empty.
+ *
+ * The file is still opened for each write: the cached handles are read only,
+ * and a cached stream would have to be flushed before every
+ * FlatFileSeq::Flush() for its data to be committed. This is a single open
+ * per connected block, while the undo data of a block can be read many times.
+ */
+static bool UndoWriteToDisk(FlatFileSeq seq, const CBlockUndo &blockundo,
+                            Span<const uint8_t> compressed, FlatFilePos &pos,
                             const BlockHash &hashBlock,
                             const CMessageHeader::MessageMagic &messageStart) {
     // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
+    CAutoFile fileout(seq.Open(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull()) {
         return error("%s: OpenUndoFile failed", __func__);
     }
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(blockundo, fileout.GetVersion());
+    unsigned int nSize =
+        compressed.empty()
+            ? GetSerializeSize(blockundo, fileout.GetVersion())
+            : (compressed.size() | BLOCK_STORAGE_COMPRESSED_FLAG);
     fileout << messageStart << nSize;
 
     // Write undo data
@@ -547,7 +950,12 @@ static bool UndoWriteToDisk(const CBlockUndo &blockundo, FlatFilePos &pos,
         return error("%s: ftell failed", __func__);
     }
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    if (compressed.empty()) {
+        fileout << blockundo;
+    } else {
+        fileout.write(reinterpret_cast<const char *>(compressed.data()),
+                      compressed.size());
+    }
 
     // calculate & write checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
@@ -558,32 +966,152 @@ static bool UndoWriteToDisk(const CBlockUndo &blockundo, FlatFilePos &pos,
     return true;
 }
 
+/**
+ * Get the data stored at pos in a memory mapped block or undo file, whose
+ * size is given by the storage header preceding it, followed by trailer_size
+ * more bytes. The header also tells whether the data is compressed. Returns
+ * false if the file could not be mapped.
+ */
+static bool MapStoredData(const FlatFileSeq &seq, const FlatFilePos &pos,
+                          size_t trailer_size,
+                          std::shared_ptr<const MappedFlatFile> &file,
+                          Span<const uint8_t> &data, bool &compressed) {
+    if (pos.nPos < BLOCK_STORAGE_HEADER_SIZE) {
+        return false;
+    }
+    file = seq.Map(pos, 0);
+    if (!file || file->Data().size() < pos.nPos) {
+        return false;
+    }
+    const uint32_t stored_size =
+        ReadLE32(file->Data().data() + pos.nPos - sizeof(uint32_t));
+    compressed = stored_size & BLOCK_STORAGE_COMPRESSED_FLAG;
+    const size_t size =
+        (stored_size & ~BLOCK_STORAGE_COMPRESSED_FLAG) + trailer_size;
+    if (file->Data().size() - pos.nPos < size) {
+        // The data was written after the file got mapped.
+        file = seq.Map(pos, size);
+        if (!file || file->Data().size() - pos.nPos < size) {
+            return false;
+        }
+    }
+    data = file->Data().subspan(pos.nPos, size);
+    return true;
+}
+
+/**
+ * Read the data stored at pos in a block or undo file through a cached file
+ * handle, like MapStoredData(). The data is read into buffer, and data points
+ * to it. The disk magic of the storage header is returned in magic if it is
+ * not nullptr. Returns false if the file could not be read this way.
+ */
+static bool ReadStoredData(const FlatFileSeq &seq, const FlatFilePos &pos,
+                           size_t trailer_size, std::vector<uint8_t> &buffer,
+                           Span<const uint8_t> &data, bool &compressed,
+                           CMessageHeader::MessageMagic *magic = nullptr) {
+    if (pos.nPos < BLOCK_STORAGE_HEADER_SIZE) {
+        return false;
+    }
+    std::shared_ptr<const FlatFileHandle> file = seq.OpenCached(pos);
+    uint8_t header[BLOCK_STORAGE_HEADER_SIZE];
+    if (!file ||
+        !file->Read(pos.nPos - BLOCK_STORAGE_HEADER_SIZE, Span{header})) {
+        return false;
+    }
+    const uint32_t stored_size =
+        ReadLE32(header + CMessageHeader::MESSAGE_START_SIZE);
+    compressed = stored_size & BLOCK_STORAGE_COMPRESSED_FLAG;
+    const size_t size = stored_size & ~BLOCK_STORAGE_COMPRESSED_FLAG;
+    buffer.resize(size + trailer_size);
+    if (!file->Read(pos.nPos, buffer)) {
+        return false;
+    }
+    if (magic) {
+        std::copy(header, header + CMessageHeader::MESSAGE_START_SIZE,
+                  magic->begin());
+    }
+    data = buffer;
+    return true;
+}
+
+/**
+ * Deserialize the undo data of a block, returning the hash it is checked
+ * against.
+ */
+template <typename Stream>
+static uint256 ReadUndoData(Stream &stream, CBlockUndo &blockundo,
+                            const CBlockIndex *pprev) {
+    // We need a CHashVerifier as reserializing may lose data
+    CHashVerifier<Stream> verifier(&stream);
+    verifier << pprev->GetBlockHash();
+    verifier >> blockundo;
+    return verifier.GetHash();
+}
+
 bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
     FlatFilePos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
         return error("%s: no undo data available", __func__);
     }
 
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        return error("%s: OpenUndoFile failed", __func__);
-    }
-
-    // Read block
+    std::shared_ptr<const MappedFlatFile> file;
+    std::vector<uint8_t> buffer;
+    Span<const uint8_t> data;
+    bool compressed;
+    std::vector<uint8_t> decompressed;
     uint256 hashChecksum;
-    // We need a CHashVerifier as reserializing may lose data
-    CHashVerifier<CAutoFile> verifier(&filein);
-    try {
-        verifier << pindex->pprev->GetBlockHash();
-        verifier >> blockundo;
-        filein >> hashChecksum;
-    } catch (const std::exception &e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    uint256 hash;
+    if (MapStoredData(UndoFileSeq(), pos, sizeof(uint256), file, data,
+                      compressed) ||
+        ReadStoredData(UndoFileSeq(), pos, sizeof(uint256), buffer, data,
+                       compressed)) {
+        Span<const uint8_t> undo_data =
+            data.first(data.size() - sizeof(uint256));
+        if (compressed) {
+            if (!DecompressStoredData(undo_data, decompressed)) {
+                return error("%s: Corrupted compressed undo data", __func__);
+            }
+            undo_data = decompressed;
+        }
+        try {
+            SpanReader reader(SER_DISK, CLIENT_VERSION, undo_data);
+            hash = ReadUndoData(reader, blockundo, pindex->pprev);
+            SpanReader(SER_DISK, CLIENT_VERSION,
+                       data.last(sizeof(uint256))) >>
+                hashChecksum;
+        } catch (const std::exception &e) {
+            return error("%s: Deserialize error - %s", __func__, e.what());
+        }
+    } else {
+        // Open history file to read, starting with the size of the undo data
+        if (pos.nPos < sizeof(uint32_t)) {
+            return error("%s: Invalid undo position %s", __func__,
+                         pos.ToString());
+        }
+        FlatFilePos size_pos{pos.nFile, pos.nPos - uint32_t(sizeof(uint32_t))};
+        CAutoFile filein(OpenUndoFile(size_pos, true), SER_DISK,
+                         CLIENT_VERSION);
+        if (filein.IsNull()) {
+            return error("%s: OpenUndoFile failed", __func__);
+        }
+
+        // Read block
+        try {
+            if (ReadCompressedData(filein, decompressed)) {
+                SpanReader reader(SER_DISK, CLIENT_VERSION, decompressed);
+                hash = ReadUndoData(reader, blockundo, pindex->pprev);
+            } else {
+                hash = ReadUndoData(filein, blockundo, pindex->pprev);
+            }
+            filein >> hashChecksum;
+        } catch (const std::exception &e) {
+            return error("%s: Deserialize or I/O error - %s", __func__,
+                         e.what());
+        }
     }
 
     // Verify checksum
-    if (hashChecksum != verifier.GetHash()) {
+    if (hashChecksum != hash) {
         return error("%s: Checksum mismatch", __func__);
     }
 
@@ -629,6 +1157,10 @@ uint64_t BlockManager::CalculateCurrentUsage() {
 void UnlinkPrunedFiles(const std::set<int> &setFilesToPrune) {
     for (const int i : setFilesToPrune) {
         FlatFilePos pos(i, 0);
+        g_block_file_maps.Remove(BlockFileSeq().FileName(pos));
+        g_undo_file_maps.Remove(UndoFileSeq().FileName(pos));
+        g_block_file_handles.Remove(BlockFileSeq().FileName(pos));
+        g_undo_file_handles.Remove(UndoFileSeq().FileName(pos));
         fs::remove(BlockFileSeq().FileName(pos));
         fs::remove(UndoFileSeq().FileName(pos));
         LogPrint(BCLog::BLOCKSTORE, "Prune: %s deleted blk/rev (%05u)\n",
@@ -636,15 +1168,36 @@ void UnlinkPrunedFiles(const std::set<int> &setFilesToPrune) {
     }
 }
 
+static bool MapBlockFiles() {
+    return gArgs.GetBoolArg("-mmapblockfiles", DEFAULT_MMAP_BLOCK_FILES);
+}
+
 static FlatFileSeq BlockFileSeq() {
     return FlatFileSeq(gArgs.GetBlocksDirPath(), "blk",
                        gArgs.GetBoolArg("-fastprune", false)
                            ? 0x4000 /* 16kb */
-                           : BLOCKFILE_CHUNK_SIZE);
+                           : BLOCKFILE_CHUNK_SIZE,
+                       MapBlockFiles() ? &g_block_file_maps : nullptr,
+                       &g_block_file_handles);
 }
 
 static FlatFileSeq UndoFileSeq() {
-    return FlatFileSeq(gArgs.GetBlocksDirPath(), "rev", UNDOFILE_CHUNK_SIZE);
+    return FlatFileSeq(gArgs.GetBlocksDirPath(), "rev", UNDOFILE_CHUNK_SIZE,
+                       MapBlockFiles() ? &g_undo_file_maps : nullptr,
+                       &g_undo_file_handles);
+}
+
+/** Directory where ConvertBlockFiles() rewrites the block and undo files. */
+static fs::path ConvertedBlockFilesDir() {
+    return gArgs.GetBlocksDirPath() / "convert";
+}
+
+static FlatFileSeq ConvertedBlockFileSeq() {
+    return FlatFileSeq(ConvertedBlockFilesDir(), "blk", BLOCKFILE_CHUNK_SIZE);
+}
+
+static FlatFileSeq ConvertedUndoFileSeq() {
+    return FlatFileSeq(ConvertedBlockFilesDir(), "rev", UNDOFILE_CHUNK_SIZE);
 }
 
 FILE *OpenBlockFile(const FlatFilePos &pos, bool fReadOnly) {
@@ -749,16 +1302,23 @@ bool BlockManager::FindUndoPos(BlockValidationState &state, int nFile,
     return true;
 }
 
-static bool WriteBlockToDisk(const CBlock &block, FlatFilePos &pos,
+/**
+ * Write a block to the given file sequence, as compressed unless it is empty.
+ */
+static bool WriteBlockToDisk(FlatFileSeq seq, const CBlock &block,
+                             Span<const uint8_t> compressed, FlatFilePos &pos,
                              const CMessageHeader::MessageMagic &messageStart) {
     // Open history file to append
-    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
+    CAutoFile fileout(seq.Open(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull()) {
         return error("WriteBlockToDisk: OpenBlockFile failed");
     }
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(block, fileout.GetVersion());
+    unsigned int nSize =
+        compressed.empty()
+            ? GetSerializeSize(block, fileout.GetVersion())
+            : (compressed.size() | BLOCK_STORAGE_COMPRESSED_FLAG);
     fileout << messageStart << nSize;
 
     // Write block
@@ -768,7 +1328,12 @@ static bool WriteBlockToDisk(const CBlock &block, FlatFilePos &pos,
     }
 
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    if (compressed.empty()) {
+        fileout << block;
+    } else {
+        fileout.write(reinterpret_cast<const char *>(compressed.data()),
+                      compressed.size());
+    }
 
     return true;
 }
@@ -779,12 +1344,16 @@ bool BlockManager::WriteUndoDataForBlock(const CBlockUndo &blockundo,
                                          const CChainParams &chainparams) {
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
+        const std::vector<uint8_t> compressed = CompressStoredObject(blockundo);
+        const unsigned int nUndoSize =
+            compressed.empty() ? ::GetSerializeSize(blockundo, CLIENT_VERSION)
+                               : compressed.size();
         FlatFilePos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos,
-                         ::GetSerializeSize(blockundo, CLIENT_VERSION) + 40)) {
+        if (!FindUndoPos(state, pindex->nFile, _pos, nUndoSize + 40)) {
             return error("ConnectBlock(): FindUndoPos failed");
         }
-        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(),
+        if (!UndoWriteToDisk(UndoFileSeq(), blockundo, compressed, _pos,
+                             pindex->pprev->GetBlockHash(),
                              chainparams.DiskMagic())) {
             return AbortNode(state, "Failed to write undo data");
         }
@@ -814,19 +1383,51 @@ bool ReadBlockFromDisk(CBlock &block, const FlatFilePos &pos,
                        const Consensus::Params &params) {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s",
-                     pos.ToString());
-    }
+    std::shared_ptr<const MappedFlatFile> file;
+    std::vector<uint8_t> buffer;
+    Span<const uint8_t> data;
+    bool compressed;
+    std::vector<uint8_t> decompressed;
+    if (MapStoredData(BlockFileSeq(), pos, 0, file, data, compressed) ||
+        ReadStoredData(BlockFileSeq(), pos, 0, buffer, data, compressed)) {
+        if (compressed) {
+            if (!DecompressStoredData(data, decompressed)) {
+                return error("%s: Corrupted compressed block at %s", __func__,
+                             pos.ToString());
+            }
+            data = decompressed;
+        }
+        try {
+            SpanReader(SER_DISK, CLIENT_VERSION, data) >> block;
+        } catch (const std::exception &e) {
+            return error("%s: Deserialize error - %s at %s", __func__,
+                         e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read, starting with the size of the block
+        if (pos.nPos < sizeof(uint32_t)) {
+            return error("%s: Invalid block position %s", __func__,
+                         pos.ToString());
+        }
+        FlatFilePos size_pos{pos.nFile, pos.nPos - uint32_t(sizeof(uint32_t))};
+        CAutoFile filein(OpenBlockFile(size_pos, true), SER_DISK,
+                         CLIENT_VERSION);
+        if (filein.IsNull()) {
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s",
+                         pos.ToString());
+        }
 
-    // Read block
-    try {
-        filein >> block;
-    } catch (const std::exception &e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__,
-                     e.what(), pos.ToString());
+        // Read block
+        try {
+            if (ReadCompressedData(filein, decompressed)) {
+                SpanReader(SER_DISK, CLIENT_VERSION, decompressed) >> block;
+            } else {
+                filein >> block;
+            }
+        } catch (const std::exception &e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__,
+                         e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -859,6 +1460,165 @@ bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block, const FlatFilePos &pos,
+                          const CMessageHeader::MessageMagic &diskMagic) {
+    block.clear();
+    if (pos.nPos < BLOCK_STORAGE_HEADER_SIZE) {
+        return error("%s: Invalid block position %s", __func__,
+                     pos.ToString());
+    }
+
+    CMessageHeader::MessageMagic blk_start;
+    Span<const uint8_t> data;
+    bool compressed;
+    if (ReadStoredData(BlockFileSeq(), pos, 0, block, data, compressed,
+                       &blk_start)) {
+        if (blk_start != diskMagic) {
+            block.clear();
+            return error("%s: Block magic mismatch for %s: %s versus expected "
+                         "%s",
+                         __func__, pos.ToString(), HexStr(blk_start),
+                         HexStr(diskMagic));
+        }
+        if (compressed) {
+            std::vector<uint8_t> stored;
+            stored.swap(block);
+            if (!DecompressStoredData(stored, block)) {
+                block.clear();
+                return error("%s: Corrupted compressed block at %s", __func__,
+                             pos.ToString());
+            }
+        }
+        return true;
+    }
+
+    // Open history file to read, starting with the storage header
+    FlatFilePos header_pos{pos.nFile, pos.nPos - BLOCK_STORAGE_HEADER_SIZE};
+    CAutoFile filein(OpenBlockFile(header_pos, true), SER_DISK,
+                     CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return error("ReadRawBlockFromDisk: OpenBlockFile failed for %s",
+                     pos.ToString());
+    }
+
+    try {
+        unsigned int blk_size;
+        filein >> blk_start >> blk_size;
+
+        if (blk_start != diskMagic) {
+            return error("%s: Block magic mismatch for %s: %s versus expected "
+                         "%s",
+                         __func__, pos.ToString(), HexStr(blk_start),
+                         HexStr(diskMagic));
+        }
+        compressed = blk_size & BLOCK_STORAGE_COMPRESSED_FLAG;
+        blk_size &= ~BLOCK_STORAGE_COMPRESSED_FLAG;
+
+        block.resize(blk_size);
+        filein.read(reinterpret_cast<char *>(block.data()), blk_size);
+        if (compressed) {
+            std::vector<uint8_t> stored;
+            stored.swap(block);
+            if (!DecompressStoredData(stored, block)) {
+                block.clear();
+                return error("%s: Corrupted compressed block at %s", __func__,
+                             pos.ToString());
+            }
+        }
+    } catch (const std::exception &e) {
+        block.clear();
+        return error("%s: Read from block file failed: %s for %s", __func__,
+                     e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block,
+                          const CBlockIndex *pindex,
+                          const CMessageHeader::MessageMagic &diskMagic) {
+    FlatFilePos blockPos;
+    {
+        LOCK(cs_main);
+        blockPos = pindex->GetBlockPos();
+    }
+
+    if (!ReadRawBlockFromDisk(block, blockPos, diskMagic)) {
+        return false;
+    }
+
+    // The block header comes first, hashing it is enough to make sure this is
+    // the block we expect.
+    CBlockHeader header;
+    try {
+        VectorReader(SER_DISK, CLIENT_VERSION, block, 0) >> header;
+    } catch (const std::exception &e) {
+        block.clear();
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(),
+                     blockPos.ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash()) {
+        block.clear();
+        return error("ReadRawBlockFromDisk(CBlockIndex*): header hash doesn't "
+                     "match index for %s at %s",
+                     pindex->ToString(), blockPos.ToString());
+    }
+
+    return true;
+}
+
+std::shared_ptr<const CBlock>
+BlockManager::ReadBlock(const CBlockIndex *pindex,
+                        const Consensus::Params &consensusParams) {
+    const BlockHash hash = pindex->GetBlockHash();
+    if (std::shared_ptr<const CBlock> block = m_block_cache.Get(hash)) {
+        return block;
+    }
+
+    auto block = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*block, pindex, consensusParams)) {
+        return nullptr;
+    }
+    m_block_cache.Insert(hash, block, RecursiveDynamicUsage(block));
+    return block;
+}
+
+std::shared_ptr<const CBlockUndo>
+BlockManager::ReadBlockUndo(const CBlockIndex *pindex) {
+    const BlockHash hash = pindex->GetBlockHash();
+    if (std::shared_ptr<const CBlockUndo> undo = m_undo_cache.Get(hash)) {
+        return undo;
+    }
+
+    auto undo = std::make_shared<CBlockUndo>();
+    if (!UndoReadFromDisk(*undo, pindex)) {
+        return nullptr;
+    }
+    m_undo_cache.Insert(hash, undo,
+                        memusage::DynamicUsage(undo) +
+                            undo->DynamicMemoryUsage());
+    return undo;
+}
+
+/**
+ * Get the size of the data of a block, as given by the storage header
+ * preceding it.
+ */
+static std::optional<uint32_t> ReadStoredBlockSize(const FlatFilePos &pos) {
+    if (pos.nPos < sizeof(uint32_t)) {
+        return std::nullopt;
+    }
+    FlatFilePos size_pos{pos.nFile, pos.nPos - uint32_t(sizeof(uint32_t))};
+    CAutoFile file(OpenBlockFile(size_pos, true), SER_DISK, CLIENT_VERSION);
+    uint32_t stored_size;
+    try {
+        file >> stored_size;
+    } catch (const std::exception &) {
+        return std::nullopt;
+    }
+    return stored_size & ~BLOCK_STORAGE_COMPRESSED_FLAG;
+}
+
 /**
  * Store block on disk. If dbp is non-nullptr, the file is known to already
  * reside on disk.
@@ -867,10 +1627,25 @@ FlatFilePos BlockManager::SaveBlockToDisk(const CBlock &block, int nHeight,
                                           CChain &active_chain,
                                           const CChainParams &chainparams,
                                           const FlatFilePos *dbp) {
-    unsigned int nBlockSize = ::GetSerializeSize(block, CLIENT_VERSION);
+    std::vector<uint8_t> compressed;
+    unsigned int nBlockSize;
     FlatFilePos blockPos;
     if (dbp != nullptr) {
         blockPos = *dbp;
+        // The block may be stored compressed or not, regardless of the
+        // current -blockcompression setting.
+        std::optional<uint32_t> stored_size = ReadStoredBlockSize(*dbp);
+        if (!stored_size) {
+            error("%s: failed to read the size of the block at %s", __func__,
+                  dbp->ToString());
+            return FlatFilePos();
+        }
+        nBlockSize = *stored_size;
+    } else {
+        compressed = CompressStoredObject(block);
+        nBlockSize = compressed.empty()
+                         ? ::GetSerializeSize(block, CLIENT_VERSION)
+                         : compressed.size();
     }
     if (!FindBlockPos(blockPos, nBlockSize + 8, nHeight, active_chain,
                       block.GetBlockTime(), dbp != nullptr)) {
@@ -878,7 +1653,8 @@ FlatFilePos BlockManager::SaveBlockToDisk(const CBlock &block, int nHeight,
         return FlatFilePos();
     }
     if (dbp == nullptr) {
-        if (!WriteBlockToDisk(block, blockPos, chainparams.DiskMagic())) {
+        if (!WriteBlockToDisk(BlockFileSeq(), block, compressed, blockPos,
+                              chainparams.DiskMagic())) {
             AbortNode("Failed to write block");
             return FlatFilePos();
         }
@@ -886,6 +1662,355 @@ FlatFilePos BlockManager::SaveBlockToDisk(const CBlock &block, int nHeight,
     return blockPos;
 }
 
+bool BlockManager::ConvertBlockFiles(const CChainParams &chainparams) {
+    AssertLockHeld(cs_main);
+    // Leftovers of an interrupted conversion, which the block index doesn't
+    // point to.
+    fs::remove_all(ConvertedBlockFilesDir());
+
+    // The blocks of each file, in the order they are stored.
+    std::map<int, std::vector<CBlockIndex *>> file_blocks;
+    const int last_blockfile = WITH_LOCK(cs_LastBlockFile,
+                                         return m_last_blockfile);
+    for (const auto &[hash, pindex] : m_block_index) {
+        if (pindex->nStatus.hasData() && pindex->nFile < last_blockfile) {
+            file_blocks[pindex->nFile].push_back(pindex);
+        }
+    }
+
+    LogPrintf("Converting %u block files to %s storage...\n",
+              file_blocks.size(),
+              CompressBlockFiles() ? "compressed" : "uncompressed");
+    for (auto &[nFile, blocks] : file_blocks) {
+        if (ShutdownRequested()) {
+            return true;
+        }
+        std::sort(blocks.begin(), blocks.end(),
+                  [](const CBlockIndex *a, const CBlockIndex *b) {
+                      return a->nDataPos < b->nDataPos;
+                  });
+
+        CBlockFileInfo info = *GetBlockFileInfo(nFile);
+        const uint64_t old_size = info.nSize + info.nUndoSize;
+        info.nSize = 0;
+        info.nUndoSize = 0;
+        std::vector<std::pair<FlatFilePos, FlatFilePos>> positions;
+        positions.reserve(blocks.size());
+        for (const CBlockIndex *pindex : blocks) {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus())) {
+                return error("%s: failed to read block %s", __func__,
+                             pindex->GetBlockHash().ToString());
+            }
+            const std::vector<uint8_t> compressed = CompressStoredObject(block);
+            FlatFilePos block_pos(nFile, info.nSize);
+            if (!WriteBlockToDisk(ConvertedBlockFileSeq(), block, compressed,
+                                  block_pos, chainparams.DiskMagic())) {
+                return error("%s: failed to write block %s", __func__,
+                             pindex->GetBlockHash().ToString());
+            }
+            info.nSize = block_pos.nPos +
+                         (compressed.empty()
+                              ? ::GetSerializeSize(block, CLIENT_VERSION)
+                              : compressed.size());
+
+            FlatFilePos undo_pos;
+            if (pindex->nStatus.hasUndo()) {
+                CBlockUndo blockundo;
+                if (!UndoReadFromDisk(blockundo, pindex)) {
+                    return error("%s: failed to read the undo data of %s",
+                                 __func__, pindex->GetBlockHash().ToString());
+                }
+                const std::vector<uint8_t> compressed_undo =
+                    CompressStoredObject(blockundo);
+                undo_pos = FlatFilePos(nFile, info.nUndoSize);
+                if (!UndoWriteToDisk(ConvertedUndoFileSeq(), blockundo,
+                                     compressed_undo, undo_pos,
+                                     pindex->pprev->GetBlockHash(),
+                                     chainparams.DiskMagic())) {
+                    return error("%s: failed to write the undo data of %s",
+                                 __func__, pindex->GetBlockHash().ToString());
+                }
+                info.nUndoSize =
+                    undo_pos.nPos +
+                    (compressed_undo.empty()
+                         ? ::GetSerializeSize(blockundo, CLIENT_VERSION)
+                         : compressed_undo.size()) +
+                    sizeof(uint256);
+            }
+            positions.emplace_back(block_pos, undo_pos);
+        }
+        if (!ConvertedBlockFileSeq().Flush(FlatFilePos(nFile, info.nSize),
+                                           true) ||
+            !ConvertedUndoFileSeq().Flush(FlatFilePos(nFile, info.nUndoSize),
+                                          true)) {
+            return error("%s: failed to commit block file %i", __func__,
+                         nFile);
+        }
+
+        // The block index points to the rewritten files from now on.
+        std::vector<const CBlockIndex *> updated;
+        updated.reserve(blocks.size());
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            CBlockIndex *pindex = blocks[i];
+            pindex->nDataPos = positions[i].first.nPos;
+            if (pindex->nStatus.hasUndo()) {
+                pindex->nUndoPos = positions[i].second.nPos;
+            }
+            updated.push_back(pindex);
+        }
+        {
+            LOCK(cs_LastBlockFile);
+            m_blockfile_info[nFile].nSize = info.nSize;
+            m_blockfile_info[nFile].nUndoSize = info.nUndoSize;
+        }
+        if (!m_block_tree_db->WriteBlockFileConversion(nFile, info, updated)) {
+            return AbortNode("Failed to write to block index database");
+        }
+        if (!ReplaceConvertedBlockFile(nFile)) {
+            return false;
+        }
+        LogPrintf("Converted block file blk%05u.dat, from %u to %u bytes\n",
+                  nFile, old_size, info.nSize + info.nUndoSize);
+    }
+
+    fs::remove_all(ConvertedBlockFilesDir());
+    return true;
+}
+
+/** Move a file rewritten by ConvertBlockFiles() in place of the original. */
+static bool ReplaceConvertedFile(const FlatFileSeq &seq,
+                                 const FlatFileSeq &converted_seq,
+                                 FlatFileMapCache &maps,
+                                 FlatFileHandleCache &handles,
+                                 const FlatFilePos &pos) {
+    const fs::path path = converted_seq.FileName(pos);
+    // The file was already moved if the replacement got interrupted.
+    if (!fs::exists(path)) {
+        return true;
+    }
+    // Drop the mapping and the handle to the original file before it is
+    // replaced, so that no new read goes through them.
+    maps.Remove(seq.FileName(pos));
+    handles.Remove(seq.FileName(pos));
+    const bool ret = RenameOver(path, seq.FileName(pos));
+    // A concurrent read may have opened the original file again in the
+    // meantime. Mappings are checked against the file they were made from,
+    // but handles are not.
+    handles.Remove(seq.FileName(pos));
+    return ret;
+}
+
+bool BlockManager::ReplaceConvertedBlockFile(int nFile) {
+    const FlatFilePos pos(nFile, 0);
+    if (!ReplaceConvertedFile(BlockFileSeq(), ConvertedBlockFileSeq(),
+                              g_block_file_maps, g_block_file_handles, pos) ||
+        !ReplaceConvertedFile(UndoFileSeq(), ConvertedUndoFileSeq(),
+                              g_undo_file_maps, g_undo_file_handles, pos)) {
+        return AbortNode(
+            strprintf("Failed to replace block file %i by its converted copy",
+                      nFile));
+    }
+    if (!m_block_tree_db->EraseBlockFileConversion()) {
+        return AbortNode("Failed to write to block index database");
+    }
+    return true;
+}
+
+/**
+ * Reads the block files on several threads during a reindex, deserializing
+ * their blocks and running the context-free checks on them while the blocks
+ * of the previous files are being imported.
+ *
+ * The files are handed over in order, as the blocks must be imported in the
+ * order they are stored to rebuild the same block index as a serial reindex.
+ * No more than one file per thread, and no more than
+ * MAX_REINDEX_READ_AHEAD_SIZE bytes of files, are read ahead of the file being
+ * imported. A single file is still read ahead if it is larger on its own.
+ * Deserialized blocks take about twice their size on disk, so the peak memory
+ * is about 2 * (MAX_REINDEX_READ_AHEAD_SIZE + MAX_BLOCKFILE_SIZE), 1.25 GiB,
+ * regardless of the number of threads.
+ */
+class ReindexFileReader {
+public:
+    //! The blocks of a file, with their positions.
+    using FileBlocks =
+        std::vector<std::pair<std::shared_ptr<CBlock>, FlatFilePos>>;
+
+    ReindexFileReader(const Config &config, int num_threads)
+        : m_config(config), m_max_ahead(num_threads) {
+        WITH_LOCK(m_mutex, m_next_read_size = BlockFileSize(m_next_read));
+        for (int i = 0; i < num_threads; ++i) {
+            m_threads.emplace_back([this, i] {
+                util::ThreadRename(strprintf("reindex.%i", i));
+                ThreadRead();
+            });
+        }
+    }
+
+    ~ReindexFileReader() {
+        WITH_LOCK(m_mutex, m_interrupt = true);
+        m_cv.notify_all();
+        for (std::thread &thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    /**
+     * Wait for the blocks of the next file. Returns std::nullopt once there
+     * are no files left.
+     */
+    std::optional<FileBlocks> Next() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex) {
+        WAIT_LOCK(m_mutex, lock);
+        m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+            return m_files.count(m_next_import) || IsEnd(m_next_import);
+        });
+        auto node = m_files.extract(m_next_import);
+        if (node.empty()) {
+            return std::nullopt;
+        }
+        auto size = m_read_sizes.extract(m_next_import);
+        m_size_ahead -= size.mapped();
+        ++m_next_import;
+        m_cv.notify_all();
+        return std::move(node.mapped());
+    }
+
+private:
+    const Config &m_config;
+    const int m_max_ahead;
+
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    //! Next file to be read by a thread.
+    int m_next_read GUARDED_BY(m_mutex){0};
+    //! Size of the next file to be read, 0 if it does not exist.
+    uint64_t m_next_read_size GUARDED_BY(m_mutex){0};
+    //! Next file to be imported.
+    int m_next_import GUARDED_BY(m_mutex){0};
+    //! The first missing file, once it is found.
+    std::optional<int> m_end GUARDED_BY(m_mutex);
+    //! The files which were read, but not imported yet.
+    std::map<int, FileBlocks> m_files GUARDED_BY(m_mutex);
+    //! Size of the files being read or read, but not imported yet.
+    std::map<int, uint64_t> m_read_sizes GUARDED_BY(m_mutex);
+    //! Total size of the files in m_read_sizes.
+    uint64_t m_size_ahead GUARDED_BY(m_mutex){0};
+    bool m_interrupt GUARDED_BY(m_mutex){false};
+    std::vector<std::thread> m_threads;
+
+    bool IsEnd(int nFile) const EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+        return m_end && nFile >= *m_end;
+    }
+
+    static uint64_t BlockFileSize(int nFile) {
+        try {
+            return fs::file_size(GetBlockPosFilename(FlatFilePos(nFile, 0)));
+        } catch (const fs::filesystem_error &) {
+            return 0;
+        }
+    }
+
+    /**
+     * Whether the next file can be read without exceeding the limits. Files
+     * are claimed in order, so the file to be imported next can always be
+     * read once nothing is read ahead of it.
+     */
+    bool CanReadNext() const EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+        return m_next_read < m_next_import + m_max_ahead &&
+               (m_size_ahead == 0 || m_size_ahead + m_next_read_size <=
+                                         MAX_REINDEX_READ_AHEAD_SIZE);
+    }
+
+    void ThreadRead() EXCLUSIVE_LOCKS_REQUIRED(!m_mutex) {
+        const CChainParams &params = m_config.GetChainParams();
+        const BlockValidationOptions options(m_config);
+        while (true) {
+            int nFile;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+                    return m_interrupt || IsEnd(m_next_read) || CanReadNext();
+                });
+                if (m_interrupt || IsEnd(m_next_read)) {
+                    return;
+                }
+                nFile = m_next_read++;
+                m_read_sizes.emplace(nFile, m_next_read_size);
+                m_size_ahead += m_next_read_size;
+                m_next_read_size = BlockFileSize(m_next_read);
+            }
+
+            FlatFilePos pos(nFile, 0);
+            FILE *file = fs::exists(GetBlockPosFilename(pos))
+                             ? OpenBlockFile(pos, true)
+                             : nullptr;
+            FileBlocks blocks;
+            if (file) {
+                ReadExternalBlockFile(
+                    m_config, file, &pos,
+                    [&](const std::shared_ptr<CBlock> &pblock,
+                        FlatFilePos *dbp) {
+                        // The result is remembered by the block, and invalid
+                        // blocks are checked again when they get accepted.
+                        BlockValidationState state;
+                        CheckBlock(*pblock, state, params.GetConsensus(),
+                                   options);
+                        blocks.emplace_back(pblock, *dbp);
+                        return true;
+                    });
+            }
+
+            LOCK(m_mutex);
+            if (file) {
+                m_files.emplace(nFile, std::move(blocks));
+            } else if (!IsEnd(nFile)) {
+                // No block files left to reindex, or the error is logged in
+                // OpenBlockFile
+                m_end = nFile;
+            }
+            m_cv.notify_all();
+        }
+    }
+};
+
+/**
+ * Import the blocks of all the block files, read by num_threads threads.
+ * Returns false if a shutdown was requested.
+ */
+static bool ReindexInParallel(const Config &config, CChainState &chainstate,
+                              int num_threads) {
+    ReindexFileReader reader(config, num_threads);
+    int nFile = 0;
+    while (std::optional<ReindexFileReader::FileBlocks> blocks =
+               reader.Next()) {
+        LogPrintf("Reindexing block file blk%05u.dat...\n",
+                  (unsigned int)nFile);
+        int64_t nStart = GetTimeMillis();
+        int nLoaded = 0;
+        for (auto &[pblock, pos] : *blocks) {
+            if (ShutdownRequested()) {
+                return false;
+            }
+            try {
+                if (!chainstate.LoadExternalBlock(config, pblock, &pos,
+                                                  nLoaded)) {
+                    break;
+                }
+            } catch (const std::exception &e) {
+                LogPrintf("%s: I/O error - %s\n", __func__, e.what());
+            }
+        }
+        if (ShutdownRequested()) {
+            return false;
+        }
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded,
+                  GetTimeMillis() - nStart);
+        nFile++;
+    }
+    return true;
+}
+
 struct CImportingNow {
     CImportingNow() {
         assert(fImporting == false);
@@ -909,27 +2034,39 @@ void ThreadImport(const Config &config, ChainstateManager &chainman,
 
         // -reindex
         if (fReindex) {
-            int nFile = 0;
-            while (true) {
-                FlatFilePos pos(nFile, 0);
-                if (!fs::exists(GetBlockPosFilename(pos))) {
-                    // No block files left to reindex
-                    break;
-                }
-                FILE *file = OpenBlockFile(pos, true);
-                if (!file) {
-                    // This error is logged in OpenBlockFile
-                    break;
-                }
-                LogPrintf("Reindexing block file blk%05u.dat...\n",
-                          (unsigned int)nFile);
-                chainman.ActiveChainstate().LoadExternalBlockFile(config, file,
-                                                                  &pos);
-                if (ShutdownRequested()) {
+            const int reindex_threads =
+                std::clamp<int>(args.GetIntArg("-reindexthreads",
+                                               DEFAULT_REINDEX_THREADS),
+                                1, MAX_REINDEX_THREADS);
+            if (reindex_threads > 1) {
+                if (!ReindexInParallel(config, chainman.ActiveChainstate(),
+                                       reindex_threads)) {
                     LogPrintf("Shutdown requested. Exit %s\n", __func__);
                     return;
                 }
-                nFile++;
+            } else {
+                int nFile = 0;
+                while (true) {
+                    FlatFilePos pos(nFile, 0);
+                    if (!fs::exists(GetBlockPosFilename(pos))) {
+                        // No block files left to reindex
+                        break;
+                    }
+                    FILE *file = OpenBlockFile(pos, true);
+                    if (!file) {
+                        // This error is logged in OpenBlockFile
+                        break;
+                    }
+                    LogPrintf("Reindexing block file blk%05u.dat...\n",
+                              (unsigned int)nFile);
+                    chainman.ActiveChainstate().LoadExternalBlockFile(
+                        config, file, &pos);
+                    if (ShutdownRequested()) {
+                        LogPrintf("Shutdown requested. Exit %s\n", __func__);
+                        return;
+                    }
+                    nFile++;
+                }
             }
             WITH_LOCK(
                 ::cs_main,
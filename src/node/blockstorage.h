@@ -6,10 +6,14 @@
 #define BITCOIN_NODE_BLOCKSTORAGE_H
 
 #include <cstdint>
+#include <thread>
 #include <vector>
 
+#include <blockindexarena.h>
 #include <fs.h>
+#include <node/blockcache.h>
 #include <protocol.h> // For CMessageHeader::MessageStartChars
+#include <span.h>
 #include <txdb.h>
 
 class ArgsManager;
@@ -39,6 +43,49 @@ static constexpr unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
+/**
+ * Size of the header (disk magic and block size) preceding each block in the
+ * blk?????.dat files
+ */
+static constexpr unsigned int BLOCK_STORAGE_HEADER_SIZE = 8;
+/** Default for -blockcompression */
+static constexpr bool DEFAULT_BLOCK_COMPRESSION{false};
+/**
+ * Flag set in the size field of the storage header of the blocks and undo data
+ * which are stored compressed. The stored data is then the size of the
+ * uncompressed data (4 bytes, little endian) followed by the compressed data.
+ */
+static constexpr uint32_t BLOCK_STORAGE_COMPRESSED_FLAG = 0x80000000;
+/** Default for -backgroundprune */
+static constexpr bool DEFAULT_BACKGROUND_PRUNE{false};
+/** Default for -mmapblockfiles */
+static constexpr bool DEFAULT_MMAP_BLOCK_FILES{false};
+/**
+ * Maximum number of blk?????.dat files, and of rev?????.dat files, kept
+ * memory mapped with -mmapblockfiles
+ */
+static constexpr size_t MAX_MAPPED_BLOCK_FILES = 64;
+/**
+ * Maximum number of blk?????.dat files, and of rev?????.dat files, kept open
+ * for reading
+ */
+static constexpr size_t MAX_OPEN_BLOCK_FILES = 8;
+/**
+ * Default for -blockcachesize, the memory used by each of the caches of
+ * recently read blocks and undo data, in MiB
+ */
+static constexpr int64_t DEFAULT_BLOCK_CACHE_SIZE_MB = 32;
+/** Default for -blockindexsnapshot */
+static constexpr bool DEFAULT_BLOCK_INDEX_SNAPSHOT{false};
+/** Default for -reindexthreads, the number of threads reading block files */
+static constexpr int DEFAULT_REINDEX_THREADS = 1;
+/** Maximum number of threads reading block files during a reindex */
+static constexpr int MAX_REINDEX_THREADS = 16;
+/**
+ * Maximum size of the block files read ahead of the one being imported during
+ * a reindex on several threads
+ */
+static constexpr uint64_t MAX_REINDEX_READ_AHEAD_SIZE = 4 * MAX_BLOCKFILE_SIZE;
 
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
@@ -49,6 +96,8 @@ extern bool fHavePruned;
 extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
+/** True if the pruned block files are deleted on a background thread. */
+extern bool g_background_prune;
 
 typedef std::unordered_map<BlockHash, CBlockIndex *, BlockHasher> BlockMap;
 
@@ -71,6 +120,12 @@ private:
                       uint64_t nTime, bool fKnown);
     bool FindUndoPos(BlockValidationState &state, int nFile, FlatFilePos &pos,
                      unsigned int nAddSize);
+    /**
+     * Move a rewritten block file and its undo file in place of the original
+     * ones, once the block index points to their content.
+     */
+    bool ReplaceConvertedBlockFile(int nFile)
+        EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
     /**
      * Calculate the block/rev files to delete based on height specified
@@ -120,9 +175,21 @@ private:
     /** Dirty block file entries. */
     std::set<int> m_dirty_fileinfo;
 
+    /** Storage of the entries of m_block_index. */
+    BlockIndexArena m_block_index_arena GUARDED_BY(cs_main);
+
+    /** Thread started by UnlinkPrunedFilesInBackground(). */
+    std::thread m_prune_thread;
+
 public:
     BlockMap m_block_index GUARDED_BY(cs_main);
 
+    /**
+     * Memory used by the block index entries, including the map from their
+     * hashes.
+     */
+    size_t GetBlockIndexMemoryUsage() const EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     /**
      * All pairs A->B, where A (or one of its ancestors) misses transactions,
      * but B has transactions. Pruned nodes may have entries where B is missing
@@ -133,6 +200,33 @@ public:
     std::unique_ptr<CBlockTreeDB> m_block_tree_db GUARDED_BY(::cs_main);
 
     bool WriteBlockIndexDB() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+    /**
+     * Delete the pruned block and undo files on a background thread, so that
+     * block connection doesn't wait for a slow disk. The block index marking
+     * them as pruned must have been written already.
+     */
+    void UnlinkPrunedFilesInBackground(const std::set<int> &setFilesToPrune);
+    /** Wait for the files being deleted in the background. */
+    void WaitForPrunedFiles();
+    /**
+     * Write all the block index entries to a snapshot file (blockindex.dat in
+     * the blocks directory), made of fixed size records sorted by height. It
+     * is loaded instead of the block tree database on the next startup with
+     * -blockindexsnapshot.
+     *
+     * This is meant to be called at shutdown, once the block index has been
+     * flushed: the snapshot is only used if the block tree database has not
+     * been written to since.
+     */
+    bool WriteBlockIndexSnapshot() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+    /**
+     * Load the block index entries from the snapshot file, if it is up to
+     * date. Returns false if there is no usable snapshot, in which case the
+     * entries must be loaded from the block tree database. A snapshot can only
+     * be loaded once.
+     */
+    bool LoadBlockIndexSnapshot(const Consensus::Params &consensus_params)
+        EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
     bool LoadBlockIndexDB(ChainstateManager &chainman)
         EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
@@ -164,10 +258,41 @@ public:
     /** Get block file info entry for one block file */
     CBlockFileInfo *GetBlockFileInfo(size_t n);
 
+    /**
+     * Blocks and undo data recently read through ReadBlock() and
+     * ReadBlockUndo(), shared by the RPC, REST, P2P and index code.
+     */
+    BlockDataCache<CBlock> m_block_cache{DEFAULT_BLOCK_CACHE_SIZE_MB << 20};
+    BlockDataCache<CBlockUndo> m_undo_cache{DEFAULT_BLOCK_CACHE_SIZE_MB
+                                            << 20};
+
+    /**
+     * Read a block from disk, or get it from the cache of recently read
+     * blocks. Returns nullptr if it could not be read.
+     */
+    std::shared_ptr<const CBlock>
+    ReadBlock(const CBlockIndex *pindex,
+              const Consensus::Params &consensusParams);
+    /** Same as ReadBlock(), for the undo data of the block. */
+    std::shared_ptr<const CBlockUndo> ReadBlockUndo(const CBlockIndex *pindex);
+
     bool WriteUndoDataForBlock(const CBlockUndo &blockundo,
                                BlockValidationState &state, CBlockIndex *pindex,
                                const CChainParams &chainparams);
 
+    /**
+     * Rewrite the block and undo files, except the last ones which are still
+     * being written, so that the blocks and undo data they contain are stored
+     * compressed or not as selected by -blockcompression.
+     *
+     * Each file is rewritten in the convert subdirectory of the blocks
+     * directory, then the block index is updated and the rewritten files
+     * replace the original ones. The replacement is completed on the next
+     * startup if it gets interrupted.
+     */
+    bool ConvertBlockFiles(const CChainParams &chainparams)
+        EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
     FlatFilePos SaveBlockToDisk(const CBlock &block, int nHeight,
                                 CChain &active_chain,
                                 const CChainParams &chainparams,
@@ -205,7 +330,30 @@ bool ReadBlockFromDisk(CBlock &block, const FlatFilePos &pos,
                        const Consensus::Params &consensusParams);
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
                        const Consensus::Params &consensusParams);
+/**
+ * Read a block as it is serialized on disk, without deserializing it. The
+ * bytes are the same as the network serialization of the block, so they can
+ * be sent to peers or returned by the REST and RPC interfaces as they are.
+ *
+ * Only the storage header is checked against the disk magic: the content of
+ * the block is not validated.
+ */
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block, const FlatFilePos &pos,
+                          const CMessageHeader::MessageMagic &diskMagic);
+/**
+ * Same as above, but also checks that the hash of the block header matches
+ * the one of pindex.
+ */
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block,
+                          const CBlockIndex *pindex,
+                          const CMessageHeader::MessageMagic &diskMagic);
 bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex);
+/**
+ * Decompress a block or undo data stored with BLOCK_STORAGE_COMPRESSED_FLAG.
+ * Returns false if the stored data is malformed.
+ */
+bool DecompressStoredData(Span<const uint8_t> stored,
+                          std::vector<uint8_t> &data);
 
 void ThreadImport(const Config &config, ChainstateManager &chainman,
                   std::vector<fs::path> vImportFiles, const ArgsManager &args);
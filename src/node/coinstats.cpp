@@ -183,4 +183,28 @@ static void FinalizeHash(MuHash3072 &muhash, CCoinsStats &stats) {
     stats.hashSerialized = out;
 }
 static void FinalizeHash(std::nullptr_t, CCoinsStats &stats) {}
+
+CoinsSerializedHasher::CoinsSerializedHasher(const BlockHash &best_block)
+    : m_hasher(SER_GETHASH, PROTOCOL_VERSION) {
+    CCoinsStats stats{CoinStatsHashType::HASH_SERIALIZED};
+    stats.hashBlock = best_block;
+    PrepareHash(m_hasher, stats);
+}
+
+void CoinsSerializedHasher::Add(const COutPoint &outpoint, const Coin &coin) {
+    if (!m_outputs.empty() && outpoint.GetTxId() != m_txid) {
+        ApplyHash(m_hasher, m_txid, m_outputs);
+        m_outputs.clear();
+    }
+    m_txid = outpoint.GetTxId();
+    m_outputs[outpoint.GetN()] = coin;
+}
+
+uint256 CoinsSerializedHasher::Finalize() {
+    if (!m_outputs.empty()) {
+        ApplyHash(m_hasher, m_txid, m_outputs);
+        m_outputs.clear();
+    }
+    return m_hasher.GetHash();
+}
 } // namespace node
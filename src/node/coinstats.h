@@ -9,12 +9,15 @@
 #include <chain.h>
 #include <coins.h>
 #include <consensus/amount.h>
+#include <hash.h>
 #include <primitives/blockhash.h>
+#include <primitives/txid.h>
 #include <streams.h>
 #include <uint256.h>
 
 #include <cstdint>
 #include <functional>
+#include <map>
 
 class CCoinsView;
 namespace node {
@@ -67,6 +70,27 @@ bool GetUTXOStats(CCoinsView *view, node::BlockManager &blockman,
                   const std::function<void()> &interruption_point = {},
                   const CBlockIndex *pindex = nullptr);
 
+/**
+ * Compute the HASH_SERIALIZED hash of a UTXO set from its coins, fed one by
+ * one in the order of the coins database. This yields the same hash as
+ * GetUTXOStats() over a database holding these coins.
+ */
+class CoinsSerializedHasher {
+public:
+    explicit CoinsSerializedHasher(const BlockHash &best_block);
+
+    void Add(const COutPoint &outpoint, const Coin &coin);
+
+    //! Hash of all the coins added so far. No coin can be added afterwards.
+    uint256 Finalize();
+
+private:
+    CHashWriter m_hasher;
+    //! Outputs of the transaction being added
+    TxId m_txid;
+    std::map<uint32_t, Coin> m_outputs;
+};
+
 uint64_t GetBogoSize(const CScript &script_pub_key);
 
 CDataStream TxOutSer(const COutPoint &outpoint, const Coin &coin);
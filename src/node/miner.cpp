@@ -27,6 +27,7 @@
 #include <validation.h>
 
 #include <algorithm>
+#include <set>
 #include <utility>
 
 namespace node {
@@ -109,8 +110,8 @@ void BlockAssembler::resetBlock() {
     inBlock.clear();
 
     // Reserve space for coinbase tx.
-    nBlockSize = 1000;
-    nBlockSigChecks = 100;
+    nBlockSize = COINBASE_RESERVED_SIZE;
+    nBlockSigChecks = COINBASE_RESERVED_SIGCHECKS;
 
     // These counters do not include coinbase tx.
     nBlockTx = 0;
@@ -120,6 +121,42 @@ void BlockAssembler::resetBlock() {
 std::optional<int64_t> BlockAssembler::m_last_block_num_txs{std::nullopt};
 std::optional<int64_t> BlockAssembler::m_last_block_size{std::nullopt};
 
+/**
+ * Create the coinbase transaction of a block at nHeight, on top of pindexPrev,
+ * collecting nFees.
+ */
+static CTransactionRef
+CreateCoinbase(const CScript &scriptPubKeyIn, int nHeight, Amount nFees,
+               const Consensus::Params &consensusParams,
+               const CBlockIndex *pindexPrev) {
+    CMutableTransaction coinbaseTx;
+    coinbaseTx.vin.resize(1);
+    coinbaseTx.vin[0].prevout = COutPoint();
+    coinbaseTx.vout.resize(1);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[0].nValue =
+        nFees + GetBlockSubsidy(nHeight, consensusParams);
+    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+
+    const std::vector<CTxDestination> whitelisted =
+        GetMinerFundWhitelist(consensusParams, pindexPrev);
+    if (!whitelisted.empty()) {
+        const Amount fund = GetMinerFundAmount(coinbaseTx.vout[0].nValue);
+        coinbaseTx.vout[0].nValue -= fund;
+        coinbaseTx.vout.emplace_back(fund,
+                                     GetScriptForDestination(whitelisted[0]));
+    }
+
+    // Make sure the coinbase is big enough.
+    uint64_t coinbaseSize = ::GetSerializeSize(coinbaseTx, PROTOCOL_VERSION);
+    if (coinbaseSize < MIN_TX_SIZE) {
+        coinbaseTx.vin[0].scriptSig
+            << std::vector<uint8_t>(MIN_TX_SIZE - coinbaseSize - 1);
+    }
+
+    return MakeTransactionRef(coinbaseTx);
+}
+
 std::unique_ptr<CBlockTemplate>
 BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
     int64_t nTimeStart = GetTimeMicros();
@@ -184,32 +221,8 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
     m_last_block_size = nBlockSize;
 
     // Create coinbase transaction.
-    CMutableTransaction coinbaseTx;
-    coinbaseTx.vin.resize(1);
-    coinbaseTx.vin[0].prevout = COutPoint();
-    coinbaseTx.vout.resize(1);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[0].nValue =
-        nFees + GetBlockSubsidy(nHeight, consensusParams);
-    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-
-    const std::vector<CTxDestination> whitelisted =
-        GetMinerFundWhitelist(consensusParams, pindexPrev);
-    if (!whitelisted.empty()) {
-        const Amount fund = GetMinerFundAmount(coinbaseTx.vout[0].nValue);
-        coinbaseTx.vout[0].nValue -= fund;
-        coinbaseTx.vout.emplace_back(fund,
-                                     GetScriptForDestination(whitelisted[0]));
-    }
-
-    // Make sure the coinbase is big enough.
-    uint64_t coinbaseSize = ::GetSerializeSize(coinbaseTx, PROTOCOL_VERSION);
-    if (coinbaseSize < MIN_TX_SIZE) {
-        coinbaseTx.vin[0].scriptSig
-            << std::vector<uint8_t>(MIN_TX_SIZE - coinbaseSize - 1);
-    }
-
-    pblocktemplate->entries[0].tx = MakeTransactionRef(coinbaseTx);
+    pblocktemplate->entries[0].tx = CreateCoinbase(
+        scriptPubKeyIn, nHeight, nFees, consensusParams, pindexPrev);
     pblocktemplate->entries[0].fees = -1 * nFees;
     pblock->vtx[0] = pblocktemplate->entries[0].tx;
 
@@ -533,6 +546,232 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected,
     }
 }
 
+IncrementalBlockAssembler::IncrementalBlockAssembler(
+    const Config &config, ChainstateManager &chainman,
+    const CTxMemPool &mempool)
+    : m_config(config), m_chainman(chainman), m_mempool(mempool) {}
+
+void IncrementalBlockAssembler::TransactionAddedToMempool(
+    const CTransactionRef &tx, uint64_t mempool_sequence) {
+    LOCK(m_mutex);
+    m_added.push_back(tx->GetId());
+}
+
+void IncrementalBlockAssembler::TransactionRemovedFromMempool(
+    const CTransactionRef &tx, MemPoolRemovalReason reason,
+    uint64_t mempool_sequence) {
+    LOCK(m_mutex);
+    m_removed.push_back(tx->GetId());
+}
+
+IncrementalBlockAssembler::Stats IncrementalBlockAssembler::GetStats() const {
+    LOCK(m_mutex);
+    return m_stats;
+}
+
+void IncrementalBlockAssembler::Rebuild(CChainState &chainstate,
+                                        const CScript &scriptPubKeyIn) {
+    // The notifications received so far are reflected by the mempool.
+    m_added.clear();
+    m_removed.clear();
+    m_stale = false;
+    m_tip = nullptr;
+    m_entries.clear();
+
+    BlockAssembler assembler(m_config, chainstate, m_mempool);
+    m_template = assembler.CreateNewBlock(scriptPubKeyIn);
+    m_max_block_size = assembler.GetMaxGeneratedBlockSize();
+    m_max_block_sigchecks = assembler.GetMaxGeneratedBlockSigChecks();
+    m_block_min_fee_rate = assembler.GetBlockMinFeeRate();
+
+    m_block_size = BlockAssembler::COINBASE_RESERVED_SIZE;
+    m_block_sigchecks = BlockAssembler::COINBASE_RESERVED_SIGCHECKS;
+    m_fees = Amount::zero();
+    for (size_t i = 1; i < m_template->entries.size(); ++i) {
+        const CBlockTemplateEntry &entry = m_template->entries[i];
+        m_entries.emplace(entry.tx->GetId(), entry);
+        m_block_size += entry.tx->GetTotalSize();
+        m_block_sigchecks += entry.sigChecks;
+        m_fees += entry.fees;
+    }
+
+    m_tip = chainstate.m_chain.Tip();
+    m_last_rebuild = GetTime();
+    m_lock_time_cutoff =
+        (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+            ? m_tip->GetMedianTimePast()
+            : m_template->block.GetBlockTime();
+}
+
+bool IncrementalBlockAssembler::Append(const TxId &txid) {
+    if (m_entries.count(txid)) {
+        return true;
+    }
+    const std::optional<CTxMemPool::txiter> it = m_mempool.GetIter(txid);
+    if (!it) {
+        // Already gone, its removal is pending.
+        return true;
+    }
+    const CTxMemPoolEntry &entry = **it;
+
+    // Transactions below the minimum fee rate would not be selected by a full
+    // assembly either, nor would non-final ones.
+    if (entry.GetModifiedFee() <
+        m_block_min_fee_rate.GetFee(entry.GetTxSize())) {
+        return true;
+    }
+    TxValidationState state;
+    if (!ContextualCheckTransaction(m_config.GetChainParams().GetConsensus(),
+                                    entry.GetTx(), state, m_tip->nHeight + 1,
+                                    m_lock_time_cutoff)) {
+        return true;
+    }
+
+    for (const CTxMemPoolEntry &parent : entry.GetMemPoolParentsConst()) {
+        if (!m_entries.count(parent.GetTx().GetId())) {
+            return false;
+        }
+    }
+    if (m_block_size + entry.GetTxSize() >= m_max_block_size ||
+        m_block_sigchecks + entry.GetSigChecks() >= m_max_block_sigchecks) {
+        return false;
+    }
+
+    m_entries.emplace(txid, CBlockTemplateEntry(entry.GetSharedTx(),
+                                                entry.GetFee(),
+                                                entry.GetSigChecks()));
+    m_block_size += entry.GetTxSize();
+    m_block_sigchecks += entry.GetSigChecks();
+    m_fees += entry.GetFee();
+    ++m_stats.txs_added;
+    return true;
+}
+
+void IncrementalBlockAssembler::Drop(
+    std::map<TxId, CBlockTemplateEntry>::iterator it) {
+    m_block_size -= it->second.tx->GetTotalSize();
+    m_block_sigchecks -= it->second.sigChecks;
+    m_fees -= it->second.fees;
+    m_entries.erase(it);
+    ++m_stats.txs_removed;
+}
+
+void IncrementalBlockAssembler::Update() {
+    // Drop the transactions which left the mempool. A transaction which came
+    // back since is kept.
+    std::set<TxId> dropped;
+    for (const TxId &txid : m_removed) {
+        auto it = m_entries.find(txid);
+        if (it == m_entries.end() || m_mempool.exists(txid)) {
+            continue;
+        }
+        Drop(it);
+        dropped.insert(txid);
+    }
+    m_removed.clear();
+
+    // Drop their descendants as well, transitively. These left the mempool
+    // along with them, but their own notifications may not have been received
+    // yet.
+    while (!dropped.empty()) {
+        std::set<TxId> dropped_children;
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            const auto next = std::next(it);
+            for (const CTxIn &txin : it->second.tx->vin) {
+                if (dropped.count(txin.prevout.GetTxId())) {
+                    if (m_mempool.exists(it->first)) {
+                        // Let the next assembly from scratch pick it again.
+                        m_stale = true;
+                    }
+                    dropped_children.insert(it->first);
+                    Drop(it);
+                    break;
+                }
+            }
+            it = next;
+        }
+        dropped = std::move(dropped_children);
+    }
+
+    // Append the transactions which entered the mempool, parents first.
+    for (const TxId &txid : m_added) {
+        if (!Append(txid)) {
+            m_stale = true;
+        }
+    }
+    m_added.clear();
+}
+
+std::unique_ptr<CBlockTemplate>
+IncrementalBlockAssembler::GetBlockTemplate(const CScript &scriptPubKeyIn) {
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, m_mempool.cs);
+    LOCK(m_mutex);
+    CChainState &chainstate = m_chainman.ActiveChainstate();
+    const CBlockIndex *pindexPrev = chainstate.m_chain.Tip();
+    assert(pindexPrev != nullptr);
+    const Consensus::Params &consensusParams =
+        m_config.GetChainParams().GetConsensus();
+
+    const bool rebuild =
+        m_tip != pindexPrev ||
+        !IsMagneticAnomalyEnabled(consensusParams, pindexPrev) ||
+        (m_stale && GetTime() - m_last_rebuild >=
+                        BLOCK_TEMPLATE_REBUILD_INTERVAL);
+    if (rebuild) {
+        Rebuild(chainstate, scriptPubKeyIn);
+    } else if (!m_added.empty() || !m_removed.empty()) {
+        Update();
+    }
+
+    auto pblocktemplate = std::make_unique<CBlockTemplate>();
+    CBlock *const pblock = &pblocktemplate->block;
+    const int nHeight = pindexPrev->nHeight + 1;
+
+    pblocktemplate->entries.reserve(m_entries.size() + 1);
+    pblocktemplate->entries.emplace_back(
+        CreateCoinbase(scriptPubKeyIn, nHeight, m_fees, consensusParams,
+                       pindexPrev),
+        -1 * m_fees, 0);
+    for (const auto &[txid, entry] : m_entries) {
+        pblocktemplate->entries.push_back(entry);
+    }
+
+    // Fill in header.
+    pblock->nVersion = m_template->block.nVersion;
+    pblock->hashPrevBlock = pindexPrev->GetBlockHash();
+    pblock->nTime = m_template->block.nTime;
+    UpdateTime(pblock, m_config.GetChainParams(), pindexPrev);
+    pblock->nBits =
+        GetNextWorkRequired(pindexPrev, pblock, m_config.GetChainParams());
+    pblock->nNonce = 0;
+
+    pblock->vtx.reserve(pblocktemplate->entries.size());
+    for (const CBlockTemplateEntry &entry : pblocktemplate->entries) {
+        pblock->vtx.push_back(entry.tx);
+    }
+
+    BlockAssembler::m_last_block_num_txs = m_entries.size();
+    BlockAssembler::m_last_block_size = m_block_size;
+
+    const int64_t nTime = GetTimeMicros() - nTimeStart;
+    m_stats.last_time = nTime;
+    if (rebuild) {
+        ++m_stats.rebuilds;
+        m_stats.rebuild_time += nTime;
+    } else {
+        ++m_stats.updates;
+        m_stats.update_time += nTime;
+    }
+    LogPrint(BCLog::BENCH,
+             "IncrementalBlockAssembler: %s template in %.2fms (%u txs)\n",
+             rebuild ? "assembled" : "updated", 0.001 * nTime,
+             m_entries.size());
+
+    return pblocktemplate;
+}
+
 static const std::vector<uint8_t>
 getExcessiveBlockSizeSig(uint64_t nExcessiveBlockSize) {
     std::string cbmsg = "/EB" + getSubVersionEB(nExcessiveBlockSize) + "/";
@@ -8,17 +8,22 @@
 
 #include <consensus/amount.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
+#include <validationinterface.h>
 
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index_container.hpp>
 
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <optional>
+#include <vector>
 
 class CBlockIndex;
 class CChainParams;
+class ChainstateManager;
 class Config;
 class CScript;
 
@@ -28,6 +33,13 @@ struct Params;
 
 namespace node {
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -incrementalblocktemplate */
+static const bool DEFAULT_INCREMENTAL_BLOCK_TEMPLATE = false;
+/**
+ * Minimum time between two assemblies from scratch of the incrementally
+ * maintained block template while the tip does not change, in seconds.
+ */
+static constexpr int64_t BLOCK_TEMPLATE_REBUILD_INTERVAL = 5;
 
 struct CBlockTemplateEntry {
     CTransactionRef tx;
@@ -176,6 +188,14 @@ public:
     CreateNewBlock(const CScript &scriptPubKeyIn);
 
     uint64_t GetMaxGeneratedBlockSize() const { return nMaxGeneratedBlockSize; }
+    uint64_t GetMaxGeneratedBlockSigChecks() const {
+        return nMaxGeneratedBlockSigChecks;
+    }
+    CFeeRate GetBlockMinFeeRate() const { return blockMinFeeRate; }
+
+    //! Block size and sigchecks reserved for the coinbase transaction.
+    static constexpr uint64_t COINBASE_RESERVED_SIZE = 1000;
+    static constexpr uint64_t COINBASE_RESERVED_SIGCHECKS = 100;
 
     static std::optional<int64_t> m_last_block_num_txs;
     static std::optional<int64_t> m_last_block_size;
@@ -229,6 +249,110 @@ private:
         EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 };
 
+/**
+ * Block template which is kept up to date as transactions enter and leave the
+ * mempool, so that a fresh template can be returned without selecting the
+ * transactions from the whole mempool again.
+ *
+ * The template is assembled from scratch by BlockAssembler when the tip
+ * changes. After that, the transactions added to the mempool are appended to
+ * it as long as they fit and their in-mempool parents are in it already, and
+ * the ones removed from the mempool are dropped from it along with their
+ * descendants. When some added
+ * transactions could not be appended, the template is assembled from scratch
+ * again, at most every BLOCK_TEMPLATE_REBUILD_INTERVAL. Appending transactions
+ * relies on the canonical transaction ordering, before the activation of which
+ * the template is always assembled from scratch.
+ *
+ * Unlike the assemblies from scratch, the updates are not checked with
+ * TestBlockValidity(): they only ever append mempool transactions whose
+ * in-mempool ancestors are in the template already.
+ */
+class IncrementalBlockAssembler final : public CValidationInterface {
+public:
+    struct Stats {
+        //! Number of templates assembled from scratch.
+        uint64_t rebuilds{0};
+        //! Number of templates updated incrementally.
+        uint64_t updates{0};
+        //! Number of transactions appended to and dropped from the templates
+        //! by the updates.
+        uint64_t txs_added{0};
+        uint64_t txs_removed{0};
+        //! Total time spent assembling from scratch and updating, in
+        //! microseconds.
+        int64_t rebuild_time{0};
+        int64_t update_time{0};
+        //! Time spent by the last assembly from scratch or update, in
+        //! microseconds.
+        int64_t last_time{0};
+    };
+
+    IncrementalBlockAssembler(const Config &config, ChainstateManager &chainman,
+                              const CTxMemPool &mempool);
+
+    /**
+     * Bring the template up to date and return a copy of it, with coinbase to
+     * scriptPubKeyIn.
+     */
+    std::unique_ptr<CBlockTemplate>
+    GetBlockTemplate(const CScript &scriptPubKeyIn)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    Stats GetStats() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+protected:
+    void TransactionAddedToMempool(const CTransactionRef &tx,
+                                   uint64_t mempool_sequence) override
+        EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+    void TransactionRemovedFromMempool(const CTransactionRef &tx,
+                                       MemPoolRemovalReason reason,
+                                       uint64_t mempool_sequence) override
+        EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+private:
+    const Config &m_config;
+    ChainstateManager &m_chainman;
+    const CTxMemPool &m_mempool;
+
+    mutable Mutex m_mutex;
+
+    //! Transactions added to and removed from the mempool since the last
+    //! update, in the order of the notifications.
+    std::vector<TxId> m_added GUARDED_BY(m_mutex);
+    std::vector<TxId> m_removed GUARDED_BY(m_mutex);
+
+    //! Template as last assembled from scratch, for its header.
+    std::unique_ptr<CBlockTemplate> m_template GUARDED_BY(m_mutex);
+    //! Tip the template builds on.
+    const CBlockIndex *m_tip GUARDED_BY(m_mutex){nullptr};
+    //! Non-coinbase transactions of the template, in canonical order.
+    std::map<TxId, CBlockTemplateEntry> m_entries GUARDED_BY(m_mutex);
+    uint64_t m_block_size GUARDED_BY(m_mutex){0};
+    uint64_t m_block_sigchecks GUARDED_BY(m_mutex){0};
+    Amount m_fees GUARDED_BY(m_mutex);
+    //! Whether some added transactions could not be appended.
+    bool m_stale GUARDED_BY(m_mutex){false};
+    int64_t m_last_rebuild GUARDED_BY(m_mutex){0};
+    int64_t m_lock_time_cutoff GUARDED_BY(m_mutex){0};
+
+    //! Limits of the last BlockAssembler.
+    uint64_t m_max_block_size GUARDED_BY(m_mutex){0};
+    uint64_t m_max_block_sigchecks GUARDED_BY(m_mutex){0};
+    CFeeRate m_block_min_fee_rate GUARDED_BY(m_mutex);
+
+    Stats m_stats GUARDED_BY(m_mutex);
+
+    void Rebuild(CChainState &chainstate, const CScript &scriptPubKeyIn)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs, m_mutex);
+    void Update() EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs, m_mutex);
+    void Drop(std::map<TxId, CBlockTemplateEntry>::iterator it)
+        EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    /** Try to append an added transaction, returns false if it did not fit */
+    bool Append(const TxId &txid)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs, m_mutex);
+};
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock *pblock, const CBlockIndex *pindexPrev,
                          uint64_t nExcessiveBlockSize,
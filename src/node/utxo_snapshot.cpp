@@ -0,0 +1,167 @@
+// Copyright (c) 2022 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/utxo_snapshot.h>
+
+#include <clientversion.h>
+#include <hash.h>
+#include <logging.h>
+#include <streams.h>
+#include <util/thread.h>
+
+#include <iterator>
+#include <limits>
+
+namespace node {
+
+SnapshotChunk SnapshotChunk::Encode(const SnapshotCoinsBatch &coins) {
+    SnapshotChunk chunk;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, chunk.m_payload, 0);
+    WriteCompactSize(writer, coins.size());
+
+    auto it = coins.begin();
+    while (it != coins.end()) {
+        // A group holds the following coins of the same txid, as long as
+        // their output indices are increasing.
+        auto group_end = std::next(it);
+        while (group_end != coins.end() &&
+               group_end->first.GetTxId() == it->first.GetTxId() &&
+               group_end->first.GetN() > std::prev(group_end)->first.GetN()) {
+            ++group_end;
+        }
+
+        writer << it->first.GetTxId();
+        WriteCompactSize(writer, std::distance(it, group_end));
+        uint32_t next_n = 0;
+        for (; it != group_end; ++it) {
+            const uint32_t gap = it->first.GetN() - next_n;
+            writer << VARINT(gap) << it->second;
+            next_n = it->first.GetN() + 1;
+        }
+    }
+
+    chunk.m_checksum = Hash(chunk.m_payload);
+    return chunk;
+}
+
+bool SnapshotChunk::IsValid() const {
+    return Hash(m_payload) == m_checksum;
+}
+
+void SnapshotChunk::Decode(SnapshotCoinsBatch &coins) const {
+    CDataStream reader(m_payload, SER_DISK, CLIENT_VERSION);
+    uint64_t coins_left = ReadCompactSize(reader, false);
+    // Every coin takes more than one byte, so this bounds the allocation
+    // whatever count the chunk claims.
+    if (coins_left > reader.size()) {
+        throw std::ios_base::failure("Invalid snapshot chunk coins count");
+    }
+    coins.reserve(coins.size() + coins_left);
+
+    while (coins_left > 0) {
+        TxId txid;
+        reader >> txid;
+        const uint64_t group_size = ReadCompactSize(reader, false);
+        if (group_size == 0 || group_size > coins_left) {
+            throw std::ios_base::failure("Invalid snapshot chunk group size");
+        }
+        coins_left -= group_size;
+
+        uint64_t next_n = 0;
+        for (uint64_t i = 0; i < group_size; ++i) {
+            uint32_t gap;
+            Coin coin;
+            reader >> VARINT(gap) >> coin;
+            const uint64_t n = next_n + gap;
+            if (n > std::numeric_limits<uint32_t>::max()) {
+                throw std::ios_base::failure(
+                    "Invalid snapshot chunk output index");
+            }
+            coins.emplace_back(COutPoint(txid, uint32_t(n)), std::move(coin));
+            next_n = n + 1;
+        }
+    }
+
+    if (!reader.empty()) {
+        throw std::ios_base::failure("Unexpected data after snapshot chunk");
+    }
+}
+
+bool SnapshotCoinsQueue::Push(
+    std::shared_ptr<const SnapshotCoinsBatch> batch) {
+    WAIT_LOCK(m_mutex, lock);
+    m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+        return m_aborted || m_batches.size() < MAX_PENDING;
+    });
+    if (m_aborted) {
+        return false;
+    }
+    m_batches.push_back(std::move(batch));
+    m_cv.notify_all();
+    return true;
+}
+
+std::shared_ptr<const SnapshotCoinsBatch> SnapshotCoinsQueue::Pop() {
+    WAIT_LOCK(m_mutex, lock);
+    m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+        return m_aborted || m_closed || !m_batches.empty();
+    });
+    if (m_aborted || m_batches.empty()) {
+        return nullptr;
+    }
+    std::shared_ptr<const SnapshotCoinsBatch> batch =
+        std::move(m_batches.front());
+    m_batches.pop_front();
+    m_cv.notify_all();
+    return batch;
+}
+
+void SnapshotCoinsQueue::Close() {
+    LOCK(m_mutex);
+    m_closed = true;
+    m_cv.notify_all();
+}
+
+void SnapshotCoinsQueue::Abort() {
+    LOCK(m_mutex);
+    m_aborted = true;
+    m_cv.notify_all();
+}
+
+SnapshotChunkWriter::SnapshotChunkWriter(CAutoFile &file) {
+    m_thread = std::thread(&util::TraceThread, "snapshotwrite", [this, &file] {
+        while (auto batch = m_queue.Pop()) {
+            try {
+                file << SnapshotChunk::Encode(*batch);
+            } catch (const std::ios_base::failure &e) {
+                LogPrintf("[snapshot] failed to write snapshot chunk: %s\n",
+                          e.what());
+                m_write_ok = false;
+                m_queue.Abort();
+            }
+        }
+    });
+}
+
+SnapshotChunkWriter::~SnapshotChunkWriter() {
+    m_queue.Abort();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+bool SnapshotChunkWriter::Push(
+    std::shared_ptr<const SnapshotCoinsBatch> batch) {
+    return m_queue.Push(std::move(batch));
+}
+
+bool SnapshotChunkWriter::Finish() {
+    m_queue.Close();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    return m_write_ok;
+}
+
+} // namespace node
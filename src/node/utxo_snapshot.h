@@ -6,10 +6,37 @@
 #ifndef BITCOIN_NODE_UTXO_SNAPSHOT_H
 #define BITCOIN_NODE_UTXO_SNAPSHOT_H
 
+#include <coins.h>
 #include <primitives/blockhash.h>
+#include <primitives/transaction.h>
 #include <serialize.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <ios>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class CAutoFile;
 
 namespace node {
+//! Bytes identifying a UTXO snapshot file.
+static constexpr std::array<uint8_t, 5> SNAPSHOT_MAGIC_BYTES = {
+    {'u', 't', 'x', 'o', 0xff}};
+
+/**
+ * Version of the UTXO snapshot format. Version 1 snapshots were a plain
+ * stream of outpoint and coin pairs without any header, version 2 snapshots
+ * store the coins grouped by txid in checksummed chunks.
+ */
+static constexpr uint16_t SNAPSHOT_VERSION = 2;
+
 //! Metadata describing a serialized version of a UTXO set from which an
 //! assumeutxo CChainState can be constructed.
 class SnapshotMetadata {
@@ -27,10 +54,116 @@ public:
                      uint64_t nchaintx)
         : m_base_blockhash(base_blockhash), m_coins_count(coins_count) {}
 
-    SERIALIZE_METHODS(SnapshotMetadata, obj) {
-        READWRITE(obj.m_base_blockhash, obj.m_coins_count);
+    template <typename Stream> void Serialize(Stream &s) const {
+        s << SNAPSHOT_MAGIC_BYTES << SNAPSHOT_VERSION << m_base_blockhash
+          << m_coins_count;
+    }
+
+    template <typename Stream> void Unserialize(Stream &s) {
+        std::array<uint8_t, SNAPSHOT_MAGIC_BYTES.size()> magic;
+        s >> magic;
+        if (magic != SNAPSHOT_MAGIC_BYTES) {
+            throw std::ios_base::failure("Invalid UTXO snapshot magic bytes");
+        }
+        uint16_t version;
+        s >> version;
+        if (version != SNAPSHOT_VERSION) {
+            throw std::ios_base::failure("Unsupported UTXO snapshot version");
+        }
+        s >> m_base_blockhash >> m_coins_count;
+    }
+};
+
+//! Coins of a UTXO snapshot, in the order they are stored.
+using SnapshotCoinsBatch = std::vector<std::pair<COutPoint, Coin>>;
+
+//! Number of coins after which the snapshot writer starts a new chunk, at the
+//! next txid boundary.
+static constexpr size_t SNAPSHOT_CHUNK_COINS = 10000;
+
+/**
+ * The coins of a UTXO snapshot are stored in a sequence of chunks following
+ * the metadata. Each chunk is checksummed and can be verified and decoded on
+ * its own, independently of the chunks around it.
+ *
+ * The payload of a chunk holds the number of coins it contains, followed by
+ * groups of coins sharing a txid: the txid, the number of coins in the group,
+ * then for each coin the gap between its output index and the previous one
+ * followed by the coin itself, using the compressed coin serialization.
+ */
+class SnapshotChunk {
+public:
+    std::vector<uint8_t> m_payload;
+    //! Double SHA256 of the payload.
+    uint256 m_checksum;
+
+    //! Encode coins into a new chunk, in the order they are given.
+    static SnapshotChunk Encode(const SnapshotCoinsBatch &coins);
+
+    //! Whether the payload matches the checksum.
+    bool IsValid() const;
+
+    /**
+     * Decode the coins of the chunk, appending them to coins. Throws
+     * std::ios_base::failure if the payload is malformed.
+     */
+    void Decode(SnapshotCoinsBatch &coins) const;
+
+    SERIALIZE_METHODS(SnapshotChunk, obj) {
+        READWRITE(obj.m_payload, obj.m_checksum);
     }
 };
+
+/**
+ * Queue of batches of snapshot coins, handed over from a producer thread to a
+ * consumer thread. The producer blocks while MAX_PENDING batches are waiting,
+ * which bounds the memory used whatever the snapshot size.
+ */
+class SnapshotCoinsQueue {
+public:
+    static constexpr size_t MAX_PENDING = 8;
+
+    //! Returns false if the queue was aborted.
+    bool Push(std::shared_ptr<const SnapshotCoinsBatch> batch);
+
+    //! Returns nullptr once the queue is closed and empty, or aborted.
+    std::shared_ptr<const SnapshotCoinsBatch> Pop();
+
+    //! No more batches will be pushed.
+    void Close();
+
+    //! Make any pending or further Push() and Pop() fail.
+    void Abort();
+
+private:
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::shared_ptr<const SnapshotCoinsBatch>>
+        m_batches GUARDED_BY(m_mutex);
+    bool m_closed GUARDED_BY(m_mutex){false};
+    bool m_aborted GUARDED_BY(m_mutex){false};
+};
+
+/**
+ * Encodes chunks of snapshot coins and writes them to a file on a background
+ * thread, while the caller keeps reading coins from the database.
+ */
+class SnapshotChunkWriter {
+public:
+    explicit SnapshotChunkWriter(CAutoFile &file);
+    ~SnapshotChunkWriter();
+
+    //! Returns false if writing failed.
+    bool Push(std::shared_ptr<const SnapshotCoinsBatch> batch);
+
+    //! Wait for all the chunks to be written. Returns false if writing failed.
+    bool Finish();
+
+private:
+    SnapshotCoinsQueue m_queue;
+    bool m_write_ok{true};
+    std::thread m_thread;
+};
 } // namespace node
 
 #endif // BITCOIN_NODE_UTXO_SNAPSHOT_H
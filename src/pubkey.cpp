@@ -224,6 +224,41 @@ bool CPubKey::VerifySchnorr(const uint256 &hash,
     return VerifySchnorr(hash, sig);
 }
 
+bool CPubKey::VerifySchnorrBatch(
+    const std::vector<CPubKey> &pubkeys, const std::vector<uint256> &hashes,
+    const std::vector<std::array<uint8_t, SCHNORR_SIZE>> &sigs) {
+    assert(pubkeys.size() == hashes.size() && pubkeys.size() == sigs.size());
+    assert(secp256k1_context_verify &&
+           "secp256k1_context_verify must be initialized to use CPubKey.");
+
+    const size_t count = pubkeys.size();
+    std::vector<secp256k1_pubkey> parsed(count);
+    std::vector<const secp256k1_pubkey *> pubkey_ptrs(count);
+    std::vector<const uint8_t *> hash_ptrs(count);
+    std::vector<const uint8_t *> sig_ptrs(count);
+    for (size_t i = 0; i < count; i++) {
+        if (!pubkeys[i].IsValid() ||
+            !secp256k1_ec_pubkey_parse(secp256k1_context_verify, &parsed[i],
+                                       pubkeys[i].data(), pubkeys[i].size())) {
+            return false;
+        }
+        pubkey_ptrs[i] = &parsed[i];
+        hash_ptrs[i] = hashes[i].begin();
+        sig_ptrs[i] = sigs[i].data();
+    }
+
+    // Large enough for the multi-multiplication of a full chunk of
+    // signatures to use the fastest algorithm.
+    static constexpr size_t SCRATCH_SIZE = 256 * 1024;
+    secp256k1_scratch_space *scratch =
+        secp256k1_scratch_space_create(secp256k1_context_verify, SCRATCH_SIZE);
+    const int ret = secp256k1_schnorr_verify_batch(
+        secp256k1_context_verify, scratch, sig_ptrs.data(), hash_ptrs.data(),
+        pubkey_ptrs.data(), count);
+    secp256k1_scratch_space_destroy(secp256k1_context_verify, scratch);
+    return ret;
+}
+
 bool CPubKey::RecoverCompact(const uint256 &hash,
                              const std::vector<uint8_t> &vchSig) {
     if (vchSig.size() != COMPACT_SIGNATURE_SIZE) {
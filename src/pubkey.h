@@ -174,6 +174,18 @@ public:
     bool VerifySchnorr(const uint256 &hash,
                        const std::vector<uint8_t> &vchSig) const;
 
+    /**
+     * Verify a batch of Schnorr signatures at once, which is significantly
+     * faster than verifying them one by one. sigs[i] is checked against
+     * pubkeys[i] and hashes[i]; all three vectors must have the same size.
+     * Returns true iff all the signatures are valid, but doesn't tell which
+     * one is invalid otherwise.
+     */
+    static bool
+    VerifySchnorrBatch(const std::vector<CPubKey> &pubkeys,
+                       const std::vector<uint256> &hashes,
+                       const std::vector<std::array<uint8_t, SCHNORR_SIZE>> &sigs);
+
     /**
      * Check whether a DER-serialized ECDSA signature is normalized (lower-S).
      */
@@ -33,7 +33,7 @@
 using node::GetTransaction;
 using node::IsBlockPruned;
 using node::NodeContext;
-using node::ReadBlockFromDisk;
+using node::ReadRawBlockFromDisk;
 
 // Allow a max of 15 outpoints to be queried at once.
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15;
@@ -295,15 +295,18 @@ static bool rest_block(const Config &config, const std::any &context,
 
     const BlockHash hash(rawHash);
 
-    CBlock block;
+    // The binary and hex formats are served from the raw block data.
+    const bool raw = rf == RetFormat::BINARY || rf == RetFormat::HEX;
+    std::vector<uint8_t> block_data;
+    std::shared_ptr<const CBlock> block;
     CBlockIndex *pblockindex = nullptr;
     CBlockIndex *tip = nullptr;
+    ChainstateManager *maybe_chainman = GetChainman(context, req);
+    if (!maybe_chainman) {
+        return false;
+    }
+    ChainstateManager &chainman = *maybe_chainman;
     {
-        ChainstateManager *maybe_chainman = GetChainman(context, req);
-        if (!maybe_chainman) {
-            return false;
-        }
-        ChainstateManager &chainman = *maybe_chainman;
         LOCK(cs_main);
         tip = chainman.ActiveTip();
         pblockindex = chainman.m_blockman.LookupBlockIndex(hash);
@@ -316,36 +319,38 @@ static bool rest_block(const Config &config, const std::any &context,
                            hashStr + " not available (pruned data)");
         }
 
-        if (!ReadBlockFromDisk(block, pblockindex,
-                               config.GetChainParams().GetConsensus())) {
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        if (raw) {
+            if (!ReadRawBlockFromDisk(block_data, pblockindex,
+                                      config.GetChainParams().DiskMagic())) {
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            }
+        } else {
+            block = chainman.m_blockman.ReadBlock(
+                pblockindex, config.GetChainParams().GetConsensus());
+            if (!block) {
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            }
         }
     }
 
     switch (rf) {
         case RetFormat::BINARY: {
-            CDataStream ssBlock(SER_NETWORK,
-                                PROTOCOL_VERSION | RPCSerializationFlags());
-            ssBlock << block;
-            std::string binaryBlock = ssBlock.str();
+            std::string binaryBlock(block_data.begin(), block_data.end());
             req->WriteHeader("Content-Type", "application/octet-stream");
             req->WriteReply(HTTP_OK, binaryBlock);
             return true;
         }
 
         case RetFormat::HEX: {
-            CDataStream ssBlock(SER_NETWORK,
-                                PROTOCOL_VERSION | RPCSerializationFlags());
-            ssBlock << block;
-            std::string strHex = HexStr(ssBlock) + "\n";
+            std::string strHex = HexStr(block_data) + "\n";
             req->WriteHeader("Content-Type", "text/plain");
             req->WriteReply(HTTP_OK, strHex);
             return true;
         }
 
         case RetFormat::JSON: {
-            UniValue objBlock =
-                blockToJSON(block, tip, pblockindex, showTxDetails);
+            UniValue objBlock = blockToJSON(chainman.m_blockman, *block, tip,
+                                            pblockindex, showTxDetails);
             std::string strJSON = objBlock.write() + "\n";
             req->WriteHeader("Content-Type", "application/json");
             req->WriteReply(HTTP_OK, strJSON);
@@ -53,9 +53,11 @@ using node::CoinStatsHashType;
 using node::GetUTXOStats;
 using node::IsBlockPruned;
 using node::NodeContext;
-using node::ReadBlockFromDisk;
+using node::ReadRawBlockFromDisk;
+using node::SNAPSHOT_CHUNK_COINS;
+using node::SnapshotChunkWriter;
+using node::SnapshotCoinsBatch;
 using node::SnapshotMetadata;
-using node::UndoReadFromDisk;
 
 struct CUpdatedBlock {
     BlockHash hash;
@@ -164,21 +166,22 @@ UniValue blockheaderToJSON(const CBlockIndex *tip,
     return result;
 }
 
-UniValue blockToJSON(const CBlock &block, const CBlockIndex *tip,
-                     const CBlockIndex *blockindex, bool txDetails) {
+UniValue blockToJSON(BlockManager &blockman, const CBlock &block,
+                     const CBlockIndex *tip, const CBlockIndex *blockindex,
+                     bool txDetails) {
     UniValue result = blockheaderToJSON(tip, blockindex);
 
     result.pushKV("size", (int)::GetSerializeSize(block, PROTOCOL_VERSION));
     UniValue txs(UniValue::VARR);
     if (txDetails) {
-        CBlockUndo blockUndo;
-        const bool have_undo = !IsBlockPruned(blockindex) &&
-                               UndoReadFromDisk(blockUndo, blockindex);
+        const std::shared_ptr<const CBlockUndo> blockUndo =
+            IsBlockPruned(blockindex) ? nullptr
+                                      : blockman.ReadBlockUndo(blockindex);
         for (size_t i = 0; i < block.vtx.size(); ++i) {
             const CTransactionRef &tx = block.vtx.at(i);
             // coinbase transaction (i == 0) doesn't have undo data
             const CTxUndo *txundo =
-                (have_undo && i) ? &blockUndo.vtxundo.at(i - 1) : nullptr;
+                (blockUndo && i) ? &blockUndo->vtxundo.at(i - 1) : nullptr;
             UniValue objTx(UniValue::VOBJ);
             TxToUniv(*tx, BlockHash(), objTx, true, RPCSerializationFlags(),
                      txundo);
@@ -1064,15 +1067,16 @@ static RPCHelpMan getblockheader() {
     };
 }
 
-static CBlock GetBlockChecked(const Config &config,
-                              const CBlockIndex *pblockindex) {
-    CBlock block;
+static std::shared_ptr<const CBlock>
+GetBlockChecked(BlockManager &blockman, const Config &config,
+                const CBlockIndex *pblockindex) {
     if (IsBlockPruned(pblockindex)) {
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
     }
 
-    if (!ReadBlockFromDisk(block, pblockindex,
-                           config.GetChainParams().GetConsensus())) {
+    std::shared_ptr<const CBlock> block = blockman.ReadBlock(
+        pblockindex, config.GetChainParams().GetConsensus());
+    if (!block) {
         // Block not found on disk. This could be because we have the block
         // header in our index but not yet have the block or did not accept the
         // block.
@@ -1082,14 +1086,31 @@ static CBlock GetBlockChecked(const Config &config,
     return block;
 }
 
-static CBlockUndo GetUndoChecked(const CBlockIndex *pblockindex) {
-    CBlockUndo blockUndo;
+static std::vector<uint8_t>
+GetRawBlockChecked(const Config &config, const CBlockIndex *pblockindex) {
+    std::vector<uint8_t> data;
+    if (IsBlockPruned(pblockindex)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+    }
+
+    if (!ReadRawBlockFromDisk(data, pblockindex,
+                              config.GetChainParams().DiskMagic())) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+    }
+
+    return data;
+}
+
+static std::shared_ptr<const CBlockUndo>
+GetUndoChecked(BlockManager &blockman, const CBlockIndex *pblockindex) {
     if (IsBlockPruned(pblockindex)) {
         throw JSONRPCError(RPC_MISC_ERROR,
                            "Undo data not available (pruned data)");
     }
 
-    if (!UndoReadFromDisk(blockUndo, pblockindex)) {
+    std::shared_ptr<const CBlockUndo> blockUndo =
+        blockman.ReadBlockUndo(pblockindex);
+    if (!blockUndo) {
         throw JSONRPCError(RPC_MISC_ERROR, "Can't read undo data from disk");
     }
 
@@ -1203,12 +1224,12 @@ static RPCHelpMan getblock() {
                 }
             }
 
-            CBlock block;
+            std::shared_ptr<const CBlock> block;
+            std::vector<uint8_t> block_data;
             const CBlockIndex *pblockindex;
             const CBlockIndex *tip;
+            ChainstateManager &chainman = EnsureAnyChainman(request.context);
             {
-                ChainstateManager &chainman =
-                    EnsureAnyChainman(request.context);
                 LOCK(cs_main);
                 pblockindex = chainman.m_blockman.LookupBlockIndex(hash);
                 tip = chainman.ActiveTip();
@@ -1218,18 +1239,20 @@ static RPCHelpMan getblock() {
                                        "Block not found");
                 }
 
-                block = GetBlockChecked(config, pblockindex);
+                if (verbosity <= 0) {
+                    block_data = GetRawBlockChecked(config, pblockindex);
+                } else {
+                    block = GetBlockChecked(chainman.m_blockman, config,
+                                            pblockindex);
+                }
             }
 
             if (verbosity <= 0) {
-                CDataStream ssBlock(SER_NETWORK,
-                                    PROTOCOL_VERSION | RPCSerializationFlags());
-                ssBlock << block;
-                std::string strHex = HexStr(ssBlock);
-                return strHex;
+                return HexStr(block_data);
             }
 
-            return blockToJSON(block, tip, pblockindex, verbosity >= 2);
+            return blockToJSON(chainman.m_blockman, *block, tip, pblockindex,
+                               verbosity >= 2);
         },
     };
 }
@@ -2433,6 +2456,62 @@ RPCHelpMan unparkblock() {
     };
 }
 
+template <typename T>
+static UniValue BlockDataCacheToJSON(node::BlockDataCache<T> &cache) {
+    const typename node::BlockDataCache<T>::Stats stats = cache.GetStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("entries", uint64_t(stats.entries));
+    ret.pushKV("usage", uint64_t(stats.usage));
+    ret.pushKV("maxusage", uint64_t(stats.max_usage));
+    ret.pushKV("hits", stats.hits);
+    ret.pushKV("misses", stats.misses);
+    return ret;
+}
+
+static std::vector<RPCResult> BlockDataCacheDescription() {
+    return {
+        {RPCResult::Type::NUM, "entries", "Number of cached entries"},
+        {RPCResult::Type::NUM, "usage",
+         "Memory used by the cached entries, in bytes"},
+        {RPCResult::Type::NUM, "maxusage",
+         "Maximum memory used by the cached entries, in bytes"},
+        {RPCResult::Type::NUM, "hits",
+         "Number of reads served from the cache since startup"},
+        {RPCResult::Type::NUM, "misses",
+         "Number of reads not found in the cache since startup"},
+    };
+}
+
+static RPCHelpMan getblockcacheinfo() {
+    return RPCHelpMan{
+        "getblockcacheinfo",
+        "Returns details about the caches of recently read blocks and undo "
+        "data, which are shared by the RPC, REST, P2P and index code.\n",
+        {},
+        RPCResult{RPCResult::Type::OBJ,
+                  "",
+                  "",
+                  {
+                      {RPCResult::Type::OBJ, "blocks", "The block cache",
+                       BlockDataCacheDescription()},
+                      {RPCResult::Type::OBJ, "undo", "The undo data cache",
+                       BlockDataCacheDescription()},
+                  }},
+        RPCExamples{HelpExampleCli("getblockcacheinfo", "") +
+                    HelpExampleRpc("getblockcacheinfo", "")},
+        [&](const RPCHelpMan &self, const Config &config,
+            const JSONRPCRequest &request) -> UniValue {
+            ChainstateManager &chainman = EnsureAnyChainman(request.context);
+            UniValue ret(UniValue::VOBJ);
+            ret.pushKV("blocks",
+                       BlockDataCacheToJSON(chainman.m_blockman.m_block_cache));
+            ret.pushKV("undo",
+                       BlockDataCacheToJSON(chainman.m_blockman.m_undo_cache));
+            return ret;
+        },
+    };
+}
+
 static RPCHelpMan getchaintxstats() {
     return RPCHelpMan{
         "getchaintxstats",
@@ -2674,8 +2753,12 @@ static RPCHelpMan getblockstats() {
                 }
             }
 
-            const CBlock block = GetBlockChecked(config, pindex);
-            const CBlockUndo blockUndo = GetUndoChecked(pindex);
+            const std::shared_ptr<const CBlock> pblock =
+                GetBlockChecked(chainman.m_blockman, config, pindex);
+            const std::shared_ptr<const CBlockUndo> pblockUndo =
+                GetUndoChecked(chainman.m_blockman, pindex);
+            const CBlock &block = *pblock;
+            const CBlockUndo &blockUndo = *pblockUndo;
 
             // Calculate everything if nothing selected (default)
             const bool do_all = stats.size() == 0;
@@ -3366,6 +3449,10 @@ UniValue CreateUTXOSnapshot(NodeContext &node, CChainState &chainstate,
 
     afile << metadata;
 
+    // The chunks are encoded and written on a background thread while the
+    // coins database is being read.
+    SnapshotChunkWriter writer(afile);
+    auto batch = std::make_shared<SnapshotCoinsBatch>();
     COutPoint key;
     Coin coin;
     unsigned int iter{0};
@@ -3376,13 +3463,27 @@ UniValue CreateUTXOSnapshot(NodeContext &node, CChainState &chainstate,
         }
         ++iter;
         if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            afile << key;
-            afile << coin;
+            // Only start a new chunk at a txid boundary, so the coins of a
+            // transaction are grouped together.
+            if (batch->size() >= SNAPSHOT_CHUNK_COINS &&
+                key.GetTxId() != batch->back().first.GetTxId()) {
+                if (!writer.Push(std::move(batch))) {
+                    throw JSONRPCError(RPC_MISC_ERROR,
+                                       "Unable to write UTXO snapshot");
+                }
+                batch = std::make_shared<SnapshotCoinsBatch>();
+            }
+            batch->emplace_back(key, std::move(coin));
         }
 
         pcursor->Next();
     }
 
+    if ((!batch->empty() && !writer.Push(std::move(batch))) ||
+        !writer.Finish()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write UTXO snapshot");
+    }
+
     afile.fclose();
 
     UniValue result(UniValue::VOBJ);
@@ -3399,6 +3500,7 @@ void RegisterBlockchainRPCCommands(CRPCTable &t) {
         //  ------------------  ----------------------
         { "blockchain",         getbestblockhash,                  },
         { "blockchain",         getblock,                          },
+        { "blockchain",         getblockcacheinfo,                 },
         { "blockchain",         getblockfrompeer,                  },
         { "blockchain",         getblockchaininfo,                 },
         { "blockchain",         getblockcount,                     },
@@ -19,6 +19,7 @@ class ChainstateManager;
 class CTxMemPool;
 class RPCHelpMan;
 namespace node {
+class BlockManager;
 struct NodeContext;
 } // namespace node
 
@@ -38,9 +39,9 @@ double GetDifficulty(const CBlockIndex *blockindex);
 void RPCNotifyBlockChange(const CBlockIndex *pindex);
 
 /** Block description to JSON */
-UniValue blockToJSON(const CBlock &block, const CBlockIndex *tip,
-                     const CBlockIndex *blockindex, bool txDetails = false)
-    LOCKS_EXCLUDED(cs_main);
+UniValue blockToJSON(node::BlockManager &blockman, const CBlock &block,
+                     const CBlockIndex *tip, const CBlockIndex *blockindex,
+                     bool txDetails = false) LOCKS_EXCLUDED(cs_main);
 
 /** Mempool information to JSON */
 UniValue MempoolInfoToJSON(const CTxMemPool &pool);
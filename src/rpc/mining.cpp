@@ -11,9 +11,11 @@
 #include <consensus/activation.h>
 #include <consensus/amount.h>
 #include <consensus/consensus.h>
+#include <consensus/merkle.h>
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <hash.h>
 #include <key_io.h>
 #include <minerfund.h>
 #include <net.h>
@@ -29,6 +31,7 @@
 #include <script/descriptor.h>
 #include <script/script.h>
 #include <shutdown.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <univalue.h>
 #include <util/strencodings.h>
@@ -37,13 +40,18 @@
 #include <util/translation.h>
 #include <validation.h>
 #include <validationinterface.h>
+#include <version.h>
 #include <warnings.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <deque>
+#include <optional>
 
 using node::BlockAssembler;
 using node::CBlockTemplate;
 using node::IncrementExtraNonce;
+using node::IncrementalBlockAssembler;
 using node::NodeContext;
 using node::UpdateTime;
 
@@ -523,6 +531,30 @@ static RPCHelpMan getmininginfo() {
                 {RPCResult::Type::NUM, "networkhashps",
                  "The network hashes per second"},
                 {RPCResult::Type::NUM, "pooledtx", "The size of the mempool"},
+                {RPCResult::Type::OBJ,
+                 "blocktemplate",
+                 /* optional */ true,
+                 "Statistics of the incrementally maintained block template "
+                 "(only present with -incrementalblocktemplate)",
+                 {
+                     {RPCResult::Type::NUM, "rebuilds",
+                      "The number of templates assembled from scratch"},
+                     {RPCResult::Type::NUM, "updates",
+                      "The number of templates updated incrementally"},
+                     {RPCResult::Type::NUM, "txsadded",
+                      "The number of transactions appended by the updates"},
+                     {RPCResult::Type::NUM, "txsremoved",
+                      "The number of transactions dropped by the updates"},
+                     {RPCResult::Type::NUM, "rebuildtime",
+                      "The total time spent assembling templates from "
+                      "scratch, in microseconds"},
+                     {RPCResult::Type::NUM, "updatetime",
+                      "The total time spent updating templates, in "
+                      "microseconds"},
+                     {RPCResult::Type::NUM, "lasttime",
+                      "The time spent on the last template, in "
+                      "microseconds"},
+                 }},
                 {RPCResult::Type::STR, "chain",
                  "current network name (main, test, regtest)"},
                 {RPCResult::Type::STR, "warnings",
@@ -552,6 +584,19 @@ static RPCHelpMan getmininginfo() {
             obj.pushKV("networkhashps",
                        getnetworkhashps().HandleRequest(config, request));
             obj.pushKV("pooledtx", uint64_t(mempool.size()));
+            if (node.block_template) {
+                const IncrementalBlockAssembler::Stats stats =
+                    node.block_template->GetStats();
+                UniValue blocktemplate(UniValue::VOBJ);
+                blocktemplate.pushKV("rebuilds", stats.rebuilds);
+                blocktemplate.pushKV("updates", stats.updates);
+                blocktemplate.pushKV("txsadded", stats.txs_added);
+                blocktemplate.pushKV("txsremoved", stats.txs_removed);
+                blocktemplate.pushKV("rebuildtime", stats.rebuild_time);
+                blocktemplate.pushKV("updatetime", stats.update_time);
+                blocktemplate.pushKV("lasttime", stats.last_time);
+                obj.pushKV("blocktemplate", blocktemplate);
+            }
             obj.pushKV("chain", config.GetChainParams().NetworkIDString());
             obj.pushKV("warnings", GetWarnings(false).original);
             return obj;
@@ -630,6 +675,65 @@ static UniValue BIP22ValidationResult(const Config &config,
     return "valid?";
 }
 
+/**
+ * Number of templates returned by getblocktemplate which are remembered, so
+ * that a client holding one of them can request only the changes from it.
+ */
+static constexpr size_t MAX_BLOCK_TEMPLATE_HISTORY = 10;
+
+namespace {
+struct BlockTemplateTxs {
+    uint256 id;
+    BlockHash hashPrevBlock;
+    //! Non-coinbase transactions of the template, sorted by txid.
+    std::vector<TxId> txids;
+};
+} // namespace
+
+static std::deque<BlockTemplateTxs>
+    g_block_template_history GUARDED_BY(cs_main);
+
+/**
+ * Remember the transactions of a new template, the last remembered one being
+ * the current template. The template id commits to the block it builds on and
+ * to its transactions.
+ */
+static void RememberBlockTemplate(const CBlock &block)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    BlockTemplateTxs entry;
+    entry.hashPrevBlock = block.hashPrevBlock;
+    entry.txids.reserve(block.vtx.size());
+    for (const CTransactionRef &tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            entry.txids.push_back(tx->GetId());
+        }
+    }
+    std::sort(entry.txids.begin(), entry.txids.end());
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << entry.hashPrevBlock << entry.txids;
+    entry.id = ss.GetHash();
+
+    if (!g_block_template_history.empty() &&
+        g_block_template_history.back().id == entry.id) {
+        return;
+    }
+    g_block_template_history.push_back(std::move(entry));
+    if (g_block_template_history.size() > MAX_BLOCK_TEMPLATE_HISTORY) {
+        g_block_template_history.pop_front();
+    }
+}
+
+static const BlockTemplateTxs *FindBlockTemplate(const uint256 &id)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    for (const BlockTemplateTxs &entry : g_block_template_history) {
+        if (entry.id == id) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
 static RPCHelpMan getblocktemplate() {
     return RPCHelpMan{
         "getblocktemplate",
@@ -672,6 +776,15 @@ static RPCHelpMan getblocktemplate() {
                           "'serverlist', 'workid'"},
                      },
                  },
+                 {"templateid", RPCArg::Type::STR_HEX,
+                  RPCArg::Optional::OMITTED_NAMED_ARG,
+                  "The templateid of a template previously returned. If it is "
+                  "still known and builds on the same block, only the "
+                  "transactions added to and removed from it are returned"},
+                 {"encoding", RPCArg::Type::STR, /* default */ "\"json\"",
+                  "\"json\" to return the transactions as a JSON array, or "
+                  "\"binary\" to return them as a single serialized blob in "
+                  "'txdata'"},
              },
              "\"template_request\""},
         },
@@ -690,10 +803,22 @@ static RPCHelpMan getblocktemplate() {
                      "The preferred block version"},
                     {RPCResult::Type::STR, "previousblockhash",
                      "The hash of current highest block"},
+                    {RPCResult::Type::STR_HEX, "templateid",
+                     "identifier of the transactions of this template, to "
+                     "request only the changes from it"},
+                    {RPCResult::Type::STR_HEX, "basetemplateid",
+                     /* optional */ true,
+                     "if the requested templateid is known, the template the "
+                     "'transactions' and 'removed' fields are relative to. The "
+                     "transactions of this template are then those of the "
+                     "base template minus the removed ones plus the added "
+                     "ones, in canonical (txid) order"},
                     {RPCResult::Type::ARR,
                      "transactions",
+                     /* optional */ true,
                      "contents of non-coinbase transactions that should be "
-                     "included in the next block",
+                     "included in the next block, or that were added to the "
+                     "base template; not present with binary encoding",
                      {
                          {RPCResult::Type::OBJ,
                           "",
@@ -741,6 +866,27 @@ static RPCHelpMan getblocktemplate() {
                                "zero"},
                           }},
                      }},
+                    {RPCResult::Type::ARR,
+                     "removed",
+                     /* optional */ true,
+                     "transactions removed from the base template; only "
+                     "present along with basetemplateid and json encoding",
+                     {
+                         {RPCResult::Type::STR_HEX, "", "The transaction id"},
+                     }},
+                    {RPCResult::Type::STR_HEX, "txdata", /* optional */ true,
+                     "with binary encoding, the compact size prefixed list of "
+                     "the txids removed from the base template, followed by "
+                     "the compact size prefixed list of the transactions "
+                     "otherwise listed in 'transactions', each serialized "
+                     "followed by its fee and sigchecks as 64 bits integers"},
+                    {RPCResult::Type::ARR,
+                     "merklebranch",
+                     "merkle branch of the coinbase transaction, to compute "
+                     "the merkle root from the coinbase txid",
+                     {
+                         {RPCResult::Type::STR_HEX, "", "hash"},
+                     }},
                     {RPCResult::Type::OBJ,
                      "coinbaseaux",
                      "data that should be included in the coinbase's scriptSig "
@@ -813,12 +959,31 @@ static RPCHelpMan getblocktemplate() {
             const JSONRPCRequest &request) -> UniValue {
             NodeContext &node = EnsureAnyNodeContext(request.context);
             ChainstateManager &chainman = EnsureChainman(node);
+
+            // The incrementally maintained template, if any, learns about the
+            // mempool changes through the validation interface queue. Let it
+            // catch up with the changes counted so far before building from
+            // it, and return their count so that the template is not cached
+            // against changes it has not seen.
+            auto sync_block_template = [&]() {
+                AssertLockNotHeld(cs_main);
+                const CTxMemPool &pool = EnsureMemPool(node);
+                const unsigned int updated =
+                    WITH_LOCK(cs_main, return pool.GetTransactionsUpdated());
+                if (node.block_template) {
+                    SyncWithValidationInterfaceQueue();
+                }
+                return updated;
+            };
+            unsigned int nTransactionsUpdatedSynced = sync_block_template();
             LOCK(cs_main);
 
             const CChainParams &chainparams = config.GetChainParams();
 
             std::string strMode = "template";
             UniValue lpval = NullUniValue;
+            std::optional<uint256> base_template_id;
+            bool binary_encoding = false;
             std::set<std::string> setClientRules;
             CChainState &active_chainstate = chainman.ActiveChainstate();
             CChain &active_chain = active_chainstate.m_chain;
@@ -834,6 +999,21 @@ static RPCHelpMan getblocktemplate() {
                 }
                 lpval = find_value(oparam, "longpollid");
 
+                const UniValue &templateidval =
+                    find_value(oparam, "templateid");
+                if (!templateidval.isNull()) {
+                    base_template_id = ParseHashV(templateidval, "templateid");
+                }
+                const UniValue &encodingval = find_value(oparam, "encoding");
+                if (encodingval.isStr() && encodingval.get_str() == "binary") {
+                    binary_encoding = true;
+                } else if (!encodingval.isNull() &&
+                           !(encodingval.isStr() &&
+                             encodingval.get_str() == "json")) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER,
+                                       "Invalid encoding");
+                }
+
                 if (strMode == "proposal") {
                     const UniValue &dataval = find_value(oparam, "data");
                     if (!dataval.isStr()) {
@@ -938,6 +1118,7 @@ static RPCHelpMan getblocktemplate() {
                         }
                     }
                 }
+                nTransactionsUpdatedSynced = sync_block_template();
                 ENTER_CRITICAL_SECTION(cs_main);
 
                 if (!IsRPCRunning()) {
@@ -948,32 +1129,39 @@ static RPCHelpMan getblocktemplate() {
                 // send an expires-immediately template to stop miners?
             }
 
-            // Update block
+            // Update block. The incrementally maintained template, if any, is
+            // cheap to bring up to date and does not need to be rate limited.
             static CBlockIndex *pindexPrev;
             static int64_t nStart;
             static std::unique_ptr<CBlockTemplate> pblocktemplate;
             if (pindexPrev != active_chain.Tip() ||
                 (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
-                 GetTime() - nStart > 5)) {
+                 (node.block_template || GetTime() - nStart > 5))) {
                 // Clear pindexPrev so future calls make a new block, despite
                 // any failures from here on
                 pindexPrev = nullptr;
 
                 // Store the pindexBest used before CreateNewBlock, to avoid
                 // races
-                nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+                nTransactionsUpdatedLast =
+                    node.block_template ? nTransactionsUpdatedSynced
+                                        : mempool.GetTransactionsUpdated();
                 CBlockIndex *pindexPrevNew = active_chain.Tip();
                 nStart = GetTime();
 
                 // Create new block
                 CScript scriptDummy = CScript() << OP_TRUE;
                 pblocktemplate =
-                    BlockAssembler(config, active_chainstate, mempool)
-                        .CreateNewBlock(scriptDummy);
+                    node.block_template
+                        ? node.block_template->GetBlockTemplate(scriptDummy)
+                        : BlockAssembler(config, active_chainstate, mempool)
+                              .CreateNewBlock(scriptDummy);
                 if (!pblocktemplate) {
                     throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
                 }
 
+                RememberBlockTemplate(pblocktemplate->block);
+
                 // Need to update only after we know CreateNewBlock succeeded
                 pindexPrev = pindexPrevNew;
             }
@@ -981,6 +1169,32 @@ static RPCHelpMan getblocktemplate() {
             CHECK_NONFATAL(pindexPrev);
             // pointer for convenience
             CBlock *pblock = &pblocktemplate->block;
+            const Consensus::Params &consensusParams =
+                chainparams.GetConsensus();
+
+            CHECK_NONFATAL(!g_block_template_history.empty());
+            const BlockTemplateTxs &current = g_block_template_history.back();
+
+            // Only return the changes from the template the client holds, if
+            // it builds on the same block. The client relies on the canonical
+            // transaction ordering to put the transactions back in order.
+            const BlockTemplateTxs *base = nullptr;
+            if (base_template_id &&
+                IsMagneticAnomalyEnabled(consensusParams, pindexPrev)) {
+                base = FindBlockTemplate(*base_template_id);
+                if (base && base->hashPrevBlock != current.hashPrevBlock) {
+                    base = nullptr;
+                }
+            }
+            std::vector<TxId> removed;
+            if (base) {
+                for (const TxId &txid : base->txids) {
+                    if (!std::binary_search(current.txids.begin(),
+                                            current.txids.end(), txid)) {
+                        removed.push_back(txid);
+                    }
+                }
+            }
 
             // Update nTime
             UpdateTime(pblock, chainparams, pindexPrev);
@@ -996,6 +1210,7 @@ static RPCHelpMan getblocktemplate() {
 
             UniValue transactions(UniValue::VARR);
             transactions.reserve(pblock->vtx.size());
+            std::vector<int> binary_entries;
             int index_in_template = 0;
             for (const auto &it : pblock->vtx) {
                 const CTransaction &tx = *it;
@@ -1011,6 +1226,18 @@ static RPCHelpMan getblocktemplate() {
                     continue;
                 }
 
+                if (base && std::binary_search(base->txids.begin(),
+                                               base->txids.end(), txId)) {
+                    index_in_template++;
+                    continue;
+                }
+
+                if (binary_encoding) {
+                    binary_entries.push_back(index_in_template);
+                    index_in_template++;
+                    continue;
+                }
+
                 UniValue entry(UniValue::VOBJ);
                 entry.reserve(printSigops ? 6 : 5);
                 entry.__pushKV("data", EncodeHexTx(tx));
@@ -1033,8 +1260,6 @@ static RPCHelpMan getblocktemplate() {
             UniValue aux(UniValue::VOBJ);
 
             UniValue minerFundList(UniValue::VARR);
-            const Consensus::Params &consensusParams =
-                chainparams.GetConsensus();
             for (auto fundDestination :
                  GetMinerFundWhitelist(consensusParams, pindexPrev)) {
                 minerFundList.push_back(
@@ -1068,7 +1293,35 @@ static RPCHelpMan getblocktemplate() {
             result.pushKV("version", pblock->nVersion);
 
             result.pushKV("previousblockhash", pblock->hashPrevBlock.GetHex());
-            result.pushKV("transactions", transactions);
+            result.pushKV("templateid", current.id.GetHex());
+            if (base) {
+                result.pushKV("basetemplateid", base->id.GetHex());
+            }
+            if (binary_encoding) {
+                CDataStream ssTxs(SER_NETWORK, PROTOCOL_VERSION);
+                ssTxs << removed;
+                WriteCompactSize(ssTxs, binary_entries.size());
+                for (const int index : binary_entries) {
+                    const auto &entry = pblocktemplate->entries[index];
+                    ssTxs << *entry.tx << entry.fees << entry.sigChecks;
+                }
+                result.pushKV("txdata", HexStr(ssTxs));
+            } else {
+                result.pushKV("transactions", transactions);
+                if (base) {
+                    UniValue removedTxs(UniValue::VARR);
+                    removedTxs.reserve(removed.size());
+                    for (const TxId &txid : removed) {
+                        removedTxs.push_back(txid.GetHex());
+                    }
+                    result.pushKV("removed", removedTxs);
+                }
+            }
+            UniValue merkleBranch(UniValue::VARR);
+            for (const uint256 &hash : BlockCoinbaseMerkleBranch(*pblock)) {
+                merkleBranch.push_back(hash.GetHex());
+            }
+            result.pushKV("merklebranch", merkleBranch);
             result.pushKV("coinbaseaux", aux);
             result.pushKV("coinbasetxn", coinbasetxn);
             result.pushKV("coinbasevalue", int64_t(coinbasevalue / SATOSHI));
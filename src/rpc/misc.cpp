@@ -25,6 +25,7 @@
 #include <util/message.h> // For MessageSign(), MessageVerify()
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <validation.h>
 
 #include <univalue.h>
 
@@ -536,6 +537,18 @@ static UniValue RPCLockedMemoryInfo() {
     return obj;
 }
 
+static UniValue RPCBlockIndexMemoryInfo(ChainstateManager &chainman) {
+    LOCK(cs_main);
+    const size_t entries = chainman.m_blockman.m_block_index.size();
+    const size_t usage = chainman.m_blockman.GetBlockIndexMemoryUsage();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("entries", uint64_t(entries));
+    obj.pushKV("usage", uint64_t(usage));
+    obj.pushKV("bytes_per_entry",
+               uint64_t(entries == 0 ? 0 : usage / entries));
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo() {
     char *ptr = nullptr;
@@ -595,6 +608,17 @@ static RPCHelpMan getmemoryinfo() {
                          {RPCResult::Type::NUM, "chunks_free",
                           "Number unused chunks"},
                      }},
+                    {RPCResult::Type::OBJ,
+                     "blockindex",
+                     "Information about the block index",
+                     {
+                         {RPCResult::Type::NUM, "entries",
+                          "Number of block index entries"},
+                         {RPCResult::Type::NUM, "usage",
+                          "Number of bytes used by the block index"},
+                         {RPCResult::Type::NUM, "bytes_per_entry",
+                          "Average number of bytes used by each entry"},
+                     }},
                 }},
             RPCResult{"mode \"mallocinfo\"", RPCResult::Type::STR, "",
                       "\"<malloc version=\"1\">...\""},
@@ -609,6 +633,9 @@ static RPCHelpMan getmemoryinfo() {
             if (mode == "stats") {
                 UniValue obj(UniValue::VOBJ);
                 obj.pushKV("locked", RPCLockedMemoryInfo());
+                obj.pushKV("blockindex",
+                           RPCBlockIndexMemoryInfo(
+                               EnsureAnyChainman(request.context)));
                 return obj;
             } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
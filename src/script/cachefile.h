@@ -0,0 +1,103 @@
+// Copyright (c) 2022 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SCRIPT_CACHEFILE_H
+#define BITCOIN_SCRIPT_CACHEFILE_H
+
+#include <clientversion.h>
+#include <fs.h>
+#include <hash.h>
+#include <logging.h>
+#include <streams.h>
+#include <uint256.h>
+#include <util/system.h>
+
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * The signature and script execution caches are saved to the datadir on
+ * shutdown and loaded back on startup, so that the transactions which were
+ * in the mempool don't have their scripts verified again when they get mined
+ * after a restart.
+ *
+ * The cache entries are salted with a secret nonce, which is saved along with
+ * them. A cached result is only trusted by the client version which produced
+ * it, and the file is protected by a checksum: a file which fails any of
+ * these checks is ignored and the cache starts empty.
+ */
+static const uint64_t SCRIPT_CACHE_FILE_VERSION = 1;
+
+template <typename Entry>
+bool WriteCacheFile(const fs::path &path, const uint256 &nonce,
+                    const std::vector<Entry> &entries) {
+    fs::path path_tmp = path;
+    path_tmp += ".new";
+    try {
+        CAutoFile file(fsbridge::fopen(path_tmp, "wb"), SER_DISK,
+                       CLIENT_VERSION);
+        if (file.IsNull()) {
+            return false;
+        }
+
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        hasher << SCRIPT_CACHE_FILE_VERSION << int32_t(CLIENT_VERSION)
+               << nonce << entries;
+        file << SCRIPT_CACHE_FILE_VERSION << int32_t(CLIENT_VERSION) << nonce
+             << entries << hasher.GetHash();
+
+        if (!FileCommit(file.Get())) {
+            throw std::runtime_error("FileCommit failed");
+        }
+        file.fclose();
+        if (!RenameOver(path_tmp, path)) {
+            throw std::runtime_error("Rename failed");
+        }
+    } catch (const std::exception &e) {
+        LogPrintf("Failed to write %s: %s. Continuing anyway.\n",
+                  fs::PathToString(path), e.what());
+        return false;
+    }
+    return true;
+}
+
+template <typename Entry>
+bool ReadCacheFile(const fs::path &path, uint256 &nonce,
+                   std::vector<Entry> &entries) {
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return false;
+    }
+
+    try {
+        CHashVerifier<CAutoFile> verifier(&file);
+        uint64_t version;
+        int32_t client_version;
+        verifier >> version >> client_version;
+        if (version != SCRIPT_CACHE_FILE_VERSION ||
+            client_version != CLIENT_VERSION) {
+            LogPrintf("Ignoring %s written by another client version\n",
+                      fs::PathToString(path));
+            return false;
+        }
+
+        verifier >> nonce >> entries;
+
+        uint256 checksum;
+        file >> checksum;
+        if (checksum != verifier.GetHash()) {
+            throw std::runtime_error("Checksum mismatch, data corrupted");
+        }
+    } catch (const std::exception &e) {
+        LogPrintf("Failed to read %s: %s. Continuing anyway.\n",
+                  fs::PathToString(path), e.what());
+        entries.clear();
+        return false;
+    }
+    return true;
+}
+
+#endif // BITCOIN_SCRIPT_CACHEFILE_H
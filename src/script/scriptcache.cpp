@@ -8,6 +8,7 @@
 #include <cuckoocache.h>
 #include <primitives/transaction.h>
 #include <random.h>
+#include <script/cachefile.h>
 #include <script/sigcache.h>
 #include <sync.h>
 #include <util/system.h>
@@ -34,6 +35,10 @@ struct ScriptCacheElement {
         : key(keyIn), nSigChecks(nSigChecksIn) {}
 
     const KeyType &getKey() const { return key; }
+
+    SERIALIZE_METHODS(ScriptCacheElement, obj) {
+        READWRITE(obj.key, obj.nSigChecks);
+    }
 };
 
 static_assert(sizeof(ScriptCacheElement) == 32,
@@ -71,16 +76,22 @@ public:
 
 static CuckooCache::cache<ScriptCacheElement, ScriptCacheHasher>
     g_scriptExecutionCache;
+static uint256 g_scriptExecutionCacheNonce;
 static CSHA256 g_scriptExecutionCacheHasher;
 
-void InitScriptExecutionCache() {
-    // Setup the salted hasher
-    uint256 nonce = GetRandHash();
+static void SetScriptExecutionCacheNonce(const uint256 &nonce) {
+    g_scriptExecutionCacheNonce = nonce;
     // We want the nonce to be 64 bytes long to force the hasher to process
     // this chunk, which makes later hash computations more efficient. We
     // just write our 32-byte entropy twice to fill the 64 bytes.
+    g_scriptExecutionCacheHasher.Reset();
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
+}
+
+void InitScriptExecutionCache() {
+    // Setup the salted hasher
+    SetScriptExecutionCacheNonce(GetRandHash());
     // nMaxCacheSize is unsigned. If -maxscriptcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
     size_t nMaxCacheSize =
@@ -95,6 +106,42 @@ void InitScriptExecutionCache() {
               (nElems * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nElems);
 }
 
+static fs::path GetScriptExecutionCachePath() {
+    return gArgs.GetDataDirNet() / "scriptcache.dat";
+}
+
+bool DumpScriptExecutionCache() {
+    AssertLockHeld(cs_main);
+
+    std::vector<ScriptCacheElement> entries;
+    g_scriptExecutionCache.for_each(
+        [&](const ScriptCacheElement &elem) { entries.push_back(elem); });
+    if (!WriteCacheFile(GetScriptExecutionCachePath(),
+                        g_scriptExecutionCacheNonce, entries)) {
+        return false;
+    }
+    LogPrintf("Dumped %u script execution cache entries to disk\n",
+              entries.size());
+    return true;
+}
+
+bool LoadScriptExecutionCache() {
+    AssertLockHeld(cs_main);
+
+    uint256 nonce;
+    std::vector<ScriptCacheElement> entries;
+    if (!ReadCacheFile(GetScriptExecutionCachePath(), nonce, entries)) {
+        return false;
+    }
+    SetScriptExecutionCacheNonce(nonce);
+    for (const ScriptCacheElement &elem : entries) {
+        g_scriptExecutionCache.insert(elem);
+    }
+    LogPrintf("Loaded %u script execution cache entries from disk\n",
+              entries.size());
+    return true;
+}
+
 ScriptCacheKey::ScriptCacheKey(const CTransaction &tx, uint32_t flags) {
     std::array<uint8_t, 32> hash;
     CSHA256 hasher = g_scriptExecutionCacheHasher;
@@ -8,6 +8,7 @@
 #include <array>
 #include <cstdint>
 
+#include <serialize.h>
 #include <sync.h>
 
 // Actually declared in validation.cpp; can't include because of circular
@@ -39,6 +40,8 @@ public:
         return rhs.data == data;
     }
 
+    SERIALIZE_METHODS(ScriptCacheKey, obj) { READWRITE(obj.data); }
+
     friend class ScriptCacheHasher;
 };
 
@@ -52,6 +55,16 @@ static const int64_t MAX_MAX_SCRIPT_CACHE_SIZE = 16384;
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+/** Save the script execution cache to the datadir. */
+bool DumpScriptExecutionCache() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/**
+ * Load the script execution cache saved by DumpScriptExecutionCache(), if
+ * any. To be called right after InitScriptExecutionCache(), as the keys
+ * computed before the load are invalidated.
+ */
+bool LoadScriptExecutionCache() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /**
  * Check if a given key is in the cache, and if so, return its values.
  * (if not found, nSigChecks may or may not be set to an arbitrary value)
@@ -6,9 +6,12 @@
 #include <script/sigcache.h>
 
 #include <cuckoocache.h>
+#include <logging.h>
 #include <pubkey.h>
 #include <random.h>
+#include <script/cachefile.h>
 #include <uint256.h>
+#include <util/strencodings.h>
 #include <util/system.h>
 
 #include <boost/thread/lock_types.hpp>
@@ -24,6 +27,7 @@ namespace {
 class CSignatureCache {
 private:
     //! Entries are SHA256(nonce || signature hash || public key || signature):
+    uint256 m_nonce;
     CSHA256 m_salted_hasher;
     typedef CuckooCache::cache<CuckooCache::KeyOnly<uint256>,
                                SignatureCacheHasher>
@@ -31,16 +35,19 @@ private:
     map_type setValid;
     boost::shared_mutex cs_sigcache;
 
-public:
-    CSignatureCache() {
-        uint256 nonce = GetRandHash();
+    void SetNonce(const uint256 &nonce) {
+        m_nonce = nonce;
         // We want the nonce to be 64 bytes long to force the hasher to process
         // this chunk, which makes later hash computations more efficient. We
         // just write our 32-byte entropy twice to fill the 64 bytes.
+        m_salted_hasher.Reset();
         m_salted_hasher.Write(nonce.begin(), 32);
         m_salted_hasher.Write(nonce.begin(), 32);
     }
 
+public:
+    CSignatureCache() { SetNonce(GetRandHash()); }
+
     void ComputeEntry(uint256 &entry, const uint256 &hash,
                       const std::vector<uint8_t> &vchSig,
                       const CPubKey &pubkey) {
@@ -60,7 +67,31 @@ public:
         boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
         setValid.insert(entry);
     }
-    uint32_t setup_bytes(size_t n) { return setValid.setup_bytes(n); }
+    uint32_t setup_bytes(size_t n) {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        // Entries salted with the previous nonce can't be hit anymore.
+        SetNonce(GetRandHash());
+        return setValid.setup_bytes(n);
+    }
+
+    void Dump(uint256 &nonce, std::vector<uint256> &entries) {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = m_nonce;
+        setValid.for_each(
+            [&](const uint256 &entry) { entries.push_back(entry); });
+    }
+
+    /**
+     * Insert entries salted with the given nonce, which replaces the current
+     * one. Must not run concurrently with any signature check.
+     */
+    void Load(const uint256 &nonce, const std::vector<uint256> &entries) {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        SetNonce(nonce);
+        for (const uint256 &entry : entries) {
+            setValid.insert(entry);
+        }
+    }
 };
 
 /**
@@ -90,6 +121,32 @@ void InitSignatureCache() {
               (nElems * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nElems);
 }
 
+static fs::path GetSignatureCachePath() {
+    return gArgs.GetDataDirNet() / "sigcache.dat";
+}
+
+bool DumpSignatureCache() {
+    uint256 nonce;
+    std::vector<uint256> entries;
+    signatureCache.Dump(nonce, entries);
+    if (!WriteCacheFile(GetSignatureCachePath(), nonce, entries)) {
+        return false;
+    }
+    LogPrintf("Dumped %u signature cache entries to disk\n", entries.size());
+    return true;
+}
+
+bool LoadSignatureCache() {
+    uint256 nonce;
+    std::vector<uint256> entries;
+    if (!ReadCacheFile(GetSignatureCachePath(), nonce, entries)) {
+        return false;
+    }
+    signatureCache.Load(nonce, entries);
+    LogPrintf("Loaded %u signature cache entries from disk\n", entries.size());
+    return true;
+}
+
 template <typename F>
 bool RunMemoizedCheck(const std::vector<uint8_t> &vchSig, const CPubKey &pubkey,
                       const uint256 &sighash, bool storeOrErase, const F &fun) {
@@ -114,9 +171,68 @@ bool CachingTransactionSignatureChecker::IsCached(
                             [] { return false; });
 }
 
+void SchnorrSignatureBatch::Add(const std::vector<uint8_t> &vchSig,
+                                const CPubKey &pubkey, const uint256 &sighash,
+                                std::optional<uint256> cache_entry) {
+    assert(vchSig.size() == CPubKey::SCHNORR_SIZE);
+    m_pubkeys.push_back(pubkey);
+    m_sighashes.push_back(sighash);
+    m_sigs.emplace_back();
+    std::copy(vchSig.begin(), vchSig.end(), m_sigs.back().begin());
+    if (cache_entry) {
+        m_cache_entries.push_back(*cache_entry);
+    }
+}
+
+bool SchnorrSignatureBatch::Verify() {
+    if (m_sigs.empty()) {
+        return true;
+    }
+
+    bool fOk = CPubKey::VerifySchnorrBatch(m_pubkeys, m_sighashes, m_sigs);
+    if (!fOk) {
+        // The batch doesn't tell which signature is invalid, so find out by
+        // checking them one by one.
+        fOk = true;
+        for (size_t i = 0; i < m_sigs.size(); i++) {
+            if (!m_pubkeys[i].VerifySchnorr(m_sighashes[i], m_sigs[i])) {
+                LogPrint(BCLog::VALIDATION,
+                         "Invalid Schnorr signature in batch for pubkey %s, "
+                         "sighash %s\n",
+                         HexStr(m_pubkeys[i]), m_sighashes[i].ToString());
+                fOk = false;
+                break;
+            }
+        }
+    }
+
+    if (fOk) {
+        for (const uint256 &entry : m_cache_entries) {
+            signatureCache.Set(entry);
+        }
+    }
+
+    m_pubkeys.clear();
+    m_sighashes.clear();
+    m_sigs.clear();
+    m_cache_entries.clear();
+    return fOk;
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(
     const std::vector<uint8_t> &vchSig, const CPubKey &pubkey,
     const uint256 &sighash) const {
+    if (m_batch && vchSig.size() == CPubKey::SCHNORR_SIZE) {
+        uint256 entry;
+        signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
+        if (signatureCache.Get(entry, !store)) {
+            return true;
+        }
+        m_batch->Add(vchSig, pubkey, sighash,
+                     store ? std::make_optional(entry) : std::nullopt);
+        return true;
+    }
+
     return RunMemoizedCheck(vchSig, pubkey, sighash, store, [&] {
         return TransactionSignatureChecker::VerifySignature(vchSig, pubkey,
                                                             sighash);
@@ -6,9 +6,13 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include <pubkey.h>
 #include <script/interpreter.h>
+#include <uint256.h>
 #include <util/hasher.h>
 
+#include <array>
+#include <optional>
 #include <vector>
 
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
@@ -17,12 +21,45 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIGCACHE = true;
 
-class CPubKey;
+/**
+ * Schnorr signatures whose verification has been deferred by a
+ * CachingTransactionSignatureChecker, so that they can be verified all at
+ * once. The ones that were meant to be stored in the signature cache are
+ * added to it when they are found to be valid.
+ */
+class SchnorrSignatureBatch {
+private:
+    std::vector<CPubKey> m_pubkeys;
+    std::vector<uint256> m_sighashes;
+    std::vector<std::array<uint8_t, CPubKey::SCHNORR_SIZE>> m_sigs;
+    //! Signature cache entries to add if the batch is valid
+    std::vector<uint256> m_cache_entries;
+
+public:
+    /**
+     * Defer the verification of a Schnorr signature. If cache_entry is set,
+     * it is added to the signature cache once the signature is verified.
+     */
+    void Add(const std::vector<uint8_t> &vchSig, const CPubKey &pubkey,
+             const uint256 &sighash, std::optional<uint256> cache_entry);
+
+    size_t size() const { return m_sigs.size(); }
+
+    /**
+     * Verify all the signatures in the batch. If the batch verification
+     * fails, the signatures are verified individually, which is the
+     * authoritative result. The batch is emptied in any case.
+     */
+    bool Verify();
+};
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker {
 private:
     bool store;
+    SchnorrSignatureBatch *m_batch;
 
     bool IsCached(const std::vector<uint8_t> &vchSig, const CPubKey &vchPubKey,
                   const uint256 &sighash) const;
@@ -31,10 +68,18 @@ public:
     CachingTransactionSignatureChecker(const CTransaction *txToIn,
                                        unsigned int nInIn,
                                        const Amount amountIn, bool storeIn,
-                                       PrecomputedTransactionData &txdataIn)
+                                       PrecomputedTransactionData &txdataIn,
+                                       SchnorrSignatureBatch *batchIn = nullptr)
         : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn),
-          store(storeIn) {}
+          store(storeIn), m_batch(batchIn) {}
 
+    /**
+     * If a batch is provided, Schnorr signatures which are not cached are
+     * added to it and assumed to be valid. This is only sound if any invalid
+     * signature makes the script fail, i.e. SCRIPT_VERIFY_NULLFAIL is
+     * enforced, and if the batch is verified before the script is deemed
+     * valid.
+     */
     bool VerifySignature(const std::vector<uint8_t> &vchSig,
                          const CPubKey &vchPubKey,
                          const uint256 &sighash) const override;
@@ -44,4 +89,13 @@ public:
 
 void InitSignatureCache();
 
+/** Save the signature cache to the datadir. */
+bool DumpSignatureCache();
+
+/**
+ * Load the signature cache saved by DumpSignatureCache(), if any. To be called
+ * right after InitSignatureCache(), before any signature gets checked.
+ */
+bool LoadSignatureCache();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
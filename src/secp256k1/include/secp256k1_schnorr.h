@@ -28,6 +28,36 @@ SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_schnorr_verify(
   const secp256k1_pubkey *pubkey
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4);
 
+/**
+ * Verify a batch of signatures created by secp256k1_schnorr_sign.
+ *
+ * This is significantly faster than verifying the signatures one by one, but
+ * does not tell which signature is incorrect when the batch fails.
+ *
+ * Returns: 1: all the signatures are correct
+ *          0: at least one signature is incorrect
+ * Args:    ctx:       a secp256k1 context object, initialized for verification.
+ *          scratch:   scratch space used for the multi-multiplication. If
+ *                     NULL or too small, a slower algorithm is used.
+ * In:      sig64:     array of n pointers to 64-byte signatures (cannot be NULL
+ *                     unless n is 0)
+ *          msghash32: array of n pointers to the 32-byte message hashes being
+ *                     verified (cannot be NULL unless n is 0). See
+ *                     secp256k1_schnorr_verify for restrictions on the
+ *                     message hashes.
+ *          pubkey:    array of n pointers to the public keys to verify with
+ *                     (cannot be NULL unless n is 0)
+ *          n:         the number of signatures to verify
+ */
+SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_schnorr_verify_batch(
+  const secp256k1_context* ctx,
+  secp256k1_scratch_space *scratch,
+  const unsigned char *const *sig64,
+  const unsigned char *const *msghash32,
+  const secp256k1_pubkey *const *pubkey,
+  size_t n
+) SECP256K1_ARG_NONNULL(1);
+
 /**
  * Create a signature using a custom EC-Schnorr-SHA256 construction. It
  * produces non-malleable 64-byte signatures which support batch validation,
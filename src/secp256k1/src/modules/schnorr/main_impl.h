@@ -30,6 +30,41 @@ int secp256k1_schnorr_verify(
     return secp256k1_schnorr_sig_verify(&ctx->ecmult_ctx, sig64, &q, msghash32);
 }
 
+int secp256k1_schnorr_verify_batch(
+    const secp256k1_context* ctx,
+    secp256k1_scratch_space *scratch,
+    const unsigned char *const *sig64,
+    const unsigned char *const *msghash32,
+    const secp256k1_pubkey *const *pubkey,
+    size_t n
+) {
+    secp256k1_ge q[SECP256K1_SCHNORR_BATCH_SIZE];
+    size_t i, j, chunk;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(n == 0 || msghash32 != NULL);
+    ARG_CHECK(n == 0 || sig64 != NULL);
+    ARG_CHECK(n == 0 || pubkey != NULL);
+
+    for (i = 0; i < n; i += chunk) {
+        chunk = n - i < SECP256K1_SCHNORR_BATCH_SIZE ? n - i : SECP256K1_SCHNORR_BATCH_SIZE;
+        for (j = 0; j < chunk; j++) {
+            ARG_CHECK(msghash32[i + j] != NULL);
+            ARG_CHECK(sig64[i + j] != NULL);
+            ARG_CHECK(pubkey[i + j] != NULL);
+            if (!secp256k1_pubkey_load(ctx, &q[j], pubkey[i + j])) {
+                return 0;
+            }
+        }
+
+        if (!secp256k1_schnorr_sig_verify_batch(&ctx->error_callback, &ctx->ecmult_ctx, scratch, sig64 + i, q, msghash32 + i, chunk)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 int secp256k1_schnorr_sign(
     const secp256k1_context *ctx,
     unsigned char *sig64,
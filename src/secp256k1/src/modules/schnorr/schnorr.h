@@ -9,6 +9,7 @@
 
 #include "scalar.h"
 #include "group.h"
+#include "scratch.h"
 
 static int secp256k1_schnorr_sig_verify(
     const secp256k1_ecmult_context* ctx,
@@ -17,6 +18,16 @@ static int secp256k1_schnorr_sig_verify(
     const unsigned char *msg32
 );
 
+static int secp256k1_schnorr_sig_verify_batch(
+    const secp256k1_callback* error_callback,
+    const secp256k1_ecmult_context* ctx,
+    secp256k1_scratch *scratch,
+    const unsigned char *const *sig64,
+    secp256k1_ge *pubkeys,
+    const unsigned char *const *msg32,
+    size_t n
+);
+
 static int secp256k1_schnorr_compute_e(
     secp256k1_scalar* res,
     const unsigned char *r,
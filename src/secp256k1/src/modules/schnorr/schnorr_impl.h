@@ -98,6 +98,121 @@ static int secp256k1_schnorr_sig_verify(
     return 1;
 }
 
+/** Maximum number of signatures verified at once by
+ * secp256k1_schnorr_sig_verify_batch. */
+#define SECP256K1_SCHNORR_BATCH_SIZE 64
+
+typedef struct {
+    const secp256k1_scalar *scalars;
+    const secp256k1_ge *points;
+} secp256k1_schnorr_batch_ecmult_data;
+
+static int secp256k1_schnorr_batch_ecmult_callback(secp256k1_scalar *sc, secp256k1_ge *pt, size_t idx, void *data) {
+    const secp256k1_schnorr_batch_ecmult_data *batch = (const secp256k1_schnorr_batch_ecmult_data *)data;
+    *sc = batch->scalars[idx];
+    *pt = batch->points[idx];
+    return 1;
+}
+
+/**
+ * Batch verification, using option 2 above on a random linear combination
+ * of the equations. With randomizers a_i, the batch is valid if:
+ *   sum(a_i * s_i) * G - sum(a_i * R_i) - sum(a_i * e_i * P_i) == 0
+ *
+ * The randomizers are derived from a hash of the whole batch so they cannot
+ * be predicted by whoever produced the signatures. a_0 is set to 1, which
+ * doesn't weaken the scheme.
+ */
+static int secp256k1_schnorr_sig_verify_batch(
+    const secp256k1_callback* error_callback,
+    const secp256k1_ecmult_context* ctx,
+    secp256k1_scratch *scratch,
+    const unsigned char *const *sig64,
+    secp256k1_ge *pubkeys,
+    const unsigned char *const *msg32,
+    size_t n
+) {
+    secp256k1_scalar scalars[2 * SECP256K1_SCHNORR_BATCH_SIZE];
+    secp256k1_ge points[2 * SECP256K1_SCHNORR_BATCH_SIZE];
+    secp256k1_schnorr_batch_ecmult_data data;
+    secp256k1_scalar s, e, a, sum_s;
+    secp256k1_fe Rx;
+    secp256k1_gej res;
+    secp256k1_sha256 sha;
+    unsigned char seed[32], buf[36];
+    size_t i, size;
+    int overflow;
+
+    VERIFY_CHECK(n <= SECP256K1_SCHNORR_BATCH_SIZE);
+
+    /* Seed the randomizers with the content of the batch. */
+    secp256k1_sha256_initialize(&sha);
+    for (i = 0; i < n; i++) {
+        secp256k1_sha256_write(&sha, sig64[i], 64);
+        secp256k1_sha256_write(&sha, msg32[i], 32);
+        secp256k1_eckey_pubkey_serialize(&pubkeys[i], buf, &size, 1);
+        VERIFY_CHECK(size == 33);
+        secp256k1_sha256_write(&sha, buf, 33);
+    }
+    secp256k1_sha256_finalize(&sha, seed);
+
+    secp256k1_scalar_set_int(&sum_s, 0);
+    for (i = 0; i < n; i++) {
+        /* Extract s */
+        overflow = 0;
+        secp256k1_scalar_set_b32(&s, sig64[i] + 32, &overflow);
+        if (overflow) {
+            return 0;
+        }
+
+        /* Extract R.x and decompress R, with R.y a quadratic residue. */
+        if (!secp256k1_fe_set_b32(&Rx, sig64[i])) {
+            return 0;
+        }
+        if (!secp256k1_ge_set_xquad(&points[2 * i], &Rx)) {
+            return 0;
+        }
+
+        /* Compute e */
+        secp256k1_schnorr_compute_e(&e, sig64[i], &pubkeys[i], msg32[i]);
+
+        /* Derive a_i = Hash(seed || i) */
+        if (i == 0) {
+            secp256k1_scalar_set_int(&a, 1);
+        } else {
+            memcpy(buf, seed, 32);
+            buf[32] = (i >> 24) & 0xff;
+            buf[33] = (i >> 16) & 0xff;
+            buf[34] = (i >> 8) & 0xff;
+            buf[35] = i & 0xff;
+            secp256k1_sha256_initialize(&sha);
+            secp256k1_sha256_write(&sha, buf, 36);
+            secp256k1_sha256_finalize(&sha, buf);
+            secp256k1_scalar_set_b32(&a, buf, NULL);
+        }
+
+        /* -a_i * R_i */
+        secp256k1_scalar_negate(&scalars[2 * i], &a);
+
+        /* -a_i * e_i * P_i */
+        points[2 * i + 1] = pubkeys[i];
+        secp256k1_scalar_mul(&e, &e, &a);
+        secp256k1_scalar_negate(&scalars[2 * i + 1], &e);
+
+        /* sum(a_i * s_i) */
+        secp256k1_scalar_mul(&s, &s, &a);
+        secp256k1_scalar_add(&sum_s, &sum_s, &s);
+    }
+
+    data.scalars = scalars;
+    data.points = points;
+    if (!secp256k1_ecmult_multi_var(error_callback, ctx, scratch, &res, &sum_s, secp256k1_schnorr_batch_ecmult_callback, &data, 2 * n)) {
+        return 0;
+    }
+
+    return secp256k1_gej_is_infinity(&res);
+}
+
 static int secp256k1_schnorr_compute_e(
     secp256k1_scalar* e,
     const unsigned char *r,
@@ -78,6 +78,57 @@ void test_schnorr_sign_verify(void) {
 
 #undef SIG_COUNT
 
+#define SIG_COUNT 100
+
+void test_schnorr_verify_batch(void) {
+    unsigned char privkey[32];
+    unsigned char msg32[SIG_COUNT][32];
+    unsigned char sig64[SIG_COUNT][64];
+    secp256k1_pubkey pubkey[SIG_COUNT];
+    const unsigned char *sigs[SIG_COUNT];
+    const unsigned char *msgs[SIG_COUNT];
+    const secp256k1_pubkey *pubkeys[SIG_COUNT];
+    secp256k1_scratch_space *scratch = secp256k1_scratch_space_create(ctx, 1024 * 1024);
+    int i, pos;
+
+    for (i = 0; i < SIG_COUNT; i++) {
+        secp256k1_scalar key;
+        random_scalar_order_test(&key);
+        secp256k1_scalar_get_b32(privkey, &key);
+        secp256k1_testrand256_test(msg32[i]);
+        CHECK(secp256k1_ec_pubkey_create(ctx, &pubkey[i], privkey) == 1);
+        CHECK(secp256k1_schnorr_sign(ctx, sig64[i], msg32[i], privkey, NULL, NULL) == 1);
+        sigs[i] = sig64[i];
+        msgs[i] = msg32[i];
+        pubkeys[i] = &pubkey[i];
+    }
+
+    /* Empty batches are valid. */
+    CHECK(secp256k1_schnorr_verify_batch(ctx, scratch, NULL, NULL, NULL, 0) == 1);
+
+    /* Valid batches, spanning several chunks or not, with and without scratch
+     * space. */
+    CHECK(secp256k1_schnorr_verify_batch(ctx, scratch, sigs, msgs, pubkeys, 1) == 1);
+    CHECK(secp256k1_schnorr_verify_batch(ctx, scratch, sigs, msgs, pubkeys, SIG_COUNT) == 1);
+    CHECK(secp256k1_schnorr_verify_batch(ctx, NULL, sigs, msgs, pubkeys, SIG_COUNT) == 1);
+
+    /* Corrupt a random signature, the whole batch must fail. */
+    i = secp256k1_testrand_int(SIG_COUNT);
+    pos = secp256k1_testrand_bits(6);
+    sig64[i][pos] ^= 1 + secp256k1_testrand_int(255);
+    CHECK(secp256k1_schnorr_verify(ctx, sig64[i], msg32[i], &pubkey[i]) == 0);
+    CHECK(secp256k1_schnorr_verify_batch(ctx, scratch, sigs, msgs, pubkeys, SIG_COUNT) == 0);
+    CHECK(secp256k1_schnorr_verify_batch(ctx, NULL, sigs, msgs, pubkeys, SIG_COUNT) == 0);
+    CHECK(secp256k1_schnorr_verify_batch(ctx, scratch, sigs + i, msgs + i, pubkeys + i, 1) == 0);
+
+    /* Swapping messages between two valid signatures must fail as well. */
+    CHECK(secp256k1_schnorr_verify_batch(ctx, scratch, sigs, msgs + 1, pubkeys, 1) == 0);
+
+    secp256k1_scratch_space_destroy(ctx, scratch);
+}
+
+#undef SIG_COUNT
+
 void run_schnorr_compact_test(void) {
     {
         /* Test vector 1 */
@@ -516,6 +567,7 @@ void run_schnorr_tests(void) {
     }
 
     test_schnorr_sign_verify();
+    test_schnorr_verify_batch();
     run_schnorr_compact_test();
 }
 
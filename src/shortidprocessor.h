@@ -92,6 +92,10 @@ public:
     size_t getItemCount() const { return itemsAvailable.size(); }
     /** Unique shortid count */
     size_t getShortIdCount() const { return shortIdIndexMap.size(); }
+    /** Whether the shortid matches one of the supplied ones */
+    bool hasShortId(uint64_t shortid) const {
+        return shortIdIndexMap.count(shortid) > 0;
+    }
 
     /**
      * Attempts to add a known item by matching its shortid with the supplied
@@ -7,6 +7,7 @@
 #define BITCOIN_STREAMS_H
 
 #include <serialize.h>
+#include <span.h>
 #include <support/allocators/zeroafterfree.h>
 
 #include <algorithm>
@@ -187,6 +188,56 @@ public:
     }
 };
 
+/**
+ * Minimal stream for reading from an existing span of bytes, such as a memory
+ * mapped file, without copying it.
+ */
+class SpanReader {
+private:
+    const int m_type;
+    const int m_version;
+    Span<const uint8_t> m_data;
+
+public:
+    /**
+     * @param[in]  type Serialization Type
+     * @param[in]  version Serialization Version (including any flags)
+     * @param[in]  data Referenced byte span to read from
+     */
+    SpanReader(int type, int version, Span<const uint8_t> data)
+        : m_type(type), m_version(version), m_data(data) {}
+
+    template <typename T> SpanReader &operator>>(T &&obj) {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return m_version; }
+    int GetType() const { return m_type; }
+
+    size_t size() const { return m_data.size(); }
+    bool empty() const { return m_data.empty(); }
+
+    void read(char *dst, size_t n) {
+        if (n == 0) {
+            return;
+        }
+        if (n > m_data.size()) {
+            throw std::ios_base::failure("SpanReader::read(): end of data");
+        }
+        memcpy(dst, m_data.data(), n);
+        m_data = m_data.subspan(n);
+    }
+
+    void ignore(size_t n) {
+        if (n > m_data.size()) {
+            throw std::ios_base::failure("SpanReader::ignore(): end of data");
+        }
+        m_data = m_data.subspan(n);
+    }
+};
+
 /**
  * Double ended buffer combining vector and stream-like interfaces.
  *
@@ -0,0 +1,229 @@
+// Copyright (c) 2022 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * A memory resource which hands out fixed size blocks of memory carved out of
+ * large chunks, and recycles freed blocks through per-size free lists.
+ *
+ * Node based containers such as std::unordered_map do one allocation per
+ * element. Serving them from a pool rather than from malloc avoids the
+ * allocator's per-allocation overhead and keeps the nodes close together in
+ * memory, which makes both inserting and looking elements up cheaper.
+ *
+ * Blocks of up to MAX_BLOCK_SIZE_BYTES bytes with an alignment of at most
+ * ALIGN_BYTES are served from the pool, anything else is forwarded to
+ * ::operator new. Memory handed to the free lists is never returned to the
+ * system before the resource is destroyed.
+ *
+ * The resource is not thread safe: all containers allocating from the same
+ * resource must be used from a single thread at a time.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource final {
+    //! Free blocks are linked together through their own memory.
+    struct ListNode {
+        ListNode *m_next;
+
+        explicit ListNode(ListNode *next) : m_next(next) {}
+    };
+
+    //! All blocks are aligned to (and sized in multiples of) this value.
+    static constexpr std::size_t ELEM_ALIGN_BYTES =
+        std::max(alignof(ListNode), ALIGN_BYTES);
+    static_assert((ELEM_ALIGN_BYTES & (ELEM_ALIGN_BYTES - 1)) == 0,
+                  "ELEM_ALIGN_BYTES must be a power of two");
+    static_assert(sizeof(ListNode) <= ELEM_ALIGN_BYTES,
+                  "Units of size ELEM_ALIGN_BYTES must fit a ListNode");
+    static_assert(MAX_BLOCK_SIZE_BYTES % ELEM_ALIGN_BYTES == 0,
+                  "MAX_BLOCK_SIZE_BYTES must be a multiple of the alignment");
+
+    //! Size of each chunk allocated from the system.
+    const std::size_t m_chunk_size_bytes;
+
+    //! All the chunks allocated so far, released by the destructor.
+    std::vector<std::byte *> m_allocated_chunks;
+
+    //! One free list per block size, indexed by the number of alignment units.
+    std::array<ListNode *, MAX_BLOCK_SIZE_BYTES / ELEM_ALIGN_BYTES + 1>
+        m_free_lists{};
+
+    //! Untouched memory left in the current chunk.
+    std::byte *m_available_memory_it{nullptr};
+    std::byte *m_available_memory_end{nullptr};
+
+    static constexpr std::size_t NumElemAlignBytes(std::size_t bytes) {
+        return (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES +
+               (bytes == 0);
+    }
+
+    static constexpr bool IsFreeListUsable(std::size_t bytes,
+                                           std::size_t alignment) {
+        return alignment <= ELEM_ALIGN_BYTES && bytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    void PlacementAddToList(void *p, ListNode *&node) {
+        node = new (p) ListNode{node};
+    }
+
+    void AllocateChunk() {
+        // Give whatever is left of the current chunk to the free lists, so it
+        // is not lost.
+        const std::size_t remaining_bytes =
+            m_available_memory_end - m_available_memory_it;
+        if (remaining_bytes != 0) {
+            PlacementAddToList(
+                m_available_memory_it,
+                m_free_lists[remaining_bytes / ELEM_ALIGN_BYTES]);
+        }
+
+        void *storage = ::operator new(m_chunk_size_bytes,
+                                       std::align_val_t{ELEM_ALIGN_BYTES});
+        m_available_memory_it = new (storage) std::byte[m_chunk_size_bytes];
+        m_available_memory_end = m_available_memory_it + m_chunk_size_bytes;
+        m_allocated_chunks.push_back(m_available_memory_it);
+    }
+
+public:
+    /**
+     * Construct a resource allocating chunks of chunk_size_bytes bytes. The
+     * first chunk is only allocated when it is needed.
+     */
+    explicit PoolResource(std::size_t chunk_size_bytes)
+        : m_chunk_size_bytes(NumElemAlignBytes(chunk_size_bytes) *
+                             ELEM_ALIGN_BYTES) {
+        assert(m_chunk_size_bytes >= MAX_BLOCK_SIZE_BYTES);
+    }
+
+    PoolResource() : PoolResource(256 * 1024) {}
+
+    PoolResource(const PoolResource &) = delete;
+    PoolResource &operator=(const PoolResource &) = delete;
+
+    ~PoolResource() {
+        for (std::byte *chunk : m_allocated_chunks) {
+            ::operator delete(static_cast<void *>(chunk),
+                              std::align_val_t{ELEM_ALIGN_BYTES});
+        }
+    }
+
+    void *Allocate(std::size_t bytes, std::size_t alignment) {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            return ::operator new(bytes, std::align_val_t{alignment});
+        }
+
+        const std::size_t num_alignments = NumElemAlignBytes(bytes);
+        if (m_free_lists[num_alignments] != nullptr) {
+            return std::exchange(m_free_lists[num_alignments],
+                                 m_free_lists[num_alignments]->m_next);
+        }
+
+        const std::size_t round_bytes = num_alignments * ELEM_ALIGN_BYTES;
+        if (round_bytes >
+            std::size_t(m_available_memory_end - m_available_memory_it)) {
+            AllocateChunk();
+        }
+        return std::exchange(m_available_memory_it,
+                             m_available_memory_it + round_bytes);
+    }
+
+    void Deallocate(void *p, std::size_t bytes,
+                    std::size_t alignment) noexcept {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            ::operator delete(p, std::align_val_t{alignment});
+            return;
+        }
+        PlacementAddToList(p, m_free_lists[NumElemAlignBytes(bytes)]);
+    }
+
+    std::size_t NumAllocatedChunks() const {
+        return m_allocated_chunks.size();
+    }
+
+    std::size_t ChunkSizeBytes() const { return m_chunk_size_bytes; }
+};
+
+/**
+ * Allocator serving memory from a PoolResource.
+ *
+ * The resource is shared by all the copies of the allocator, and lives as long
+ * as any container uses it. This lets a container be moved away from its
+ * owner together with its memory. A default constructed allocator creates a
+ * resource of its own.
+ */
+template <class T, std::size_t MAX_BLOCK_SIZE_BYTES,
+          std::size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator {
+public:
+    using value_type = T;
+    using ResourceType = PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>;
+    // Assigned containers adopt the pool of their source.
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    PoolAllocator() : m_resource(std::make_shared<ResourceType>()) {}
+
+    explicit PoolAllocator(std::shared_ptr<ResourceType> resource) noexcept
+        : m_resource(std::move(resource)) {}
+
+    // Moving an allocator leaves the source untouched, as the standard
+    // requires: a moved-from container must still be able to allocate.
+    PoolAllocator(const PoolAllocator &other) noexcept = default;
+    PoolAllocator &operator=(const PoolAllocator &other) noexcept = default;
+
+    template <class U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>
+                      &other) noexcept
+        : m_resource(other.resource()) {}
+
+    template <typename U> struct rebind {
+        using other = PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>;
+    };
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(
+            m_resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        m_resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    const std::shared_ptr<ResourceType> &resource() const noexcept {
+        return m_resource;
+    }
+
+private:
+    std::shared_ptr<ResourceType> m_resource;
+};
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES,
+          std::size_t ALIGN_BYTES>
+bool operator==(
+    const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &a,
+    const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &b) noexcept {
+    return a.resource() == b.resource();
+}
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES,
+          std::size_t ALIGN_BYTES>
+bool operator!=(
+    const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &a,
+    const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &b) noexcept {
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
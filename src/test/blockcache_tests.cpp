@@ -0,0 +1,113 @@
+// Copyright (c) 2022 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockcache.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <config.h>
+#include <node/blockstorage.h>
+#include <undo.h>
+#include <validation.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+using node::BlockDataCache;
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+static BlockHash BlockHashFor(uint8_t n) {
+    uint256 hash;
+    *hash.begin() = n;
+    return BlockHash(hash);
+}
+
+BOOST_AUTO_TEST_CASE(blockdatacache_lru) {
+    BlockDataCache<int> cache(30);
+    for (int i = 0; i < 3; ++i) {
+        cache.Insert(BlockHashFor(i), std::make_shared<const int>(i), 10);
+    }
+    BOOST_CHECK_EQUAL(cache.GetStats().entries, 3U);
+    BOOST_CHECK_EQUAL(cache.GetStats().usage, 30U);
+
+    // Entry 0 becomes the most recently used, so 1 gets evicted.
+    BOOST_CHECK_EQUAL(*cache.Get(BlockHashFor(0)), 0);
+    cache.Insert(BlockHashFor(3), std::make_shared<const int>(3), 10);
+    BOOST_CHECK(!cache.Get(BlockHashFor(1)));
+    BOOST_CHECK_EQUAL(*cache.Get(BlockHashFor(0)), 0);
+    BOOST_CHECK_EQUAL(*cache.Get(BlockHashFor(2)), 2);
+    BOOST_CHECK_EQUAL(*cache.Get(BlockHashFor(3)), 3);
+
+    // Inserting an entry twice keeps the first one.
+    cache.Insert(BlockHashFor(3), std::make_shared<const int>(4), 10);
+    BOOST_CHECK_EQUAL(*cache.Get(BlockHashFor(3)), 3);
+
+    // Entries larger than the cache are not added.
+    cache.Insert(BlockHashFor(4), std::make_shared<const int>(4), 31);
+    BOOST_CHECK(!cache.Get(BlockHashFor(4)));
+
+    auto stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.entries, 3U);
+    BOOST_CHECK_EQUAL(stats.usage, 30U);
+    BOOST_CHECK_EQUAL(stats.max_usage, 30U);
+    BOOST_CHECK_EQUAL(stats.hits, 5U);
+    BOOST_CHECK_EQUAL(stats.misses, 2U);
+
+    // Shrinking the cache evicts the least recently used entries.
+    cache.SetMaxUsage(15);
+    stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.entries, 1U);
+    BOOST_CHECK_EQUAL(stats.usage, 10U);
+    BOOST_CHECK_EQUAL(*cache.Get(BlockHashFor(3)), 3);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.GetStats().entries, 0U);
+    BOOST_CHECK_EQUAL(cache.GetStats().usage, 0U);
+    BOOST_CHECK(!cache.Get(BlockHashFor(3)));
+}
+
+BOOST_FIXTURE_TEST_CASE(blockmanager_read_cached, TestChain100Setup) {
+    const Consensus::Params &params =
+        GetConfig().GetChainParams().GetConsensus();
+    node::BlockManager &blockman = m_node.chainman->m_blockman;
+    const CBlockIndex *tip =
+        WITH_LOCK(cs_main, return m_node.chainman->ActiveTip());
+
+    blockman.m_block_cache.Clear();
+    blockman.m_undo_cache.Clear();
+    const auto block_stats = blockman.m_block_cache.GetStats();
+    const auto undo_stats = blockman.m_undo_cache.GetStats();
+
+    // The first read goes to disk, the next ones share the cached data.
+    std::shared_ptr<const CBlock> block = blockman.ReadBlock(tip, params);
+    BOOST_REQUIRE(block);
+    BOOST_CHECK(block->GetHash() == tip->GetBlockHash());
+    BOOST_CHECK_EQUAL(blockman.ReadBlock(tip, params), block);
+    BOOST_CHECK_EQUAL(blockman.m_block_cache.GetStats().hits,
+                      block_stats.hits + 1);
+    BOOST_CHECK_EQUAL(blockman.m_block_cache.GetStats().misses,
+                      block_stats.misses + 1);
+    BOOST_CHECK_EQUAL(blockman.m_block_cache.GetStats().entries, 1U);
+    BOOST_CHECK(blockman.m_block_cache.GetStats().usage > 0);
+
+    std::shared_ptr<const CBlockUndo> undo = blockman.ReadBlockUndo(tip);
+    BOOST_REQUIRE(undo);
+    BOOST_CHECK_EQUAL(undo->vtxundo.size(), block->vtx.size() - 1);
+    BOOST_CHECK_EQUAL(blockman.ReadBlockUndo(tip), undo);
+    BOOST_CHECK_EQUAL(blockman.m_undo_cache.GetStats().hits,
+                      undo_stats.hits + 1);
+    BOOST_CHECK_EQUAL(blockman.m_undo_cache.GetStats().misses,
+                      undo_stats.misses + 1);
+
+    // Failed reads are not cached.
+    CBlockIndex missing_index{*tip};
+    const BlockHash missing_hash = tip->pprev->GetBlockHash();
+    missing_index.phashBlock = &missing_hash;
+    BOOST_CHECK(!blockman.ReadBlock(&missing_index, params));
+    BOOST_CHECK_EQUAL(blockman.m_block_cache.GetStats().entries, 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,10 +2,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <arith_uint256.h>
 #include <chainparams.h>
 #include <config.h>
 #include <consensus/consensus.h>
+#include <consensus/merkle.h>
 #include <consensus/validation.h>
+#include <pow/pow.h>
 #include <validation.h>
 
 #include <test/util/setup_common.h>
@@ -100,4 +103,65 @@ BOOST_AUTO_TEST_CASE(blockfail) {
     RunCheckOnBlock(config, block, "bad-blk-length");
 }
 
+BOOST_FIXTURE_TEST_CASE(checked_blocks, RegTestingSetup) {
+    const Config &config = GetConfig();
+    const Consensus::Params &params = config.GetChainParams().GetConsensus();
+
+    // A block large enough for its transactions to be checked in parallel,
+    // with an odd number of transactions.
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42 * SATOSHI;
+    CBlock block;
+    block.nBits = UintToArith256(params.powLimit).GetCompact();
+    block.vtx.push_back(MakeTransactionRef(tx));
+    while (block.vtx.size() < MIN_PARALLEL_TX_CHECKS + 1) {
+        tx.vin[0].prevout = InsecureRandOutPoint();
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    auto solve = [&](CBlock &b) {
+        b.hashMerkleRoot = BlockMerkleRoot(b);
+        while (!CheckProofOfWork(b.GetHash(), b.nBits, params)) {
+            ++b.nNonce;
+        }
+    };
+    solve(block);
+
+    BlockValidationState state;
+    BOOST_CHECK(
+        CheckBlock(block, state, params, BlockValidationOptions(config)));
+
+    // The same block in another object passes too.
+    CBlock copy = block;
+    copy.fChecked = false;
+    BOOST_CHECK(
+        CheckBlock(copy, state, params, BlockValidationOptions(config)));
+
+    // A mutated block with the same hash is still rejected.
+    CBlock mutated = block;
+    mutated.fChecked = false;
+    mutated.vtx.push_back(mutated.vtx.back());
+    BOOST_CHECK_EQUAL(mutated.GetHash(), block.GetHash());
+    BOOST_CHECK(
+        !CheckBlock(mutated, state, params, BlockValidationOptions(config)));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-duplicate");
+
+    // The first invalid transaction is reported when they are checked in
+    // parallel.
+    CBlock invalid = block;
+    invalid.fChecked = false;
+    tx.vin.push_back(tx.vin[0]);
+    invalid.vtx[MIN_PARALLEL_TX_CHECKS / 2] = MakeTransactionRef(tx);
+    const TxId invalid_txid = tx.GetId();
+    solve(invalid);
+    state = BlockValidationState();
+    BOOST_CHECK(
+        !CheckBlock(invalid, state, params, BlockValidationOptions(config)));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-inputs-duplicate");
+    BOOST_CHECK(state.GetDebugMessage().find(invalid_txid.ToString()) !=
+                std::string::npos);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -322,6 +322,171 @@ BOOST_AUTO_TEST_CASE(SufficientPreforwardRTTest) {
                       SHARED_TX_OFFSET - 1);
 }
 
+BOOST_AUTO_TEST_CASE(LargeMempoolRoundTripTest) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+
+    LOCK2(cs_main, pool.cs);
+    // Enough transactions for their short IDs to be computed in parallel.
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42 * SATOSHI;
+    while (pool.size() < MIN_PARALLEL_SHORTIDS) {
+        tx.vin[0].prevout = InsecureRandOutPoint();
+        pool.addUnchecked(entry.FromTx(tx));
+    }
+    pool.addUnchecked(entry.FromTx(block.vtx[1]));
+    pool.addUnchecked(entry.FromTx(block.vtx[2]));
+
+    CBlockHeaderAndShortTxIDs shortIDs(block);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << shortIDs;
+
+    CBlockHeaderAndShortTxIDs shortIDs2;
+    stream >> shortIDs2;
+
+    PartiallyDownloadedBlock partialBlock(GetConfig(), &pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    BOOST_CHECK(partialBlock.IsTxAvailable(1));
+    BOOST_CHECK(partialBlock.IsTxAvailable(2));
+
+    // Only the matched transactions are still referenced after InitData.
+    BOOST_CHECK_EQUAL(
+        pool.mapTx.find(block.vtx[2]->GetId())->GetSharedTx().use_count(),
+        SHARED_TX_OFFSET + 1);
+    BOOST_CHECK_EQUAL(
+        pool.mapTx.find(tx.GetId())->GetSharedTx().use_count(), 2);
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {}) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+}
+
+BOOST_AUTO_TEST_CASE(SortedShortIdsRoundTripTest) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+
+    // Put the block in the canonical transaction order.
+    std::sort(block.vtx.begin() + 1, block.vtx.end(),
+              [](const CTransactionRef &a, const CTransactionRef &b) {
+                  return a->GetId() < b->GetId();
+              });
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    const Consensus::Params &params =
+        GetConfig().GetChainParams().GetConsensus();
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, params)) {
+        ++block.nNonce;
+    }
+
+    LOCK2(cs_main, pool.cs);
+    pool.addUnchecked(entry.FromTx(block.vtx[2]));
+
+    CBlockHeaderAndShortTxIDs shortIDs(block, /*sortedShortTxIDsIn=*/true);
+    BOOST_CHECK(shortIDs.HasSortedShortTxIDs());
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << shortIDs;
+
+    CBlockHeaderAndShortTxIDs shortIDs2(/*sortedShortTxIDsIn=*/true);
+    stream >> shortIDs2;
+    BOOST_CHECK(stream.empty());
+    BOOST_CHECK_EQUAL(shortIDs2.GetNonce(), shortIDs.GetNonce());
+
+    // The missing transaction is requested by its position in the compact
+    // block, which the sender maps back to the block.
+    PartiallyDownloadedBlock partialBlock(GetConfig(), &pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+    BOOST_CHECK(partialBlock.IsTxAvailable(0));
+    std::vector<uint32_t> missing;
+    for (size_t i = 0; i < shortIDs2.BlockTxCount(); i++) {
+        if (!partialBlock.IsTxAvailable(i)) {
+            missing.push_back(i);
+        }
+    }
+    BOOST_CHECK_EQUAL(missing.size(), 1U);
+    const std::vector<uint32_t> indexes =
+        CBlockHeaderAndShortTxIDs::GetSortedTxIndexes(block,
+                                                      shortIDs2.GetNonce());
+    BOOST_CHECK_EQUAL(indexes.size(), block.vtx.size());
+    BOOST_CHECK_EQUAL(indexes[0], 0U);
+    const CTransactionRef missing_tx = block.vtx[indexes[missing[0]]];
+    BOOST_CHECK(missing_tx != block.vtx[2]);
+
+    // The reconstructed block is in the canonical order.
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, {missing_tx}) ==
+                READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+    bool mutated;
+    BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(),
+                      BlockMerkleRoot(block2, &mutated).ToString());
+    BOOST_CHECK(!mutated);
+}
+
+BOOST_AUTO_TEST_CASE(SortedShortIdsFormatterTest) {
+    // Many short IDs take less space sorted than in the block order.
+    std::vector<uint64_t> shortids(10000);
+    for (uint64_t &shortid : shortids) {
+        shortid = InsecureRandBits(48);
+    }
+    std::sort(shortids.begin(), shortids.end());
+
+    CDataStream sorted(SER_NETWORK, PROTOCOL_VERSION);
+    sorted << Using<SortedShortIdsFormatter>(shortids);
+    BOOST_CHECK_LT(sorted.size(), shortids.size() * 5);
+
+    std::vector<uint64_t> shortids2;
+    sorted >> Using<SortedShortIdsFormatter>(shortids2);
+    BOOST_CHECK(shortids == shortids2);
+
+    // Short IDs above 48 bits are rejected, with a single short ID (the Rice
+    // parameter is 47) whose quotient is too large...
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        WriteCompactSize(ss, 1);
+        BitStreamWriter<CDataStream> bitwriter(ss);
+        bitwriter.Write(0b110, 3);
+        bitwriter.Write(0, 47);
+        bitwriter.Flush();
+        std::vector<uint64_t> out;
+        BOOST_CHECK_EXCEPTION(ss >> Using<SortedShortIdsFormatter>(out),
+                              std::ios_base::failure,
+                              HasReason("short ID out of range"));
+    }
+    // ... or with two short IDs (the Rice parameter is 46) adding up too much.
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        WriteCompactSize(ss, 2);
+        BitStreamWriter<CDataStream> bitwriter(ss);
+        GolombRiceEncode(bitwriter, 46, 0xffffffffffffL);
+        GolombRiceEncode(bitwriter, 46, 1);
+        bitwriter.Flush();
+        std::vector<uint64_t> out;
+        BOOST_CHECK_EXCEPTION(ss >> Using<SortedShortIdsFormatter>(out),
+                              std::ios_base::failure,
+                              HasReason("short ID out of range"));
+    }
+
+    // A huge count is rejected before decoding anything when it is above the
+    // bound, instead of decoding 2-bit short IDs with a Rice parameter of 1.
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        CBlockHeader header;
+        ss << header << uint64_t(0);
+        WriteCompactSize(ss, uint64_t(1) << 47);
+        ss << std::vector<uint8_t>(1000);
+        CBlockHeaderAndShortTxIDs cmpctblock(/*sortedShortTxIDsIn=*/true,
+                                             /*maxShortTxIDsIn=*/1000);
+        BOOST_CHECK_EXCEPTION(ss >> cmpctblock, std::ios_base::failure,
+                              HasReason("too many short IDs"));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest) {
     CTxMemPool pool;
     CMutableTransaction coinbase;
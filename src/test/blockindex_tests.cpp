@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <blockindexarena.h>
 #include <blockvalidity.h>
 #include <chain.h>
 #include <uint256.h>
@@ -11,6 +12,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <limits>
+#include <vector>
 
 BOOST_FIXTURE_TEST_SUITE(blockindex_tests, BasicTestingSetup)
 
@@ -463,4 +465,33 @@ BOOST_AUTO_TEST_CASE(index_assumevalid_tests) {
         }
     }
 }
+BOOST_AUTO_TEST_CASE(arena_allocation) {
+    BlockIndexArena arena;
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+
+    // Fill a few chunks, the entries must not move as more get created.
+    const size_t count = 2 * BlockIndexArena::CHUNK_SIZE + 10;
+    std::vector<CBlockIndex *> entries;
+    for (size_t i = 0; i < count; ++i) {
+        CBlockHeader header;
+        header.nTime = i;
+        CBlockIndex *pindex = arena.New(header);
+        pindex->pprev = entries.empty() ? nullptr : entries.back();
+        pindex->nHeight = i;
+        entries.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(arena.Size(), count);
+    BOOST_CHECK_GE(arena.DynamicMemoryUsage(), count * sizeof(CBlockIndex));
+
+    for (size_t i = 0; i < count; ++i) {
+        BOOST_CHECK_EQUAL(entries[i]->nHeight, int(i));
+        BOOST_CHECK_EQUAL(entries[i]->nTime, i);
+        BOOST_CHECK(entries[i]->pprev == (i == 0 ? nullptr : entries[i - 1]));
+    }
+
+    arena.Clear();
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+    BOOST_CHECK_EQUAL(arena.DynamicMemoryUsage(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -66,6 +66,29 @@ struct FailingCheck {
     void swap(FailingCheck &x) { std::swap(fails, x.fails); };
 };
 
+/**
+ * A check that always succeeds but defers its actual result into the batch
+ * of the worker running it.
+ */
+struct DeferredFailingCheck {
+    struct Batch {
+        static std::atomic<size_t> n_deferred;
+        bool fails{false};
+        bool Verify() { return !fails; }
+    };
+
+    bool fails;
+    DeferredFailingCheck(bool _fails) : fails(_fails){};
+    DeferredFailingCheck() : fails(true){};
+    bool operator()() const { return !fails; }
+    bool operator()(Batch &batch) const {
+        Batch::n_deferred.fetch_add(1, std::memory_order_relaxed);
+        batch.fails |= fails;
+        return true;
+    }
+    void swap(DeferredFailingCheck &x) { std::swap(fails, x.fails); };
+};
+
 struct UniqueCheck {
     static Mutex m;
     static std::unordered_multiset<size_t> results GUARDED_BY(m);
@@ -131,12 +154,14 @@ std::condition_variable FrozenCleanupCheck::cv{};
 Mutex UniqueCheck::m;
 std::unordered_multiset<size_t> UniqueCheck::results;
 std::atomic<size_t> FakeCheckCheckCompletion::n_calls{0};
+std::atomic<size_t> DeferredFailingCheck::Batch::n_deferred{0};
 std::atomic<size_t> MemoryCheck::fake_allocated_memory{0};
 
 // Queue Typedefs
 typedef CCheckQueue<FakeCheckCheckCompletion> Correct_Queue;
 typedef CCheckQueue<FakeCheck> Standard_Queue;
 typedef CCheckQueue<FailingCheck> Failing_Queue;
+typedef CCheckQueue<DeferredFailingCheck> DeferredFailing_Queue;
 typedef CCheckQueue<UniqueCheck> Unique_Queue;
 typedef CCheckQueue<MemoryCheck> Memory_Queue;
 typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
@@ -227,6 +252,40 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Catches_Failure) {
     }
     fail_queue->StopWorkerThreads();
 }
+
+/** Test that the work deferred by the checks into per-worker batches is
+ * verified, and that a failure is reported.
+ */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Deferred_Failure) {
+    auto fail_queue =
+        std::make_unique<DeferredFailing_Queue>(QUEUE_BATCH_SIZE);
+    fail_queue->StartWorkerThreads(SCRIPT_CHECK_THREADS);
+
+    for (size_t i = 0; i < 1001; ++i) {
+        DeferredFailingCheck::Batch::n_deferred = 0;
+        CCheckQueueControl<DeferredFailingCheck> control(fail_queue.get());
+        size_t remaining = i;
+        while (remaining) {
+            size_t r = InsecureRandRange(10);
+
+            std::vector<DeferredFailingCheck> vChecks;
+            vChecks.reserve(r);
+            for (size_t k = 0; k < r && remaining; k++, remaining--) {
+                vChecks.emplace_back(remaining == 1);
+            }
+            control.Add(vChecks);
+        }
+        bool success = control.Wait();
+        BOOST_REQUIRE(DeferredFailingCheck::Batch::n_deferred > 0 || i == 0);
+        if (i > 0) {
+            BOOST_REQUIRE(!success);
+        } else {
+            BOOST_REQUIRE(success);
+        }
+    }
+    fail_queue->StopWorkerThreads();
+}
+
 // Test that a block validation which fails does not interfere with
 // future blocks, ie, the bad state is cleared.
 BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure) {
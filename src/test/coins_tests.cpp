@@ -17,6 +17,7 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
 #include <map>
 #include <vector>
 
@@ -936,4 +937,108 @@ BOOST_AUTO_TEST_CASE(coin_write) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(coins_background_flush) {
+    CCoinsViewDB db{"test", /*nCacheSize*/ 1 << 23, /*fMemory*/ true,
+                    /*fWipe*/ false};
+    CCoinsViewBackgroundFlush flush_view{db};
+    CCoinsViewCache cache{&flush_view};
+    const Coin coin(CTxOut(VALUE1, CScript() << OP_TRUE), 1, false);
+
+    // Write a first coin synchronously.
+    const COutPoint spent(TxId(InsecureRand256()), 0);
+    cache.AddCoin(spent, Coin(coin), false);
+    const BlockHash block1(InsecureRand256());
+    cache.SetBestBlock(block1);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.HaveCoin(spent));
+    BOOST_CHECK(db.GetBestBlock() == block1);
+
+    // Spend it, add new coins and flush them in the background.
+    BOOST_CHECK(cache.SpendCoin(spent));
+    std::vector<COutPoint> outpoints;
+    for (uint32_t i = 0; i < 1000; i++) {
+        outpoints.emplace_back(TxId(InsecureRand256()), i);
+        cache.AddCoin(outpoints.back(), Coin(coin), false);
+    }
+    const BlockHash block2(InsecureRand256());
+    cache.SetBestBlock(block2);
+    BOOST_CHECK(flush_view.FlushInBackground(cache));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+
+    // Whether or not the write completed, the cache sees the flushed state.
+    BOOST_CHECK(cache.GetBestBlock() == block2);
+    BOOST_CHECK(!cache.HaveCoin(spent));
+    for (const COutPoint &outpoint : outpoints) {
+        BOOST_CHECK(cache.AccessCoin(outpoint) == coin);
+    }
+
+    BOOST_CHECK(flush_view.WaitForFlush());
+    BOOST_CHECK(db.GetBestBlock() == block2);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    BOOST_CHECK(!db.HaveCoin(spent));
+    for (const COutPoint &outpoint : outpoints) {
+        BOOST_CHECK(db.HaveCoin(outpoint));
+    }
+
+    // A synchronous flush waits for the background write and still works.
+    BOOST_CHECK(cache.SpendCoin(outpoints.front()));
+    BOOST_CHECK(flush_view.FlushInBackground(cache));
+    const BlockHash block3(InsecureRand256());
+    cache.SetBestBlock(block3);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.GetBestBlock() == block3);
+    BOOST_CHECK(!db.HaveCoin(outpoints.front()));
+}
+
+BOOST_AUTO_TEST_CASE(coins_db_getcoins) {
+    CCoinsViewDB db{"test", /*nCacheSize*/ 1 << 23, /*fMemory*/ true,
+                    /*fWipe*/ false};
+    CCoinsViewBackgroundFlush flush_view{db};
+    CCoinsViewCache cache{&flush_view};
+
+    std::vector<COutPoint> outpoints;
+    std::vector<Coin> expected;
+    for (uint32_t i = 0; i < 200; i++) {
+        outpoints.emplace_back(TxId(InsecureRand256()), i);
+        expected.emplace_back(CTxOut(int64_t(i + 1) * SATOSHI, CScript()),
+                              i + 1, false);
+        cache.AddCoin(outpoints.back(), Coin(expected.back()), false);
+    }
+    cache.SetBestBlock(BlockHash(InsecureRand256()));
+    BOOST_CHECK(cache.Flush());
+
+    // Spend some coins and flush in the background, so that lookups through
+    // the flush view may be answered by the coins being written.
+    for (uint32_t i = 0; i < outpoints.size(); i += 3) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+        expected[i].Clear();
+    }
+    // Not in the database at all, and looked up twice.
+    outpoints.emplace_back(TxId(InsecureRand256()), 0);
+    expected.emplace_back();
+    outpoints.push_back(outpoints[1]);
+    expected.push_back(expected[1]);
+    cache.SetBestBlock(BlockHash(InsecureRand256()));
+    BOOST_CHECK(flush_view.FlushInBackground(cache));
+
+    const size_t expected_found = std::count_if(
+        expected.begin(), expected.end(),
+        [](const Coin &coin) { return !coin.IsSpent(); });
+    auto check_getcoins = [&](const CCoinsView &view) {
+        std::vector<Coin> coins(outpoints.size());
+        BOOST_CHECK_EQUAL(view.GetCoins(outpoints, coins), expected_found);
+        for (size_t i = 0; i < outpoints.size(); i++) {
+            BOOST_CHECK(coins[i] == expected[i]);
+        }
+    };
+
+    // Whether or not the write completed.
+    check_getcoins(flush_view);
+
+    // The database is up to date once the write completed.
+    BOOST_CHECK(flush_view.WaitForFlush());
+    check_getcoins(flush_view);
+    check_getcoins(db);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,12 +4,14 @@
 
 #include <compressor.h>
 #include <script/standard.h>
+#include <util/compression.h>
 
 #include <test/util/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
 
 #include <cstdint>
+#include <vector>
 
 // amounts 0.00000001 .. 0.00100000
 #define NUM_MULTIPLES_UNIT 100000
@@ -146,4 +148,80 @@ BOOST_AUTO_TEST_CASE(compress_script_to_uncompressed_pubkey_id) {
     BOOST_CHECK_EQUAL(out[0], 0x04 | (script[65] & 0x01));
 }
 
+static void CheckCompressLZ(const std::vector<uint8_t> &data) {
+    const std::vector<uint8_t> compressed = CompressLZ(data);
+    BOOST_CHECK(compressed.size() <= data.size() + data.size() / 255 + 16);
+
+    std::vector<uint8_t> decompressed;
+    BOOST_CHECK(DecompressLZ(compressed, data.size(), decompressed));
+    BOOST_CHECK(decompressed == data);
+
+    // The data must decompress to exactly the given size.
+    if (!data.empty()) {
+        BOOST_CHECK(!DecompressLZ(compressed, data.size() - 1, decompressed));
+    }
+    BOOST_CHECK(!DecompressLZ(compressed, data.size() + 1, decompressed));
+
+    // Truncated data is rejected.
+    for (size_t i = 0; i < compressed.size(); ++i) {
+        BOOST_CHECK(!DecompressLZ(Span<const uint8_t>{compressed}.first(i),
+                                  data.size(), decompressed));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compress_lz_roundtrip) {
+    CheckCompressLZ({});
+    CheckCompressLZ({0x42});
+    CheckCompressLZ({'a', 'b', 'c', 'a', 'b', 'c', 'a', 'b', 'c'});
+
+    // A long run of the same byte is copied from the previous byte, with a
+    // length which doesn't fit in the token.
+    std::vector<uint8_t> run(100000, 0x42);
+    CheckCompressLZ(run);
+    BOOST_CHECK(CompressLZ(run).size() < 500);
+
+    // Random data doesn't compress.
+    const std::vector<uint8_t> random = g_insecure_rand_ctx.randbytes(4096);
+    CheckCompressLZ(random);
+
+    // Repeated random data is copied without overlap.
+    std::vector<uint8_t> repeated;
+    for (int i = 0; i < 50; ++i) {
+        repeated.insert(repeated.end(), random.begin(), random.begin() + 300);
+    }
+    CheckCompressLZ(repeated);
+    BOOST_CHECK(CompressLZ(repeated).size() < 600);
+
+    // Matches can't be further than 64KiB back.
+    std::vector<uint8_t> distant = g_insecure_rand_ctx.randbytes(70000);
+    distant.insert(distant.end(), distant.begin(), distant.begin() + 1000);
+    const std::vector<uint8_t> compressed = CompressLZ(distant);
+    std::vector<uint8_t> decompressed;
+    BOOST_CHECK(DecompressLZ(compressed, distant.size(), decompressed));
+    BOOST_CHECK(decompressed == distant);
+}
+
+BOOST_AUTO_TEST_CASE(compress_lz_malformed) {
+    std::vector<uint8_t> out;
+    auto decompress = [&](const std::vector<uint8_t> &in, size_t size) {
+        return DecompressLZ(in, size, out);
+    };
+    // One literal followed by a 4 bytes copy at offset 1.
+    BOOST_CHECK(decompress({0x10, 'a', 0x01, 0x00, 0x00}, 5));
+    BOOST_CHECK(out == std::vector<uint8_t>(5, 'a'));
+
+    // The copy must start within the output.
+    BOOST_CHECK(!decompress({0x10, 'a', 0x00, 0x00, 0x00}, 5));
+    BOOST_CHECK(!decompress({0x10, 'a', 0x02, 0x00, 0x00}, 5));
+    // The data must end with literals.
+    BOOST_CHECK(!decompress({0x10, 'a', 0x01, 0x00}, 5));
+    BOOST_CHECK(!decompress({}, 0));
+    // The output can't grow past the given size.
+    BOOST_CHECK(!decompress({0x10, 'a', 0x01, 0x00, 0x00}, 4));
+    // The length of the literals is cut short.
+    BOOST_CHECK(!decompress({0xf0, 0xff, 0xff, 0xff}, 1000000));
+    // A size the input can't expand to is rejected before allocating it.
+    BOOST_CHECK(!decompress({0x10, 'a'}, size_t{1} << 40));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -11,6 +11,8 @@
 #include <boost/test/unit_test.hpp>
 
 #include <memory>
+#include <optional>
+#include <vector>
 
 // Test if a string consists entirely of null characters
 static bool is_null_key(const std::vector<uint8_t> &key) {
@@ -167,6 +169,61 @@ BOOST_AUTO_TEST_CASE(dbwrapper_batch) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_readmany) {
+    // Perform tests both obfuscated and non-obfuscated.
+    for (const bool obfuscate : {false, true}) {
+        fs::path ph = m_args.GetDataDirBase() /
+                      (obfuscate ? "dbwrapper_readmany_obfuscate_true"
+                                 : "dbwrapper_readmany_obfuscate_false");
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+
+        // Store every other key.
+        std::vector<uint256> in(50);
+        for (uint32_t i = 0; i < in.size(); i += 2) {
+            in[i] = InsecureRand256();
+            BOOST_CHECK(dbw.Write(i, in[i]));
+        }
+
+        // Look them up out of order, with duplicates and with keys past the
+        // last one in the database.
+        std::vector<uint32_t> keys;
+        for (uint32_t i = 0; i < in.size() + 10; ++i) {
+            keys.push_back(InsecureRandRange(in.size() + 10));
+        }
+        keys.push_back(0);
+        keys.push_back(0);
+
+        std::vector<std::optional<uint256>> values;
+        const size_t found =
+            dbw.ReadMany(Span<const uint32_t>{keys}, values);
+        BOOST_REQUIRE_EQUAL(values.size(), keys.size());
+
+        size_t expected_found = 0;
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i] < in.size() && keys[i] % 2 == 0) {
+                BOOST_REQUIRE(values[i]);
+                BOOST_CHECK_EQUAL(values[i]->ToString(),
+                                  in[keys[i]].ToString());
+                ++expected_found;
+            } else {
+                BOOST_CHECK(!values[i]);
+            }
+        }
+        BOOST_CHECK_EQUAL(found, expected_found);
+
+        // Values which don't deserialize are reported as not found, like
+        // Read() does.
+        std::vector<std::optional<std::pair<uint256, uint256>>> bad_values;
+        BOOST_CHECK_EQUAL(dbw.ReadMany(Span<const uint32_t>{keys}, bad_values),
+                          0U);
+        BOOST_CHECK_EQUAL(bad_values.size(), keys.size());
+
+        // Nothing to look up.
+        BOOST_CHECK_EQUAL(dbw.ReadMany(Span<const uint32_t>{}, values), 0U);
+        BOOST_CHECK(values.empty());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(dbwrapper_iterator) {
     // Perform tests both obfuscated and non-obfuscated.
     for (const bool obfuscate : {false, true}) {
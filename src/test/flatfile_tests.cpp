@@ -131,4 +131,163 @@ BOOST_AUTO_TEST_CASE(flatfile_flush) {
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1U);
 }
 
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(flatfile_map) {
+    const auto data_dir = m_args.GetDataDirBase();
+    FlatFileMapCache cache(1);
+    FlatFileSeq seq(data_dir, "a", 100, &cache);
+    FlatFileSeq seq_unmapped(data_dir, "b", 100);
+
+    // Without a map cache, or a file, nothing gets mapped.
+    BOOST_CHECK(!seq_unmapped.Map(FlatFilePos(0, 0), 0));
+    BOOST_CHECK(!seq.Map(FlatFilePos(0, 0), 0));
+
+    const std::vector<uint8_t> data1{1, 2, 3, 4};
+    const std::vector<uint8_t> data2{5, 6, 7};
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 0)), SER_DISK, CLIENT_VERSION);
+        file.write(reinterpret_cast<const char *>(data1.data()), data1.size());
+    }
+
+    auto mapped = seq.Map(FlatFilePos(0, 1), 3);
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK(mapped->Data() == Span<const uint8_t>{data1});
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+
+    // Asking for more than the file holds fails, and the cached mapping is
+    // reused as long as it is large enough.
+    BOOST_CHECK(!seq.Map(FlatFilePos(0, 1), 4));
+    BOOST_CHECK(!seq.Map(FlatFilePos(0, 1), 4));
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+    mapped = seq.Map(FlatFilePos(0, 0), 4);
+    BOOST_CHECK_EQUAL(seq.Map(FlatFilePos(0, 2), 1), mapped);
+
+    // Data appended to the file gets mapped when it is needed.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, data1.size())), SER_DISK,
+                       CLIENT_VERSION);
+        file.write(reinterpret_cast<const char *>(data2.data()), data2.size());
+    }
+    BOOST_CHECK_EQUAL(seq.Map(FlatFilePos(0, 0), 4), mapped);
+    auto remapped = seq.Map(FlatFilePos(0, 4), 3);
+    BOOST_REQUIRE(remapped);
+    BOOST_CHECK(remapped != mapped);
+    BOOST_CHECK_EQUAL(remapped->Data().size(), data1.size() + data2.size());
+    BOOST_CHECK(remapped->Data().last(3) == Span<const uint8_t>{data2});
+    // The previous mapping remains usable while it is referenced.
+    BOOST_CHECK(mapped->Data() == Span<const uint8_t>{data1});
+
+    // Mapping another file evicts the least recently used one.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(1, 0)), SER_DISK, CLIENT_VERSION);
+        file.write(reinterpret_cast<const char *>(data2.data()), data2.size());
+    }
+    BOOST_CHECK(seq.Map(FlatFilePos(1, 0), 3));
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+    BOOST_CHECK(seq.Map(FlatFilePos(0, 0), 7) != remapped);
+
+    // A file replaced on disk is mapped again.
+    mapped = seq.Map(FlatFilePos(1, 0), 3);
+    fs::remove(seq.FileName(FlatFilePos(1, 0)));
+    {
+        CAutoFile file(seq.Open(FlatFilePos(1, 0)), SER_DISK, CLIENT_VERSION);
+        file.write(reinterpret_cast<const char *>(data1.data()), data1.size());
+    }
+    remapped = seq.Map(FlatFilePos(1, 0), 3);
+    BOOST_REQUIRE(remapped);
+    BOOST_CHECK(remapped->Data() == Span<const uint8_t>{data1});
+    BOOST_CHECK(mapped->Data() == Span<const uint8_t>{data2});
+
+    cache.Remove(seq.FileName(FlatFilePos(1, 0)));
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+
+    // A file truncated when it is finalized is mapped again, at its new size.
+    bool out_of_space;
+    seq.Allocate(FlatFilePos(2, 0), 1, out_of_space);
+    {
+        CAutoFile file(seq.Open(FlatFilePos(2, 0)), SER_DISK, CLIENT_VERSION);
+        file.write(reinterpret_cast<const char *>(data1.data()), data1.size());
+    }
+    mapped = seq.Map(FlatFilePos(2, 0), data1.size());
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(mapped->Data().size(), 100U);
+    BOOST_CHECK(seq.Flush(FlatFilePos(2, data1.size()), true));
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+    remapped = seq.Map(FlatFilePos(2, 0), data1.size());
+    BOOST_REQUIRE(remapped);
+    BOOST_CHECK(remapped->Data() == Span<const uint8_t>{data1});
+}
+
+BOOST_AUTO_TEST_CASE(flatfile_handles) {
+    const auto data_dir = m_args.GetDataDirBase();
+    FlatFileHandleCache cache(1);
+    FlatFileSeq seq(data_dir, "a", 100, nullptr, &cache);
+    FlatFileSeq seq_uncached(data_dir, "b", 100);
+
+    // Without a handle cache, or a file, nothing gets opened.
+    BOOST_CHECK(!seq_uncached.OpenCached(FlatFilePos(0, 0)));
+    BOOST_CHECK(!seq.OpenCached(FlatFilePos(0, 0)));
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+
+    const std::vector<uint8_t> data1{1, 2, 3, 4};
+    const std::vector<uint8_t> data2{5, 6, 7};
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 0)), SER_DISK, CLIENT_VERSION);
+        file.write(reinterpret_cast<const char *>(data1.data()), data1.size());
+    }
+
+    auto handle = seq.OpenCached(FlatFilePos(0, 0));
+    BOOST_REQUIRE(handle);
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+    BOOST_CHECK_EQUAL(seq.OpenCached(FlatFilePos(0, 2)), handle);
+    std::vector<uint8_t> read(2);
+    BOOST_CHECK(handle->Read(1, read));
+    BOOST_CHECK(read == std::vector<uint8_t>(data1.begin() + 1,
+                                             data1.begin() + 3));
+    // Reading past the end of the file fails.
+    BOOST_CHECK(!handle->Read(3, read));
+
+    // Data appended to the file can be read through the open handle.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, data1.size())), SER_DISK,
+                       CLIENT_VERSION);
+        file.write(reinterpret_cast<const char *>(data2.data()), data2.size());
+    }
+    BOOST_CHECK(handle->Read(data1.size(), read));
+    BOOST_CHECK(read == std::vector<uint8_t>(data2.begin(), data2.begin() + 2));
+
+    // Opening another file evicts the least recently used one, which remains
+    // usable while it is referenced.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(1, 0)), SER_DISK, CLIENT_VERSION);
+        file.write(reinterpret_cast<const char *>(data2.data()), data2.size());
+    }
+    BOOST_CHECK(seq.OpenCached(FlatFilePos(1, 0)));
+    BOOST_CHECK_EQUAL(cache.Size(), 1U);
+    BOOST_CHECK(seq.OpenCached(FlatFilePos(0, 0)) != handle);
+    BOOST_CHECK(handle->Read(0, read));
+    BOOST_CHECK(read == std::vector<uint8_t>(data1.begin(), data1.begin() + 2));
+
+    // A file replaced on disk is opened again once its handle is removed.
+    handle = seq.OpenCached(FlatFilePos(1, 0));
+    fs::remove(seq.FileName(FlatFilePos(1, 0)));
+    {
+        CAutoFile file(seq.Open(FlatFilePos(1, 0)), SER_DISK, CLIENT_VERSION);
+        file.write(reinterpret_cast<const char *>(data1.data()), data1.size());
+    }
+    BOOST_CHECK_EQUAL(seq.OpenCached(FlatFilePos(1, 0)), handle);
+    cache.Remove(seq.FileName(FlatFilePos(1, 0)));
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+    auto reopened = seq.OpenCached(FlatFilePos(1, 0));
+    BOOST_REQUIRE(reopened);
+    BOOST_CHECK(reopened->Read(0, read));
+    BOOST_CHECK(read == std::vector<uint8_t>(data1.begin(), data1.begin() + 2));
+    BOOST_CHECK(handle->Read(0, read));
+    BOOST_CHECK(read == std::vector<uint8_t>(data2.begin(), data2.begin() + 2));
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.Size(), 0U);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
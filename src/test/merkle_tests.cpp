@@ -278,6 +278,10 @@ BOOST_AUTO_TEST_CASE(merkle_test) {
             // If no mutation was done (once for every ntx value), try up to 16
             // branches.
             if (mutate == 0) {
+                if (ntx > 0) {
+                    BOOST_CHECK(BlockCoinbaseMerkleBranch(block) ==
+                                BlockMerkleBranch(block, 0));
+                }
                 for (int loop = 0; loop < std::min(ntx, 16); loop++) {
                     // If ntx <= 16, try all branches. Otherwise, try 16 random
                     // ones.
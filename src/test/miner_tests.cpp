@@ -22,6 +22,7 @@
 #include <util/system.h>
 #include <util/time.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <test/util/setup_common.h>
 
@@ -32,6 +33,7 @@
 using node::BlockAssembler;
 using node::CBlockTemplate;
 using node::CBlockTemplateEntry;
+using node::IncrementalBlockAssembler;
 using node::IncrementExtraNonce;
 
 namespace miner_tests {
@@ -896,4 +898,101 @@ BOOST_AUTO_TEST_CASE(TestCBlockTemplateEntry) {
     BOOST_CHECK_EQUAL(txEntry.sigChecks, 10);
 }
 
+BOOST_AUTO_TEST_CASE(IncrementalBlockAssembler_updates) {
+    const Config &config = GetConfig();
+    const Consensus::Params &params = config.GetChainParams().GetConsensus();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    TestMemPoolEntryHelper entry;
+    const int nHeight =
+        WITH_LOCK(cs_main, return m_node.chainman->ActiveHeight()) + 1;
+
+    IncrementalBlockAssembler assembler(config, *m_node.chainman,
+                                        *m_node.mempool);
+    RegisterValidationInterface(&assembler);
+
+    // The first template is assembled from scratch.
+    std::unique_ptr<CBlockTemplate> pblocktemplate =
+        assembler.GetBlockTemplate(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 1u);
+    BOOST_CHECK_EQUAL(assembler.GetStats().rebuilds, 1u);
+    BOOST_CHECK_EQUAL(assembler.GetStats().updates, 0u);
+
+    // A parent and its child enter the mempool.
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout = COutPoint(TxId(InsecureRand256()), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 10 * COIN;
+    const CTransactionRef parent = MakeTransactionRef(tx);
+    tx.vin[0].prevout = COutPoint(parent->GetId(), 0);
+    tx.vout[0].nValue = 9 * COIN;
+    const CTransactionRef child = MakeTransactionRef(tx);
+    {
+        LOCK2(cs_main, m_node.mempool->cs);
+        for (const CTransactionRef &ptx : {parent, child}) {
+            m_node.mempool->addUnchecked(
+                entry.Fee(10000 * SATOSHI).Time(GetTime()).FromTx(ptx));
+            GetMainSignals().TransactionAddedToMempool(
+                ptx, m_node.mempool->GetAndIncrementSequence());
+        }
+    }
+    SyncWithValidationInterfaceQueue();
+
+    // They are appended to the template, in canonical order.
+    pblocktemplate = assembler.GetBlockTemplate(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 3u);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetId() <
+                pblocktemplate->block.vtx[2]->GetId());
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0]->GetValueOut(),
+                      GetBlockSubsidy(nHeight, params) + 20000 * SATOSHI);
+    BOOST_CHECK_EQUAL(pblocktemplate->entries[0].fees, -20000 * SATOSHI);
+    BOOST_CHECK(pblocktemplate->block.hashPrevBlock ==
+                WITH_LOCK(cs_main, return m_node.chainman->ActiveTip()
+                                              ->GetBlockHash()));
+    IncrementalBlockAssembler::Stats stats = assembler.GetStats();
+    BOOST_CHECK_EQUAL(stats.rebuilds, 1u);
+    BOOST_CHECK_EQUAL(stats.updates, 1u);
+    BOOST_CHECK_EQUAL(stats.txs_added, 2u);
+    BOOST_CHECK_EQUAL(stats.txs_removed, 0u);
+
+    // Removing the parent drops both transactions from the template, even
+    // before the notification for the child is received.
+    UnregisterValidationInterface(&assembler);
+    {
+        LOCK2(cs_main, m_node.mempool->cs);
+        m_node.mempool->removeRecursive(*parent,
+                                        MemPoolRemovalReason::CONFLICT);
+    }
+    SyncWithValidationInterfaceQueue();
+    RegisterValidationInterface(&assembler);
+    GetMainSignals().TransactionRemovedFromMempool(
+        parent, MemPoolRemovalReason::CONFLICT,
+        WITH_LOCK(m_node.mempool->cs,
+                  return m_node.mempool->GetAndIncrementSequence()));
+    SyncWithValidationInterfaceQueue();
+
+    pblocktemplate = assembler.GetBlockTemplate(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 1u);
+    BOOST_CHECK_EQUAL(assembler.GetStats().txs_removed, 2u);
+
+    GetMainSignals().TransactionRemovedFromMempool(
+        child, MemPoolRemovalReason::CONFLICT,
+        WITH_LOCK(m_node.mempool->cs,
+                  return m_node.mempool->GetAndIncrementSequence()));
+    SyncWithValidationInterfaceQueue();
+
+    pblocktemplate = assembler.GetBlockTemplate(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 1u);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0]->GetValueOut(),
+                      GetBlockSubsidy(nHeight, params));
+    stats = assembler.GetStats();
+    BOOST_CHECK_EQUAL(stats.rebuilds, 1u);
+    BOOST_CHECK_EQUAL(stats.updates, 3u);
+    BOOST_CHECK_EQUAL(stats.txs_removed, 2u);
+
+    UnregisterValidationInterface(&assembler);
+    SyncWithValidationInterfaceQueue();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,95 @@
+// Copyright (c) 2022 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <support/allocators/pool.h>
+
+#include <memusage.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(basic_allocations) {
+    PoolResource<32, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024);
+    // No chunk is allocated until memory is requested.
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0);
+
+    // Blocks are carved out of the chunk one after the other, rounded up to
+    // the alignment.
+    auto *a = static_cast<std::byte *>(resource.Allocate(8, 8));
+    auto *b = static_cast<std::byte *>(resource.Allocate(5, 8));
+    auto *c = static_cast<std::byte *>(resource.Allocate(16, 8));
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1);
+    BOOST_CHECK(b == a + 8);
+    BOOST_CHECK(c == b + 8);
+
+    // Freed blocks are reused for allocations of the same size only.
+    resource.Deallocate(b, 5, 8);
+    auto *d = static_cast<std::byte *>(resource.Allocate(16, 8));
+    BOOST_CHECK(d == c + 16);
+    BOOST_CHECK(resource.Allocate(8, 8) == b);
+
+    // Too large or too aligned allocations are not served from the pool.
+    void *large = resource.Allocate(33, 8);
+    void *aligned = resource.Allocate(16, 16);
+    resource.Deallocate(large, 33, 8);
+    resource.Deallocate(aligned, 16, 16);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1);
+
+    // Filling the chunk up allocates a new one.
+    for (size_t i = 0; i < 1024 / 32; ++i) {
+        resource.Allocate(32, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(unordered_map) {
+    using Map = std::unordered_map<
+        uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+        PoolAllocator<std::pair<const uint64_t, uint64_t>,
+                      sizeof(std::pair<const uint64_t, uint64_t>) +
+                          sizeof(void *) * 4>>;
+
+    Map map;
+    BOOST_CHECK_EQUAL(map.get_allocator().resource()->NumAllocatedChunks(), 0);
+    for (uint64_t i = 0; i < 100000; ++i) {
+        map[i] = i * i;
+    }
+    for (uint64_t i = 0; i < 100000; i += 2) {
+        map.erase(i);
+    }
+    for (uint64_t i = 0; i < 100000; ++i) {
+        auto it = map.find(i);
+        BOOST_CHECK(i % 2 == 0 ? it == map.end() : it->second == i * i);
+    }
+
+    // The memory usage accounts for the whole chunks.
+    const auto &resource = map.get_allocator().resource();
+    BOOST_CHECK(resource->NumAllocatedChunks() > 0);
+    BOOST_CHECK(memusage::DynamicUsage(map) >=
+                resource->NumAllocatedChunks() * resource->ChunkSizeBytes());
+
+    // Erased nodes are recycled rather than taken from new chunks.
+    const size_t chunks = resource->NumAllocatedChunks();
+    for (uint64_t i = 0; i < 100000; i += 2) {
+        map[i] = i;
+    }
+    BOOST_CHECK_EQUAL(resource->NumAllocatedChunks(), chunks);
+
+    // A moved map keeps its pool alive on its own.
+    Map moved(std::move(map));
+    map = Map();
+    BOOST_CHECK_EQUAL(moved.size(), 100000);
+    BOOST_CHECK_EQUAL(moved.at(99999), uint64_t{99999} * 99999);
+    BOOST_CHECK(moved.get_allocator() != map.get_allocator());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,8 @@
 #include <script/sigcache.h>
 
 #include <key.h>
+#include <clientversion.h>
+#include <fs.h>
 #include <key_io.h>
 #include <streams.h>
 #include <tinyformat.h>
@@ -115,4 +117,127 @@ BOOST_AUTO_TEST_CASE(sig_pubkey_hash_variations) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(schnorr_batch) {
+    CDataStream stream(
+        ParseHex(
+            "010000000122739e70fbee987a8be1788395a2f2e6ad18ccb7ff611cd798071539"
+            "dde3c38e000000000151ffffffff010000000000000000016a00000000"),
+        SER_NETWORK, PROTOCOL_VERSION);
+    CTransaction dummyTx(deserialize, stream);
+    PrecomputedTransactionData txdata(dummyTx);
+    SchnorrSignatureBatch batch;
+    CachingTransactionSignatureChecker checker(&dummyTx, 0, 0 * SATOSHI, true,
+                                               txdata, &batch);
+
+    TestCachingTransactionSignatureChecker testChecker(checker);
+
+    CKey key = DecodeSecret(strSecret1C);
+    CPubKey pubkey = key.GetPubKey();
+
+    std::vector<std::vector<uint8_t>> sigs;
+    std::vector<uint256> hashes;
+    for (int n = 0; n < 100; n++) {
+        hashes.push_back(Hash(strprintf("Sigcache batch test %i", n)));
+        sigs.emplace_back();
+        BOOST_CHECK(key.SignSchnorr(hashes.back(), sigs.back()));
+    }
+
+    // Valid batch: the verification is deferred, and the signatures are only
+    // cached once the batch has been verified.
+    for (int n = 0; n < 50; n++) {
+        BOOST_CHECK(testChecker.VerifyAndStore(sigs[n], pubkey, hashes[n]));
+        BOOST_CHECK(!testChecker.IsCached(sigs[n], pubkey, hashes[n]));
+    }
+    BOOST_CHECK_EQUAL(batch.size(), 50U);
+    BOOST_CHECK(batch.Verify());
+    BOOST_CHECK_EQUAL(batch.size(), 0U);
+    for (int n = 0; n < 50; n++) {
+        BOOST_CHECK(testChecker.IsCached(sigs[n], pubkey, hashes[n]));
+    }
+
+    // Cached signatures don't need to be added to the batch again.
+    BOOST_CHECK(testChecker.VerifyAndStore(sigs[0], pubkey, hashes[0]));
+    BOOST_CHECK_EQUAL(batch.size(), 0U);
+
+    // An invalid signature is optimistically accepted, but fails the whole
+    // batch, and nothing gets cached.
+    for (int n = 50; n < 100; n++) {
+        BOOST_CHECK(testChecker.VerifyAndStore(sigs[n], pubkey, hashes[n]));
+    }
+    BOOST_CHECK(testChecker.VerifyAndStore(sigs[50], pubkey, hashes[51]));
+    BOOST_CHECK_EQUAL(batch.size(), 51U);
+    BOOST_CHECK(!batch.Verify());
+    BOOST_CHECK_EQUAL(batch.size(), 0U);
+    for (int n = 50; n < 100; n++) {
+        BOOST_CHECK(!testChecker.IsCached(sigs[n], pubkey, hashes[n]));
+    }
+
+    // ECDSA signatures are not deferred.
+    std::vector<uint8_t> ecdsa_sig;
+    BOOST_CHECK(key.SignECDSA(hashes[0], ecdsa_sig));
+    BOOST_CHECK(testChecker.VerifyAndStore(ecdsa_sig, pubkey, hashes[0]));
+    BOOST_CHECK(!testChecker.VerifyAndStore(ecdsa_sig, pubkey, hashes[1]));
+    BOOST_CHECK_EQUAL(batch.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(persistence) {
+    CDataStream stream(
+        ParseHex(
+            "010000000122739e70fbee987a8be1788395a2f2e6ad18ccb7ff611cd798071539"
+            "dde3c38e000000000151ffffffff010000000000000000016a00000000"),
+        SER_NETWORK, PROTOCOL_VERSION);
+    CTransaction dummyTx(deserialize, stream);
+    PrecomputedTransactionData txdata(dummyTx);
+    CachingTransactionSignatureChecker checker(&dummyTx, 0, 0 * SATOSHI, true,
+                                               txdata);
+
+    TestCachingTransactionSignatureChecker testChecker(checker);
+
+    CKey key = DecodeSecret(strSecret1C);
+    CPubKey pubkey = key.GetPubKey();
+
+    std::vector<std::vector<uint8_t>> sigs;
+    std::vector<uint256> hashes;
+    for (int n = 0; n < 10; n++) {
+        hashes.push_back(Hash(strprintf("Sigcache persistence test %i", n)));
+        sigs.emplace_back();
+        BOOST_CHECK(key.SignSchnorr(hashes.back(), sigs.back()));
+        BOOST_CHECK(testChecker.VerifyAndStore(sigs[n], pubkey, hashes[n]));
+    }
+
+    // Nothing to load yet.
+    BOOST_CHECK(!LoadSignatureCache());
+    BOOST_CHECK(DumpSignatureCache());
+
+    // A restart starts over with a new nonce, so nothing is cached anymore
+    // until the saved cache is loaded.
+    InitSignatureCache();
+    for (int n = 0; n < 10; n++) {
+        BOOST_CHECK(!testChecker.IsCached(sigs[n], pubkey, hashes[n]));
+    }
+    BOOST_CHECK(LoadSignatureCache());
+    for (int n = 0; n < 10; n++) {
+        BOOST_CHECK(testChecker.IsCached(sigs[n], pubkey, hashes[n]));
+    }
+
+    // A corrupted file is ignored.
+    const fs::path path = gArgs.GetDataDirNet() / "sigcache.dat";
+    std::vector<uint8_t> data;
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        data.resize(fs::file_size(path));
+        file.read(reinterpret_cast<char *>(data.data()), data.size());
+    }
+    data[data.size() / 2] ^= 1;
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    }
+    InitSignatureCache();
+    BOOST_CHECK(!LoadSignatureCache());
+    for (int n = 0; n < 10; n++) {
+        BOOST_CHECK(!testChecker.IsCached(sigs[n], pubkey, hashes[n]));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
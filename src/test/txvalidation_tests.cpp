@@ -4,8 +4,12 @@
 
 #include <config.h>
 #include <consensus/validation.h>
+#include <key.h>
 #include <primitives/transaction.h>
+#include <script/interpreter.h>
 #include <script/script.h>
+#include <script/sighashtype.h>
+#include <txmempool.h>
 #include <validation.h>
 
 #include <test/util/setup_common.h>
@@ -48,4 +52,81 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup) {
     BOOST_CHECK_EQUAL(result.m_state.GetRejectReason(), "bad-tx-coinbase");
     BOOST_CHECK(result.m_state.GetResult() == TxValidationResult::TX_CONSENSUS);
 }
+
+/**
+ * Ensure that a batch of transactions is accepted or rejected transaction by
+ * transaction.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_batch_accept, TestChain100Setup) {
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+
+    const auto Spend = [&](const CTransactionRef &from, uint32_t n,
+                           Amount value, size_t n_outputs = 1) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(from->GetId(), n);
+        tx.vout.assign(n_outputs, CTxOut(value, scriptPubKey));
+
+        std::vector<uint8_t> vchSig;
+        uint256 hash =
+            SignatureHash(scriptPubKey, CTransaction(tx), 0,
+                          SigHashType().withForkId(), from->vout[n].nValue);
+        BOOST_CHECK(coinbaseKey.SignECDSA(hash, vchSig));
+        vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+        tx.vin[0].scriptSig << vchSig;
+        return tx;
+    };
+
+    // Split the mature coinbase into several confirmed outputs.
+    const CMutableTransaction fanout =
+        Spend(m_coinbase_txns[0], 0, 10 * COIN, 4);
+    CreateAndProcessBlock({fanout}, scriptPubKey);
+    const CTransactionRef fanout_ref = MakeTransactionRef(fanout);
+
+    const CTransactionRef valid0 =
+        MakeTransactionRef(Spend(fanout_ref, 0, 9 * COIN));
+    CMutableTransaction bad_sig = Spend(fanout_ref, 1, 9 * COIN);
+    bad_sig.vout[0].nValue = 8 * COIN;
+    const CTransactionRef valid2 =
+        MakeTransactionRef(Spend(fanout_ref, 2, 9 * COIN));
+    const CTransactionRef conflict2 =
+        MakeTransactionRef(Spend(fanout_ref, 2, 8 * COIN));
+    const CTransactionRef child0 =
+        MakeTransactionRef(Spend(valid0, 0, 8 * COIN));
+
+    LOCK(cs_main);
+    const std::vector<MempoolAcceptResult> results =
+        m_node.chainman->ProcessTransactions(
+            {valid0, MakeTransactionRef(bad_sig), valid2, conflict2, child0,
+             valid0});
+    BOOST_REQUIRE_EQUAL(results.size(), 6U);
+
+    BOOST_CHECK(results[0].m_result_type ==
+                MempoolAcceptResult::ResultType::VALID);
+    BOOST_CHECK(results[1].m_result_type ==
+                MempoolAcceptResult::ResultType::INVALID);
+    BOOST_CHECK(results[1].m_state.GetResult() ==
+                TxValidationResult::TX_CONSENSUS);
+    BOOST_CHECK(results[2].m_result_type ==
+                MempoolAcceptResult::ResultType::VALID);
+    BOOST_CHECK_EQUAL(results[3].m_state.GetRejectReason(),
+                      "txn-mempool-conflict");
+    BOOST_CHECK_EQUAL(results[4].m_state.GetRejectReason(),
+                      "bad-txns-inputs-missingorspent");
+    BOOST_CHECK_EQUAL(results[5].m_state.GetRejectReason(),
+                      "txn-already-in-mempool");
+
+    // The sigchecks counted by the parallel script checks are the same as the
+    // ones counted by the serial ones.
+    LOCK(m_node.mempool->cs);
+    BOOST_CHECK_EQUAL(m_node.mempool->size(), 2U);
+    for (const CTransactionRef &tx : {valid0, valid2}) {
+        auto it = m_node.mempool->GetIter(tx->GetId());
+        BOOST_REQUIRE(it);
+        BOOST_CHECK_EQUAL((*it)->GetSigChecks(), 1);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -690,4 +690,29 @@ BOOST_AUTO_TEST_CASE(scriptcache_values) {
     CHECK_CACHE_HAS(key1A, 42);
 }
 
+BOOST_FIXTURE_TEST_CASE(scriptcache_persistence, BasicTestingSetup) {
+    LOCK(cs_main);
+    InitScriptExecutionCache();
+
+    CMutableTransaction tx1;
+    tx1.nVersion = 1;
+    CMutableTransaction tx2;
+    tx2.nVersion = 2;
+    uint32_t flags = 0x7fffffff;
+    AddKeyInScriptCache(ScriptCacheKey(CTransaction(tx1), flags), 42);
+    AddKeyInScriptCache(ScriptCacheKey(CTransaction(tx2), flags), 0);
+    BOOST_CHECK(DumpScriptExecutionCache());
+
+    // A restart starts over with a new nonce, so the keys don't match the
+    // entries from before anymore...
+    InitScriptExecutionCache();
+    CHECK_CACHE_MISSING(ScriptCacheKey(CTransaction(tx1), flags));
+    CHECK_CACHE_MISSING(ScriptCacheKey(CTransaction(tx2), flags));
+
+    // ... until the saved cache, along with its nonce, is loaded.
+    BOOST_CHECK(LoadScriptExecutionCache());
+    CHECK_CACHE_HAS(ScriptCacheKey(CTransaction(tx1), flags), 42);
+    CHECK_CACHE_HAS(ScriptCacheKey(CTransaction(tx2), flags), 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 
 #include <addrman.h>
 #include <banman.h>
+#include <blockencodings.h>
 #include <chainparams.h>
 #include <config.h>
 #include <consensus/consensus.h>
@@ -189,6 +190,10 @@ ChainTestingSetup::ChainTestingSetup(
 
     constexpr int script_check_threads = 2;
     StartScriptCheckWorkerThreads(script_check_threads);
+    StartInputFetchWorkerThreads(script_check_threads);
+    StartTxCheckWorkerThreads(script_check_threads);
+    StartShortIdWorkerThreads(script_check_threads);
+    StartBlockReadAheadThreads(script_check_threads);
 }
 
 ChainTestingSetup::~ChainTestingSetup() {
@@ -196,6 +201,10 @@ ChainTestingSetup::~ChainTestingSetup() {
         m_node.scheduler->stop();
     }
     StopScriptCheckWorkerThreads();
+    StopInputFetchWorkerThreads();
+    StopTxCheckWorkerThreads();
+    StopShortIdWorkerThreads();
+    StopBlockReadAheadThreads();
     GetMainSignals().FlushBackgroundCallbacks();
     GetMainSignals().UnregisterBackgroundSignalScheduler();
     m_node.connman.reset();
@@ -5,6 +5,8 @@
 #include <chainparams.h>
 #include <config.h>
 #include <consensus/validation.h>
+#include <hash.h>
+#include <node/coinstats.h>
 #include <node/utxo_snapshot.h>
 #include <random.h>
 #include <rpc/blockchain.h>
@@ -20,6 +22,12 @@
 
 #include <boost/test/unit_test.hpp>
 
+using node::CCoinsStats;
+using node::CoinsSerializedHasher;
+using node::CoinStatsHashType;
+using node::GetUTXOStats;
+using node::SnapshotChunk;
+using node::SnapshotCoinsBatch;
 using node::SnapshotMetadata;
 
 BOOST_FIXTURE_TEST_SUITE(validation_chainstatemanager_tests, ChainTestingSetup)
@@ -208,14 +216,13 @@ BOOST_FIXTURE_TEST_CASE(chainstatemanager_activate_snapshot,
     BOOST_REQUIRE(!CreateAndActivateUTXOSnapshot(
         m_node, m_path_root,
         [](CAutoFile &auto_infile, SnapshotMetadata &metadata) {
-            // A UTXO is missing but count is correct
-            metadata.m_coins_count -= 1;
-
-            COutPoint outpoint;
-            Coin coin;
+            // A chunk is missing but count is correct
+            SnapshotChunk chunk;
+            auto_infile >> chunk;
 
-            auto_infile >> outpoint;
-            auto_infile >> coin;
+            SnapshotCoinsBatch coins;
+            chunk.Decode(coins);
+            metadata.m_coins_count -= coins.size();
         }));
     BOOST_REQUIRE(!CreateAndActivateUTXOSnapshot(
         m_node, m_path_root,
@@ -241,6 +248,58 @@ BOOST_FIXTURE_TEST_CASE(chainstatemanager_activate_snapshot,
             // Wrong hash
             metadata.m_base_blockhash = BlockHash{uint256::ONE};
         }));
+
+    // Should not load a snapshot with a forged coin stored before the real
+    // coin for the same outpoint, even though the hash of the coins as read
+    // matches: only the first one of duplicate outpoints gets inserted. The
+    // two coins are in the same chunk, or in consecutive ones.
+    for (const bool split : {false, true}) {
+        const fs::path forged_path = m_path_root / "forged_snapshot.dat";
+        {
+            FILE *infile{fsbridge::fopen(
+                m_path_root / tfm::format("test_snapshot.%d.dat",
+                                          snapshot_height),
+                "rb")};
+            CAutoFile auto_infile{infile, SER_DISK, CLIENT_VERSION};
+            SnapshotMetadata metadata;
+            auto_infile >> metadata;
+            SnapshotCoinsBatch coins;
+            while (coins.size() < metadata.m_coins_count) {
+                SnapshotChunk chunk;
+                auto_infile >> chunk;
+                chunk.Decode(coins);
+            }
+
+            BOOST_REQUIRE(!coins.empty());
+            // Copied, as the insertion may reallocate the coins.
+            const auto [outpoint, coin] = coins.back();
+            Coin forged{CTxOut{coin.GetTxOut().nValue + COIN,
+                               CScript() << OP_TRUE},
+                        coin.GetHeight(), coin.IsCoinBase()};
+            coins.emplace(std::prev(coins.end()), outpoint, std::move(forged));
+            metadata.m_coins_count = coins.size();
+
+            FILE *outfile{fsbridge::fopen(forged_path, "wb")};
+            CAutoFile auto_outfile{outfile, SER_DISK, CLIENT_VERSION};
+            auto_outfile << metadata;
+            if (split) {
+                const SnapshotCoinsBatch last{coins.back()};
+                coins.pop_back();
+                auto_outfile << SnapshotChunk::Encode(coins)
+                             << SnapshotChunk::Encode(last);
+            } else {
+                auto_outfile << SnapshotChunk::Encode(coins);
+            }
+        }
+
+        FILE *infile{fsbridge::fopen(forged_path, "rb")};
+        CAutoFile auto_infile{infile, SER_DISK, CLIENT_VERSION};
+        SnapshotMetadata metadata;
+        auto_infile >> metadata;
+        BOOST_REQUIRE(!chainman.ActivateSnapshot(auto_infile, metadata,
+                                                 /*in_memory*/ true));
+    }
+
     BOOST_REQUIRE(CreateAndActivateUTXOSnapshot(m_node, m_path_root));
 
     // Ensure our active chain is the snapshot chainstate.
@@ -411,4 +470,102 @@ BOOST_FIXTURE_TEST_CASE(chainstatemanager_loadblockindex, TestChain100Setup) {
     BOOST_CHECK_EQUAL(cs2.setBlockIndexCandidates.size(), num_indexes);
 }
 
+//! The hash computed while loading a snapshot must match the one computed from
+//! the coins database, or the database would always have to be hashed again.
+BOOST_FIXTURE_TEST_CASE(chainstatemanager_snapshot_hash, TestChain100Setup) {
+    CChainState &chainstate = m_node.chainman->ActiveChainstate();
+    LOCK(::cs_main);
+    chainstate.ForceFlushStateToDisk();
+    CCoinsViewDB &coinsdb = chainstate.CoinsDB();
+
+    CCoinsStats stats{CoinStatsHashType::HASH_SERIALIZED};
+    BOOST_REQUIRE(
+        GetUTXOStats(&coinsdb, m_node.chainman->m_blockman, stats, [] {}));
+
+    CoinsSerializedHasher hasher(coinsdb.GetBestBlock());
+    std::unique_ptr<CCoinsViewCursor> cursor(coinsdb.Cursor());
+    uint64_t coins_count = 0;
+    for (; cursor->Valid(); cursor->Next()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_REQUIRE(cursor->GetKey(outpoint) && cursor->GetValue(coin));
+        hasher.Add(outpoint, coin);
+        ++coins_count;
+    }
+    BOOST_CHECK_EQUAL(coins_count, stats.coins_count);
+    BOOST_CHECK_EQUAL(hasher.Finalize(), stats.hashSerialized);
+}
+
+//! Snapshot chunks must give back the coins they were built from, in order,
+//! and detect corruption.
+BOOST_AUTO_TEST_CASE(snapshot_chunk_encoding) {
+    const TxId txid1{InsecureRand256()};
+    const TxId txid2{InsecureRand256()};
+    const Coin coin{CTxOut{1234 * SATOSHI, CScript() << OP_TRUE}, 42, false};
+    const Coin coinbase{CTxOut{50 * COIN, CScript() << OP_FALSE}, 7, true};
+
+    SnapshotCoinsBatch coins;
+    coins.emplace_back(COutPoint{txid1, 0}, coin);
+    coins.emplace_back(COutPoint{txid1, 5}, coinbase);
+    coins.emplace_back(COutPoint{txid1, 100000}, coin);
+    // Not increasing, starts a new group for the same txid.
+    coins.emplace_back(COutPoint{txid1, 3}, coin);
+    coins.emplace_back(COutPoint{txid2, 0xfffffffe}, coinbase);
+
+    const SnapshotChunk chunk = SnapshotChunk::Encode(coins);
+    BOOST_CHECK(chunk.IsValid());
+
+    SnapshotCoinsBatch decoded;
+    chunk.Decode(decoded);
+    BOOST_CHECK_EQUAL(decoded.size(), coins.size());
+    for (size_t i = 0; i < std::min(decoded.size(), coins.size()); ++i) {
+        BOOST_CHECK(decoded[i].first == coins[i].first);
+        BOOST_CHECK(decoded[i].second.GetTxOut() == coins[i].second.GetTxOut());
+        BOOST_CHECK_EQUAL(decoded[i].second.GetHeight(),
+                          coins[i].second.GetHeight());
+        BOOST_CHECK_EQUAL(decoded[i].second.IsCoinBase(),
+                          coins[i].second.IsCoinBase());
+    }
+
+    // Round trip through serialization.
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << chunk;
+    SnapshotChunk read_chunk;
+    stream >> read_chunk;
+    BOOST_CHECK(read_chunk.IsValid());
+    BOOST_CHECK(read_chunk.m_payload == chunk.m_payload);
+
+    // Any corruption of the payload is caught by the checksum.
+    SnapshotChunk corrupted = chunk;
+    corrupted.m_payload[corrupted.m_payload.size() / 2] ^= 1;
+    BOOST_CHECK(!corrupted.IsValid());
+
+    // A truncated payload fails to decode.
+    SnapshotChunk truncated = chunk;
+    truncated.m_payload.pop_back();
+    SnapshotCoinsBatch truncated_coins;
+    BOOST_CHECK_THROW(truncated.Decode(truncated_coins),
+                      std::ios_base::failure);
+
+    // A coins count the payload cannot hold fails to decode, before anything
+    // gets allocated for these coins.
+    SnapshotChunk oversized;
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, oversized.m_payload, 0);
+    WriteCompactSize(writer, uint64_t{1} << 47);
+    writer << txid1;
+    oversized.m_checksum = Hash(oversized.m_payload);
+    BOOST_CHECK(oversized.IsValid());
+    SnapshotCoinsBatch oversized_coins;
+    BOOST_CHECK_THROW(oversized.Decode(oversized_coins),
+                      std::ios_base::failure);
+
+    // Grouping by txid saves repeating it for every coin.
+    size_t plain_size = 0;
+    for (const auto &[outpoint, c] : coins) {
+        plain_size += GetSerializeSize(outpoint, CLIENT_VERSION) +
+                      GetSerializeSize(c, CLIENT_VERSION);
+    }
+    BOOST_CHECK_LT(chunk.m_payload.size(), plain_size);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
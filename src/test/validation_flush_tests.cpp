@@ -56,7 +56,9 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate) {
             "CCoinsViewCache memory usage: " << _view.DynamicMemoryUsage());
     };
 
-    constexpr size_t MAX_COINS_CACHE_BYTES = 1024;
+    // The coins cache allocates its first 256 KiB pool chunk along with the
+    // first coin, so leave a little room on top of it.
+    constexpr size_t MAX_COINS_CACHE_BYTES = 262144 + 512;
 
     // Without any coins in the cache, we shouldn't need to flush.
     BOOST_CHECK_EQUAL(chainstate.GetCoinsCacheSizeState(
@@ -98,10 +100,12 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate) {
         COutPoint res = add_coin(view);
         print_view_mem_usage(view);
         BOOST_CHECK_EQUAL(view.AccessCoin(res).DynamicMemoryUsage(), COIN_SIZE);
+        // The pool chunk allocated for the first coin takes us over to LARGE
+        // right away.
         BOOST_CHECK_EQUAL(
             chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES,
                                               /*max_mempool_size_bytes*/ 0),
-            CoinsCacheSizeState::OK);
+            CoinsCacheSizeState::LARGE);
     }
 
     // Adding some additional coins will push us over the edge to CRITICAL.
@@ -122,7 +126,7 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate) {
     // Passing non-zero max mempool usage should allow us more headroom.
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES,
-                                          /*max_mempool_size_bytes*/ 1 << 10),
+                                          /*max_mempool_size_bytes*/ 1 << 19),
         CoinsCacheSizeState::OK);
 
     for (int i{0}; i < 3; ++i) {
@@ -130,7 +134,7 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate) {
         print_view_mem_usage(view);
         BOOST_CHECK_EQUAL(
             chainstate.GetCoinsCacheSizeState(
-                MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 10),
+                MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 19),
             CoinsCacheSizeState::OK);
     }
 
@@ -159,8 +163,8 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate) {
                           CoinsCacheSizeState::OK);
     }
 
-    // Flushing the view doesn't take us back to OK because cacheCoins has
-    // preallocated memory that doesn't get reclaimed even after flush.
+    // Flushing the view takes us back to OK, as the flushed cache starts over
+    // with a fresh pool.
 
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, 0),
@@ -172,7 +176,7 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate) {
 
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(MAX_COINS_CACHE_BYTES, 0),
-        CoinsCacheSizeState::CRITICAL);
+        CoinsCacheSizeState::OK);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
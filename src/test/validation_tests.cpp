@@ -6,14 +6,20 @@
 #include <validation.h>
 
 #include <chainparams.h>
+#include <checkqueue.h>
 #include <clientversion.h>
+#include <coins.h>
 #include <config.h>
 #include <consensus/amount.h>
 #include <consensus/consensus.h>
+#include <fs.h>
 #include <net.h>
+#include <node/blockstorage.h>
 #include <primitives/transaction.h>
 #include <streams.h>
 #include <uint256.h>
+#include <undo.h>
+#include <util/strencodings.h>
 #include <util/system.h>
 #include <validation.h>
 
@@ -24,6 +30,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <map>
+#include <string>
 #include <vector>
 
 BOOST_FIXTURE_TEST_SUITE(validation_tests, TestingSetup)
@@ -161,4 +169,347 @@ BOOST_AUTO_TEST_CASE(test_assumeutxo) {
     BOOST_CHECK_EQUAL(out210.nChainTx, (unsigned int)210);
 }
 
+namespace {
+/**
+ * A read-only view that can safely be queried from several threads, like the
+ * coins database.
+ */
+class ThreadSafeCoinsView : public CCoinsView {
+public:
+    std::map<COutPoint, Coin> m_coins;
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override {
+        auto it = m_coins.find(outpoint);
+        if (it == m_coins.end()) {
+            return false;
+        }
+        coin = it->second;
+        return true;
+    }
+};
+} // namespace
+
+static void CheckPrefetchBlockInputs(CCheckQueue<CInputFetchCheck> *queue) {
+    ThreadSafeCoinsView base;
+    std::vector<COutPoint> base_outpoints;
+    for (uint32_t i = 0; i < 4; i++) {
+        const COutPoint outpoint(TxId(InsecureRand256()), i);
+        base.m_coins.emplace(
+            outpoint, Coin(CTxOut(int64_t(i + 1) * COIN, CScript() << OP_TRUE),
+                           1, false));
+        base_outpoints.push_back(outpoint);
+    }
+
+    CCoinsViewCache cache(&base);
+    // The last coin is spent in the cache, and the spentness has not been
+    // flushed to the base yet: it must not be resurrected by the prefetch.
+    BOOST_CHECK(cache.SpendCoin(base_outpoints[3]));
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.emplace_back(50 * COIN, CScript() << OP_TRUE);
+
+    CMutableTransaction parent;
+    parent.vin.emplace_back(base_outpoints[0]);
+    parent.vin.emplace_back(base_outpoints[1]);
+    parent.vout.emplace_back(2 * COIN, CScript() << OP_TRUE);
+    const CTransactionRef parent_tx = MakeTransactionRef(parent);
+
+    CMutableTransaction child;
+    child.vin.emplace_back(COutPoint(parent_tx->GetId(), 0));
+    child.vin.emplace_back(base_outpoints[2]);
+    child.vin.emplace_back(base_outpoints[3]);
+    // Not in the base view at all.
+    const COutPoint missing(TxId(InsecureRand256()), 0);
+    child.vin.emplace_back(missing);
+    child.vout.emplace_back(COIN, CScript() << OP_TRUE);
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    block.vtx.push_back(parent_tx);
+    block.vtx.push_back(MakeTransactionRef(child));
+
+    BOOST_CHECK_EQUAL(PrefetchBlockInputs(block, cache, base, queue), 3U);
+    for (size_t i = 0; i < 3; i++) {
+        BOOST_CHECK(cache.HaveCoinInCache(base_outpoints[i]));
+        BOOST_CHECK(cache.AccessCoin(base_outpoints[i]).GetTxOut() ==
+                    base.m_coins.at(base_outpoints[i]).GetTxOut());
+    }
+    BOOST_CHECK(!cache.HaveCoinInCache(base_outpoints[3]));
+    BOOST_CHECK(!cache.HaveCoinInCache(COutPoint(parent_tx->GetId(), 0)));
+    BOOST_CHECK(!cache.HaveCoinInCache(missing));
+    // 3 prefetched coins + the spent one.
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 4U);
+
+    // Everything is cached now, so there is nothing left to prefetch.
+    BOOST_CHECK_EQUAL(PrefetchBlockInputs(block, cache, base, queue), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_block_inputs) {
+    // Prefetch on the calling thread only.
+    CheckPrefetchBlockInputs(nullptr);
+
+    CCheckQueue<CInputFetchCheck> queue(1);
+    queue.StartWorkerThreads(3);
+    CheckPrefetchBlockInputs(&queue);
+    queue.StopWorkerThreads();
+}
+
+BOOST_FIXTURE_TEST_CASE(connect_blocks_read_ahead, TestChain100Setup) {
+    CChainState &chainstate = m_node.chainman->ActiveChainstate();
+    const Config &config = GetConfig();
+    CBlockIndex *tip = WITH_LOCK(cs_main, return chainstate.m_chain.Tip());
+    CBlockIndex *pindex = tip->GetAncestor(50);
+
+    // Disconnect half of the chain, and have it connected back from disk,
+    // going through the blocks read ahead.
+    BlockValidationState state;
+    BOOST_CHECK(chainstate.InvalidateBlock(config, state, pindex));
+    BOOST_CHECK_EQUAL(WITH_LOCK(cs_main, return chainstate.m_chain.Height()),
+                      49);
+
+    const uint64_t taken_before =
+        WITH_LOCK(cs_main, return chainstate.m_blocks_read_ahead_taken);
+    WITH_LOCK(cs_main, chainstate.ResetBlockFailureFlags(pindex));
+    BOOST_CHECK(chainstate.ActivateBestChain(config, state));
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(chainstate.m_chain.Tip(), tip);
+    // Each ActivateBestChainStep() call reads the blocks following the first
+    // one ahead, which are then connected from memory.
+    BOOST_CHECK_GE(chainstate.m_blocks_read_ahead_taken - taken_before,
+                   uint64_t(MAX_BLOCKS_READ_AHEAD));
+    BOOST_CHECK_EQUAL(chainstate.CoinsTip().GetBestBlock(),
+                      tip->GetBlockHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(read_raw_block_from_disk, TestChain100Setup) {
+    const CChainParams &params = GetConfig().GetChainParams();
+    const CBlockIndex *tip =
+        WITH_LOCK(cs_main, return m_node.chainman->ActiveTip());
+
+    // The raw block is the serialization of the deserialized block.
+    CBlock block;
+    BOOST_REQUIRE(node::ReadBlockFromDisk(block, tip, params.GetConsensus()));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+
+    std::vector<uint8_t> block_data;
+    BOOST_REQUIRE(
+        node::ReadRawBlockFromDisk(block_data, tip, params.DiskMagic()));
+    BOOST_CHECK_EQUAL(HexStr(block_data), HexStr(ss));
+
+    // The header must match the expected block.
+    const BlockHash wrong_hash = tip->pprev->GetBlockHash();
+    CBlockIndex wrong_index{*tip};
+    wrong_index.phashBlock = &wrong_hash;
+    BOOST_CHECK(!node::ReadRawBlockFromDisk(block_data, &wrong_index,
+                                            params.DiskMagic()));
+    BOOST_CHECK(block_data.empty());
+
+    // The storage header must carry the disk magic.
+    CMessageHeader::MessageMagic wrong_magic = params.DiskMagic();
+    wrong_magic[0] ^= 0xff;
+    BOOST_CHECK(!node::ReadRawBlockFromDisk(block_data, tip, wrong_magic));
+    BOOST_CHECK(!node::ReadRawBlockFromDisk(
+        block_data, WITH_LOCK(cs_main, return tip->GetBlockPos()),
+        wrong_magic));
+}
+
+BOOST_FIXTURE_TEST_CASE(read_block_from_mapped_file, TestChain100Setup) {
+    const Consensus::Params &params =
+        GetConfig().GetChainParams().GetConsensus();
+
+    // Read a block and its undo data, serialized, with or without
+    // -mmapblockfiles.
+    auto read_block = [&](const CBlockIndex *pindex, bool mapped) {
+        gArgs.ForceSetArg("-mmapblockfiles", mapped ? "1" : "0");
+        CBlock block;
+        CBlockUndo undo;
+        BOOST_CHECK(node::ReadBlockFromDisk(block, pindex, params));
+        BOOST_CHECK(node::UndoReadFromDisk(undo, pindex));
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << block << undo;
+        return HexStr(ss);
+    };
+
+    const CBlockIndex *tip =
+        WITH_LOCK(cs_main, return m_node.chainman->ActiveTip());
+    for (const CBlockIndex *pindex = tip; pindex->pprev;
+         pindex = pindex->pprev) {
+        BOOST_CHECK_EQUAL(read_block(pindex, true), read_block(pindex, false));
+    }
+
+    // Blocks written after the files got mapped can be read as well.
+    gArgs.ForceSetArg("-mmapblockfiles", "1");
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    tip = WITH_LOCK(cs_main, return m_node.chainman->ActiveTip());
+    BOOST_CHECK_EQUAL(read_block(tip, true), read_block(tip, false));
+
+    // The checksum of the mapped undo data is verified.
+    CBlockIndex wrong_index{*tip};
+    wrong_index.pprev = tip->pprev->pprev;
+    gArgs.ForceSetArg("-mmapblockfiles", "1");
+    CBlockUndo undo;
+    BOOST_CHECK(!node::UndoReadFromDisk(undo, &wrong_index));
+
+    gArgs.ClearForcedArg("-mmapblockfiles");
+}
+
+BOOST_FIXTURE_TEST_CASE(compressed_block_storage, TestChain100Setup) {
+    const CChainParams &params = GetConfig().GetChainParams();
+    gArgs.ForceSetArg("-blockcompression", "1");
+
+    // An output script which compresses well and can be spent by anyone, so
+    // both the blocks and the undo data get compressed.
+    const CScript script = CScript() << std::vector<uint8_t>(500, 0x42)
+                                     << OP_DROP << OP_TRUE;
+    CMutableTransaction tx = CreateValidMempoolTransaction(
+        m_coinbase_txns[0], 0, 0, coinbaseKey, script, COIN, false);
+    CreateAndProcessBlock({tx}, script);
+    CMutableTransaction spend;
+    spend.vin.emplace_back(COutPoint(tx.GetId(), 0));
+    spend.vout.emplace_back(COIN / 2, script);
+    CreateAndProcessBlock({spend}, script);
+
+    const CBlockIndex *tip =
+        WITH_LOCK(cs_main, return m_node.chainman->ActiveTip());
+    BOOST_CHECK_EQUAL(tip->nHeight, 102);
+    {
+        // The size field of the storage header is flagged, and the stored
+        // block is smaller.
+        CBlock block;
+        BOOST_CHECK(node::ReadBlockFromDisk(block, tip, params.GetConsensus()));
+        const FlatFilePos pos = WITH_LOCK(cs_main, return tip->GetBlockPos());
+        CAutoFile file(
+            node::OpenBlockFile({pos.nFile, pos.nPos - 4}, true), SER_DISK,
+            CLIENT_VERSION);
+        uint32_t stored_size;
+        file >> stored_size;
+        BOOST_CHECK(stored_size & node::BLOCK_STORAGE_COMPRESSED_FLAG);
+        BOOST_CHECK((stored_size & ~node::BLOCK_STORAGE_COMPRESSED_FLAG) <
+                    GetSerializeSize(block, CLIENT_VERSION) / 2);
+    }
+
+    // The compressed and uncompressed blocks are read the same, with or
+    // without -mmapblockfiles.
+    for (const CBlockIndex *pindex = tip; pindex->nHeight > 98;
+         pindex = pindex->pprev) {
+        for (const bool mapped : {false, true}) {
+            gArgs.ForceSetArg("-mmapblockfiles", mapped ? "1" : "0");
+            CBlock block;
+            BOOST_CHECK(
+                node::ReadBlockFromDisk(block, pindex, params.GetConsensus()));
+            CBlockUndo undo;
+            BOOST_CHECK(node::UndoReadFromDisk(undo, pindex));
+            BOOST_CHECK_EQUAL(undo.vtxundo.size(), block.vtx.size() - 1);
+
+            std::vector<uint8_t> block_data;
+            BOOST_CHECK(node::ReadRawBlockFromDisk(block_data, pindex,
+                                                   params.DiskMagic()));
+            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+            ss << block;
+            BOOST_CHECK_EQUAL(HexStr(block_data), HexStr(ss));
+        }
+    }
+
+    gArgs.ClearForcedArg("-mmapblockfiles");
+    gArgs.ClearForcedArg("-blockcompression");
+}
+
+BOOST_FIXTURE_TEST_CASE(block_index_snapshot, TestChain100Setup) {
+    const Consensus::Params &params =
+        GetConfig().GetChainParams().GetConsensus();
+    node::BlockManager &blockman = m_node.chainman->m_blockman;
+
+    auto describe = [](const node::BlockMap &block_index) {
+        std::map<BlockHash, std::string> entries;
+        for (const auto &[hash, pindex] : block_index) {
+            const BlockHash prev =
+                pindex->pprev ? pindex->pprev->GetBlockHash() : BlockHash();
+            entries.emplace(
+                hash,
+                strprintf("%s %d %d %u %u %d %s %u %u %u %u %u",
+                          prev.ToString(), pindex->nHeight, pindex->nFile,
+                          pindex->nDataPos, pindex->nUndoPos, pindex->nVersion,
+                          pindex->hashMerkleRoot.ToString(), pindex->nTime,
+                          pindex->nBits, pindex->nNonce,
+                          pindex->nStatus.getRawValue(), pindex->nTx));
+        }
+        return entries;
+    };
+
+    // Load the snapshot with another block manager, sharing the block tree
+    // database.
+    auto load_snapshot = [&](std::map<BlockHash, std::string> &entries) {
+        LOCK(cs_main);
+        node::BlockManager loaded;
+        loaded.m_block_tree_db = std::move(blockman.m_block_tree_db);
+        const bool ok = loaded.LoadBlockIndexSnapshot(params);
+        blockman.m_block_tree_db = std::move(loaded.m_block_tree_db);
+        entries = describe(loaded.m_block_index);
+        return ok;
+    };
+
+    const fs::path path = gArgs.GetBlocksDirPath() / "blockindex.dat";
+    std::map<BlockHash, std::string> entries;
+    {
+        LOCK(cs_main);
+        m_node.chainman->ActiveChainstate().ForceFlushStateToDisk();
+        const std::map<BlockHash, std::string> expected =
+            describe(blockman.m_block_index);
+        BOOST_CHECK_EQUAL(expected.size(), 101U);
+
+        BOOST_CHECK(blockman.WriteBlockIndexSnapshot());
+        BOOST_CHECK(load_snapshot(entries));
+        BOOST_CHECK(entries == expected);
+
+        // A snapshot is only loaded once.
+        BOOST_CHECK(!fs::exists(path));
+        BOOST_CHECK(!load_snapshot(entries));
+        BOOST_CHECK(entries.empty());
+
+        // A corrupted snapshot is not loaded.
+        BOOST_CHECK(blockman.WriteBlockIndexSnapshot());
+        FILE *file = fsbridge::fopen(path, "r+b");
+        BOOST_REQUIRE(file);
+        BOOST_CHECK_EQUAL(fseek(file, -64, SEEK_END), 0);
+        const int byte = fgetc(file);
+        BOOST_CHECK_EQUAL(fseek(file, -64, SEEK_END), 0);
+        fputc(byte ^ 0xff, file);
+        fclose(file);
+        BOOST_CHECK(!load_snapshot(entries));
+        BOOST_CHECK(entries.empty());
+
+        BOOST_CHECK(blockman.WriteBlockIndexSnapshot());
+    }
+
+    // The snapshot is stale once the status of a block has changed, even
+    // though no block data was written.
+    CChainState &chainstate = m_node.chainman->ActiveChainstate();
+    CBlockIndex *tip = WITH_LOCK(cs_main, return chainstate.m_chain.Tip());
+    BlockValidationState state;
+    BOOST_CHECK(chainstate.InvalidateBlock(GetConfig(), state, tip));
+    {
+        LOCK(cs_main);
+        chainstate.ForceFlushStateToDisk();
+        BOOST_CHECK(!load_snapshot(entries));
+        BOOST_CHECK(entries.empty());
+        chainstate.ResetBlockFailureFlags(tip);
+    }
+    BOOST_CHECK(chainstate.ActivateBestChain(GetConfig(), state));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(chainstate.m_chain.Tip(), tip);
+        chainstate.ForceFlushStateToDisk();
+        BOOST_CHECK(blockman.WriteBlockIndexSnapshot());
+    }
+
+    // The snapshot is stale once a block has been written.
+    CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    LOCK(cs_main);
+    chainstate.ForceFlushStateToDisk();
+    BOOST_CHECK(!load_snapshot(entries));
+    BOOST_CHECK(entries.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
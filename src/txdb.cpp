@@ -11,6 +11,7 @@
 #include <random.h>
 #include <shutdown.h>
 #include <util/system.h>
+#include <util/thread.h>
 #include <util/translation.h>
 #include <util/vector.h>
 #include <version.h>
@@ -28,6 +29,8 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_INDEX_SNAPSHOT = 'S';
+static const char DB_BLOCK_FILE_CONVERSION = 'V';
 
 // Keys used in previous version that might still be found in the DB:
 static constexpr uint8_t DB_TXINDEX_BLOCK{'T'};
@@ -99,6 +102,27 @@ bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
     return m_db->Exists(CoinEntry(&outpoint));
 }
 
+size_t CCoinsViewDB::GetCoins(Span<const COutPoint> outpoints,
+                              Span<Coin> coins) const {
+    assert(outpoints.size() == coins.size());
+    std::vector<CoinEntry> keys;
+    keys.reserve(outpoints.size());
+    for (const COutPoint &outpoint : outpoints) {
+        keys.emplace_back(&outpoint);
+    }
+
+    std::vector<std::optional<Coin>> values;
+    const size_t found = m_db->ReadMany(Span<const CoinEntry>{keys}, values);
+    for (size_t i = 0; i < coins.size(); ++i) {
+        if (values[i]) {
+            coins[i] = std::move(*values[i]);
+        } else {
+            coins[i].Clear();
+        }
+    }
+    return found;
+}
+
 BlockHash CCoinsViewDB::GetBestBlock() const {
     BlockHash hashBestChain;
     if (!m_db->Read(DB_BEST_BLOCK, hashBestChain)) {
@@ -115,7 +139,8 @@ std::vector<BlockHash> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins,
+                              const BlockHash &hashBlock, CCoinsMap *release) {
     CDBBatch batch(*m_db);
     size_t count = 0;
     size_t changed = 0;
@@ -141,7 +166,8 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin();
+         it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
             if (it->second.coin.IsSpent()) {
@@ -152,8 +178,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        it = release ? release->erase(it) : std::next(it);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n",
                      batch.SizeEstimate() * (1.0 / 1048576.0));
@@ -183,10 +208,170 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
     return ret;
 }
 
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, &mapCoins);
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins,
+                              const BlockHash &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, nullptr);
+}
+
 size_t CCoinsViewDB::EstimateSize() const {
     return m_db->EstimateSize(DB_COIN, char(DB_COIN + 1));
 }
 
+CCoinsViewBackgroundFlush::CCoinsViewBackgroundFlush(CCoinsViewDB &db)
+    : CCoinsViewBacked(&db), m_db(db) {}
+
+CCoinsViewBackgroundFlush::~CCoinsViewBackgroundFlush() {
+    WaitForFlush();
+}
+
+bool CCoinsViewBackgroundFlush::GetCoin(const COutPoint &outpoint,
+                                        Coin &coin) const {
+    std::shared_ptr<const CCoinsMap> pending =
+        WITH_LOCK(m_mutex, return m_pending);
+    if (pending) {
+        CCoinsMap::const_iterator it = pending->find(outpoint);
+        if (it != pending->end()) {
+            if (it->second.coin.IsSpent()) {
+                return false;
+            }
+            coin = it->second.coin;
+            return true;
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewBackgroundFlush::HaveCoin(const COutPoint &outpoint) const {
+    std::shared_ptr<const CCoinsMap> pending =
+        WITH_LOCK(m_mutex, return m_pending);
+    if (pending) {
+        CCoinsMap::const_iterator it = pending->find(outpoint);
+        if (it != pending->end()) {
+            return !it->second.coin.IsSpent();
+        }
+    }
+    return base->HaveCoin(outpoint);
+}
+
+size_t CCoinsViewBackgroundFlush::GetCoins(Span<const COutPoint> outpoints,
+                                           Span<Coin> coins) const {
+    assert(outpoints.size() == coins.size());
+    std::shared_ptr<const CCoinsMap> pending =
+        WITH_LOCK(m_mutex, return m_pending);
+    if (!pending) {
+        return base->GetCoins(outpoints, coins);
+    }
+
+    // Answer from the coins being written what we can, and look the others up
+    // in the database in one go.
+    size_t found = 0;
+    std::vector<size_t> missing_indices;
+    std::vector<COutPoint> missing_outpoints;
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        CCoinsMap::const_iterator it = pending->find(outpoints[i]);
+        if (it == pending->end()) {
+            missing_indices.push_back(i);
+            missing_outpoints.push_back(outpoints[i]);
+        } else if (it->second.coin.IsSpent()) {
+            coins[i].Clear();
+        } else {
+            coins[i] = it->second.coin;
+            ++found;
+        }
+    }
+
+    std::vector<Coin> missing_coins(missing_outpoints.size());
+    found += base->GetCoins(missing_outpoints, missing_coins);
+    for (size_t i = 0; i < missing_indices.size(); ++i) {
+        coins[missing_indices[i]] = std::move(missing_coins[i]);
+    }
+    return found;
+}
+
+BlockHash CCoinsViewBackgroundFlush::GetBestBlock() const {
+    {
+        LOCK(m_mutex);
+        if (m_pending) {
+            return m_pending_block;
+        }
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundFlush::BatchWrite(CCoinsMap &mapCoins,
+                                           const BlockHash &hashBlock) {
+    if (!WaitForFlush()) {
+        return false;
+    }
+    if (!m_write_in_background) {
+        return base->BatchWrite(mapCoins, hashBlock);
+    }
+
+    // Take the coins over as a whole, along with the pool they are allocated
+    // from, leaving the caller with an empty map.
+    auto pending = std::make_shared<const CCoinsMap>(std::move(mapCoins));
+    mapCoins.clear();
+    {
+        LOCK(m_mutex);
+        m_pending = pending;
+        m_pending_block = hashBlock;
+    }
+    m_writer = std::thread(
+        &util::TraceThread, "coinsflush", [this, pending, hashBlock] {
+            bool ret = false;
+            try {
+                ret = m_db.WriteCoins(*pending, hashBlock);
+            } catch (const std::exception &e) {
+                LogPrintf("Error writing coins database in the "
+                          "background: %s\n",
+                          e.what());
+            } catch (...) {
+                LogPrintf("Unknown error writing coins database in the "
+                          "background\n");
+            }
+            if (!ret) {
+                // The cache was already emptied, these coins cannot be
+                // written again.
+                AbortNode("Failed to write to coin database");
+            }
+            LOCK(m_mutex);
+            m_pending.reset();
+            m_write_failed |= !ret;
+            m_write_done_cv.notify_all();
+        });
+    return true;
+}
+
+CCoinsViewCursor *CCoinsViewBackgroundFlush::Cursor() const {
+    {
+        // The cursor iterates the database, wait for it to be complete.
+        WAIT_LOCK(m_mutex, lock);
+        m_write_done_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+            return m_pending == nullptr;
+        });
+    }
+    return base->Cursor();
+}
+
+bool CCoinsViewBackgroundFlush::FlushInBackground(CCoinsViewCache &cache) {
+    m_write_in_background = true;
+    bool ret = cache.Flush();
+    m_write_in_background = false;
+    return ret;
+}
+
+bool CCoinsViewBackgroundFlush::WaitForFlush() {
+    if (m_writer.joinable()) {
+        m_writer.join();
+    }
+    LOCK(m_mutex);
+    return !m_write_failed;
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe)
     : CDBWrapper(gArgs.GetDataDirNet() / "blocks" / "index", nCacheSize,
                  fMemory, fWipe) {}
@@ -211,6 +396,40 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
 
+bool CBlockTreeDB::WriteBlockIndexSnapshotId(const uint256 &id) {
+    return Write(DB_BLOCK_INDEX_SNAPSHOT, id, true);
+}
+
+bool CBlockTreeDB::ReadBlockIndexSnapshotId(uint256 &id) {
+    return Read(DB_BLOCK_INDEX_SNAPSHOT, id);
+}
+
+bool CBlockTreeDB::EraseBlockIndexSnapshotId() {
+    return Erase(DB_BLOCK_INDEX_SNAPSHOT, true);
+}
+
+bool CBlockTreeDB::WriteBlockFileConversion(
+    int nFile, const CBlockFileInfo &info,
+    const std::vector<const CBlockIndex *> &blockinfo) {
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_BLOCK_FILES, nFile), info);
+    for (const CBlockIndex *pindex : blockinfo) {
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, pindex->GetBlockHash()),
+                    CDiskBlockIndex(pindex));
+    }
+    batch.Write(DB_BLOCK_FILE_CONVERSION, nFile);
+    batch.Erase(DB_BLOCK_INDEX_SNAPSHOT);
+    return WriteBatch(batch, true);
+}
+
+bool CBlockTreeDB::ReadBlockFileConversion(int &nFile) {
+    return Read(DB_BLOCK_FILE_CONVERSION, nFile);
+}
+
+bool CBlockTreeDB::EraseBlockFileConversion() {
+    return Erase(DB_BLOCK_FILE_CONVERSION, true);
+}
+
 CCoinsViewCursor *CCoinsViewDB::Cursor() const {
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(
         const_cast<CDBWrapper &>(*m_db).NewIterator(), GetBestBlock());
@@ -281,6 +500,10 @@ bool CBlockTreeDB::WriteBatchSync(
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()),
                     CDiskBlockIndex(*it));
     }
+    // Any change to the block index makes the snapshot stale.
+    if (!fileInfo.empty() || !blockinfo.empty()) {
+        batch.Erase(DB_BLOCK_INDEX_SNAPSHOT);
+    }
     return WriteBatch(batch, true);
 }
 
@@ -521,5 +744,6 @@ bool CBlockTreeDB::Upgrade(const Consensus::Params &params) {
     LogPrintf("Updating the block index database version to %d\n",
               CLIENT_VERSION);
     batch.Write("version", uint64_t(CLIENT_VERSION));
+    batch.Erase(DB_BLOCK_INDEX_SNAPSHOT);
     return WriteBatch(batch);
 }
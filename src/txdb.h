@@ -11,9 +11,11 @@
 #include <dbwrapper.h>
 #include <flatfile.h>
 
+#include <condition_variable>
 #include <memory>
 #include <optional>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -57,6 +59,11 @@ protected:
     fs::path m_ldb_path;
     bool m_is_memory;
 
+    //! Write the coins in mapCoins, erasing them from release (if not null)
+    //! as they are written.
+    bool WriteCoins(const CCoinsMap &mapCoins, const BlockHash &hashBlock,
+                    CCoinsMap *release);
+
 public:
     /**
      * @param[in] ldb_path    Location in the filesystem where leveldb data will
@@ -67,11 +74,17 @@ public:
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
+    size_t GetCoins(Span<const COutPoint> outpoints,
+                    Span<Coin> coins) const override;
     BlockHash GetBestBlock() const override;
     std::vector<BlockHash> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    //! Same as BatchWrite, but leaves mapCoins untouched so that it can be
+    //! read from concurrently while it is being written.
+    bool WriteCoins(const CCoinsMap &mapCoins, const BlockHash &hashBlock);
+
     //! Attempt to update from an older database format.
     //! Returns whether an error occurred.
     bool Upgrade();
@@ -81,6 +94,66 @@ public:
     void ResizeCache(size_t new_cache_size) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
+/**
+ * CCoinsView sitting on top of a CCoinsViewDB, which can write a flush of the
+ * coins cache to the database on a background thread.
+ *
+ * When asked to, the flushed coins are handed to a writer thread as a frozen
+ * snapshot, so that the caller can continue with an empty cache right away.
+ * Until the write completed, lookups are served from the snapshot first and
+ * only fall through to the database for coins it does not contain. The
+ * database marks the write as in progress through its head blocks, so a crash
+ * in the middle of it is recovered by replaying blocks on startup, as for a
+ * synchronous flush.
+ *
+ * At most one write is in flight at a time: any further write waits for the
+ * previous one to complete. The memory held by the snapshot is not accounted
+ * for in the cache size, so a background flush can temporarily use up to
+ * twice the coins cache size.
+ */
+class CCoinsViewBackgroundFlush final : public CCoinsViewBacked {
+private:
+    CCoinsViewDB &m_db;
+
+    mutable Mutex m_mutex;
+    //! Signaled when a background write completed
+    mutable std::condition_variable m_write_done_cv;
+    //! Coins being written by the background thread, if any
+    std::shared_ptr<const CCoinsMap> m_pending GUARDED_BY(m_mutex);
+    //! Best block of the coins being written
+    BlockHash m_pending_block GUARDED_BY(m_mutex);
+    //! Whether a background write failed
+    bool m_write_failed GUARDED_BY(m_mutex){false};
+
+    std::thread m_writer;
+    //! Whether the next BatchWrite should happen in the background
+    bool m_write_in_background{false};
+
+public:
+    explicit CCoinsViewBackgroundFlush(CCoinsViewDB &db);
+    ~CCoinsViewBackgroundFlush();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    size_t GetCoins(Span<const COutPoint> outpoints,
+                    Span<Coin> coins) const override;
+    BlockHash GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) override;
+    CCoinsViewCursor *Cursor() const override;
+
+    /**
+     * Flush the given cache, which must sit on top of this view, writing its
+     * coins to the database on a background thread. Returns false if the
+     * flush (or an earlier background write) failed.
+     */
+    bool FlushInBackground(CCoinsViewCache &cache);
+
+    /**
+     * Wait for a background write to complete. Returns false if it failed.
+     */
+    bool WaitForFlush();
+};
+
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
 class CCoinsViewDBCursor : public CCoinsViewCursor {
 public:
@@ -117,6 +190,24 @@ public:
     bool IsReindexing() const;
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    /**
+     * The id of the block index snapshot file, which is only present while
+     * the snapshot matches the content of the database: it is erased along
+     * with every write to the block index entries or block file info.
+     */
+    bool WriteBlockIndexSnapshotId(const uint256 &id);
+    bool ReadBlockIndexSnapshotId(uint256 &id);
+    bool EraseBlockIndexSnapshotId();
+    /**
+     * Update the info of a block file which was rewritten, and the entries of
+     * its blocks, along with the number of the file. It is kept until the
+     * rewritten file replaces the original one.
+     */
+    bool WriteBlockFileConversion(
+        int nFile, const CBlockFileInfo &info,
+        const std::vector<const CBlockIndex *> &blockinfo);
+    bool ReadBlockFileConversion(int &nFile);
+    bool EraseBlockFileConversion();
     bool LoadBlockIndexGuts(
         const Consensus::Params &params,
         std::function<CBlockIndex *(const BlockHash &)> insertBlockIndex);
@@ -11,6 +11,7 @@
 #include <compressor.h>
 #include <consensus/consensus.h>
 #include <disconnectresult.h>
+#include <memusage.h>
 #include <serialize.h>
 #include <version.h>
 
@@ -76,6 +77,17 @@ public:
     std::vector<CTxUndo> vtxundo;
 
     SERIALIZE_METHODS(CBlockUndo, obj) { READWRITE(obj.vtxundo); }
+
+    size_t DynamicMemoryUsage() const {
+        size_t mem = memusage::DynamicUsage(vtxundo);
+        for (const CTxUndo &txundo : vtxundo) {
+            mem += memusage::DynamicUsage(txundo.vprevout);
+            for (const Coin &coin : txundo.vprevout) {
+                mem += coin.DynamicMemoryUsage();
+            }
+        }
+        return mem;
+    }
 };
 
 /**
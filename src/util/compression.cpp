@@ -0,0 +1,158 @@
+// Copyright (c) 2022 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <util/compression.h>
+
+#include <crypto/common.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_OFFSET = 0xffff;
+//! Lengths which don't fit in the 4 bits of the token are continued in the
+//! following bytes.
+constexpr size_t TOKEN_LENGTH_MAX = 15;
+constexpr int HASH_BITS = 16;
+
+void WriteLength(std::vector<uint8_t> &out, size_t length) {
+    while (length >= 0xff) {
+        out.push_back(0xff);
+        length -= 0xff;
+    }
+    out.push_back(length);
+}
+
+bool ReadLength(Span<const uint8_t> &in, size_t &length) {
+    uint8_t byte;
+    do {
+        if (in.empty()) {
+            return false;
+        }
+        byte = in[0];
+        in = in.subspan(1);
+        length += byte;
+    } while (byte == 0xff);
+    return true;
+}
+
+void WriteLiterals(std::vector<uint8_t> &out, Span<const uint8_t> literals,
+                   size_t match_length) {
+    const size_t match_code = match_length ? match_length - MIN_MATCH : 0;
+    out.push_back((std::min(literals.size(), TOKEN_LENGTH_MAX) << 4) |
+                  std::min(match_code, TOKEN_LENGTH_MAX));
+    if (literals.size() >= TOKEN_LENGTH_MAX) {
+        WriteLength(out, literals.size() - TOKEN_LENGTH_MAX);
+    }
+    out.insert(out.end(), literals.begin(), literals.end());
+}
+
+void WriteMatch(std::vector<uint8_t> &out, size_t offset, size_t length) {
+    out.push_back(offset & 0xff);
+    out.push_back(offset >> 8);
+    if (length - MIN_MATCH >= TOKEN_LENGTH_MAX) {
+        WriteLength(out, length - MIN_MATCH - TOKEN_LENGTH_MAX);
+    }
+}
+} // namespace
+
+std::vector<uint8_t> CompressLZ(Span<const uint8_t> input) {
+    std::vector<uint8_t> out;
+    out.reserve(input.size() + input.size() / 0xff + 16);
+    std::vector<uint32_t> table(size_t(1) << HASH_BITS, 0);
+
+    const size_t size = input.size();
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (pos + MIN_MATCH <= size) {
+        const uint32_t sequence = ReadLE32(&input[pos]);
+        const uint32_t hash = (sequence * 2654435761U) >> (32 - HASH_BITS);
+        const size_t candidate = table[hash];
+        table[hash] = pos;
+
+        if (candidate >= pos || pos - candidate > MAX_OFFSET ||
+            ReadLE32(&input[candidate]) != sequence) {
+            // Skip faster through data which doesn't compress.
+            pos += 1 + ((pos - anchor) >> 6);
+            continue;
+        }
+
+        size_t length = MIN_MATCH;
+        while (pos + length < size &&
+               input[candidate + length] == input[pos + length]) {
+            ++length;
+        }
+        WriteLiterals(out, input.subspan(anchor, pos - anchor), length);
+        WriteMatch(out, pos - candidate, length);
+        pos += length;
+        anchor = pos;
+    }
+
+    // The data always ends with a run of literals, possibly empty.
+    WriteLiterals(out, input.subspan(anchor), 0);
+    return out;
+}
+
+bool DecompressLZ(Span<const uint8_t> input, size_t size,
+                  std::vector<uint8_t> &output) {
+    output.clear();
+    // Each byte of input expands to at most 0xff bytes of output, through the
+    // length continuation bytes. Reject larger sizes before allocating.
+    if (size / 0xff > input.size()) {
+        return false;
+    }
+    output.reserve(size);
+    while (true) {
+        if (input.empty()) {
+            return false;
+        }
+        const uint8_t token = input[0];
+        input = input.subspan(1);
+
+        size_t literals = token >> 4;
+        if (literals == TOKEN_LENGTH_MAX && !ReadLength(input, literals)) {
+            return false;
+        }
+        if (literals > input.size() || literals > size - output.size()) {
+            return false;
+        }
+        output.insert(output.end(), input.begin(), input.begin() + literals);
+        input = input.subspan(literals);
+
+        if (input.empty()) {
+            // Last run of literals.
+            return output.size() == size;
+        }
+
+        if (input.size() < 2) {
+            return false;
+        }
+        const size_t offset = input[0] | (size_t(input[1]) << 8);
+        input = input.subspan(2);
+        size_t length = token & TOKEN_LENGTH_MAX;
+        if (length == TOKEN_LENGTH_MAX && !ReadLength(input, length)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (offset == 0 || offset > output.size() ||
+            length > size - output.size()) {
+            return false;
+        }
+
+        // The output has been reserved, so this doesn't move the data.
+        output.resize(output.size() + length);
+        uint8_t *dest = output.data() + output.size() - length;
+        const uint8_t *src = dest - offset;
+        if (offset >= length) {
+            std::memcpy(dest, src, length);
+        } else {
+            // The copy overlaps the bytes it produces, so it goes forward one
+            // byte at a time.
+            for (size_t i = 0; i < length; ++i) {
+                dest[i] = src[i];
+            }
+        }
+    }
+}
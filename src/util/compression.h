@@ -0,0 +1,33 @@
+// Copyright (c) 2022 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTIL_COMPRESSION_H
+#define BITCOIN_UTIL_COMPRESSION_H
+
+#include <span.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Fast LZ77 compression, trading compression ratio for speed.
+ *
+ * The compressed data is a sequence of literal runs, each followed by a copy
+ * of previous output up to 64KiB back, using the same layout as the LZ4 block
+ * format. The size of the uncompressed data is not stored, it must be kept
+ * along with the compressed data.
+ */
+std::vector<uint8_t> CompressLZ(Span<const uint8_t> input);
+
+/**
+ * Decompress data produced by CompressLZ(), whose uncompressed size is given.
+ * Returns false if the data is malformed or does not decompress to exactly
+ * size bytes. The output is never allocated larger than the input can expand
+ * to, whatever the size.
+ */
+bool DecompressLZ(Span<const uint8_t> input, size_t size,
+                  std::vector<uint8_t> &output);
+
+#endif // BITCOIN_UTIL_COMPRESSION_H
@@ -20,6 +20,7 @@
 #include <consensus/tx_check.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/sha256.h>
 #include <deploymentstatus.h>
 #include <hash.h>
 #include <index/blockfilterindex.h>
@@ -50,6 +51,8 @@
 #include <util/check.h> // For NDEBUG compile time check
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <util/thread.h>
+#include <util/threadnames.h>
 #include <util/trace.h>
 #include <util/translation.h>
 #include <validationinterface.h>
@@ -58,24 +61,35 @@
 #include <boost/algorithm/string/replace.hpp>
 
 #include <algorithm>
+#include <deque>
+#include <functional>
+#include <future>
 #include <numeric>
 #include <optional>
 #include <string>
 #include <thread>
+#include <unordered_set>
 
+using node::BLOCK_STORAGE_COMPRESSED_FLAG;
 using node::BLOCKFILE_CHUNK_SIZE;
 using node::BlockManager;
 using node::BlockMap;
 using node::CCoinsStats;
+using node::CoinsSerializedHasher;
 using node::CoinStatsHashType;
+using node::DecompressStoredData;
 using node::fHavePruned;
 using node::fImporting;
 using node::fPruneMode;
 using node::fReindex;
+using node::g_background_prune;
 using node::GetUTXOStats;
 using node::nPruneTarget;
 using node::OpenBlockFile;
 using node::ReadBlockFromDisk;
+using node::SnapshotChunk;
+using node::SnapshotCoinsBatch;
+using node::SnapshotCoinsQueue;
 using node::SnapshotMetadata;
 using node::UNDOFILE_CHUNK_SIZE;
 using node::UndoReadFromDisk;
@@ -118,6 +132,7 @@ uint256 g_best_block;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool g_background_flush = DEFAULT_BACKGROUND_FLUSH;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
 BlockHash hashAssumeValid;
@@ -284,6 +299,12 @@ static bool CheckInputsFromMempoolAndCache(
                              /*scriptCacheStore=*/true, txdata, nSigChecksOut);
 }
 
+/**
+ * Run script checks on the script check worker threads. Returns whether they
+ * all passed.
+ */
+static bool RunScriptChecksInParallel(std::vector<CScriptCheck> &vChecks);
+
 namespace {
 
 class MemPoolAccept {
@@ -364,6 +385,22 @@ public:
                             /*m_test_accept=*/false,
                             /*m_package_submission=*/true};
         }
+
+        /**
+         * Parameters for the validation of a batch of unrelated transactions.
+         * The mempool is trimmed once all of them have been submitted.
+         */
+        static ATMPArgs
+        UnrelatedBatchAccept(const Config &config, int64_t accept_time,
+                             std::vector<COutPoint> &coins_to_uncache) {
+            return ATMPArgs{config,
+                            accept_time,
+                            /*m_bypass_limits=*/false,
+                            coins_to_uncache,
+                            /*m_test_accept=*/false,
+                            /*m_package_submission=*/true};
+        }
+
         // No default ctor to avoid exposing details to clients and allowing the
         // possibility of mixing up the order of the arguments. Use static
         // functions above instead.
@@ -395,6 +432,17 @@ public:
                                              ATMPArgs &args)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Batch acceptance of unrelated transactions. Each transaction is accepted
+     * or rejected on its own, as with AcceptSingleTransaction(), but the
+     * policy script checks of all of them run in parallel while the mempool
+     * lock is released. Returns a result for each transaction, in order.
+     */
+    std::vector<MempoolAcceptResult>
+    AcceptUnrelatedTransactions(const std::vector<CTransactionRef> &txns,
+                                ATMPArgs &args)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 private:
     // All the intermediate state that gets passed between the various levels
     // of checking a given transaction.
@@ -443,16 +491,39 @@ private:
         // ConsensusScriptChecks
         const uint32_t m_next_block_script_verify_flags;
         int m_sig_checks_standard;
+
+        /**
+         * Filled in by PreScriptChecks() for the construction of the mempool
+         * entry in PostScriptChecks().
+         */
+        LockPoints m_lock_points;
+        bool m_spends_coinbase;
     };
 
-    // Run the policy checks on a given transaction, excluding any script
-    // checks. Looks up inputs, calculates feerate, considers replacement,
-    // evaluates package limits, etc. As this function can be invoked for "free"
-    // by a peer, only tests that are fast should be done here (to avoid CPU
-    // DoS).
+    // Run the policy checks on a given transaction, including the policy
+    // script checks. This is PreScriptChecks(), PolicyScriptChecks() and
+    // PostScriptChecks() in a row.
     bool PreChecks(ATMPArgs &args, Workspace &ws)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
 
+    // Run the policy checks on a given transaction which don't need its
+    // sigchecks count, excluding any script checks. Looks up inputs,
+    // calculates feerate, considers replacement, etc. As this function can be
+    // invoked for "free" by a peer, only tests that are fast should be done
+    // here (to avoid CPU DoS).
+    bool PreScriptChecks(ATMPArgs &args, Workspace &ws)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
+
+    // Run the script checks using the standard flags, which gives the sigchecks
+    // count of the transaction. Its inputs must have been looked up by
+    // PreScriptChecks().
+    bool PolicyScriptChecks(Workspace &ws) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    // Build the mempool entry and run the policy checks depending on its
+    // virtual size: mempool minimum fee and package limits.
+    bool PostScriptChecks(ATMPArgs &args, Workspace &ws)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
+
     // Enforce package mempool ancestor/descendant limits (distinct from
     // individual ancestor/descendant limits done in PreChecks).
     bool PackageMempoolChecks(const std::vector<CTransactionRef> &txns,
@@ -503,18 +574,23 @@ private:
 bool MemPoolAccept::PreChecks(ATMPArgs &args, Workspace &ws) {
     AssertLockHeld(cs_main);
     AssertLockHeld(m_pool.cs);
-    const CTransactionRef &ptx = ws.m_ptx;
+    return PreScriptChecks(args, ws) && PolicyScriptChecks(ws) &&
+           PostScriptChecks(args, ws);
+}
+
+bool MemPoolAccept::PreScriptChecks(ATMPArgs &args, Workspace &ws) {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(m_pool.cs);
     const CTransaction &tx = *ws.m_ptx;
     const TxId &txid = ws.m_ptx->GetId();
 
     // Copy/alias what we need out of args
-    const int64_t nAcceptTime = args.m_accept_time;
     const bool bypass_limits = args.m_bypass_limits;
     std::vector<COutPoint> &coins_to_uncache = args.m_coins_to_uncache;
 
     // Alias what we need out of ws
     TxValidationState &state = ws.m_state;
-    std::unique_ptr<CTxMemPoolEntry> &entry = ws.m_entry;
+    LockPoints &lp = ws.m_lock_points;
     // Coinbase is only valid in a block, not as a loose transaction.
     if (!CheckRegularTransaction(tx, state)) {
         // state filled in by CheckRegularTransaction.
@@ -557,7 +633,6 @@ bool MemPoolAccept::PreChecks(ATMPArgs &args, Workspace &ws) {
         }
     }
 
-    LockPoints lp;
     m_view.SetBackend(m_viewmempool);
 
     const CCoinsViewCache &coins_cache = m_active_chainstate.CoinsTip();
@@ -640,11 +715,11 @@ bool MemPoolAccept::PreChecks(ATMPArgs &args, Workspace &ws) {
 
     // Keep track of transactions that spend a coinbase, which we re-scan
     // during reorgs to ensure COINBASE_MATURITY is still met.
-    bool fSpendsCoinbase = false;
+    ws.m_spends_coinbase = false;
     for (const CTxIn &txin : tx.vin) {
         const Coin &coin = m_view.AccessCoin(txin.prevout);
         if (coin.IsCoinBase()) {
-            fSpendsCoinbase = true;
+            ws.m_spends_coinbase = true;
             break;
         }
     }
@@ -661,20 +736,42 @@ bool MemPoolAccept::PreChecks(ATMPArgs &args, Workspace &ws) {
                              strprintf("%d < %d", ws.m_modified_fees,
                                        ::minRelayTxFee.GetFee(nSize)));
     }
+    return true;
+}
+
+bool MemPoolAccept::PolicyScriptChecks(Workspace &ws) {
+    AssertLockHeld(cs_main);
+    const CTransaction &tx = *ws.m_ptx;
 
     // Validate input scripts against standard script flags.
     const uint32_t scriptVerifyFlags =
         ws.m_next_block_script_verify_flags | STANDARD_SCRIPT_VERIFY_FLAGS;
     ws.m_precomputed_txdata = PrecomputedTransactionData{tx};
-    if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false,
-                           ws.m_precomputed_txdata, ws.m_sig_checks_standard)) {
+    if (!CheckInputScripts(tx, ws.m_state, m_view, scriptVerifyFlags, true,
+                           false, ws.m_precomputed_txdata,
+                           ws.m_sig_checks_standard)) {
         // State filled in by CheckInputScripts
         return false;
     }
+    return true;
+}
+
+bool MemPoolAccept::PostScriptChecks(ATMPArgs &args, Workspace &ws) {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(m_pool.cs);
+
+    // Copy/alias what we need out of args
+    const int64_t nAcceptTime = args.m_accept_time;
+    const bool bypass_limits = args.m_bypass_limits;
+
+    // Alias what we need out of ws
+    TxValidationState &state = ws.m_state;
+    std::unique_ptr<CTxMemPoolEntry> &entry = ws.m_entry;
 
     entry.reset(new CTxMemPoolEntry(
-        ptx, ws.m_base_fees, nAcceptTime, m_active_chainstate.m_chain.Height(),
-        fSpendsCoinbase, ws.m_sig_checks_standard, lp));
+        ws.m_ptx, ws.m_base_fees, nAcceptTime,
+        m_active_chainstate.m_chain.Height(), ws.m_spends_coinbase,
+        ws.m_sig_checks_standard, ws.m_lock_points));
 
     ws.m_vsize = entry->GetTxVirtualSize();
 
@@ -1108,6 +1205,136 @@ PackageMempoolAcceptResult MemPoolAccept::AcceptPackage(const Package &package,
     }
     return submission_result;
 }
+
+std::vector<MempoolAcceptResult> MemPoolAccept::AcceptUnrelatedTransactions(
+    const std::vector<CTransactionRef> &txns, ATMPArgs &args) {
+    AssertLockHeld(cs_main);
+
+    std::vector<Workspace> workspaces{};
+    workspaces.reserve(txns.size());
+    std::transform(txns.cbegin(), txns.cend(), std::back_inserter(workspaces),
+                   [&args, this](const auto &tx) {
+                       return Workspace(
+                           tx,
+                           GetNextBlockScriptFlags(
+                               args.m_config.GetChainParams().GetConsensus(),
+                               m_active_chainstate.m_chain.Tip()));
+                   });
+
+    // Do the cheap checks of all the transactions first, and collect the
+    // script checks of the ones which pass them. Each transaction gets its own
+    // limiter, which also counts its sigchecks when the checks are run, and
+    // its own flag, set if one of its checks fails.
+    std::vector<TxSigCheckLimiter> sig_check_limiters(workspaces.size());
+    std::vector<std::atomic<bool>> scripts_failed(workspaces.size());
+    std::vector<CScriptCheck> vChecks;
+    {
+        LOCK(m_pool.cs);
+        for (size_t i = 0; i < workspaces.size(); ++i) {
+            Workspace &ws = workspaces[i];
+            if (!PreScriptChecks(args, ws)) {
+                continue;
+            }
+            const CTransaction &tx = *ws.m_ptx;
+            const uint32_t scriptVerifyFlags =
+                ws.m_next_block_script_verify_flags |
+                STANDARD_SCRIPT_VERIFY_FLAGS;
+            ws.m_precomputed_txdata = PrecomputedTransactionData{tx};
+            // This only fails when a cached script execution breaks the
+            // sigchecks limit, with the state filled in.
+            int nSigChecksUnused;
+            const size_t first_check = vChecks.size();
+            CheckInputScripts(tx, ws.m_state, m_view, scriptVerifyFlags, true,
+                              false, ws.m_precomputed_txdata, nSigChecksUnused,
+                              sig_check_limiters[i], nullptr, &vChecks);
+            for (size_t j = first_check; j < vChecks.size(); ++j) {
+                vChecks[j].SetTxFailedFlag(&scripts_failed[i]);
+            }
+        }
+    }
+
+    // Run the script checks on the script check worker threads, without
+    // holding the mempool lock. The inputs have all been cached in m_view,
+    // which is not modified until they are done. A failing check only flags
+    // its own transaction, so the checks of the others all run. Only the
+    // flagged transactions are checked again, to find out why they are
+    // invalid.
+    RunScriptChecksInParallel(vChecks);
+    for (size_t i = 0; i < workspaces.size(); ++i) {
+        Workspace &ws = workspaces[i];
+        if (!ws.m_state.IsValid()) {
+            continue;
+        }
+        if (!scripts_failed[i]) {
+            ws.m_sig_checks_standard =
+                MAX_TX_SIGCHECKS - sig_check_limiters[i].get_remaining();
+        } else {
+            PolicyScriptChecks(ws);
+        }
+    }
+
+    // mempool "read lock" (held through
+    // GetMainSignals().TransactionAddedToMempool())
+    LOCK(m_pool.cs);
+
+    // Submit the transactions which passed. The mempool is only pruned with
+    // cs_main held, so their inputs are still available, but the ones
+    // submitted earlier in the batch may be the same or conflict with them.
+    for (Workspace &ws : workspaces) {
+        if (!ws.m_state.IsValid()) {
+            continue;
+        }
+        if (m_pool.exists(ws.m_ptx->GetId())) {
+            ws.m_state.Invalid(TxValidationResult::TX_CONFLICT,
+                               "txn-already-in-mempool");
+            continue;
+        }
+        for (const CTxIn &txin : ws.m_ptx->vin) {
+            if (m_pool.mapNextTx.count(txin.prevout)) {
+                ws.m_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY,
+                                   "txn-mempool-conflict");
+                break;
+            }
+        }
+        if (!ws.m_state.IsValid()) {
+            continue;
+        }
+        if (!PostScriptChecks(args, ws) || !ConsensusScriptChecks(args, ws)) {
+            continue;
+        }
+        // The mempool is not trimmed here, so this cannot fail.
+        Finalize(args, ws);
+    }
+
+    // Trim the mempool once, after all the transactions have been submitted.
+    if (!args.m_bypass_limits) {
+        m_pool.LimitSize(
+            m_active_chainstate.CoinsTip(),
+            gArgs.GetIntArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
+            std::chrono::hours{
+                gArgs.GetIntArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
+    }
+
+    std::vector<MempoolAcceptResult> results;
+    results.reserve(workspaces.size());
+    for (Workspace &ws : workspaces) {
+        if (!ws.m_state.IsValid()) {
+            results.push_back(MempoolAcceptResult::Failure(ws.m_state));
+            continue;
+        }
+        if (!m_pool.exists(ws.m_ptx->GetId())) {
+            ws.m_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY,
+                               "mempool full");
+            results.push_back(MempoolAcceptResult::Failure(ws.m_state));
+            continue;
+        }
+        results.push_back(
+            MempoolAcceptResult::Success(ws.m_vsize, ws.m_base_fees));
+        GetMainSignals().TransactionAddedToMempool(
+            ws.m_ptx, m_pool.GetAndIncrementSequence());
+    }
+    return results;
+}
 } // namespace
 
 MempoolAcceptResult AcceptToMemoryPool(const Config &config,
@@ -1143,6 +1370,44 @@ MempoolAcceptResult AcceptToMemoryPool(const Config &config,
     return result;
 }
 
+std::vector<MempoolAcceptResult>
+AcceptToMemoryPoolBatch(const Config &config, CChainState &active_chainstate,
+                        const std::vector<CTransactionRef> &txs,
+                        int64_t accept_time) {
+    AssertLockHeld(::cs_main);
+    assert(active_chainstate.GetMempool() != nullptr);
+    CTxMemPool &pool{*active_chainstate.GetMempool()};
+
+    std::vector<COutPoint> coins_to_uncache;
+    auto args = MemPoolAccept::ATMPArgs::UnrelatedBatchAccept(
+        config, accept_time, coins_to_uncache);
+    std::vector<MempoolAcceptResult> results =
+        MemPoolAccept(pool, active_chainstate)
+            .AcceptUnrelatedTransactions(txs, args);
+
+    // Remove the coins which were not present in the coins cache before, as in
+    // AcceptToMemoryPool(), unless they are spent by an accepted transaction.
+    std::unordered_set<COutPoint, SaltedOutpointHasher> accepted_prevouts;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        if (results[i].m_result_type == MempoolAcceptResult::ResultType::VALID) {
+            for (const CTxIn &txin : txs[i]->vin) {
+                accepted_prevouts.insert(txin.prevout);
+            }
+        }
+    }
+    for (const COutPoint &outpoint : coins_to_uncache) {
+        if (accepted_prevouts.count(outpoint) == 0) {
+            active_chainstate.CoinsTip().Uncache(outpoint);
+        }
+    }
+
+    // After we've (potentially) uncached entries, ensure our coins cache is
+    // still within its size limits
+    BlockValidationState stateDummy;
+    active_chainstate.FlushStateToDisk(stateDummy, FlushStateMode::PERIODIC);
+    return results;
+}
+
 PackageMempoolAcceptResult
 ProcessNewPackage(const Config &config, CChainState &active_chainstate,
                   CTxMemPool &pool, const Package &package, bool test_accept) {
@@ -1197,7 +1462,7 @@ CoinsViews::CoinsViews(std::string ldb_name, size_t cache_size_bytes,
                        bool in_memory, bool should_wipe)
     : m_dbview(gArgs.GetDataDirNet() / ldb_name, cache_size_bytes, in_memory,
                should_wipe),
-      m_catcherview(&m_dbview) {}
+      m_flushview(m_dbview), m_catcherview(&m_flushview) {}
 
 void CoinsViews::InitCache() {
     AssertLockHeld(::cs_main);
@@ -1429,10 +1694,32 @@ void UpdateCoins(CCoinsViewCache &view, const CTransaction &tx, CTxUndo &txundo,
 }
 
 bool CScriptCheck::operator()() {
+    if (!pTxFailed) {
+        return Verify(nullptr);
+    }
+    // No need to go on once another check of the transaction failed.
+    if (!*pTxFailed && !Verify(nullptr)) {
+        *pTxFailed = true;
+    }
+    return true;
+}
+
+bool CScriptCheck::operator()(SchnorrSignatureBatch &batch) {
+    if (pTxFailed) {
+        return (*this)();
+    }
+    // Assuming a signature is valid until the batch is verified is only sound
+    // if an invalid signature would make the script fail anyway.
+    return Verify((nFlags & SCRIPT_VERIFY_NULLFAIL) ? &batch : nullptr);
+}
+
+bool CScriptCheck::Verify(SchnorrSignatureBatch *batch) {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     if (!VerifyScript(scriptSig, m_tx_out.scriptPubKey, nFlags,
-                      CachingTransactionSignatureChecker(
-                          ptxTo, nIn, m_tx_out.nValue, cacheStore, txdata),
+                      CachingTransactionSignatureChecker(ptxTo, nIn,
+                                                         m_tx_out.nValue,
+                                                         cacheStore, txdata,
+                                                         batch),
                       metrics, &error)) {
         return false;
     }
@@ -1686,6 +1973,325 @@ void StopScriptCheckWorkerThreads() {
     scriptcheckqueue.StopWorkerThreads();
 }
 
+static bool RunScriptChecksInParallel(std::vector<CScriptCheck> &vChecks) {
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
+static CCheckQueue<CInputFetchCheck> inputfetchqueue(128, "inputfetch");
+
+//! Whether there are worker threads to prefetch the block inputs with.
+//! Without them prefetching would only add overhead.
+static std::atomic<bool> g_input_fetch_enabled{false};
+
+void StartInputFetchWorkerThreads(int threads_num) {
+    inputfetchqueue.StartWorkerThreads(threads_num);
+    g_input_fetch_enabled = threads_num > 0;
+}
+
+void StopInputFetchWorkerThreads() {
+    g_input_fetch_enabled = false;
+    inputfetchqueue.StopWorkerThreads();
+}
+
+static CCheckQueue<CTxCheck> txcheckqueue(128, "txcheck");
+
+//! Whether there are worker threads to check the transactions of large blocks
+//! with.
+static std::atomic<bool> g_tx_check_enabled{false};
+
+void StartTxCheckWorkerThreads(int threads_num) {
+    txcheckqueue.StartWorkerThreads(threads_num);
+    g_tx_check_enabled = threads_num > 0;
+}
+
+void StopTxCheckWorkerThreads() {
+    g_tx_check_enabled = false;
+    txcheckqueue.StopWorkerThreads();
+}
+
+bool CTxCheck::operator()() {
+    TxValidationState state;
+    for (const CTransactionRef &tx : m_txs) {
+        if (!CheckRegularTransaction(*tx, state)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CInputFetchCheck::operator()() {
+    m_view->GetCoins(m_outpoints, m_coins);
+    return true;
+}
+
+size_t PrefetchBlockInputs(const CBlock &block, CCoinsViewCache &cache,
+                           const CCoinsView &base,
+                           CCheckQueue<CInputFetchCheck> *queue) {
+    std::unordered_set<TxId, SaltedTxIdHasher> block_txids;
+    block_txids.reserve(block.vtx.size());
+    for (const auto &ptx : block.vtx) {
+        block_txids.insert(ptx->GetId());
+    }
+
+    std::vector<COutPoint> outpoints;
+    for (const auto &ptx : block.vtx) {
+        if (ptx->IsCoinBase()) {
+            continue;
+        }
+
+        for (const CTxIn &txin : ptx->vin) {
+            // Coins created in this block are not in the database yet, and the
+            // cached ones are already where we want them.
+            if (block_txids.count(txin.prevout.GetTxId()) ||
+                cache.HaveCoinInCache(txin.prevout)) {
+                continue;
+            }
+            outpoints.push_back(txin.prevout);
+        }
+    }
+
+    if (outpoints.empty()) {
+        return 0;
+    }
+
+    // Each shard then covers a narrow range of the database, which it can
+    // resolve in a single pass.
+    std::sort(outpoints.begin(), outpoints.end());
+
+    std::vector<Coin> coins(outpoints.size());
+    const Span<const COutPoint> all_outpoints{outpoints};
+    const Span<Coin> all_coins{coins};
+    std::vector<CInputFetchCheck> vChecks;
+    vChecks.reserve(outpoints.size() / INPUT_FETCH_SHARD_SIZE + 1);
+    for (size_t i = 0; i < outpoints.size(); i += INPUT_FETCH_SHARD_SIZE) {
+        const size_t count =
+            std::min(INPUT_FETCH_SHARD_SIZE, outpoints.size() - i);
+        vChecks.emplace_back(base, all_outpoints.subspan(i, count),
+                             all_coins.subspan(i, count));
+    }
+
+    if (queue) {
+        CCheckQueueControl<CInputFetchCheck> control(queue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        for (CInputFetchCheck &check : vChecks) {
+            check();
+        }
+    }
+
+    // The cache has not been touched by anyone else while the lookups were
+    // running, so the entries we got are still consistent with it.
+    size_t nAdded = 0;
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        if (!coins[i].IsSpent() &&
+            cache.EmplaceFetchedCoin(outpoints[i], std::move(coins[i]))) {
+            nAdded++;
+        }
+    }
+
+    return nAdded;
+}
+
+namespace {
+/**
+ * Pool of threads running jobs which read blocks ahead of their connection.
+ * Jobs still queued when the threads are stopped are dropped, which their
+ * futures report as a broken promise.
+ */
+class BlockReadAheadQueue {
+    using Job = std::packaged_task<std::shared_ptr<const CBlock>()>;
+
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Job> m_jobs GUARDED_BY(m_mutex);
+    bool m_request_stop GUARDED_BY(m_mutex){false};
+    std::vector<std::thread> m_worker_threads;
+
+    void Loop() {
+        while (true) {
+            Job job;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                while (m_jobs.empty() && !m_request_stop) {
+                    m_cv.wait(lock);
+                }
+                if (m_request_stop) {
+                    return;
+                }
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+public:
+    void StartWorkerThreads(const int threads_num) {
+        assert(m_worker_threads.empty());
+        for (int n = 0; n < threads_num; ++n) {
+            m_worker_threads.emplace_back([this, n]() {
+                util::ThreadRename(strprintf("readahead.%i", n));
+                Loop();
+            });
+        }
+    }
+
+    void StopWorkerThreads() {
+        WITH_LOCK(m_mutex, m_request_stop = true);
+        m_cv.notify_all();
+        for (std::thread &t : m_worker_threads) {
+            t.join();
+        }
+        m_worker_threads.clear();
+        LOCK(m_mutex);
+        m_jobs.clear();
+        m_request_stop = false;
+    }
+
+    std::shared_future<std::shared_ptr<const CBlock>>
+    Add(std::function<std::shared_ptr<const CBlock>()> func) {
+        Job job(std::move(func));
+        std::shared_future<std::shared_ptr<const CBlock>> result =
+            job.get_future().share();
+        WITH_LOCK(m_mutex, m_jobs.push_back(std::move(job)));
+        m_cv.notify_one();
+        return result;
+    }
+};
+} // namespace
+
+static BlockReadAheadQueue blockreadaheadqueue;
+
+//! Whether there are worker threads to read blocks ahead with.
+static std::atomic<bool> g_block_read_ahead_enabled{false};
+
+void StartBlockReadAheadThreads(int threads_num) {
+    blockreadaheadqueue.StartWorkerThreads(threads_num);
+    g_block_read_ahead_enabled = threads_num > 0;
+}
+
+void StopBlockReadAheadThreads() {
+    g_block_read_ahead_enabled = false;
+    blockreadaheadqueue.StopWorkerThreads();
+}
+
+/**
+ * Read a block from disk and run the context-free checks on it, so that it is
+ * marked as checked when it gets connected. The coins it spends are looked up
+ * in the given view, only to have them in the database cache by then: they
+ * can't be added to the coins cache, as the blocks before may spend them.
+ */
+static std::shared_ptr<const CBlock>
+ReadBlockAhead(const FlatFilePos &pos, const BlockHash &hash,
+               const Consensus::Params &params,
+               const BlockValidationOptions &options, const CCoinsView &view) {
+    auto pblock = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblock, pos, params) ||
+        pblock->GetHash() != hash) {
+        return nullptr;
+    }
+
+    // A failure is reported when the block gets connected.
+    BlockValidationState state;
+    if (!CheckBlock(*pblock, state, params, options)) {
+        return pblock;
+    }
+
+    try {
+        for (const auto &ptx : pblock->vtx) {
+            if (ptx->IsCoinBase()) {
+                continue;
+            }
+            for (const CTxIn &txin : ptx->vin) {
+                view.HaveCoin(txin.prevout);
+            }
+        }
+    } catch (const std::runtime_error &e) {
+        // Database errors are reported when the block gets connected.
+    }
+    return pblock;
+}
+
+void CChainState::ReadBlocksAhead(
+    const Config &config, const std::vector<CBlockIndex *> &vpindexToConnect,
+    const CBlockIndex *pindexSkip) {
+    AssertLockHeld(cs_main);
+    if (!g_block_read_ahead_enabled) {
+        return;
+    }
+
+    const Consensus::Params &consensusParams = m_params.GetConsensus();
+    std::map<BlockHash, std::shared_future<std::shared_ptr<const CBlock>>>
+        blocks;
+    int nBlocks = 0;
+    for (const CBlockIndex *pindex : reverse_iterate(vpindexToConnect)) {
+        if (nBlocks > MAX_BLOCKS_READ_AHEAD) {
+            break;
+        }
+        const bool fFirst = nBlocks++ == 0;
+
+        const BlockHash hash = pindex->GetBlockHash();
+        auto it = m_blocks_read_ahead.find(hash);
+        if (it != m_blocks_read_ahead.end()) {
+            blocks.insert(m_blocks_read_ahead.extract(it));
+            continue;
+        }
+
+        // The first block is connected right away, no need to read it ahead.
+        if (fFirst || pindex == pindexSkip || !pindex->nStatus.hasData()) {
+            continue;
+        }
+
+        const FlatFilePos pos = pindex->GetBlockPos();
+        const BlockValidationOptions options(config);
+        const CCoinsView &view = CoinsErrorCatcher();
+        blocks.emplace(hash,
+                       blockreadaheadqueue.Add([=, &consensusParams, &view]() {
+                           return ReadBlockAhead(pos, hash, consensusParams,
+                                                 options, view);
+                       }));
+    }
+
+    // The remaining blocks are no longer about to be connected.
+    ClearBlocksReadAhead();
+    m_blocks_read_ahead = std::move(blocks);
+}
+
+std::shared_ptr<const CBlock>
+CChainState::TakeBlockReadAhead(const CBlockIndex *pindex) {
+    AssertLockHeld(cs_main);
+    auto it = m_blocks_read_ahead.find(pindex->GetBlockHash());
+    if (it == m_blocks_read_ahead.end()) {
+        return nullptr;
+    }
+
+    std::shared_future<std::shared_ptr<const CBlock>> result =
+        std::move(it->second);
+    m_blocks_read_ahead.erase(it);
+    try {
+        std::shared_ptr<const CBlock> pblock = result.get();
+        if (pblock) {
+            ++m_blocks_read_ahead_taken;
+        }
+        return pblock;
+    } catch (const std::future_error &e) {
+        // The read-ahead threads were stopped before getting to it.
+        return nullptr;
+    }
+}
+
+void CChainState::ClearBlocksReadAhead() {
+    AssertLockHeld(cs_main);
+    // Wait for the jobs, so none of them outlives the coins views it uses.
+    for (const auto &[hash, result] : m_blocks_read_ahead) {
+        result.wait();
+    }
+    m_blocks_read_ahead.clear();
+}
+
 // Returns the script flags which should be checked for the block after
 // the given block.
 static uint32_t GetNextBlockScriptFlags(const Consensus::Params &params,
@@ -2366,13 +2972,6 @@ bool CChainState::FlushStateToDisk(BlockValidationState &state,
                     }
                 }
 
-                // Finally remove any pruned files
-                if (fFlushForPrune) {
-                    LOG_TIME_MILLIS_WITH_CATEGORY("unlink pruned files",
-                                                  BCLog::BENCH);
-
-                    UnlinkPrunedFiles(setFilesToPrune);
-                }
                 nLastWrite = nNow;
             }
             // Flush best chain related state. This can only be done if the
@@ -2396,13 +2995,35 @@ bool CChainState::FlushStateToDisk(BlockValidationState &state,
                 }
 
                 // Flush the chainstate (which may refer to block index
-                // entries).
-                if (!CoinsTip().Flush()) {
+                // entries). Unless a flush is forced, its coins can be written
+                // in the background while we continue with an empty cache.
+                // Not when pruning though: the coins must be on disk before
+                // the block files they could still need are removed.
+                bool flushed;
+                if (g_background_flush && mode != FlushStateMode::ALWAYS &&
+                    !fFlushForPrune) {
+                    flushed = m_coins_views->m_flushview.FlushInBackground(
+                        CoinsTip());
+                } else {
+                    flushed = CoinsTip().Flush();
+                }
+                if (!flushed) {
                     return AbortNode(state, "Failed to write to coin database");
                 }
                 nLastFlush = nNow;
                 full_flush_completed = true;
             }
+            // Finally remove any pruned files
+            if (fFlushForPrune) {
+                LOG_TIME_MILLIS_WITH_CATEGORY("unlink pruned files",
+                                              BCLog::BENCH);
+
+                if (g_background_prune) {
+                    m_blockman.UnlinkPrunedFilesInBackground(setFilesToPrune);
+                } else {
+                    UnlinkPrunedFiles(setFilesToPrune);
+                }
+            }
 
             TRACE5(utxocache, flush,
                    // in microseconds (µs)
@@ -2574,6 +3195,7 @@ bool CChainState::DisconnectTip(BlockValidationState &state,
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2721,25 +3343,42 @@ bool CChainState::ConnectTip(const Config &config, BlockValidationState &state,
     assert(pindexNew->pprev == m_chain.Tip());
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
-    std::shared_ptr<const CBlock> pthisBlock;
-    if (!pblock) {
+    std::shared_ptr<const CBlock> pthisBlock = pblock;
+    if (!pthisBlock) {
+        // Use the block if it was read ahead of time, otherwise read it now.
+        pthisBlock = TakeBlockReadAhead(pindexNew);
+    }
+    if (!pthisBlock) {
         std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
         if (!ReadBlockFromDisk(*pblockNew, pindexNew, consensusParams)) {
             return AbortNode(state, "Failed to read block");
         }
         pthisBlock = pblockNew;
-    } else {
-        pthisBlock = pblock;
     }
 
     const CBlock &blockConnecting = *pthisBlock;
 
+    int64_t nTimePrefetchStart = GetTimeMicros();
+    nTimeReadFromDisk += nTimePrefetchStart - nTime1;
+    LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n",
+             (nTimePrefetchStart - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+
+    // Pull the coins spent by the block out of the database in parallel, so
+    // ConnectBlock() finds them in the cache instead of doing one database
+    // lookup per input.
+    if (g_input_fetch_enabled) {
+        size_t nPrefetched = PrefetchBlockInputs(
+            blockConnecting, CoinsTip(), CoinsErrorCatcher(), &inputfetchqueue);
+        int64_t nTimePrefetchEnd = GetTimeMicros();
+        nTimePrefetch += nTimePrefetchEnd - nTimePrefetchStart;
+        LogPrint(BCLog::BENCH, "  - Prefetch %u inputs: %.2fms [%.2fs]\n",
+                 nPrefetched, (nTimePrefetchEnd - nTimePrefetchStart) * MILLI,
+                 nTimePrefetch * MICRO);
+    }
+
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros();
-    nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
-    LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n",
-             (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
         CCoinsViewCache view(&CoinsTip());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view,
@@ -3087,6 +3726,10 @@ bool CChainState::ActivateBestChainStep(
 
         nHeight = nTargetHeight;
 
+        // Read the blocks after the next one from disk while it is connected.
+        ReadBlocksAhead(config, vpindexToConnect,
+                        pblock ? pindexMostWork : nullptr);
+
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
             if (!ConnectTip(config, state, pindexConnect,
@@ -3865,6 +4508,81 @@ static bool CheckBlockHeader(const CBlockHeader &block,
     return true;
 }
 
+namespace {
+/**
+ * Blocks which recently passed CheckBlock(). The block hash doesn't commit to
+ * the transactions (see the merkle tree malleability below), so a block is
+ * identified by its hash along with a digest of the ids of its transactions,
+ * which are computed once for all when the transactions are created.
+ */
+class CheckedBlocks {
+private:
+    struct Entry {
+        BlockHash hash;
+        uint256 txids_digest;
+        uint64_t max_block_size;
+    };
+
+    Mutex m_mutex;
+    //! The most recently checked blocks last.
+    std::deque<Entry> m_entries GUARDED_BY(m_mutex);
+
+public:
+    static uint256 TxIdsDigest(const CBlock &block) {
+        CSHA256 hasher;
+        for (const CTransactionRef &tx : block.vtx) {
+            hasher.Write(tx->GetId().begin(), tx->GetId().size());
+        }
+        uint256 digest;
+        hasher.Finalize(digest.begin());
+        return digest;
+    }
+
+    bool Contains(const BlockHash &hash, const uint256 &txids_digest,
+                  uint64_t max_block_size) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex) {
+        LOCK(m_mutex);
+        return std::any_of(
+            m_entries.begin(), m_entries.end(), [&](const Entry &entry) {
+                return entry.hash == hash &&
+                       entry.txids_digest == txids_digest &&
+                       entry.max_block_size == max_block_size;
+            });
+    }
+
+    void Add(const BlockHash &hash, const uint256 &txids_digest,
+             uint64_t max_block_size) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex) {
+        LOCK(m_mutex);
+        m_entries.push_back({hash, txids_digest, max_block_size});
+        if (m_entries.size() > MAX_CHECKED_BLOCKS) {
+            m_entries.pop_front();
+        }
+    }
+};
+} // namespace
+
+static CheckedBlocks g_checked_blocks;
+
+/**
+ * Check the transactions of a block after the coinbase on the transaction
+ * checking worker threads. Returns false if one of them is invalid, or if
+ * the transactions could not be checked in parallel.
+ */
+static bool CheckRegularTransactionsInParallel(const CBlock &block) {
+    if (!g_tx_check_enabled || block.vtx.size() < MIN_PARALLEL_TX_CHECKS) {
+        return false;
+    }
+    const auto txs = Span<const CTransactionRef>{block.vtx}.subspan(1);
+    std::vector<CTxCheck> vChecks;
+    vChecks.reserve(txs.size() / TX_CHECK_SHARD_SIZE + 1);
+    for (size_t i = 0; i < txs.size(); i += TX_CHECK_SHARD_SIZE) {
+        vChecks.emplace_back(
+            txs.subspan(i, std::min(TX_CHECK_SHARD_SIZE, txs.size() - i)));
+    }
+    CCheckQueueControl<CTxCheck> control(&txcheckqueue);
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 bool CheckBlock(const CBlock &block, BlockValidationState &state,
                 const Consensus::Params &params,
                 BlockValidationOptions validationOptions) {
@@ -3873,6 +4591,18 @@ bool CheckBlock(const CBlock &block, BlockValidationState &state,
         return true;
     }
 
+    const bool fully_checked = validationOptions.shouldValidatePoW() &&
+                               validationOptions.shouldValidateMerkleRoot();
+    const BlockHash hash = block.GetHash();
+    const uint256 txids_digest =
+        fully_checked ? CheckedBlocks::TxIdsDigest(block) : uint256();
+    if (fully_checked &&
+        g_checked_blocks.Contains(hash, txids_digest,
+                                  validationOptions.getExcessiveBlockSize())) {
+        block.fChecked = true;
+        return true;
+    }
+
     // Check that the header is valid (particularly PoW).  This is mostly
     // redundant with the call in AcceptBlockHeader.
     if (!CheckBlockHeader(block, state, params, validationOptions)) {
@@ -3934,20 +4664,26 @@ bool CheckBlock(const CBlock &block, BlockValidationState &state,
 
     // Check transactions for regularity, skipping the first. Note that this
     // is the first time we check that all after the first are !IsCoinBase.
-    for (size_t i = 1; i < block.vtx.size(); i++) {
-        auto *tx = block.vtx[i].get();
-        if (!CheckRegularTransaction(*tx, tx_state)) {
-            return state.Invalid(
-                BlockValidationResult::BLOCK_CONSENSUS,
-                tx_state.GetRejectReason(),
-                strprintf("Transaction check failed (txid %s) %s",
-                          tx->GetId().ToString(), tx_state.GetDebugMessage()));
+    // They are checked again one by one if a check fails in parallel, to
+    // report the first invalid transaction.
+    if (!CheckRegularTransactionsInParallel(block)) {
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            auto *tx = block.vtx[i].get();
+            if (!CheckRegularTransaction(*tx, tx_state)) {
+                return state.Invalid(
+                    BlockValidationResult::BLOCK_CONSENSUS,
+                    tx_state.GetRejectReason(),
+                    strprintf("Transaction check failed (txid %s) %s",
+                              tx->GetId().ToString(),
+                              tx_state.GetDebugMessage()));
+            }
         }
     }
 
-    if (validationOptions.shouldValidatePoW() &&
-        validationOptions.shouldValidateMerkleRoot()) {
+    if (fully_checked) {
         block.fChecked = true;
+        g_checked_blocks.Add(hash, txids_digest,
+                             validationOptions.getExcessiveBlockSize());
     }
 
     return true;
@@ -4561,6 +5297,24 @@ ChainstateManager::ProcessTransaction(const CTransactionRef &tx,
     return result;
 }
 
+std::vector<MempoolAcceptResult>
+ChainstateManager::ProcessTransactions(const std::vector<CTransactionRef> &txs) {
+    AssertLockHeld(cs_main);
+    CChainState &active_chainstate = ActiveChainstate();
+    if (!active_chainstate.GetMempool()) {
+        TxValidationState state;
+        state.Invalid(TxValidationResult::TX_NO_MEMPOOL, "no-mempool");
+        return std::vector<MempoolAcceptResult>(
+            txs.size(), MempoolAcceptResult::Failure(state));
+    }
+    auto results =
+        AcceptToMemoryPoolBatch(::GetConfig(), active_chainstate, txs,
+                                GetTime());
+    active_chainstate.GetMempool()->check(
+        active_chainstate.CoinsTip(), active_chainstate.m_chain.Height() + 1);
+    return results;
+}
+
 bool TestBlockValidity(BlockValidationState &state, const CChainParams &params,
                        CChainState &chainstate, const CBlock &block,
                        CBlockIndex *pindexPrev,
@@ -5037,15 +5791,11 @@ bool CChainState::LoadGenesisBlock() {
     return true;
 }
 
-void CChainState::LoadExternalBlockFile(const Config &config, FILE *fileIn,
-                                        FlatFilePos *dbp) {
-    AssertLockNotHeld(m_chainstate_mutex);
-    // Map of disk positions for blocks with unknown parent (only used for
-    // reindex)
-    static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
-
-    int nLoaded = 0;
+void ReadExternalBlockFile(
+    const Config &config, FILE *fileIn, FlatFilePos *dbp,
+    const std::function<bool(const std::shared_ptr<CBlock> &, FlatFilePos *)>
+        &process) {
+    const CChainParams &params = config.GetChainParams();
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile
         // destructor. Make sure we have at least 2*MAX_TX_SIZE space in there
@@ -5064,20 +5814,28 @@ void CChainState::LoadExternalBlockFile(const Config &config, FILE *fileIn,
             // Remove former limit.
             blkdat.SetLimit();
             unsigned int nSize = 0;
+            bool compressed = false;
             try {
                 // Locate a header.
                 uint8_t buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(char(m_params.DiskMagic()[0]));
+                blkdat.FindByte(char(params.DiskMagic()[0]));
                 nRewind = blkdat.GetPos() + 1;
                 blkdat >> buf;
-                if (memcmp(buf, m_params.DiskMagic().data(),
+                if (memcmp(buf, params.DiskMagic().data(),
                            CMessageHeader::MESSAGE_START_SIZE)) {
                     continue;
                 }
 
                 // Read size.
                 blkdat >> nSize;
-                if (nSize < 80) {
+                compressed = nSize & BLOCK_STORAGE_COMPRESSED_FLAG;
+                nSize &= ~BLOCK_STORAGE_COMPRESSED_FLAG;
+                if (nSize < (compressed ? sizeof(uint32_t) : 80)) {
+                    continue;
+                }
+                // Compressed blocks are read whole, so don't trust their size
+                // beyond the size of a valid block.
+                if (compressed && nSize > config.GetMaxBlockSize()) {
                     continue;
                 }
             } catch (const std::exception &) {
@@ -5093,94 +5851,23 @@ void CChainState::LoadExternalBlockFile(const Config &config, FILE *fileIn,
                 }
                 blkdat.SetLimit(nBlockPos + nSize);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock &block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                const BlockHash hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != m_params.GetConsensus().hashGenesisBlock &&
-                        !m_blockman.LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(
-                            BCLog::REINDEX,
-                            "%s: Out of order block %s, parent %s not known\n",
-                            __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                        if (dbp) {
-                            mapBlocksUnknownParent.insert(
-                                std::make_pair(block.hashPrevBlock, *dbp));
-                        }
-                        continue;
-                    }
-
-                    // process in case the block isn't known yet
-                    CBlockIndex *pindex = m_blockman.LookupBlockIndex(hash);
-                    if (!pindex || !pindex->nStatus.hasData()) {
-                        BlockValidationState state;
-                        if (AcceptBlock(config, pblock, state, true, dbp,
-                                        nullptr)) {
-                            nLoaded++;
-                        }
-                        if (state.IsError()) {
-                            break;
-                        }
-                    } else if (hash !=
-                                   m_params.GetConsensus().hashGenesisBlock &&
-                               pindex->nHeight % 1000 == 0) {
-                        LogPrint(
-                            BCLog::REINDEX,
-                            "Block Import: already had block %s at height %d\n",
-                            hash.ToString(), pindex->nHeight);
-                    }
-                }
-
-                // Activate the genesis block so normal node progress can
-                // continue
-                if (hash == m_params.GetConsensus().hashGenesisBlock) {
-                    BlockValidationState state;
-                    if (!ActivateBestChain(config, state, nullptr)) {
-                        break;
+                if (compressed) {
+                    std::vector<uint8_t> stored(nSize);
+                    blkdat.read(reinterpret_cast<char *>(stored.data()),
+                                nSize);
+                    std::vector<uint8_t> data;
+                    if (!DecompressStoredData(stored, data)) {
+                        throw std::ios_base::failure(
+                            "Corrupted compressed block");
                     }
+                    SpanReader(SER_DISK, CLIENT_VERSION, data) >> *pblock;
+                } else {
+                    blkdat >> *pblock;
                 }
+                nRewind = blkdat.GetPos();
 
-                NotifyHeaderTip(*this);
-
-                // Recursively process earlier encountered successors of this
-                // block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator,
-                              std::multimap<uint256, FlatFilePos>::iterator>
-                        range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it =
-                            range.first;
-                        std::shared_ptr<CBlock> pblockrecursive =
-                            std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second,
-                                              m_params.GetConsensus())) {
-                            LogPrint(
-                                BCLog::REINDEX,
-                                "%s: Processing out of order child %s of %s\n",
-                                __func__, pblockrecursive->GetHash().ToString(),
-                                head.ToString());
-                            LOCK(cs_main);
-                            BlockValidationState dummy;
-                            if (AcceptBlock(config, pblockrecursive, dummy,
-                                            true, &it->second, nullptr)) {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip(*this);
-                    }
+                if (!process(pblock, dbp)) {
+                    break;
                 }
             } catch (const std::exception &e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__,
@@ -5190,11 +5877,114 @@ void CChainState::LoadExternalBlockFile(const Config &config, FILE *fileIn,
     } catch (const std::runtime_error &e) {
         AbortNode(std::string("System error: ") + e.what());
     }
+}
+
+// Map of disk positions for blocks with unknown parent (only used for reindex)
+static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
+
+void CChainState::LoadExternalBlockFile(const Config &config, FILE *fileIn,
+                                        FlatFilePos *dbp) {
+    AssertLockNotHeld(m_chainstate_mutex);
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    ReadExternalBlockFile(
+        config, fileIn, dbp,
+        [&](const std::shared_ptr<CBlock> &pblock, FlatFilePos *pos) {
+            return LoadExternalBlock(config, pblock, pos, nLoaded);
+        });
+    if (ShutdownRequested()) {
+        return;
+    }
 
     LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded,
               GetTimeMillis() - nStart);
 }
 
+bool CChainState::LoadExternalBlock(const Config &config,
+                                    const std::shared_ptr<CBlock> &pblock,
+                                    FlatFilePos *dbp, int &nLoaded) {
+    AssertLockNotHeld(m_chainstate_mutex);
+    const CBlock &block = *pblock;
+    const BlockHash hash = block.GetHash();
+    {
+        LOCK(cs_main);
+        // detect out of order blocks, and store them for later
+        if (hash != m_params.GetConsensus().hashGenesisBlock &&
+            !m_blockman.LookupBlockIndex(block.hashPrevBlock)) {
+            LogPrint(BCLog::REINDEX,
+                     "%s: Out of order block %s, parent %s not known\n",
+                     __func__, hash.ToString(), block.hashPrevBlock.ToString());
+            if (dbp) {
+                mapBlocksUnknownParent.insert(
+                    std::make_pair(block.hashPrevBlock, *dbp));
+            }
+            return true;
+        }
+
+        // process in case the block isn't known yet
+        CBlockIndex *pindex = m_blockman.LookupBlockIndex(hash);
+        if (!pindex || !pindex->nStatus.hasData()) {
+            BlockValidationState state;
+            if (AcceptBlock(config, pblock, state, true, dbp, nullptr)) {
+                nLoaded++;
+            }
+            if (state.IsError()) {
+                return false;
+            }
+        } else if (hash != m_params.GetConsensus().hashGenesisBlock &&
+                   pindex->nHeight % 1000 == 0) {
+            LogPrint(BCLog::REINDEX,
+                     "Block Import: already had block %s at height %d\n",
+                     hash.ToString(), pindex->nHeight);
+        }
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == m_params.GetConsensus().hashGenesisBlock) {
+        BlockValidationState state;
+        if (!ActivateBestChain(config, state, nullptr)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip(*this);
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, FlatFilePos>::iterator,
+                  std::multimap<uint256, FlatFilePos>::iterator>
+            range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, FlatFilePos>::iterator it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive =
+                std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockrecursive, it->second,
+                                  m_params.GetConsensus())) {
+                LogPrint(BCLog::REINDEX,
+                         "%s: Processing out of order child %s of %s\n",
+                         __func__, pblockrecursive->GetHash().ToString(),
+                         head.ToString());
+                LOCK(cs_main);
+                BlockValidationState dummy;
+                if (AcceptBlock(config, pblockrecursive, dummy, true,
+                                &it->second, nullptr)) {
+                    nLoaded++;
+                    queue.push_back(pblockrecursive->GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip(*this);
+        }
+    }
+    return true;
+}
+
 void CChainState::CheckBlockIndex() {
     if (!fCheckBlockIndex) {
         return;
@@ -5555,6 +6345,10 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size) {
     size_t old_coinstip_size = m_coinstip_cache_size_bytes;
     m_coinstip_cache_size_bytes = coinstip_size;
     m_coinsdb_cache_size_bytes = coinsdb_size;
+    // Resizing reopens the database, which must not be used meanwhile. A
+    // failed background write is reported by the flush below.
+    ClearBlocksReadAhead();
+    m_coins_views->m_flushview.WaitForFlush();
     CoinsDB().ResizeCache(coinsdb_size);
 
     LogPrintf("[%s] resized coinsdb cache to %.1f MiB\n", this->ToString(),
@@ -5930,6 +6724,157 @@ static void FlushSnapshotToDisk(CCoinsViewCache &coins_cache,
     coins_cache.Flush();
 }
 
+namespace {
+/**
+ * Reads and verifies the chunks of a UTXO snapshot on a background thread,
+ * and computes the HASH_SERIALIZED hash of their coins on another one, while
+ * the caller inserts them into the snapshot chainstate.
+ */
+class SnapshotCoinsReader {
+public:
+    SnapshotCoinsReader(CAutoFile &coins_file, uint64_t coins_count,
+                        int base_height, const BlockHash &base_blockhash)
+        : m_hasher(base_blockhash) {
+        m_reader = std::thread(
+            &util::TraceThread, "snapshotread",
+            [this, &coins_file, coins_count, base_height] {
+                m_read_ok = ReadCoins(coins_file, coins_count, base_height);
+                m_hash_queue.Close();
+                m_insert_queue.Close();
+            });
+        m_hashing = std::thread(&util::TraceThread, "snapshothash", [this] {
+            while (auto batch = m_hash_queue.Pop()) {
+                for (const auto &[outpoint, coin] : *batch) {
+                    m_hasher.Add(outpoint, coin);
+                }
+            }
+        });
+    }
+
+    ~SnapshotCoinsReader() {
+        m_hash_queue.Abort();
+        m_insert_queue.Abort();
+        Join();
+    }
+
+    //! Returns nullptr once all the coins were read, or on error.
+    std::shared_ptr<const SnapshotCoinsBatch> Next() {
+        return m_insert_queue.Pop();
+    }
+
+    /**
+     * To be called once Next() returned nullptr. Returns whether the whole
+     * snapshot was read successfully, and if so the hash of its coins in the
+     * order they were read.
+     *
+     * The hash is only set if the outpoints were strictly increasing. The
+     * coins database keeps the first of duplicate outpoints while the hasher
+     * keeps the last one, so the hash only describes the inserted coins when
+     * there are no duplicates.
+     */
+    bool Finish(std::optional<uint256> &hash) {
+        Join();
+        if (!m_read_ok) {
+            return false;
+        }
+        const uint256 read_hash = m_hasher.Finalize();
+        if (m_ordered) {
+            hash = read_hash;
+        }
+        return true;
+    }
+
+private:
+    SnapshotCoinsQueue m_hash_queue;
+    SnapshotCoinsQueue m_insert_queue;
+    CoinsSerializedHasher m_hasher;
+    bool m_read_ok{false};
+    //! Whether the outpoints read so far are strictly increasing.
+    bool m_ordered{true};
+    std::thread m_reader;
+    std::thread m_hashing;
+
+    void Join() {
+        if (m_reader.joinable()) {
+            m_reader.join();
+        }
+        if (m_hashing.joinable()) {
+            m_hashing.join();
+        }
+    }
+
+    bool ReadCoins(CAutoFile &coins_file, uint64_t coins_count,
+                   int base_height) {
+        uint64_t coins_read = 0;
+        COutPoint last_outpoint;
+        for (uint64_t chunks_read = 0; coins_read < coins_count;
+             ++chunks_read) {
+            auto batch = std::make_shared<SnapshotCoinsBatch>();
+            try {
+                SnapshotChunk chunk;
+                coins_file >> chunk;
+                if (!chunk.IsValid()) {
+                    LogPrintf("[snapshot] bad snapshot - checksum mismatch "
+                              "in chunk %d\n",
+                              chunks_read);
+                    return false;
+                }
+                chunk.Decode(*batch);
+            } catch (const std::ios_base::failure &) {
+                LogPrintf("[snapshot] bad snapshot format or truncated "
+                          "snapshot after deserializing %d coins\n",
+                          coins_read);
+                return false;
+            }
+
+            for (const auto &[outpoint, coin] : *batch) {
+                if (coin.GetHeight() > uint32_t(base_height) ||
+                    // Avoid integer wrap-around in coinstats.cpp:ApplyHash
+                    outpoint.GetN() >=
+                        std::numeric_limits<
+                            decltype(outpoint.GetN())>::max()) {
+                    LogPrintf("[snapshot] bad snapshot data after "
+                              "deserializing %d coins\n",
+                              coins_read);
+                    return false;
+                }
+                if (++coins_read > coins_count) {
+                    LogPrintf("[snapshot] bad snapshot - coins left over "
+                              "after deserializing %d coins\n",
+                              coins_count);
+                    return false;
+                }
+                if (coins_read > 1 && !(last_outpoint < outpoint)) {
+                    m_ordered = false;
+                }
+                last_outpoint = outpoint;
+            }
+
+            if (!m_hash_queue.Push(batch) || !m_insert_queue.Push(batch)) {
+                // Aborted
+                return false;
+            }
+        }
+
+        bool out_of_coins{false};
+        try {
+            SnapshotChunk chunk;
+            coins_file >> chunk;
+        } catch (const std::ios_base::failure &) {
+            // We expect an exception since we should be out of coins.
+            out_of_coins = true;
+        }
+        if (!out_of_coins) {
+            LogPrintf("[snapshot] bad snapshot - coins left over after "
+                      "deserializing %d coins\n",
+                      coins_count);
+            return false;
+        }
+        return true;
+    }
+};
+} // namespace
+
 bool ChainstateManager::PopulateAndValidateSnapshot(
     CChainState &snapshot_chainstate, CAutoFile &coins_file,
     const SnapshotMetadata &metadata) {
@@ -5964,72 +6909,73 @@ bool ChainstateManager::PopulateAndValidateSnapshot(
 
     const AssumeutxoData &au_data = *maybe_au_data;
 
-    COutPoint outpoint;
-    Coin coin;
     const uint64_t coins_count = metadata.m_coins_count;
-    uint64_t coins_left = metadata.m_coins_count;
 
     LogPrintf("[snapshot] loading coins from snapshot %s\n",
               base_blockhash.ToString());
     int64_t coins_processed{0};
-
-    while (coins_left > 0) {
-        try {
-            coins_file >> outpoint;
-            coins_file >> coin;
-        } catch (const std::ios_base::failure &) {
-            LogPrintf("[snapshot] bad snapshot format or truncated snapshot "
-                      "after deserializing %d coins\n",
-                      coins_count - coins_left);
-            return false;
-        }
-        if (coin.GetHeight() > uint32_t(base_height) ||
-            // Avoid integer wrap-around in coinstats.cpp:ApplyHash
-            outpoint.GetN() >=
-                std::numeric_limits<decltype(outpoint.GetN())>::max()) {
-            LogPrintf(
-                "[snapshot] bad snapshot data after deserializing %d coins\n",
-                coins_count - coins_left);
-            return false;
-        }
-        coins_cache.EmplaceCoinInternalDANGER(std::move(outpoint),
-                                              std::move(coin));
-
-        --coins_left;
-        ++coins_processed;
-
-        if (coins_processed % 1000000 == 0) {
-            LogPrintf("[snapshot] %d coins loaded (%.2f%%, %.2f MB)\n",
-                      coins_processed,
-                      static_cast<float>(coins_processed) * 100 /
-                          static_cast<float>(coins_count),
-                      coins_cache.DynamicMemoryUsage() / (1000 * 1000));
-        }
-
-        // Batch write and flush (if we need to) every so often.
-        //
-        // If our average Coin size is roughly 41 bytes, checking every 120,000
-        // coins means <5MB of memory imprecision.
-        if (coins_processed % 120000 == 0) {
-            if (ShutdownRequested()) {
-                return false;
+    int last_progress{-1};
+
+    // The coins are read and hashed on background threads while they are
+    // being inserted here.
+    SnapshotCoinsReader reader(coins_file, coins_count, base_height,
+                               base_blockhash);
+    while (auto batch = reader.Next()) {
+        for (const auto &[outpoint, coin] : *batch) {
+            coins_cache.EmplaceCoinInternalDANGER(COutPoint{outpoint},
+                                                  Coin{coin});
+            ++coins_processed;
+
+            if (coins_processed % 1000000 == 0) {
+                LogPrintf("[snapshot] %d coins loaded (%.2f%%, %.2f MB)\n",
+                          coins_processed,
+                          static_cast<float>(coins_processed) * 100 /
+                              static_cast<float>(coins_count),
+                          coins_cache.DynamicMemoryUsage() / (1000 * 1000));
             }
 
-            const auto snapshot_cache_state = WITH_LOCK(
-                ::cs_main, return snapshot_chainstate.GetCoinsCacheSizeState());
-
-            if (snapshot_cache_state >= CoinsCacheSizeState::CRITICAL) {
-                // This is a hack - we don't know what the actual best block is,
-                // but that doesn't matter for the purposes of flushing the
-                // cache here. We'll set this to its correct value
-                // (`base_blockhash`) below after the coins are loaded.
-                coins_cache.SetBestBlock(BlockHash{GetRandHash()});
+            // Batch write and flush (if we need to) every so often.
+            //
+            // If our average Coin size is roughly 41 bytes, checking every
+            // 120,000 coins means <5MB of memory imprecision.
+            if (coins_processed % 120000 == 0) {
+                if (ShutdownRequested()) {
+                    return false;
+                }
 
-                // No need to acquire cs_main since this chainstate isn't being
-                // used yet.
-                FlushSnapshotToDisk(coins_cache, /*snapshot_loaded=*/false);
+                const auto snapshot_cache_state =
+                    WITH_LOCK(::cs_main, return snapshot_chainstate
+                                             .GetCoinsCacheSizeState());
+
+                if (snapshot_cache_state >= CoinsCacheSizeState::CRITICAL) {
+                    // This is a hack - we don't know what the actual best
+                    // block is, but that doesn't matter for the purposes of
+                    // flushing the cache here. We'll set this to its correct
+                    // value (`base_blockhash`) below after the coins are
+                    // loaded.
+                    coins_cache.SetBestBlock(BlockHash{GetRandHash()});
+
+                    // No need to acquire cs_main since this chainstate isn't
+                    // being used yet.
+                    FlushSnapshotToDisk(coins_cache,
+                                        /*snapshot_loaded=*/false);
+                }
             }
         }
+
+        const int progress =
+            coins_processed * 100 / std::max<uint64_t>(coins_count, 1);
+        if (progress != last_progress) {
+            uiInterface.ShowProgress(_("Loading UTXO snapshot...").translated,
+                                     progress, false);
+            last_progress = progress;
+        }
+    }
+    uiInterface.ShowProgress("", 100, false);
+
+    std::optional<uint256> read_hash;
+    if (!reader.Finish(read_hash)) {
+        return false;
     }
 
     // Important that we set this. This and the coins_cache accesses above are
@@ -6039,20 +6985,6 @@ bool ChainstateManager::PopulateAndValidateSnapshot(
     // method.
     coins_cache.SetBestBlock(base_blockhash);
 
-    bool out_of_coins{false};
-    try {
-        coins_file >> outpoint;
-    } catch (const std::ios_base::failure &) {
-        // We expect an exception since we should be out of coins.
-        out_of_coins = true;
-    }
-    if (!out_of_coins) {
-        LogPrintf("[snapshot] bad snapshot - coins left over after "
-                  "deserializing %d coins\n",
-                  coins_count);
-        return false;
-    }
-
     LogPrintf("[snapshot] loaded %d (%.2f MB) coins from snapshot %s\n",
               coins_count, coins_cache.DynamicMemoryUsage() / (1000 * 1000),
               base_blockhash.ToString());
@@ -6062,26 +6994,37 @@ bool ChainstateManager::PopulateAndValidateSnapshot(
 
     assert(coins_cache.GetBestBlock() == base_blockhash);
 
-    CCoinsStats stats{CoinStatsHashType::HASH_SERIALIZED};
-    auto breakpoint_fnc = [] { /* TODO insert breakpoint here? */ };
-
-    // As above, okay to immediately release cs_main here since no other context
-    // knows about the snapshot_chainstate.
-    CCoinsViewDB *snapshot_coinsdb =
-        WITH_LOCK(::cs_main, return &snapshot_chainstate.CoinsDB());
-
-    if (!GetUTXOStats(snapshot_coinsdb, m_blockman, stats, breakpoint_fnc)) {
-        LogPrintf("[snapshot] failed to generate coins stats\n");
-        return false;
-    }
+    // The hash computed while reading the snapshot matches the expected one
+    // only if the coins were stored in the order of the coins database, as
+    // dumptxoutset does. Otherwise, hash the coins from the database, which is
+    // authoritative but requires reading them all back.
+    if (!read_hash || AssumeutxoHash{*read_hash} != au_data.hash_serialized) {
+        LogPrintf("[snapshot] could not verify the snapshot content hash "
+                  "while reading, hashing the coins database\n");
+
+        CCoinsStats stats{CoinStatsHashType::HASH_SERIALIZED};
+        auto breakpoint_fnc = [] { /* TODO insert breakpoint here? */ };
+
+        // As above, okay to immediately release cs_main here since no other
+        // context knows about the snapshot_chainstate.
+        CCoinsViewDB *snapshot_coinsdb =
+            WITH_LOCK(::cs_main, return &snapshot_chainstate.CoinsDB());
+
+        if (!GetUTXOStats(snapshot_coinsdb, m_blockman, stats,
+                          breakpoint_fnc)) {
+            LogPrintf("[snapshot] failed to generate coins stats\n");
+            return false;
+        }
 
-    // Assert that the deserialized chainstate contents match the expected
-    // assumeutxo value.
-    if (AssumeutxoHash{stats.hashSerialized} != au_data.hash_serialized) {
-        LogPrintf("[snapshot] bad snapshot content hash: expected %s, got %s\n",
-                  au_data.hash_serialized.ToString(),
-                  stats.hashSerialized.ToString());
-        return false;
+        // Assert that the deserialized chainstate contents match the expected
+        // assumeutxo value.
+        if (AssumeutxoHash{stats.hashSerialized} != au_data.hash_serialized) {
+            LogPrintf(
+                "[snapshot] bad snapshot content hash: expected %s, got %s\n",
+                au_data.hash_serialized.ToString(),
+                stats.hashSerialized.ToString());
+            return false;
+        }
     }
 
     snapshot_chainstate.m_chain.SetTip(snapshot_start_block);
@@ -25,6 +25,7 @@
 #include <policy/packages.h>
 #include <script/script_error.h>
 #include <script/script_metrics.h>
+#include <span.h>
 #include <sync.h>
 #include <txdb.h>
 #include <txmempool.h> // For CTxMemPool::cs
@@ -34,6 +35,8 @@
 
 #include <atomic>
 #include <cstdint>
+#include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <optional>
@@ -47,7 +50,9 @@ class CChainParams;
 class CChainState;
 class ChainstateManager;
 class Config;
+class CInputFetchCheck;
 class CScriptCheck;
+class SchnorrSignatureBatch;
 class CTxMemPool;
 class CTxUndo;
 class DisconnectedBlockTransactions;
@@ -57,6 +62,7 @@ struct FlatFilePos;
 struct PrecomputedTransactionData;
 struct LockPoints;
 struct AssumeutxoData;
+template <typename T> class CCheckQueue;
 namespace node {
 class SnapshotMetadata;
 } // namespace node
@@ -108,8 +114,15 @@ static const int64_t DEFAULT_MIN_FINALIZATION_DELAY = 2 * 60 * 60;
  * ActiveChain().Tip() will not be pruned.
  */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
+/**
+ * Maximum number of blocks read from disk and checked ahead of their
+ * connection, while the blocks before them are being connected.
+ */
+static const int MAX_BLOCKS_READ_AHEAD = 8;
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Default for -backgroundflush */
+static const bool DEFAULT_BACKGROUND_FLUSH = false;
 /**
  * Require that user allocate at least 550 MiB for block & undo files
  * (blk???.dat and rev???.dat)
@@ -136,6 +149,8 @@ extern uint256 g_best_block;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Whether to write periodic flushes of the coins cache in the background. */
+extern bool g_background_flush;
 
 /**
  * A fee rate smaller than this is considered zero fee (for relaying, mining and
@@ -215,6 +230,37 @@ void StartScriptCheckWorkerThreads(int threads_num);
  */
 void StopScriptCheckWorkerThreads();
 
+/**
+ * Run instances of input prefetching worker threads
+ */
+void StartInputFetchWorkerThreads(int threads_num);
+
+/**
+ * Stop all of the input prefetching worker threads
+ */
+void StopInputFetchWorkerThreads();
+
+/**
+ * Run instances of transaction checking worker threads, used by CheckBlock()
+ * on large blocks
+ */
+void StartTxCheckWorkerThreads(int threads_num);
+
+/**
+ * Stop all of the transaction checking worker threads
+ */
+void StopTxCheckWorkerThreads();
+
+/**
+ * Run instances of block read-ahead worker threads
+ */
+void StartBlockReadAheadThreads(int threads_num);
+
+/**
+ * Stop all of the block read-ahead worker threads
+ */
+void StopBlockReadAheadThreads();
+
 Amount GetBlockSubsidy(int nHeight, const Consensus::Params &consensusParams);
 
 bool AbortNode(BlockValidationState &state, const std::string &strMessage,
@@ -345,6 +391,34 @@ AcceptToMemoryPool(const Config &config, CChainState &active_chainstate,
                    bool bypass_limits, bool test_accept = false)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * Try to add a batch of unrelated transactions to the mempool. This is an
+ * internal function and is exposed only for testing. Client code should use
+ * ChainstateManager::ProcessTransactions()
+ *
+ * The cheap checks of all the transactions are done first, then their policy
+ * script checks are run together on the script check worker threads without
+ * holding the mempool lock, and finally the transactions which passed are
+ * added to the mempool in a short serialized section. A transaction spending
+ * the output of another one of the batch is rejected for missing inputs, and
+ * one conflicting with a transaction earlier in the batch is rejected as a
+ * mempool conflict.
+ *
+ * @param[in]  config             The global configuration.
+ * @param[in]  active_chainstate  Reference to the active chainstate.
+ * @param[in]  txs                The transactions to submit for mempool
+ *                                acceptance.
+ * @param[in]  accept_time        The timestamp for adding the transactions to
+ *                                the mempool.
+ *
+ * @returns a MempoolAcceptResult for each transaction, in the order of txs.
+ */
+std::vector<MempoolAcceptResult>
+AcceptToMemoryPoolBatch(const Config &config, CChainState &active_chainstate,
+                        const std::vector<CTransactionRef> &txs,
+                        int64_t accept_time)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /**
  * Validate (and maybe submit) a package to the mempool.
  * See doc/policy/packages.md for full detailson package validation rules.
@@ -378,6 +452,8 @@ public:
     }
 
     bool check() { return remaining >= 0; }
+
+    int64_t get_remaining() const { return remaining; }
 };
 
 class TxSigCheckLimiter : public CheckInputsLimiter {
@@ -510,12 +586,13 @@ private:
     PrecomputedTransactionData txdata;
     TxSigCheckLimiter *pTxLimitSigChecks;
     CheckInputsLimiter *pBlockLimitSigChecks;
+    std::atomic<bool> *pTxFailed;
 
 public:
     CScriptCheck()
         : ptxTo(nullptr), nIn(0), nFlags(0), cacheStore(false),
           error(ScriptError::UNKNOWN), txdata(), pTxLimitSigChecks(nullptr),
-          pBlockLimitSigChecks(nullptr) {}
+          pBlockLimitSigChecks(nullptr), pTxFailed(nullptr) {}
 
     CScriptCheck(const CTxOut &outIn, const CTransaction &txToIn,
                  unsigned int nInIn, uint32_t nFlagsIn, bool cacheIn,
@@ -525,10 +602,28 @@ public:
         : m_tx_out(outIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn),
           cacheStore(cacheIn), error(ScriptError::UNKNOWN), txdata(txdataIn),
           pTxLimitSigChecks(pTxLimitSigChecksIn),
-          pBlockLimitSigChecks(pBlockLimitSigChecksIn) {}
+          pBlockLimitSigChecks(pBlockLimitSigChecksIn), pTxFailed(nullptr) {}
 
     bool operator()();
 
+    /**
+     * Schnorr signature verifications may be deferred into a batch, which
+     * must then be verified for the check to be considered successful.
+     */
+    using Batch = SchnorrSignatureBatch;
+    bool operator()(Batch &batch);
+
+    /**
+     * Report a failure by setting the flag shared by the checks of the
+     * transaction instead of returning false, so that it doesn't stop the
+     * checks of other transactions run through the same queue. The
+     * signatures are then not deferred into the batch, whose failure could
+     * not be attributed to a transaction.
+     */
+    void SetTxFailedFlag(std::atomic<bool> *pTxFailedIn) {
+        pTxFailed = pTxFailedIn;
+    }
+
     void swap(CScriptCheck &check) {
         std::swap(ptxTo, check.ptxTo);
         std::swap(m_tx_out, check.m_tx_out);
@@ -540,13 +635,96 @@ public:
         std::swap(txdata, check.txdata);
         std::swap(pTxLimitSigChecks, check.pTxLimitSigChecks);
         std::swap(pBlockLimitSigChecks, check.pBlockLimitSigChecks);
+        std::swap(pTxFailed, check.pTxFailed);
     }
 
     ScriptError GetScriptError() const { return error; }
 
     ScriptExecutionMetrics GetScriptExecutionMetrics() const { return metrics; }
+
+private:
+    bool Verify(SchnorrSignatureBatch *batch);
 };
 
+/**
+ * Closure representing the lookup of a shard of the coins spent by a block in
+ * a thread-safe view (usually the coins database), so that many of them can be
+ * performed in parallel through a CCheckQueue. The results are written to
+ * caller-owned Coins, which are left spent for the lookups that fail.
+ */
+class CInputFetchCheck {
+private:
+    const CCoinsView *m_view;
+    Span<const COutPoint> m_outpoints;
+    Span<Coin> m_coins;
+
+public:
+    CInputFetchCheck() : m_view(nullptr) {}
+
+    CInputFetchCheck(const CCoinsView &viewIn,
+                     Span<const COutPoint> outpointsIn, Span<Coin> coinsOut)
+        : m_view(&viewIn), m_outpoints(outpointsIn), m_coins(coinsOut) {}
+
+    bool operator()();
+
+    void swap(CInputFetchCheck &check) {
+        std::swap(m_view, check.m_view);
+        std::swap(m_outpoints, check.m_outpoints);
+        std::swap(m_coins, check.m_coins);
+    }
+};
+
+//! Number of coins looked up together by each CInputFetchCheck.
+static constexpr size_t INPUT_FETCH_SHARD_SIZE = 64;
+
+/**
+ * Warm up the cache with the coins spent by the block before connecting it.
+ *
+ * Inputs spending outputs created in the block itself, as well as the ones
+ * already cached, are skipped. The others are sorted in the database order,
+ * split into shards of consecutive outpoints and looked up in `base` on the
+ * worker threads of `queue` (or on the calling thread if it is nullptr), then
+ * inserted into `cache` as non-dirty entries.
+ *
+ * `base` must be the view backing `cache` and must be safe to read from
+ * several threads at once, which is the case of the coins database.
+ *
+ * @returns the number of coins added to the cache.
+ */
+size_t PrefetchBlockInputs(const CBlock &block, CCoinsViewCache &cache,
+                           const CCoinsView &base,
+                           CCheckQueue<CInputFetchCheck> *queue);
+
+/**
+ * Closure representing the context-free checks of a shard of the non-coinbase
+ * transactions of a block, so that the transactions of a large block can be
+ * checked in parallel through a CCheckQueue. It only tells whether they are
+ * all valid, the reason of a failure is found by checking them again.
+ */
+class CTxCheck {
+private:
+    Span<const CTransactionRef> m_txs;
+
+public:
+    CTxCheck() {}
+
+    explicit CTxCheck(Span<const CTransactionRef> txsIn) : m_txs(txsIn) {}
+
+    bool operator()();
+
+    void swap(CTxCheck &check) { std::swap(m_txs, check.m_txs); }
+};
+
+//! Number of transactions checked together by each CTxCheck.
+static constexpr size_t TX_CHECK_SHARD_SIZE = 256;
+//! Minimum number of transactions in a block to check them in parallel.
+static constexpr size_t MIN_PARALLEL_TX_CHECKS = 4 * TX_CHECK_SHARD_SIZE;
+//! Maximum number of transaction checking threads. The checks are cheap enough
+//! that more threads mostly contend for the memory bandwidth.
+static constexpr int MAX_TX_CHECK_THREADS = 4;
+//! Number of blocks remembered as having passed CheckBlock().
+static constexpr size_t MAX_CHECKED_BLOCKS = 128;
+
 /** Functions for validating blocks and updating the block tree */
 
 /**
@@ -554,11 +732,29 @@ public:
  *
  * Returns true if the provided block is valid (has valid header,
  * transactions are valid, block is a valid size, etc.)
+ *
+ * The blocks which pass with the proof of work and merkle root checks are
+ * remembered, so that the checks are skipped when the same block shows up
+ * again, e.g. from another peer or when it gets connected after being read
+ * back from disk. The transactions of large blocks are checked on the
+ * transaction checking worker threads.
  */
 bool CheckBlock(const CBlock &block, BlockValidationState &state,
                 const Consensus::Params &params,
                 BlockValidationOptions validationOptions);
 
+/**
+ * Read the blocks of an external block file (such as a blk?????.dat file) in
+ * file order, and pass each of them to process, which returns false to stop
+ * reading. If dbp is not nullptr, its nPos is set to the position of each
+ * block in the file. Blocks which fail to deserialize are skipped. This takes
+ * over fileIn and closes it.
+ */
+void ReadExternalBlockFile(
+    const Config &config, FILE *fileIn, FlatFilePos *dbp,
+    const std::function<bool(const std::shared_ptr<CBlock> &, FlatFilePos *)>
+        &process);
+
 /**
  * This is a variant of ContextualCheckTransaction which computes the contextual
  * check for a transaction based on the chain tip.
@@ -613,6 +809,10 @@ public:
     //! database on disk. All unspent coins reside in this store.
     CCoinsViewDB m_dbview GUARDED_BY(cs_main);
 
+    //! This view serves the coins of a flush still being written to the
+    //! leveldb instance by a background thread (see -backgroundflush).
+    CCoinsViewBackgroundFlush m_flushview GUARDED_BY(cs_main);
+
     //! This view wraps access to the leveldb instance and handles read errors
     //! gracefully.
     CCoinsViewErrorCatcher m_catcherview GUARDED_BY(cs_main);
@@ -693,6 +893,13 @@ private:
     //! `m_chain`.
     std::unique_ptr<CoinsViews> m_coins_views;
 
+    /**
+     * Blocks about to be connected which are being read from disk and checked
+     * ahead of time on helper threads, by hash.
+     */
+    std::map<BlockHash, std::shared_future<std::shared_ptr<const CBlock>>>
+        m_blocks_read_ahead GUARDED_BY(cs_main);
+
     /**
      * The best finalized block.
      * This block cannot be reorged in any way except by explicit user action.
@@ -721,6 +928,9 @@ public:
     //! chainstate within deeply nested method calls.
     ChainstateManager &m_chainman;
 
+    //! Number of blocks connected from the blocks read ahead, for testing.
+    uint64_t m_blocks_read_ahead_taken GUARDED_BY(cs_main){0};
+
     explicit CChainState(
         CTxMemPool *mempool, node::BlockManager &blockman,
         ChainstateManager &chainman,
@@ -818,6 +1028,18 @@ public:
                                FlatFilePos *dbp = nullptr)
         EXCLUSIVE_LOCKS_REQUIRED(!m_chainstate_mutex);
 
+    /**
+     * Import one block read from an external file, stored at dbp in the block
+     * files if it is not nullptr. Blocks must be imported in the order they
+     * are stored in: a block whose parent is not known yet is set aside, and
+     * read again from disk to be imported after its parent. Returns false if
+     * importing the following blocks of the file should be aborted.
+     */
+    bool LoadExternalBlock(const Config &config,
+                           const std::shared_ptr<CBlock> &pblock,
+                           FlatFilePos *dbp, int &nLoaded)
+        EXCLUSIVE_LOCKS_REQUIRED(!m_chainstate_mutex);
+
     /**
      * Update the on-disk chain state.
      * The caches and indexes are flushed depending on the mode we're called
@@ -1010,6 +1232,24 @@ private:
                     ConnectTrace &connectTrace,
                     DisconnectedBlockTransactions &disconnectpool)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool->cs);
+    /**
+     * Start reading the blocks following the first one of vpindexToConnect
+     * (which is in reverse order) ahead of their connection, and forget about
+     * the blocks read ahead that are no longer about to be connected.
+     * pindexSkip is a block we already have in memory.
+     */
+    void ReadBlocksAhead(const Config &config,
+                         const std::vector<CBlockIndex *> &vpindexToConnect,
+                         const CBlockIndex *pindexSkip)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    /**
+     * Take the given block out of the blocks read ahead, waiting for it if
+     * needed. Returns nullptr if it was not read ahead or could not be read.
+     */
+    std::shared_ptr<const CBlock> TakeBlockReadAhead(const CBlockIndex *pindex)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    //! Wait for the blocks being read ahead, and forget about them.
+    void ClearBlocksReadAhead() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     void InvalidBlockFound(CBlockIndex *pindex,
                            const BlockValidationState &state)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -1295,6 +1535,18 @@ public:
     ProcessTransaction(const CTransactionRef &tx, bool test_accept = false)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Try to add a batch of unrelated transactions to the memory pool, running
+     * their script checks in parallel.
+     *
+     * @param[in]  txs             The transactions to submit for mempool
+     *                             acceptance.
+     * @returns a MempoolAcceptResult for each transaction, in the order of txs.
+     */
+    [[nodiscard]] std::vector<MempoolAcceptResult>
+    ProcessTransactions(const std::vector<CTransactionRef> &txs)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     //! Load the block tree and coins database from disk, initializing state if
     //! we're running with -reindex
     bool LoadBlockIndex() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
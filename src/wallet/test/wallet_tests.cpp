@@ -388,14 +388,11 @@ static int64_t AddTx(ChainstateManager &chainman, CWallet &wallet,
     CBlockIndex *block = nullptr;
     if (blockTime > 0) {
         LOCK(cs_main);
-        auto inserted = chainman.BlockIndex().emplace(BlockHash(GetRandHash()),
-                                                      new CBlockIndex);
-        assert(inserted.second);
-        const BlockHash &hash = inserted.first->first;
-        block = inserted.first->second;
+        block =
+            chainman.m_blockman.InsertBlockIndex(BlockHash(GetRandHash()));
         block->nTime = blockTime;
-        block->phashBlock = &hash;
-        confirm = {CWalletTx::Status::CONFIRMED, block->nHeight, hash, 0};
+        confirm = {CWalletTx::Status::CONFIRMED, block->nHeight,
+                   block->GetBlockHash(), 0};
     }
 
     // If transaction is already in map, to avoid inconsistencies,
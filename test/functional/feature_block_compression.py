@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the compressed storage of blocks with -blockcompression.
+
+- Generate blocks over several block files, stored uncompressed.
+- Convert the block files to compressed storage with -convertblockfiles, and
+  verify that they got smaller while the blocks and undo data are unchanged.
+- Store new blocks compressed, and reindex the compressed block files.
+- Convert the block files back to uncompressed storage, and verify that they
+  are the same as the original ones.
+"""
+
+import hashlib
+import os
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+
+class BlockCompressionTest(BitcoinTestFramework):
+
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        # Use small block files
+        self.extra_args = [["-fastprune", "-txindex"]]
+
+    def block_file(self, name):
+        return os.path.join(self.nodes[0].datadir, self.chain, "blocks", name)
+
+    def file_hash(self, name):
+        with open(self.block_file(name), 'rb') as f:
+            return hashlib.sha256(f.read()).hexdigest()
+
+    def get_state(self):
+        node = self.nodes[0]
+        blocks = []
+        for height in range(1, node.getblockcount() + 1, 50):
+            block = node.getblock(node.getblockhash(height), 2)
+            tx = node.getrawtransaction(block["tx"][0]["txid"])
+            blocks.append((node.getblock(block["hash"], 0), tx))
+        return node.getbestblockhash(), blocks
+
+    def restart_with(self, extra_args):
+        self.restart_node(0, extra_args=self.extra_args[0] + extra_args)
+        self.wait_until(
+            lambda: self.nodes[0].getindexinfo()["txindex"]["synced"])
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.generatetoaddress(
+            node, 700, node.get_deterministic_priv_key().address)
+        self.stop_node(0)
+        assert os.path.exists(self.block_file("blk00002.dat"))
+        original_hash = self.file_hash("blk00000.dat")
+        original_size = os.path.getsize(self.block_file("blk00000.dat"))
+        self.start_node(0)
+        state = self.get_state()
+
+        self.log.info("Convert the block files to compressed storage")
+        with node.assert_debug_log(
+                ["Converted block file blk00000.dat",
+                 "Converted block file blk00001.dat"],
+                unexpected_msgs=["Converted block file blk00002.dat"]):
+            self.restart_with(["-blockcompression", "-convertblockfiles"])
+        assert os.path.getsize(
+            self.block_file("blk00000.dat")) < original_size
+        assert not os.path.exists(self.block_file("convert"))
+        assert_equal(self.get_state(), state)
+        assert node.verifychain(4, 0)
+
+        self.log.info("Store new blocks compressed")
+        self.generatetoaddress(
+            node, 100, node.get_deterministic_priv_key().address)
+        state = self.get_state()
+        assert node.verifychain(4, 0)
+
+        self.log.info("Reindex the compressed block files")
+        self.restart_with(["-blockcompression", "-reindex"])
+        assert_equal(self.get_state(), state)
+
+        self.log.info("Convert the block files back to uncompressed storage")
+        self.restart_with(["-convertblockfiles"])
+        assert_equal(self.file_hash("blk00000.dat"), original_hash)
+        assert_equal(self.get_state(), state)
+        assert node.verifychain(4, 0)
+
+        self.log.info("The conversion is not allowed while reindexing")
+        self.stop_node(0)
+        node.assert_start_raises_init_error(
+            self.extra_args[0] + ["-convertblockfiles", "-reindex"],
+            "Error: -convertblockfiles can not be used while reindexing.")
+
+
+if __name__ == '__main__':
+    BlockCompressionTest().main()
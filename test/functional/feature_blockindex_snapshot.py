@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the block index snapshot written on shutdown with -blockindexsnapshot.
+
+- Generate blocks, with an invalidated fork, and stop the node. Verify that
+  the snapshot file was written.
+- Restart the node and verify that the block index was loaded from the
+  snapshot, which got removed, and is the same as before.
+- Restart the node without -blockindexsnapshot and verify that the block index
+  is loaded from the database.
+"""
+
+import os
+
+from test_framework.address import ADDRESS_ECREG_UNSPENDABLE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+
+class BlockIndexSnapshotTest(BitcoinTestFramework):
+
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        self.extra_args = [["-blockindexsnapshot"]]
+
+    def get_state(self):
+        node = self.nodes[0]
+        return (node.getblockcount(), node.getbestblockhash(),
+                node.getchaintips())
+
+    def run_test(self):
+        node = self.nodes[0]
+        snapshot_path = os.path.join(
+            node.datadir, self.chain, "blocks", "blockindex.dat")
+
+        self.generatetoaddress(
+            node, 150, node.get_deterministic_priv_key().address)
+        node.invalidateblock(node.getblockhash(140))
+        self.generatetoaddress(node, 20, ADDRESS_ECREG_UNSPENDABLE)
+        state = self.get_state()
+        assert_equal(len(state[2]), 2)
+
+        self.log.info("Write the block index snapshot on shutdown")
+        self.stop_node(0)
+        assert os.path.exists(snapshot_path)
+
+        self.log.info("Load the block index from the snapshot")
+        with node.assert_debug_log(["Loaded 171 block index entries"]):
+            self.start_node(0)
+        assert not os.path.exists(snapshot_path)
+        assert_equal(self.get_state(), state)
+
+        self.log.info("Load the block index from the database")
+        self.stop_node(0)
+        assert os.path.exists(snapshot_path)
+        os.remove(snapshot_path)
+        with node.assert_debug_log(
+                ["last block file"],
+                unexpected_msgs=["Loaded 171 block index entries"]):
+            self.start_node(0)
+        assert_equal(self.get_state(), state)
+
+        self.log.info("Skip the snapshot without -blockindexsnapshot")
+        self.restart_node(0, extra_args=[])
+        assert not os.path.exists(snapshot_path)
+        assert_equal(self.get_state(), state)
+
+
+if __name__ == '__main__':
+    BlockIndexSnapshotTest().main()
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the deletion of pruned block files in the background with
+-backgroundprune.
+
+- Generate blocks over several block files and prune some of them. Verify
+  that the files get deleted and the pruned blocks are no longer available.
+- Restart the node and verify that the pruned state was kept.
+"""
+
+import os
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error
+
+
+class BackgroundPruneTest(BitcoinTestFramework):
+
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        # Use small block files
+        self.extra_args = [["-fastprune", "-prune=1", "-backgroundprune"]]
+
+    def block_file(self, name):
+        return os.path.join(self.nodes[0].datadir, self.chain, "blocks", name)
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.generatetoaddress(
+            node, 700, node.get_deterministic_priv_key().address)
+        tip = node.getbestblockhash()
+        assert os.path.exists(self.block_file("blk00000.dat"))
+
+        self.log.info("Prune the first block files")
+        with node.assert_debug_log(["Prune: UnlinkPrunedFiles deleted blk/rev "
+                                    "(00000)"]):
+            assert_equal(node.pruneblockchain(400), 346)
+            self.wait_until(
+                lambda: not os.path.exists(self.block_file("blk00000.dat")))
+        assert not os.path.exists(self.block_file("rev00000.dat"))
+        assert os.path.exists(self.block_file("blk00002.dat"))
+        assert_raises_rpc_error(
+            -1, "Block not available (pruned data)",
+            node.getblock, node.getblockhash(1))
+        node.getblock(node.getblockhash(600))
+
+        self.log.info("The pruned state is kept after a restart")
+        self.restart_node(0)
+        assert_equal(node.getbestblockhash(), tip)
+        assert_equal(node.getblockchaininfo()["pruneheight"], 346)
+        assert_raises_rpc_error(
+            -1, "Block not available (pruned data)",
+            node.getblock, node.getblockhash(1))
+
+
+if __name__ == '__main__':
+    BackgroundPruneTest().main()
@@ -7,8 +7,11 @@
 - Start a single node and generate 3 blocks.
 - Stop the node and restart it with -reindex. Verify that the node has reindexed up to block 3.
 - Stop the node and restart it with -reindex-chainstate. Verify that the node has reindexed up to block 3.
+- Spread blocks over several block files and reindex them with -reindexthreads.
 """
 
+import os
+
 from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import assert_equal
 
@@ -31,11 +34,30 @@ class ReindexTest(BitcoinTestFramework):
         assert_equal(self.nodes[0].getblockcount(), blockcount)
         self.log.info("Success")
 
+    def reindex_in_parallel(self):
+        self.log.info("Reindex several block files with -reindexthreads")
+        # Use small block files
+        self.restart_node(0, extra_args=["-fastprune"])
+        self.generatetoaddress(self.nodes[0],
+                               600, self.nodes[0].get_deterministic_priv_key().address)
+        blockcount = self.nodes[0].getblockcount()
+        besthash = self.nodes[0].getbestblockhash()
+        self.stop_nodes()
+        blocks_dir = os.path.join(self.nodes[0].datadir, self.chain, "blocks")
+        assert os.path.exists(os.path.join(blocks_dir, "blk00001.dat"))
+
+        self.start_nodes(
+            [["-fastprune", "-reindex", "-reindexthreads=4"]])
+        assert_equal(self.nodes[0].getblockcount(), blockcount)
+        assert_equal(self.nodes[0].getbestblockhash(), besthash)
+        self.log.info("Success")
+
     def run_test(self):
         self.reindex(False)
         self.reindex(True)
         self.reindex(False)
         self.reindex(True)
+        self.reindex_in_parallel()
 
 
 if __name__ == '__main__':
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test getblocktemplate delta updates and binary encoding.
+
+- Request the changes from a previous template with templateid, as
+  transactions enter and leave the mempool.
+- Verify that the binary encoding carries the same changes as the json one.
+- Verify that a full template is returned for unknown template ids and after
+  the tip changed.
+- Run the same checks with -incrementalblocktemplate.
+"""
+
+import struct
+import time
+from io import BytesIO
+
+from test_framework.messages import (
+    CTransaction,
+    deser_compact_size,
+    deser_uint256_vector,
+)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error
+from test_framework.wallet import MiniWallet
+
+
+def decode_txdata(txdata):
+    f = BytesIO(bytes.fromhex(txdata))
+    removed = [f"{txid:064x}" for txid in deser_uint256_vector(f)]
+    added = []
+    for _ in range(deser_compact_size(f)):
+        tx = CTransaction()
+        tx.deserialize(f)
+        fee, sigchecks = struct.unpack("<qq", f.read(16))
+        added.append({"txid": tx.rehash(), "fee": fee,
+                      "sigchecks": sigchecks})
+    assert_equal(f.read(), b"")
+    return removed, added
+
+
+class GetBlockTemplateDeltaTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        # Don't relay the transactions to the second node, so that they only
+        # expire from the first node's mempool.
+        self.extra_args = [["-mempoolexpiry=1"], ["-blocksonly"]]
+        self.supports_cli = False
+
+    def bump_mocktime(self, seconds):
+        # Also get past the throttling of the template updates.
+        self.mocktime += seconds
+        for node in self.nodes:
+            node.setmocktime(self.mocktime)
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.wallet = MiniWallet(node)
+        self.generate(self.wallet, 10)
+        self.generate(node, 100)
+        self.mocktime = int(time.time())
+        self.bump_mocktime(0)
+
+        self.test_delta()
+
+        self.log.info("Test with an incrementally updated template")
+        self.restart_node(
+            0, extra_args=["-mempoolexpiry=1", "-incrementalblocktemplate"])
+        self.bump_mocktime(60)
+        self.connect_nodes(0, 1)
+        self.test_delta()
+
+    def test_delta(self):
+        node = self.nodes[0]
+
+        self.log.info("Check the template id and merkle branch")
+        tmpl0 = node.getblocktemplate()
+        assert_equal(tmpl0["transactions"], [])
+        assert_equal(tmpl0["merklebranch"], [])
+        assert "basetemplateid" not in tmpl0
+        assert "removed" not in tmpl0
+        assert_equal(node.getblocktemplate()["templateid"],
+                     tmpl0["templateid"])
+
+        self.log.info("Check the transactions added to the mempool")
+        txs = [self.wallet.send_self_transfer(from_node=node)["txid"]
+               for _ in range(3)]
+        self.bump_mocktime(6)
+        tmpl1 = node.getblocktemplate({"templateid": tmpl0["templateid"]})
+        assert tmpl1["templateid"] != tmpl0["templateid"]
+        assert_equal(tmpl1["basetemplateid"], tmpl0["templateid"])
+        assert_equal([tx["txid"] for tx in tmpl1["transactions"]],
+                     sorted(txs))
+        assert_equal(tmpl1["removed"], [])
+        assert_equal(len(tmpl1["merklebranch"]), 2)
+        assert_equal(tmpl1["merklebranch"][0], sorted(txs)[0])
+
+        full = node.getblocktemplate()
+        assert_equal(full["templateid"], tmpl1["templateid"])
+        assert_equal(full["transactions"], tmpl1["transactions"])
+        assert "basetemplateid" not in full
+
+        self.log.info("Check the transactions removed from the mempool")
+        # Let the transactions expire, they are removed when the next one is
+        # accepted.
+        self.bump_mocktime(2 * 60 * 60)
+        new_tx = self.wallet.send_self_transfer(from_node=node)["txid"]
+        assert_equal(node.getrawmempool(), [new_tx])
+        self.bump_mocktime(6)
+        tmpl2 = node.getblocktemplate({"templateid": tmpl1["templateid"]})
+        assert_equal(tmpl2["basetemplateid"], tmpl1["templateid"])
+        assert_equal([tx["txid"] for tx in tmpl2["transactions"]], [new_tx])
+        assert_equal(tmpl2["removed"], sorted(txs))
+        assert_equal(tmpl2["merklebranch"], [new_tx])
+
+        self.log.info("Check the changes from an older template")
+        tmpl = node.getblocktemplate({"templateid": tmpl0["templateid"]})
+        assert_equal(tmpl["templateid"], tmpl2["templateid"])
+        assert_equal(tmpl["basetemplateid"], tmpl0["templateid"])
+        assert_equal(tmpl["transactions"], tmpl2["transactions"])
+        assert_equal(tmpl["removed"], [])
+
+        self.log.info("Check the binary encoding")
+        tmpl = node.getblocktemplate(
+            {"templateid": tmpl1["templateid"], "encoding": "binary"})
+        assert "transactions" not in tmpl
+        assert "removed" not in tmpl
+        removed, added = decode_txdata(tmpl["txdata"])
+        assert_equal(removed, tmpl2["removed"])
+        assert_equal(added, [{"txid": tx["txid"], "fee": tx["fee"],
+                              "sigchecks": tx["sigchecks"]}
+                             for tx in tmpl2["transactions"]])
+
+        tmpl = node.getblocktemplate({"encoding": "binary"})
+        assert "basetemplateid" not in tmpl
+        removed, added = decode_txdata(tmpl["txdata"])
+        assert_equal(removed, [])
+        assert_equal([tx["txid"] for tx in added], [new_tx])
+
+        assert_raises_rpc_error(-8, "Invalid encoding", node.getblocktemplate,
+                                {"encoding": "xml"})
+
+        self.log.info("Check that unknown templates get a full template")
+        tmpl = node.getblocktemplate({"templateid": "00" * 32})
+        assert "basetemplateid" not in tmpl
+        assert "removed" not in tmpl
+        assert_equal(tmpl["transactions"], tmpl2["transactions"])
+
+        self.log.info("Check that a new tip gets a full template")
+        self.generate(node, 1)
+        tmpl = node.getblocktemplate({"templateid": tmpl2["templateid"]})
+        assert "basetemplateid" not in tmpl
+        assert_equal(tmpl["transactions"], [])
+
+
+if __name__ == '__main__':
+    GetBlockTemplateDeltaTest().main()
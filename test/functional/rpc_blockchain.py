@@ -80,6 +80,7 @@ class BlockchainTest(BitcoinTestFramework):
         self._test_getnetworkhashps()
         self._test_stopatheight()
         self._test_waitforblockheight()
+        self._test_getblockcacheinfo()
         if self.is_wallet_compiled():
             self._test_getblock()
         self._test_getblock_txfee()
@@ -454,6 +455,28 @@ class BlockchainTest(BitcoinTestFramework):
         assert_waitforheight(current_height)
         assert_waitforheight(current_height + 1)
 
+    def _test_getblockcacheinfo(self):
+        self.log.info("Test getblockcacheinfo")
+        node = self.nodes[0]
+        blockhash = node.getblockhash(HEIGHT - 1)
+
+        def assert_reads(info, old_info, hits, misses):
+            for cache in ('blocks', 'undo'):
+                assert_equal(info[cache]['hits'],
+                             old_info[cache]['hits'] + hits)
+                assert_equal(info[cache]['misses'],
+                             old_info[cache]['misses'] + misses)
+                assert_equal(info[cache]['maxusage'], 32 << 20)
+                assert 0 < info[cache]['usage'] <= info[cache]['maxusage']
+                assert info[cache]['entries'] > 0
+
+        info = node.getblockcacheinfo()
+        node.getblock(blockhash, 2)
+        new_info = node.getblockcacheinfo()
+        assert_reads(new_info, info, hits=0, misses=1)
+        node.getblock(blockhash, 2)
+        assert_reads(node.getblockcacheinfo(), new_info, hits=1, misses=0)
+
     def _test_getblock(self):
         # Checks for getblock verbose outputs
         node = self.nodes[0]
@@ -520,6 +543,9 @@ class BlockchainTest(BitcoinTestFramework):
         self.log.info(
             "Test getblock with verbosity 2 still works with pruned Undo data")
         datadir = get_datadir_path(self.options.tmpdir, 0)
+        # The undo data is cached, restart without the cache to read it from
+        # disk
+        self.restart_node(0, extra_args=['-blockcachesize=0'])
 
         def move_block_file(old, new):
             old_path = os.path.join(datadir, self.chain, 'blocks', old)
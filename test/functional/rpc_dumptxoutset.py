@@ -42,7 +42,7 @@ class DumptxoutsetTest(BitcoinTestFramework):
             # UTXO snapshot hash should be deterministic based on mocked time.
             assert_equal(
                 digest,
-                'a92dc32a15975b3c84bb1e6ac5218ff94194b4ea7d1b9372fb80184a7533a89f')
+                'ab29872a7520dca6246c2258f95cac8a9bae1415d3ace6eef4d114faf70aa083')
 
         # Specifying a path to an existing file will fail.
         assert_raises_rpc_error(
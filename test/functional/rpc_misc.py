@@ -42,6 +42,12 @@ class RpcMiscTest(BitcoinTestFramework):
         assert_greater_than(memory['chunks_free'], 0)
         assert_equal(memory['used'] + memory['free'], memory['total'])
 
+        blockindex = node.getmemoryinfo()['blockindex']
+        assert_equal(blockindex['entries'], node.getblockcount() + 1)
+        assert_greater_than(blockindex['usage'], 0)
+        assert_equal(blockindex['bytes_per_entry'],
+                     blockindex['usage'] // blockindex['entries'])
+
         self.log.info("test mallocinfo")
         try:
             mallocinfo = node.getmemoryinfo(mode="mallocinfo")